@@ -5,558 +5,12281 @@
  * v0.0.1 Author: gimmeamilk (https://www.youtube.com/channel/UCnxW29RC80oLvwTMGNI0dAg)
  * > v0.0.1 Author: Timothy Gan Z.
  *
- * Version: 0.1.0
- * Date: 24 Feb 2018
+ * Compilation:
+ *   Windows: gcc memory_scanner.c -o memory_scanner.exe -lpsapi
+ *   Linux: gcc -O2 memory_scanner.c -o memory_scanner -lpthread
+ *   Defining MEMORY_SCANNER_LIBRARY leaves out the console UI and main, to use the scanner from another program
  *
- * Run format: Run as admin and follow instructions printed
+ * Version: 0.25.2
+ * Date: 17 Oct 2026
+ *
+ * Run format: Run as admin (Windows) or as a user allowed to ptrace the target (Linux) and follow instructions printed,
+ *             or "memory_scanner view <dump file>" to browse a memory dump, or "memory_scanner bench [options]" to
+ *             measure the scanner against a synthetic target (see Benchmarks), or "memory_scanner batch <script>" to run
+ *             a script of scan steps and get the results as JSON or CSV (see Batch mode)
+ */
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+typedef int BOOL;
+#define TRUE 1
+#define FALSE 0
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <signal.h>
+
+#define IS_IN_SEARCH(mb,index) (mb->searchmask[(index)/8] & (1<<((index)%8)))
+#define REMOVE_FROM_SEARCH(mb,index) mb->searchmask[(index)/8] &= ~(1<<((index)%8));
+
+/*
+ * Platform layer
+ *
+ * Everything that touches the target process or the OS goes through the few types and functions below. The Windows
+ * implementation uses OpenProcess/VirtualQueryEx/ReadProcessMemory/WriteProcessMemory; the Linux one parses
+ * /proc/<pid>/maps, reads with process_vm_readv (falling back to pread on /proc/<pid>/mem if that is not allowed) and
+ * writes with process_vm_writev (falling back to pwrite). On Linux, track_writes and get_written_pages use the kernel's
+ * soft-dirty bits (/proc/<pid>/clear_refs and /proc/<pid>/pagemap) to tell which pages were written to. suspend_process
+ * stops every thread of a process (NtSuspendProcess, or SIGSTOP) for consistent scans, which also look up the written
+ * pages while it is stopped. start_self runs the program again as a child (CreateProcess, or fork and exec of
+ * /proc/self/exe) for the benchmarks.
+ */
+
+#define REGION_READ  1
+#define REGION_WRITE 2
+#define REGION_EXEC  4
+
+#define REGION_PRIVATE 1 //memory of the process's own: heaps, stacks, anonymous mappings
+#define REGION_MAPPED  2 //a mapped file or shared memory (including driver and GPU mappings)
+#define REGION_IMAGE   4 //part of an executable or library (on Linux also the bss after it)
+
+// A committed region of the target's address space
+typedef struct
+{
+    unsigned char *base;
+    size_t size;
+    int protect; //REGION_READ | REGION_WRITE | REGION_EXEC
+    int type; //REGION_PRIVATE, REGION_MAPPED or REGION_IMAGE
+} REGION;
+
+// An executable or library loaded in the target; its image (code, data and on Linux the bss after it) is at the same
+// offsets from base every time the target runs
+typedef struct
+{
+    unsigned char *base;
+    size_t size;
+    char name[64]; //file name without the directory
+} MODULE;
+
+#define PAGE_SIZE 4096
+#define HUGE_PAGE_SIZE (2*1024*1024) //huge page size on x86
+
+// A file mapped into memory with map_file
+typedef struct
+{
+    unsigned char *base;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+} MAPPED_FILE;
+
+// One contiguous read of a batch (see read_memory_runs)
+typedef struct
+{
+    unsigned char *addr; //address in the process
+    size_t size;
+    unsigned char *dest; //where to read it to (the bytes to write, for write_memory_runs)
+    BOOL ok; //set by read_memory_runs
+} READ_RUN;
+
+#ifdef _WIN32
+
+typedef HANDLE PROC_HANDLE;
+typedef HANDLE THREAD;
+typedef CRITICAL_SECTION LOCK;
+typedef LPTHREAD_START_ROUTINE THREAD_START;
+#define THREAD_PROC(name, arg) DWORD WINAPI name (LPVOID arg)
+#define THREAD_RETURN 0
+#define lock_init(l) InitializeCriticalSection (l)
+#define lock_free(l) DeleteCriticalSection (l)
+#define lock_enter(l) EnterCriticalSection (l)
+#define lock_leave(l) LeaveCriticalSection (l)
+typedef HANDLE SEMAPHORE;
+#define semaphore_init(s,count) (*(s) = CreateSemaphore (NULL, count, LONG_MAX, NULL))
+#define semaphore_free(s) CloseHandle (*(s))
+#define semaphore_wait(s) WaitForSingleObject (*(s), INFINITE)
+#define semaphore_post(s) ReleaseSemaphore (*(s), 1, NULL)
+
+// A copy of this program started with start_self, with its standard input and output connected to us
+typedef struct
+{
+    unsigned int pid;
+    FILE *in; //its standard input
+    FILE *out; //its standard output
+    HANDLE process;
+} CHILD;
+
+#define NULL_DEVICE "NUL"
+
+/**
+ * Function: open_process
+ * 
+ * Description: Opens a process for reading and writing its memory
+ *
+ * Input:
+ *   pid - the process identifier
+ *
+ * Output:
+ *   The process handle, or NULL (after printing why) on failure
+ */
+PROC_HANDLE open_process (unsigned int pid)
+{
+    HANDLE hProc = OpenProcess (PROCESS_ALL_ACCESS, FALSE, pid);
+
+    if (!hProc)
+    {
+        printf ("Failed to open process - error - %lu\r\n", (unsigned long)GetLastError());
+    }
+
+    return hProc;
+}
+
+/**
+ * Function: close_process
+ * 
+ * Description: Closes a handle returned by open_process
+ */
+void close_process (PROC_HANDLE hProc)
+{
+    CloseHandle (hProc);
+}
+
+/**
+ * Function: process_id
+ * 
+ * Description: The process identifier of a handle returned by open_process
+ */
+unsigned int process_id (PROC_HANDLE hProc)
+{
+    return GetProcessId (hProc);
+}
+
+/**
+ * Function: list_regions
+ * 
+ * Description: Lists all committed regions of a process using VirtualQueryEx
+ *
+ * Input:
+ *   hProc - the process
+ *   **regions - receives a malloc'd array of regions, in address order
+ *
+ * Output:
+ *   The number of regions
+ */
+int list_regions (PROC_HANDLE hProc, REGION **regions)
+{
+    MEMORY_BASIC_INFORMATION meminfo;
+    unsigned char *addr = 0;
+    int count = 0;
+    int capacity = 0;
+
+    *regions = NULL;
+
+    while (VirtualQueryEx (hProc, addr, &meminfo, sizeof(meminfo)) != 0)
+    {
+#define WRITABLE (PAGE_READWRITE | PAGE_WRITECOPY | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)
+#define EXECUTABLE (PAGE_EXECUTE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)
+        if (meminfo.State & MEM_COMMIT)
+        {
+            if (count == capacity)
+            {
+                REGION *grown = realloc (*regions, (capacity ? capacity * 2 : 256) * sizeof(REGION));
+                if (!grown) break;
+                *regions = grown;
+                capacity = capacity ? capacity * 2 : 256;
+            }
+
+            (*regions)[count].base = meminfo.BaseAddress;
+            (*regions)[count].size = meminfo.RegionSize;
+            (*regions)[count].protect = 0;
+            if (!(meminfo.Protect & (PAGE_NOACCESS | PAGE_GUARD))) (*regions)[count].protect |= REGION_READ;
+            if (meminfo.Protect & WRITABLE) (*regions)[count].protect |= REGION_WRITE;
+            if (meminfo.Protect & EXECUTABLE) (*regions)[count].protect |= REGION_EXEC;
+            (*regions)[count].type = (meminfo.Type == MEM_IMAGE) ? REGION_IMAGE :
+                                     (meminfo.Type == MEM_MAPPED) ? REGION_MAPPED : REGION_PRIVATE;
+            count++;
+        }
+        addr = (unsigned char*)meminfo.BaseAddress + meminfo.RegionSize;
+    }
+
+    return count;
+}
+
+static int compare_modules (const void *a, const void *b)
+{
+    const MODULE *x = a;
+    const MODULE *y = b;
+
+    return (x->base > y->base) - (x->base < y->base);
+}
+
+/**
+ * Function: list_modules
+ * 
+ * Description: Lists the executable and the libraries loaded in a process
+ *
+ * Input:
+ *   hProc - the process
+ *   **modules - receives a malloc'd array of modules, in address order
+ *
+ * Output:
+ *   The number of modules
+ */
+int list_modules (PROC_HANDLE hProc, MODULE **modules)
+{
+    HMODULE handles[1024];
+    DWORD needed;
+    int count, i;
+
+    *modules = NULL;
+    if (!EnumProcessModules (hProc, handles, sizeof(handles), &needed)) return 0;
+
+    count = needed / sizeof(HMODULE);
+    if (count > 1024) count = 1024;
+    *modules = malloc ((count ? count : 1) * sizeof(MODULE));
+    if (!*modules) return 0;
+
+    for (i = 0; i < count; i++)
+    {
+        MODULEINFO info;
+
+        memset (&(*modules)[i], 0, sizeof(MODULE));
+        if (GetModuleInformation (hProc, handles[i], &info, sizeof(info)))
+        {
+            (*modules)[i].base = info.lpBaseOfDll;
+            (*modules)[i].size = info.SizeOfImage;
+        }
+        GetModuleBaseNameA (hProc, handles[i], (*modules)[i].name, sizeof((*modules)[i].name));
+    }
+
+    qsort (*modules, count, sizeof(MODULE), compare_modules);
+    return count;
+}
+
+/**
+ * Function: read_memory
+ * 
+ * Description: Reads memory of a process
+ *
+ * Input:
+ *   hProc - the process
+ *   addr - address in the process
+ *   *buf - where to read to
+ *   size - number of bytes to read
+ *
+ * Output:
+ *   The number of bytes read (less than size if part of the range is unreadable)
+ */
+size_t read_memory (PROC_HANDLE hProc, const unsigned char *addr, void *buf, size_t size)
+{
+    SIZE_T bytes_read = 0;
+
+    if (!ReadProcessMemory (hProc, addr, buf, size, &bytes_read))
+    {
+        //a copy that ran into an unreadable page still reports the bytes before it
+        return GetLastError () == ERROR_PARTIAL_COPY ? bytes_read : 0;
+    }
+
+    return bytes_read;
+}
+
+/**
+ * Function: read_memory_runs
+ * 
+ * Description: Reads a batch of ranges of a process; Windows has no vectored read, so this is one call per run
+ *
+ * Input:
+ *   hProc - the process
+ *   *runs - the ranges to read; each run's ok is set if it was read completely
+ *   n - number of runs
+ *
+ * Output:
+ *   The number of system calls made
+ */
+unsigned int read_memory_runs (PROC_HANDLE hProc, READ_RUN *runs, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+    {
+        runs[i].ok = read_memory (hProc, runs[i].addr, runs[i].dest, runs[i].size) == runs[i].size;
+    }
+
+    return n;
+}
+
+/**
+ * Function: write_memory
+ * 
+ * Description: Writes memory of a process
+ *
+ * Input:
+ *   hProc - the process
+ *   addr - address in the process
+ *   *buf - the bytes to write
+ *   size - number of bytes to write
+ *
+ * Output:
+ *   TRUE if all bytes were written
+ */
+BOOL write_memory (PROC_HANDLE hProc, unsigned char *addr, const void *buf, size_t size)
+{
+    return WriteProcessMemory (hProc, addr, buf, size, NULL) != 0;
+}
+
+/**
+ * Function: write_memory_runs
+ * 
+ * Description: Writes a batch of ranges to a process; one call per run, as for reads
+ *
+ * Input:
+ *   hProc - the process
+ *   *runs - the ranges to write, each from its dest; each run's ok is set if it was written completely
+ *   n - number of runs
+ *
+ * Output:
+ *   The number of system calls made
+ */
+unsigned int write_memory_runs (PROC_HANDLE hProc, READ_RUN *runs, unsigned int n)
+{
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+    {
+        runs[i].ok = write_memory (hProc, runs[i].addr, runs[i].dest, runs[i].size);
+    }
+
+    return n;
+}
+
+/**
+ * Function: track_writes
+ * 
+ * Description: Starts tracking which pages of a process get written to, or starts again from now; see get_written_pages
+ *
+ * Output:
+ *   TRUE if the writes of the process can be tracked
+ *
+ * Notes:
+ *   Windows only tracks writes (GetWriteWatch) to memory that a process allocated with MEM_WRITE_WATCH itself, and only
+ *   for that process, so there is nothing to track another process's memory with.
+ */
+BOOL track_writes (PROC_HANDLE hProc)
+{
+    (void)hProc;
+    return FALSE;
+}
+
+/**
+ * Function: get_written_pages
+ * 
+ * Description: Finds the pages of a range that may have been written to since the last track_writes
+ *
+ * Input:
+ *   hProc - the process
+ *   addr - start of the range, page aligned
+ *   size - size of the range
+ *   *bits - receives one bit per page of the range, set if the page may have been written to
+ *
+ * Output:
+ *   TRUE on success; otherwise every page has to be taken as written to
+ */
+BOOL get_written_pages (PROC_HANDLE hProc, unsigned char *addr, size_t size, unsigned char *bits)
+{
+    (void)hProc; (void)addr; (void)size; (void)bits;
+    return FALSE;
+}
+
+/**
+ * Function: thread_start
+ * 
+ * Description: Starts a thread
+ *
+ * Input:
+ *   *thread - receives the thread
+ *   func - the thread function, declared with THREAD_PROC
+ *   arg - passed to func
+ *
+ * Output:
+ *   TRUE if the thread was started
+ */
+BOOL thread_start (THREAD *thread, THREAD_START func, void *arg)
+{
+    *thread = CreateThread (NULL, 0, func, arg, 0, NULL);
+    return *thread != NULL;
+}
+
+/**
+ * Function: thread_join
+ * 
+ * Description: Waits for a thread started with thread_start to finish
+ */
+void thread_join (THREAD thread)
+{
+    WaitForSingleObject (thread, INFINITE);
+    CloseHandle (thread);
+}
+
+/**
+ * Function: cpu_count
+ * 
+ * Description: Number of processors
+ */
+int cpu_count (void)
+{
+    SYSTEM_INFO si;
+    GetSystemInfo (&si);
+    return si.dwNumberOfProcessors;
+}
+
+/**
+ * Function: clock_ns
+ * 
+ * Description: Monotonic clock in nanoseconds
+ */
+unsigned long long clock_ns (void)
+{
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+
+    if (!freq.QuadPart) QueryPerformanceFrequency (&freq);
+    QueryPerformanceCounter (&now);
+    return (unsigned long long)(now.QuadPart / freq.QuadPart) * 1000000000ull +
+           (unsigned long long)(now.QuadPart % freq.QuadPart) * 1000000000ull / freq.QuadPart;
+}
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+/**
+ * Function: sleep_until
+ * 
+ * Description: Sleeps until clock_ns reaches a deadline. Sleep only has the resolution of the system timer (up to 15.6
+ *              ms), so a high resolution waitable timer is used where Windows has one (10 1803 and later). Every call
+ *              makes its own: the freeze thread sleeps at the same time as the UI, and a shared timer would take the
+ *              deadline of whichever set it last.
+ */
+void sleep_until (unsigned long long deadline)
+{
+    HANDLE timer;
+    unsigned long long now = clock_ns ();
+    LARGE_INTEGER due;
+
+    if (now >= deadline) return;
+    timer = CreateWaitableTimerExW (NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+
+    due.QuadPart = -(LONGLONG)((deadline - now) / 100);
+    if (timer && SetWaitableTimer (timer, &due, 0, NULL, NULL, FALSE))
+    {
+        WaitForSingleObject (timer, INFINITE);
+    }
+    else
+    {
+        Sleep ((DWORD)((deadline - now) / 1000000));
+    }
+    if (timer) CloseHandle (timer);
+}
+
+/**
+ * Function: suspend_process
+ * 
+ * Description: Suspends every thread of a process, with NtSuspendProcess from ntdll (exported since XP, but in no header)
+ *
+ * Input:
+ *   hProc - the process
+ *   deadline - clock_ns () time by which every thread has to be stopped, or 0 for SUSPEND_TIMEOUT from now (Linux only;
+ *              NtSuspendProcess returns once they are)
+ *
+ * Output:
+ *   TRUE if the process was suspended; resume_process has to be called then. FALSE if it could not be, or was stopped
+ *   already (on Linux) and is left as it is.
+ */
+typedef LONG (NTAPI *NT_PROCESS_PROC)(HANDLE);
+
+BOOL suspend_process (PROC_HANDLE hProc, unsigned long long deadline)
+{
+    HMODULE ntdll = GetModuleHandleA ("ntdll.dll");
+    NT_PROCESS_PROC suspend = ntdll ? (NT_PROCESS_PROC)GetProcAddress (ntdll, "NtSuspendProcess") : NULL;
+
+    (void)deadline;
+    return suspend && suspend (hProc) >= 0;
+}
+
+/**
+ * Function: resume_process
+ * 
+ * Description: Resumes a process suspended with suspend_process
+ */
+void resume_process (PROC_HANDLE hProc)
+{
+    HMODULE ntdll = GetModuleHandleA ("ntdll.dll");
+    NT_PROCESS_PROC resume = ntdll ? (NT_PROCESS_PROC)GetProcAddress (ntdll, "NtResumeProcess") : NULL;
+
+    if (resume) resume (hProc);
+}
+
+/**
+ * Function: map_file
+ * 
+ * Description: Maps a whole file into memory from a read-only handle, so the file itself never changes
+ *
+ * Input:
+ *   *path - the file
+ *   *map - receives the mapping
+ *   copy - TRUE to map it copy on write, so the memory can be changed without the changes reaching the file; FALSE
+ *          to map it read-only
+ *
+ * Output:
+ *   TRUE on success
+ */
+BOOL map_file (const char *path, MAPPED_FILE *map, BOOL copy)
+{
+    LARGE_INTEGER size;
+
+    map->base = NULL;
+    map->mapping = NULL;
+    map->file = CreateFileA (path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map->file == INVALID_HANDLE_VALUE) return FALSE;
+
+    if (GetFileSizeEx (map->file, &size) && size.QuadPart > 0)
+    {
+        map->size = (size_t)size.QuadPart;
+        map->mapping = CreateFileMapping (map->file, NULL, copy ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+        if (map->mapping) map->base = MapViewOfFile (map->mapping, copy ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+    }
+
+    if (!map->base)
+    {
+        if (map->mapping) CloseHandle (map->mapping);
+        CloseHandle (map->file);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Function: unmap_file
+ * 
+ * Description: Unmaps a file mapped with map_file
+ */
+void unmap_file (MAPPED_FILE *map)
+{
+    UnmapViewOfFile (map->base);
+    CloseHandle (map->mapping);
+    CloseHandle (map->file);
+}
+
+/**
+ * Function: alloc_pages
+ * 
+ * Description: Allocates zeroed pages straight from the OS
+ *
+ * Input:
+ *   size - the number of bytes (a multiple of the page size)
+ *   huge - try to back the pages with large pages; needs a multiple of HUGE_PAGE_SIZE and SeLockMemoryPrivilege
+ *
+ * Output:
+ *   The pages, or NULL
+ */
+void* alloc_pages (size_t size, BOOL huge)
+{
+    SIZE_T large = huge ? GetLargePageMinimum () : 0;
+
+    if (large && size % large == 0)
+    {
+        void *p = VirtualAlloc (NULL, size, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (p) return p;
+    }
+
+    return VirtualAlloc (NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+}
+
+/**
+ * Function: free_pages
+ * 
+ * Description: Frees pages allocated with alloc_pages
+ */
+void free_pages (void *p, size_t size)
+{
+    (void)size;
+    VirtualFree (p, 0, MEM_RELEASE);
+}
+
+/**
+ * Function: discard_pages
+ * 
+ * Description: Gives the memory of pages allocated with alloc_pages back to the OS while keeping the rest of the
+ *              allocation; the pages must not be used again
+ */
+void discard_pages (void *p, size_t size)
+{
+    VirtualFree (p, size, MEM_DECOMMIT);
+}
+
+/**
+ * Function: start_self
+ * 
+ * Description: Starts this program again as a child process with its standard input and output connected to pipes
+ *
+ * Input:
+ *   *child - receives the child
+ *   *args[] - the arguments, ending with NULL; they are joined with spaces, so they must not contain any
+ *
+ * Output:
+ *   TRUE on success
+ */
+BOOL start_self (CHILD *child, char *const args[])
+{
+    SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+    HANDLE in_read, in_write, out_read, out_write;
+    STARTUPINFOA si;
+    PROCESS_INFORMATION pi;
+    char cmd[MAX_PATH + 1024];
+    size_t len;
+    BOOL ok;
+    int i;
+
+    cmd[0] = '"';
+    len = GetModuleFileNameA (NULL, cmd + 1, MAX_PATH);
+    if (len == 0 || len >= MAX_PATH) return FALSE;
+    len++;
+    cmd[len++] = '"';
+    cmd[len] = 0;
+    for (i = 0; args[i]; i++)
+    {
+        if (len + 1 + strlen (args[i]) >= sizeof(cmd)) return FALSE;
+        cmd[len++] = ' ';
+        strcpy (cmd + len, args[i]);
+        len += strlen (args[i]);
+    }
+
+    if (!CreatePipe (&in_read, &in_write, &sa, 0)) return FALSE;
+    if (!CreatePipe (&out_read, &out_write, &sa, 0))
+    {
+        CloseHandle (in_read);
+        CloseHandle (in_write);
+        return FALSE;
+    }
+    // only the child's ends are inherited
+    SetHandleInformation (in_write, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation (out_read, HANDLE_FLAG_INHERIT, 0);
+
+    memset (&si, 0, sizeof(si));
+    si.cb = sizeof(si);
+    si.dwFlags = STARTF_USESTDHANDLES;
+    si.hStdInput = in_read;
+    si.hStdOutput = out_write;
+    si.hStdError = GetStdHandle (STD_ERROR_HANDLE);
+    ok = CreateProcessA (NULL, cmd, NULL, NULL, TRUE, 0, NULL, NULL, &si, &pi);
+    CloseHandle (in_read);
+    CloseHandle (out_write);
+    if (!ok)
+    {
+        CloseHandle (in_write);
+        CloseHandle (out_read);
+        return FALSE;
+    }
+
+    CloseHandle (pi.hThread);
+    child->process = pi.hProcess;
+    child->pid = pi.dwProcessId;
+    child->in = _fdopen (_open_osfhandle ((intptr_t)in_write, 0), "w");
+    child->out = _fdopen (_open_osfhandle ((intptr_t)out_read, _O_RDONLY), "r");
+    return child->in && child->out;
+}
+
+/**
+ * Function: stop_child
+ * 
+ * Description: Closes the pipes to a child started with start_self, which should make it exit, and waits for it
+ */
+void stop_child (CHILD *child)
+{
+    if (child->in) fclose (child->in);
+    if (child->out) fclose (child->out);
+    WaitForSingleObject (child->process, INFINITE);
+    CloseHandle (child->process);
+}
+
+/**
+ * Function: peak_memory
+ * 
+ * Description: The most memory this process has had in RAM at once (its peak working set), in bytes
+ */
+size_t peak_memory (void)
+{
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if (!GetProcessMemoryInfo (GetCurrentProcess (), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize;
+}
+
+#else
+
+typedef struct
+{
+    pid_t pid;
+    int mem_fd; //-1 if /proc/<pid>/mem could not be opened
+    int pagemap_fd; //-1 until get_written_pages is first called
+    BOOL use_mem_fd; //set once process_vm_readv/writev turned out not to be allowed
+} LINUX_PROCESS;
+
+typedef LINUX_PROCESS *PROC_HANDLE;
+typedef pthread_t THREAD;
+typedef pthread_mutex_t LOCK;
+typedef void* (*THREAD_START)(void*);
+#define THREAD_PROC(name, arg) void* name (void *arg)
+#define THREAD_RETURN NULL
+#define lock_init(l) pthread_mutex_init (l, NULL)
+#define lock_free(l) pthread_mutex_destroy (l)
+#define lock_enter(l) pthread_mutex_lock (l)
+#define lock_leave(l) pthread_mutex_unlock (l)
+typedef sem_t SEMAPHORE;
+#define semaphore_init(s,count) sem_init (s, 0, count)
+#define semaphore_free(s) sem_destroy (s)
+#define semaphore_wait(s) sem_wait (s)
+#define semaphore_post(s) sem_post (s)
+
+typedef struct
+{
+    unsigned int pid;
+    FILE *in; //its standard input
+    FILE *out; //its standard output
+} CHILD;
+
+#define NULL_DEVICE "/dev/null"
+
+#define MAX_IOVECS 1024 //IOV_MAX on Linux
+
+PROC_HANDLE open_process (unsigned int pid)
+{
+    char path[64];
+    LINUX_PROCESS *proc;
+
+    // the process has to exist and its maps have to be readable, otherwise there is nothing to scan
+    snprintf (path, sizeof(path), "/proc/%u/maps", pid);
+    if (access (path, R_OK) != 0)
+    {
+        printf ("Failed to open process - error - %d\r\n", errno);
+        return NULL;
+    }
+
+    proc = malloc (sizeof(LINUX_PROCESS));
+    if (proc)
+    {
+        // opened up front, since the worker threads may all find out at once that it is needed
+        snprintf (path, sizeof(path), "/proc/%u/mem", pid);
+        proc->pid = pid;
+        proc->mem_fd = open (path, O_RDWR);
+        if (proc->mem_fd < 0) proc->mem_fd = open (path, O_RDONLY);
+        proc->use_mem_fd = FALSE;
+        proc->pagemap_fd = -1;
+    }
+
+    return proc;
+}
+
+void close_process (PROC_HANDLE hProc)
+{
+    if (hProc)
+    {
+        if (hProc->mem_fd >= 0) close (hProc->mem_fd);
+        if (hProc->pagemap_fd >= 0) close (hProc->pagemap_fd);
+        free (hProc);
+    }
+}
+
+unsigned int process_id (PROC_HANDLE hProc)
+{
+    return hProc->pid;
+}
+
+/**
+ * Function: switch_to_mem_fd
+ * 
+ * Description: Switches a process over to /proc/<pid>/mem, used when process_vm_readv/writev fail with EPERM or ENOSYS.
+ *              The fd was opened by open_process, so threads that get here together only set the same flag.
+ *
+ * Output:
+ *   TRUE if /proc/<pid>/mem could be opened
+ */
+static BOOL switch_to_mem_fd (PROC_HANDLE hProc)
+{
+    hProc->use_mem_fd = TRUE;
+    return hProc->mem_fd >= 0;
+}
+
+/**
+ * Function: list_regions
+ * 
+ * Description: Lists all mappings of a process by parsing /proc/<pid>/maps. The consecutive private mappings of a file
+ *              are an image if one of them is executable (a loaded executable or library), together with the anonymous
+ *              mapping right after them like in list_modules; other file and shared mappings are mapped regions.
+ */
+int list_regions (PROC_HANDLE hProc, REGION **regions)
+{
+    char path[64];
+    char line[1024];
+    char last_path[1024] = "";
+    FILE *maps;
+    int count = 0;
+    int capacity = 0;
+    int file_first = 0; //first region of the private mappings of last_path
+    BOOL file_exec = FALSE; //one of them is executable
+
+    *regions = NULL;
+
+    snprintf (path, sizeof(path), "/proc/%d/maps", (int)hProc->pid);
+    maps = fopen (path, "r");
+    if (!maps) return 0;
+
+    // e.g. "7f0c4d3e5000-7f0c4d3e9000 rw-p 00000000 00:00 0" or "... r-xp 00000000 08:01 1234 /usr/lib/libc.so.6"
+    while (fgets (line, sizeof(line), maps))
+    {
+        unsigned long start, end;
+        char perms[5];
+        int name_at = 0;
+        char *name;
+        REGION *region;
+        BOOL same_file;
+
+        if (sscanf (line, "%lx-%lx %4s %*s %*s %*s %n", &start, &end, perms, &name_at) != 3 || !name_at) continue;
+        name = line + name_at;
+        name[strcspn (name, "\n")] = 0;
+
+        if (count == capacity)
+        {
+            REGION *grown = realloc (*regions, (capacity ? capacity * 2 : 256) * sizeof(REGION));
+            if (!grown) break;
+            *regions = grown;
+            capacity = capacity ? capacity * 2 : 256;
+        }
+
+        region = &(*regions)[count];
+        region->base = (unsigned char*)start;
+        region->size = end - start;
+        region->protect = 0;
+        if (perms[0] == 'r') region->protect |= REGION_READ;
+        if (perms[1] == 'w') region->protect |= REGION_WRITE;
+        if (perms[2] == 'x') region->protect |= REGION_EXEC;
+
+        // [heap], [stack] and anonymous mappings are private; so is a private mapping of /dev/zero
+        if (perms[3] == 's' || (name[0] == '/' && strcmp (name, "/dev/zero") != 0))
+        {
+            region->type = REGION_MAPPED;
+        }
+        else
+        {
+            region->type = REGION_PRIVATE;
+        }
+
+        same_file = perms[3] == 'p' && name[0] == '/' && count > 0 && strcmp (name, last_path) == 0 &&
+                    region->base == (*regions)[count-1].base + (*regions)[count-1].size;
+        if (!same_file)
+        {
+            // the mappings of the last file end here, and an anonymous mapping right after an image is its bss
+            if (file_exec && name[0] == 0 && region->base == (*regions)[count-1].base + (*regions)[count-1].size)
+            {
+                region->type = REGION_IMAGE;
+            }
+            file_first = count;
+            file_exec = FALSE;
+            snprintf (last_path, sizeof(last_path), "%s", (perms[3] == 'p' && name[0] == '/') ? name : "");
+        }
+
+        if (last_path[0] && (region->protect & REGION_EXEC)) file_exec = TRUE;
+        count++;
+
+        if (file_exec)
+        {
+            int i;
+            for (i = file_first; i < count; i++) (*regions)[i].type = REGION_IMAGE;
+        }
+    }
+
+    fclose (maps);
+    return count;
+}
+
+/**
+ * Function: list_modules
+ * 
+ * Description: Lists the files mapped in a process from /proc/<pid>/maps. The consecutive mappings of a file make one
+ *              module, together with the anonymous mapping right after them, which is where the loader puts the bss.
+ */
+int list_modules (PROC_HANDLE hProc, MODULE **modules)
+{
+    char path[64];
+    char line[1024];
+    char last_path[1024] = "";
+    BOOL extend = FALSE; //the previous mapping belongs to the last module
+    FILE *maps;
+    int count = 0;
+    int capacity = 0;
+
+    *modules = NULL;
+
+    snprintf (path, sizeof(path), "/proc/%d/maps", (int)hProc->pid);
+    maps = fopen (path, "r");
+    if (!maps) return 0;
+
+    // e.g. "7f0c4d3e5000-7f0c4d3e9000 r-xp 00000000 08:01 1234 /usr/lib/libc.so.6"
+    while (fgets (line, sizeof(line), maps))
+    {
+        unsigned long start, end;
+        char perms[5];
+        int name_at = 0;
+        char *name;
+
+        if (sscanf (line, "%lx-%lx %4s %*s %*s %*s %n", &start, &end, perms, &name_at) != 3 || !name_at) continue;
+        name = line + name_at;
+        name[strcspn (name, "\n")] = 0;
+
+        if (extend && (unsigned char*)start == (*modules)[count-1].base + (*modules)[count-1].size &&
+            (name[0] == 0 || strcmp (name, last_path) == 0))
+        {
+            (*modules)[count-1].size = end - (unsigned long)(*modules)[count-1].base;
+            extend = name[0] != 0;
+            continue;
+        }
+
+        // [heap], [stack], [vdso] and anonymous mappings are not modules
+        extend = FALSE;
+        if (name[0] != '/') continue;
+
+        if (count == capacity)
+        {
+            MODULE *grown = realloc (*modules, (capacity ? capacity * 2 : 64) * sizeof(MODULE));
+            if (!grown) break;
+            *modules = grown;
+            capacity = capacity ? capacity * 2 : 64;
+        }
+
+        (*modules)[count].base = (unsigned char*)start;
+        (*modules)[count].size = end - start;
+        snprintf ((*modules)[count].name, sizeof((*modules)[count].name), "%s", strrchr (name, '/') + 1);
+        snprintf (last_path, sizeof(last_path), "%s", name);
+        extend = TRUE;
+        count++;
+    }
+
+    fclose (maps);
+    return count;
+}
+
+size_t read_memory (PROC_HANDLE hProc, const unsigned char *addr, void *buf, size_t size)
+{
+    ssize_t n = -1;
+
+    if (!hProc->use_mem_fd)
+    {
+        struct iovec local = { buf, size };
+        struct iovec remote = { (void*)addr, size };
+
+        n = process_vm_readv (hProc->pid, &local, 1, &remote, 1, 0);
+        if (n < 0 && (errno == EPERM || errno == ENOSYS)) switch_to_mem_fd (hProc);
+    }
+
+    if (hProc->use_mem_fd && hProc->mem_fd >= 0)
+    {
+        n = pread (hProc->mem_fd, buf, size, (off_t)(uintptr_t)addr);
+    }
+
+    return (n < 0) ? 0 : (size_t)n;
+}
+
+/**
+ * Function: read_memory_runs
+ * 
+ * Description: Reads a batch of ranges of a process with as few process_vm_readv calls as possible (up to MAX_IOVECS
+ *              runs per call). process_vm_readv stops at the first remote range it cannot read, so the call is repeated
+ *              from the run after the one that failed.
+ */
+unsigned int read_memory_runs (PROC_HANDLE hProc, READ_RUN *runs, unsigned int n)
+{
+    struct iovec local[MAX_IOVECS];
+    struct iovec remote[MAX_IOVECS];
+    unsigned int syscalls = 0;
+    unsigned int i = 0;
+
+    while (i < n && !hProc->use_mem_fd)
+    {
+        unsigned int batch = (n - i > MAX_IOVECS) ? MAX_IOVECS : n - i;
+        unsigned int j;
+        ssize_t got;
+
+        for (j = 0; j < batch; j++)
+        {
+            local[j].iov_base = runs[i+j].dest;
+            local[j].iov_len = runs[i+j].size;
+            remote[j].iov_base = runs[i+j].addr;
+            remote[j].iov_len = runs[i+j].size;
+        }
+
+        got = process_vm_readv (hProc->pid, local, batch, remote, batch, 0);
+        syscalls++;
+        if (got < 0)
+        {
+            if (errno == EPERM || errno == ENOSYS)
+            {
+                switch_to_mem_fd (hProc);
+                break;
+            }
+            got = 0;
+        }
+
+        // runs that fit completely in the bytes read are done; the one it stopped in has failed
+        for (j = 0; j < batch && (size_t)got >= runs[i+j].size; j++)
+        {
+            runs[i+j].ok = TRUE;
+            got -= runs[i+j].size;
+        }
+        if (j < batch)
+        {
+            runs[i+j].ok = FALSE;
+            j++;
+        }
+        i += j;
+    }
+
+    for (; i < n; i++)
+    {
+        runs[i].ok = read_memory (hProc, runs[i].addr, runs[i].dest, runs[i].size) == runs[i].size;
+        syscalls++;
+    }
+
+    return syscalls;
+}
+
+BOOL write_memory (PROC_HANDLE hProc, unsigned char *addr, const void *buf, size_t size)
+{
+    ssize_t n = -1;
+
+    if (!hProc->use_mem_fd)
+    {
+        struct iovec local = { (void*)buf, size };
+        struct iovec remote = { addr, size };
+
+        n = process_vm_writev (hProc->pid, &local, 1, &remote, 1, 0);
+        if (n < 0 && (errno == EPERM || errno == ENOSYS)) switch_to_mem_fd (hProc);
+    }
+
+    if (hProc->use_mem_fd && hProc->mem_fd >= 0)
+    {
+        n = pwrite (hProc->mem_fd, buf, size, (off_t)(uintptr_t)addr);
+    }
+
+    return n == (ssize_t)size;
+}
+
+/**
+ * Function: write_memory_runs
+ * 
+ * Description: Writes a batch of ranges to a process with as few process_vm_writev calls as possible, the same way
+ *              read_memory_runs reads them; runs it cannot write are retried one by one with write_memory
+ */
+unsigned int write_memory_runs (PROC_HANDLE hProc, READ_RUN *runs, unsigned int n)
+{
+    struct iovec local[MAX_IOVECS];
+    struct iovec remote[MAX_IOVECS];
+    unsigned int syscalls = 0;
+    unsigned int i = 0;
+
+    while (i < n && !hProc->use_mem_fd)
+    {
+        unsigned int batch = (n - i > MAX_IOVECS) ? MAX_IOVECS : n - i;
+        unsigned int j;
+        ssize_t put;
+
+        for (j = 0; j < batch; j++)
+        {
+            local[j].iov_base = runs[i+j].dest;
+            local[j].iov_len = runs[i+j].size;
+            remote[j].iov_base = runs[i+j].addr;
+            remote[j].iov_len = runs[i+j].size;
+        }
+
+        put = process_vm_writev (hProc->pid, local, batch, remote, batch, 0);
+        syscalls++;
+        if (put < 0)
+        {
+            if (errno == EPERM || errno == ENOSYS) break;
+            put = 0;
+        }
+
+        for (j = 0; j < batch && (size_t)put >= runs[i+j].size; j++)
+        {
+            runs[i+j].ok = TRUE;
+            put -= runs[i+j].size;
+        }
+        if (j < batch)
+        {
+            runs[i+j].ok = write_memory (hProc, runs[i+j].addr, runs[i+j].dest, runs[i+j].size);
+            syscalls++;
+            j++;
+        }
+        i += j;
+    }
+
+    // write_memory switches to /proc/<pid>/mem when process_vm_writev is not allowed
+    for (; i < n; i++)
+    {
+        runs[i].ok = write_memory (hProc, runs[i].addr, runs[i].dest, runs[i].size);
+        syscalls++;
+    }
+
+    return syscalls;
+}
+
+// bits of a /proc/<pid>/pagemap entry
+#define PM_SOFT_DIRTY (1ull << 55)
+#define PM_SWAP (1ull << 62)
+#define PM_PRESENT (1ull << 63)
+
+/**
+ * Function: soft_dirty_supported
+ * 
+ * Description: Tests once if the kernel keeps soft-dirty bits (CONFIG_MEM_SOFT_DIRTY). Without them clear_refs still
+ *              accepts "4", but pagemap never shows a page as written, which would make every page look unchanged.
+ */
+static BOOL soft_dirty_supported (void)
+{
+    static int supported = -1;
+    static volatile unsigned char probe[2 * PAGE_SIZE];
+
+    if (supported < 0)
+    {
+        volatile unsigned char *page = (unsigned char*)(((uintptr_t)probe + PAGE_SIZE - 1) & ~(uintptr_t)(PAGE_SIZE - 1));
+        unsigned long long entry = 0;
+        int fd = open ("/proc/self/clear_refs", O_WRONLY);
+
+        supported = FALSE;
+        if (fd >= 0)
+        {
+            if (write (fd, "4", 1) == 1)
+            {
+                int pm = open ("/proc/self/pagemap", O_RDONLY);
+
+                page[0]++;
+                if (pm >= 0 && pread (pm, &entry, sizeof(entry), (off_t)((uintptr_t)page / PAGE_SIZE) * sizeof(entry)) == sizeof(entry))
+                {
+                    supported = (entry & PM_SOFT_DIRTY) != 0;
+                }
+                if (pm >= 0) close (pm);
+            }
+            close (fd);
+        }
+    }
+
+    return supported;
+}
+
+/**
+ * Function: track_writes
+ * 
+ * Description: Clears the soft-dirty bits of every page of the process by writing "4" to /proc/<pid>/clear_refs. The
+ *              kernel write-protects the pages again, and the first write to each one sets its bit.
+ */
+BOOL track_writes (PROC_HANDLE hProc)
+{
+    char path[64];
+    BOOL ok;
+    int fd;
+
+    if (!soft_dirty_supported ()) return FALSE;
+
+    snprintf (path, sizeof(path), "/proc/%d/clear_refs", (int)hProc->pid);
+    fd = open (path, O_WRONLY);
+    if (fd < 0) return FALSE;
+    ok = write (fd, "4", 1) == 1;
+    close (fd);
+
+    return ok;
+}
+
+/**
+ * Function: get_written_pages
+ * 
+ * Description: Reads the soft-dirty bits of a range from /proc/<pid>/pagemap. A page that is neither in memory nor in
+ *              swap is taken as written too: madvise (MADV_DONTNEED) empties pages without leaving a soft-dirty bit.
+ */
+BOOL get_written_pages (PROC_HANDLE hProc, unsigned char *addr, size_t size, unsigned char *bits)
+{
+    unsigned long long entries[512];
+    size_t npages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    size_t first = (uintptr_t)addr / PAGE_SIZE;
+    size_t done = 0;
+
+    if (hProc->pagemap_fd < 0)
+    {
+        char path[64];
+
+        snprintf (path, sizeof(path), "/proc/%d/pagemap", (int)hProc->pid);
+        hProc->pagemap_fd = open (path, O_RDONLY);
+        if (hProc->pagemap_fd < 0) return FALSE;
+    }
+
+    memset (bits, 0, (npages + 7) / 8);
+    while (done < npages)
+    {
+        size_t n = (npages - done > 512) ? 512 : npages - done;
+        size_t i;
+
+        if (pread (hProc->pagemap_fd, entries, n * sizeof(entries[0]), (off_t)(first + done) * sizeof(entries[0])) != (ssize_t)(n * sizeof(entries[0])))
+        {
+            return FALSE;
+        }
+        for (i = 0; i < n; i++)
+        {
+            if ((entries[i] & PM_SOFT_DIRTY) || !(entries[i] & (PM_PRESENT | PM_SWAP)))
+            {
+                bits[(done + i) / 8] |= 1 << ((done + i) % 8);
+            }
+        }
+        done += n;
+    }
+
+    return TRUE;
+}
+
+BOOL thread_start (THREAD *thread, THREAD_START func, void *arg)
+{
+    return pthread_create (thread, NULL, func, arg) == 0;
+}
+
+void thread_join (THREAD thread)
+{
+    pthread_join (thread, NULL);
+}
+
+int cpu_count (void)
+{
+    return (int)sysconf (_SC_NPROCESSORS_ONLN);
+}
+
+unsigned long long clock_ns (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void sleep_until (unsigned long long deadline)
+{
+    struct timespec ts;
+
+    ts.tv_sec = deadline / 1000000000ull;
+    ts.tv_nsec = deadline % 1000000000ull;
+    while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+#define SUSPEND_TIMEOUT 100 //milliseconds suspend_process waits for every thread to stop
+
+/**
+ * Function: count_running_threads
+ * 
+ * Description: Counts the threads of a process that are not stopped, by the state in /proc/<pid>/task/<tid>/stat
+ *
+ * Output:
+ *   The number of threads that are not stopped, traced or dead, or -1 if the threads could not be listed
+ */
+static int count_running_threads (pid_t pid)
+{
+    char path[320];
+    char stat[512];
+    struct dirent *entry;
+    DIR *dir;
+    int running = 0;
+
+    snprintf (path, sizeof(path), "/proc/%d/task", (int)pid);
+    dir = opendir (path);
+    if (!dir) return -1;
+
+    while ((entry = readdir (dir)) != NULL)
+    {
+        const char *state;
+        FILE *f;
+        size_t n;
+
+        if (entry->d_name[0] == '.') continue;
+        snprintf (path, sizeof(path), "/proc/%d/task/%s/stat", (int)pid, entry->d_name);
+        f = fopen (path, "r");
+        if (!f) continue; //the thread has exited
+
+        // the state follows the name, which is in parentheses and may hold anything
+        n = fread (stat, 1, sizeof(stat) - 1, f);
+        stat[n] = 0;
+        fclose (f);
+        state = strrchr (stat, ')');
+        if (state && state[1] == ' ' && !strchr ("TtZX", state[2])) running++;
+    }
+    closedir (dir);
+
+    return running;
+}
+
+/**
+ * Function: suspend_process
+ * 
+ * Description: Stops a process with SIGSTOP and waits until none of its threads runs any more. If one still runs at
+ *              the deadline (a thread blocked in the kernel can take a while), the process is continued again and the
+ *              suspension failed. A process a debugger or the user stopped is left alone.
+ */
+BOOL suspend_process (PROC_HANDLE hProc, unsigned long long deadline)
+{
+    unsigned long long timeout = clock_ns () + SUSPEND_TIMEOUT * 1000000ULL;
+
+    if (deadline == 0 || deadline > timeout) deadline = timeout;
+    if (count_running_threads (hProc->pid) <= 0) return FALSE;
+    if (kill (hProc->pid, SIGSTOP) != 0) return FALSE;
+
+    // the threads take the signal when they next run, so the checks leave the processor to them
+    while (count_running_threads (hProc->pid) > 0)
+    {
+        if (clock_ns () >= deadline)
+        {
+            kill (hProc->pid, SIGCONT);
+            return FALSE;
+        }
+        sleep_until (clock_ns () + 20000);
+    }
+
+    return TRUE;
+}
+
+void resume_process (PROC_HANDLE hProc)
+{
+    kill (hProc->pid, SIGCONT);
+}
+
+BOOL map_file (const char *path, MAPPED_FILE *map, BOOL copy)
+{
+    struct stat st;
+
+    map->base = NULL;
+    map->fd = open (path, O_RDONLY);
+    if (map->fd < 0) return FALSE;
+
+    if (fstat (map->fd, &st) == 0 && st.st_size > 0)
+    {
+        void *base = mmap (NULL, st.st_size, copy ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, map->fd, 0);
+        if (base != MAP_FAILED)
+        {
+            map->base = base;
+            map->size = st.st_size;
+        }
+    }
+
+    if (!map->base)
+    {
+        close (map->fd);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+void unmap_file (MAPPED_FILE *map)
+{
+    munmap (map->base, map->size);
+    close (map->fd);
+}
+
+void* alloc_pages (size_t size, BOOL huge)
+{
+    void *p = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (p == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+    if (huge && size % HUGE_PAGE_SIZE == 0) madvise (p, size, MADV_HUGEPAGE);
+#endif
+    return p;
+}
+
+void free_pages (void *p, size_t size)
+{
+    munmap (p, size);
+}
+
+void discard_pages (void *p, size_t size)
+{
+    madvise (p, size, MADV_DONTNEED);
+}
+
+BOOL start_self (CHILD *child, char *const args[])
+{
+    char *argv[64];
+    int in[2], out[2];
+    pid_t pid;
+    int i;
+
+    argv[0] = "memory_scanner";
+    for (i = 0; args[i] && i < 62; i++) argv[i+1] = args[i];
+    argv[i+1] = NULL;
+
+    if (pipe (in) != 0) return FALSE;
+    if (pipe (out) != 0)
+    {
+        close (in[0]);
+        close (in[1]);
+        return FALSE;
+    }
+
+    fflush (NULL);
+    pid = fork ();
+    if (pid == 0)
+    {
+        dup2 (in[0], 0);
+        dup2 (out[1], 1);
+        close (in[0]);
+        close (in[1]);
+        close (out[0]);
+        close (out[1]);
+        execv ("/proc/self/exe", argv);
+        _exit (127);
+    }
+
+    close (in[0]);
+    close (out[1]);
+    if (pid < 0)
+    {
+        close (in[1]);
+        close (out[0]);
+        return FALSE;
+    }
+
+    child->pid = (unsigned int)pid;
+    child->in = fdopen (in[1], "w");
+    child->out = fdopen (out[0], "r");
+    return child->in && child->out;
+}
+
+void stop_child (CHILD *child)
+{
+    if (child->in) fclose (child->in);
+    if (child->out) fclose (child->out);
+    waitpid ((pid_t)child->pid, NULL, 0);
+}
+
+size_t peak_memory (void)
+{
+    struct rusage usage;
+
+    if (getrusage (RUSAGE_SELF, &usage) != 0) return 0;
+    return (size_t)usage.ru_maxrss * 1024; //in KB on Linux
+}
+
+#endif
+
+/*
+ * Scan arena
+ *
+ * All memory of a scan (the memory block array and every buffer, searchmask and match list) comes from one arena, so
+ * setting up a scan of a process with tens of thousands of regions costs a few page allocations instead of three
+ * mallocs per region, and freeing it is one pass over the chunks. Small allocations are carved out of shared
+ * ARENA_CHUNK_SIZE chunks; allocations of ARENA_LARGE bytes or more get pages of their own, backed by huge pages when
+ * they are big enough for the rounding to waste little. Memory handed back with arena_release (e.g. the buffer of a
+ * block that turned sparse) goes back to the OS right away: dedicated pages are freed, and allocations of a page or
+ * more are rounded to whole pages inside the shared chunks so their pages can be discarded.
+ */
+
+#define ARENA_ALIGN 64 //cache line; allocations of PAGE_SIZE or more are page aligned instead
+#define ARENA_CHUNK_SIZE (2*HUGE_PAGE_SIZE)
+#define ARENA_LARGE (1024*1024) //allocations from this size up get their own pages
+#define ARENA_HUGE_MIN (8*HUGE_PAGE_SIZE) //dedicated allocations from this size up are rounded to huge pages
+
+// Pages the arena got from alloc_pages
+typedef struct
+{
+    unsigned char *base;
+    size_t size; //0 once released
+    BOOL dedicated; //holds a single large allocation
+} ARENA_CHUNK;
+
+typedef struct
+{
+    ARENA_CHUNK *chunks;
+    size_t count;
+    size_t capacity;
+    BOOL sorted; //chunks are in address order (see arena_release)
+    unsigned char *cursor[2]; //next free byte of the current shared chunk, for small [0] and page sized [1] allocations
+    unsigned char *limit[2]; //end of the current shared chunks
+    size_t bytes; //bytes currently held from the OS
+} ARENA;
+
+/**
+ * Function: arena_init
+ * 
+ * Description: Initializes an empty arena
+ *
+ * Input:
+ *   *arena - the arena
+ */
+void arena_init (ARENA *arena)
+{
+    memset (arena, 0, sizeof(ARENA));
+    arena->sorted = TRUE;
+}
+
+/**
+ * Function: arena_add_chunk
+ * 
+ * Description: Gets pages from the OS and records them in the arena
+ *
+ * Input:
+ *   *arena - the arena
+ *   size - the number of bytes (a multiple of the page size)
+ *   dedicated - TRUE if the pages hold a single allocation
+ *   huge - back the pages with huge pages if possible
+ *
+ * Output:
+ *   The pages, or NULL
+ */
+static unsigned char* arena_add_chunk (ARENA *arena, size_t size, BOOL dedicated, BOOL huge)
+{
+    unsigned char *base;
+
+    if (arena->count == arena->capacity)
+    {
+        size_t capacity = arena->capacity ? arena->capacity * 2 : 64;
+        ARENA_CHUNK *grown = realloc (arena->chunks, capacity * sizeof(ARENA_CHUNK));
+        if (!grown) return NULL;
+        arena->chunks = grown;
+        arena->capacity = capacity;
+    }
+
+    base = alloc_pages (size, huge);
+    if (!base) return NULL;
+
+    if (arena->count && arena->chunks[arena->count - 1].base > base) arena->sorted = FALSE;
+    arena->chunks[arena->count].base = base;
+    arena->chunks[arena->count].size = size;
+    arena->chunks[arena->count].dedicated = dedicated;
+    arena->count++;
+    arena->bytes += size;
+
+    return base;
+}
+
+/**
+ * Function: arena_alloc
+ * 
+ * Description: Allocates zeroed, ARENA_ALIGN aligned memory from an arena. Not thread safe.
+ *
+ * Input:
+ *   *arena - the arena
+ *   size - the number of bytes
+ *
+ * Output:
+ *   The memory, or NULL
+ */
+void* arena_alloc (ARENA *arena, size_t size)
+{
+    unsigned char *p;
+    int paged = size >= PAGE_SIZE;
+    size_t align = paged ? PAGE_SIZE : ARENA_ALIGN;
+
+    size = size ? (size + align - 1) & ~(align - 1) : ARENA_ALIGN;
+
+    if (size >= ARENA_LARGE)
+    {
+        BOOL huge = size >= ARENA_HUGE_MIN;
+        size_t round = huge ? HUGE_PAGE_SIZE : PAGE_SIZE;
+        return arena_add_chunk (arena, (size + round - 1) & ~(round - 1), TRUE, huge);
+    }
+
+    // page sized allocations are packed into chunks of their own so that they stay page aligned without padding
+    if (size > (size_t)(arena->limit[paged] - arena->cursor[paged]))
+    {
+        p = arena_add_chunk (arena, ARENA_CHUNK_SIZE, FALSE, FALSE);
+        if (!p) return NULL;
+        arena->cursor[paged] = p;
+        arena->limit[paged] = p + ARENA_CHUNK_SIZE;
+    }
+
+    p = arena->cursor[paged];
+    arena->cursor[paged] += size;
+    return p;
+}
+
+static int compare_arena_chunks (const void *a, const void *b)
+{
+    const unsigned char *x = ((const ARENA_CHUNK*)a)->base;
+    const unsigned char *y = ((const ARENA_CHUNK*)b)->base;
+
+    return (x > y) - (x < y);
+}
+
+// bsearch comparison finding the chunk that holds an address (released chunks keep their base, so the order holds)
+static int compare_arena_chunks_containing (const void *key, const void *chunk)
+{
+    const unsigned char *p = ((const ARENA_CHUNK*)key)->base;
+    const ARENA_CHUNK *c = chunk;
+
+    if (p < c->base) return -1;
+    return (c->size == 0 ? p > c->base : p >= c->base + c->size) ? 1 : 0;
+}
+
+/**
+ * Function: arena_release
+ * 
+ * Description: Gives the memory of an allocation back to the OS before the whole arena is freed. The allocation must not
+ *              be used again. Allocations smaller than a page only go away with arena_free, and pointers the arena does
+ *              not own (e.g. into a mapped snapshot) are ignored.
+ *
+ * Input:
+ *   *arena - the arena
+ *   *p - the allocation (may be NULL)
+ *   size - the size it was allocated with
+ */
+void arena_release (ARENA *arena, void *p, size_t size)
+{
+    ARENA_CHUNK key;
+    ARENA_CHUNK *chunk;
+
+    if (!p || size < PAGE_SIZE) return;
+
+    if (!arena->sorted)
+    {
+        qsort (arena->chunks, arena->count, sizeof(ARENA_CHUNK), compare_arena_chunks);
+        arena->sorted = TRUE;
+    }
+
+    key.base = p;
+    chunk = bsearch (&key, arena->chunks, arena->count, sizeof(ARENA_CHUNK), compare_arena_chunks_containing);
+    if (!chunk || !chunk->size) return;
+
+    if (chunk->dedicated)
+    {
+        free_pages (chunk->base, chunk->size);
+        arena->bytes -= chunk->size;
+        chunk->size = 0;
+    }
+    else
+    {
+        discard_pages (p, (size + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1));
+    }
+}
+
+/**
+ * Function: arena_free
+ * 
+ * Description: Frees everything allocated from an arena and leaves it empty
+ *
+ * Input:
+ *   *arena - the arena
+ */
+void arena_free (ARENA *arena)
+{
+    size_t i;
+
+    for (i = 0; i < arena->count; i++)
+    {
+        if (arena->chunks[i].size) free_pages (arena->chunks[i].base, arena->chunks[i].size);
+    }
+    free (arena->chunks);
+    arena_init (arena);
+}
+
+// The types of value a scan can search for
+typedef enum
+{
+    TYPE_U8, TYPE_U16, TYPE_U32, TYPE_U64,
+    TYPE_I8, TYPE_I16, TYPE_I32, TYPE_I64,
+    TYPE_F32, TYPE_F64,
+    TYPE_COUNT
+} VALUE_TYPE;
+
+// A value of any VALUE_TYPE, kept zero extended so it can also be handled as its raw bytes
+typedef union
+{
+    unsigned char u8;
+    unsigned short u16;
+    unsigned int u32;
+    unsigned long long u64;
+    signed char i8;
+    short i16;
+    int i32;
+    long long i64;
+    float f32;
+    double f64;
+} TYPED_VALUE;
+
+typedef struct
+{
+    const char *name;
+    int size;
+    BOOL is_signed;
+    BOOL is_float;
+} VALUE_TYPE_INFO;
+
+// Indexed by VALUE_TYPE
+static const VALUE_TYPE_INFO value_types[TYPE_COUNT] =
+{
+    { "u8",  1, FALSE, FALSE }, { "u16", 2, FALSE, FALSE }, { "u32", 4, FALSE, FALSE }, { "u64", 8, FALSE, FALSE },
+    { "i8",  1, TRUE,  FALSE }, { "i16", 2, TRUE,  FALSE }, { "i32", 4, TRUE,  FALSE }, { "i64", 8, TRUE,  FALSE },
+    { "f32", 4, TRUE,  TRUE  }, { "f64", 8, TRUE,  TRUE  },
+};
+
+// A single surviving candidate of a sparse memory block
+typedef struct
+{
+    size_t offset; //offset of the candidate into its memory block
+    unsigned long long value; //raw bytes of the value at the candidate when it was last scanned, zero extended
+} MATCH;
+
+#define BASELINE_PAGES 32 //pages per segment of a compressed baseline (see Compressed baselines)
+#define BASELINE_SEGMENTS(size) (((size) + BASELINE_PAGES*PAGE_SIZE - 1) / (BASELINE_PAGES*PAGE_SIZE)) //segments of a block
+
+// The previous values of BASELINE_PAGES pages of a memory block in a compressed scan
+typedef struct
+{
+    unsigned char *data; //the stored pages one after another, each LZ4 or raw (malloc'd; NULL if none is stored)
+    unsigned int end[BASELINE_PAGES]; //page k is data[end[k-1]] to data[end[k]]: empty reads as zeroes, PAGE_SIZE is raw
+} BASELINE_SEGMENT;
+
+// Memory structure of each memory block found using list_regions
+typedef struct
+{
+    PROC_HANDLE hProc; //process handle of the process this memory block is in (seems wasteful to store this multiple times unless we are scanning more than 1 process at a time)
+    unsigned char *addr; //pointer to hexadecimal address this memory block starts in
+    size_t size; //size of this memory block
+    unsigned char *buffer;
+
+    unsigned char *searchmask;
+    MATCH *matchlist; //sorted candidates, used instead of buffer and searchmask once a block has few matches (see compact_memblock)
+    BASELINE_SEGMENT *baseline; //set instead of buffer in compressed scans: the previous values, one segment per SCAN_BUFFER_SIZE bytes
+    ARENA *arena; //arena of the scan this block is in; buffer, searchmask and matchlist come from it (or from a mapped snapshot)
+    size_t matches; //number of matches to the value we are searching for in this memory block
+    int data_size; //data size of the value we are scanning for (1, 2, 4 or 8 bytes)
+    int stride; //distance between candidates: searchmask bit k is the value at offset k*stride
+    int region_type; //REGION_PRIVATE, REGION_MAPPED or REGION_IMAGE
+} MEMBLOCK;
+
+// Reads done by an update of a scan or by a read plan (see Read plans)
+typedef struct
+{
+    unsigned long long syscalls; //number of read calls made
+    unsigned long long bytes_read; //bytes copied out of the process
+    unsigned long long bytes_wasted; //bytes read that no request asked for
+    unsigned long long bytes_skipped; //bytes update_scan did not read because their pages had not been written to
+    unsigned long long bytes_failed; //bytes update_scan could not read; the candidates on them were dropped
+} READ_STATS;
+
+// How the last update of a consistent scan paused the process
+typedef struct
+{
+    BOOL suspended; //FALSE if the process could not be suspended, or was stopped already
+    double pause; //milliseconds from suspending the process to resuming it, 0 if it was not paused
+    unsigned long long bytes_staged; //bytes copied in that time
+    unsigned long long bytes_left; //bytes max_pause left to be read from the running process
+} PAUSE_STATS;
+
+// Settings of the scans of a program (see default_scan_options). Every scan keeps a copy, and the engine has no other
+// state, so a program can run scans with different settings on different threads at the same time.
+typedef struct
+{
+    int threads; //worker threads of an update (0 = one per processor)
+    BOOL incremental; //consistent updates only read the pages written to since the last one, where the OS can tell
+    BOOL compressed; //create_scan makes a compressed scan (see Compressed baselines)
+    BOOL consistent; //updates suspend the process while they copy the values (see Parallel scan engine)
+    double max_pause; //milliseconds an update may keep the process suspended (0: no limit)
+    unsigned int gap; //gap of the read plans of the scan (see Read plans)
+} SCAN_OPTIONS;
+
+// A scan: one memory block per region create_scan kept (see REGION_FILTER), in address order
+typedef struct
+{
+    PROC_HANDLE hProc; //process handle of the process being scanned
+    VALUE_TYPE type; //type of the value we are scanning for
+    int data_size; //its size in bytes
+    int stride; //alignment of the candidates (1, 2, 4 or 8 bytes)
+    MEMBLOCK *blocks;
+    size_t count; //number of memory blocks
+    ARENA arena; //owns the block array and all block data
+    MAPPED_FILE *snapshot; //set if the scan was loaded with load_scan; block data may then point into it
+    BOOL tracking; //writes to the process have been tracked since the last update_scan (see track_writes)
+    BOOL prioritize; //update_scan takes the blocks in order of priority rather than address (see REGION_FILTER)
+    BOOL compressed; //dense blocks keep their previous values compressed rather than in a buffer (see Compressed baselines)
+    SCAN_OPTIONS options; //settings of its updates; compressed only counts when the scan is made
+    READ_STATS read_stats; //reads done by the last update
+    PAUSE_STATS pause_stats; //how the last update paused the process
+    READ_STATS print_stats; //reads done by the last print_matches
+    struct SCAN_PENDING *pending; //the part of the last update a limit left undone, until it is resumed (see Scan limits)
+} SCAN;
+
+// Which regions create_scan makes memory blocks of. A region is kept if it passes every test.
+typedef struct
+{
+    int protect; //protection bits a region must have (REGION_READ | REGION_WRITE | REGION_EXEC)
+    int protect_not; //protection bits it must not have
+    int types; //REGION_PRIVATE | REGION_MAPPED | REGION_IMAGE it may be, or 0 for any
+    char module[64]; //only the regions of the module with this file name (see list_modules), or empty for any
+    unsigned char *from; //only regions that start at or after this address
+    unsigned char *to; //only regions that end at or before this address, or NULL for no limit
+    size_t min_size;
+    size_t max_size; //0 for no limit
+    BOOL prioritize; //scan private regions first, then images, then mapped regions, each in address order
+} REGION_FILTER;
+
+// The type of search we are doing
+typedef enum 
+{
+    COND_UNCONDITIONAL, //match on every address (this happens if we use the unknown scan initially)
+    COND_EQUALS, //exact match (within the epsilon for float types)
+
+    COND_INCREASED, //increased value by unknown amount
+    COND_DECREASED, //decreased value by unknown amount
+
+    COND_BETWEEN, //between two values, inclusive
+    COND_CHANGED, //different from the last scan
+    COND_UNCHANGED, //same as in the last scan
+    COND_INCREASED_BY, //increased by exactly the given amount (within the epsilon for float types)
+    COND_DECREASED_BY, //decreased by exactly the given amount (within the epsilon for float types)
+} SEARCH_CONDITION;
+
+// A search: the condition and its operands, stored in the value type of the scan
+typedef struct
+{
+    SEARCH_CONDITION condition;
+    TYPED_VALUE a; //COND_EQUALS: the value, COND_BETWEEN: the lower bound, COND_INCREASED_BY/COND_DECREASED_BY: the amount
+    TYPED_VALUE b; //COND_BETWEEN: the upper bound
+    double epsilon; //float types: how far from the value still counts as equal
+} SEARCH_PARAMS;
+
+// Names of the conditions in scripts and benchmark results, in SEARCH_CONDITION order (see parse_search)
+const char *condition_names[] =
+{
+    "unknown", "equals", "increased", "decreased", "between", "changed", "unchanged", "increased_by", "decreased_by"
+};
+#define CONDITION_COUNT (sizeof(condition_names) / sizeof(condition_names[0]))
+
+
+#ifdef _WIN32
+// Enable or disable a privilege in an access token
+// source: http://msdn.microsoft.com/en-us/library/aa446619(VS.85).aspx
+BOOL SetPrivilege(
+    HANDLE hToken,          // access token handle
+    LPCTSTR lpszPrivilege,  // name of privilege to enable/disable
+    BOOL bEnablePrivilege   // to enable or disable privilege
+    )
+{
+	TOKEN_PRIVILEGES tp;
+	LUID luid;
+
+	if ( !LookupPrivilegeValue(
+			NULL,            // lookup privilege on local system
+			lpszPrivilege,   // privilege to lookup
+			&luid ) )        // receives LUID of privilege
+	{
+		printf("LookupPrivilegeValue error: %u\n", GetLastError() );
+		return FALSE;
+	}
+
+	tp.PrivilegeCount = 1;
+	tp.Privileges[0].Luid = luid;
+	if (bEnablePrivilege)
+		tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	else
+		tp.Privileges[0].Attributes = 0;
+
+	// Enable the privilege or disable all privileges.
+
+	if ( !AdjustTokenPrivileges(
+		   hToken,
+		   FALSE,
+		   &tp,
+		   sizeof(TOKEN_PRIVILEGES),
+		   (PTOKEN_PRIVILEGES) NULL,
+		   (PDWORD) NULL) )
+	{
+		  printf("AdjustTokenPrivileges error: %u\n", GetLastError() );
+		  return FALSE;
+	}
+
+	if (GetLastError() == ERROR_NOT_ALL_ASSIGNED)
+
+	{
+		  printf("The token does not have the specified privilege. \n");
+		  return FALSE;
+	}
+
+	return TRUE;
+}
+#endif
+
+/**
+ * Function: searchmask_size
+ * 
+ * Description: Size in bytes of the searchmask of a block: one bit per stride bytes
+ */
+size_t searchmask_size (size_t size, int stride)
+{
+    return (size / stride + 7) / 8;
+}
+
+/**
+ * Function: candidate_count
+ * 
+ * Description: Number of candidates in a block: the multiples of stride that still have a whole value after them
+ */
+size_t candidate_count (size_t size, int data_size, int stride)
+{
+    return (size < (size_t)data_size) ? 0 : (size - data_size) / stride + 1;
+}
+
+/**
+ * Function: init_memblock
+ * 
+ * Description: Sets up an individual block of memory that stores data of each individual virtual page. 
+ *
+ * Input:
+ *   *mb - the memory block to set up (an element of a scan's block array)
+ *   *scan - the scan the block belongs to; its buffer (or baseline) and searchmask are allocated from the scan's arena
+ *   *region - a pointer to the region returned by list_regions
+ *
+ * Output:
+ *   TRUE on success
+ */
+BOOL init_memblock (MEMBLOCK *mb, SCAN *scan, REGION *region)
+{
+    mb->hProc = scan->hProc;
+    mb->addr = region->base;
+    mb->size = region->size;
+    mb->buffer = scan->compressed ? NULL : arena_alloc (&scan->arena, region->size);
+    mb->baseline = scan->compressed ? arena_alloc (&scan->arena, BASELINE_SEGMENTS (region->size) * sizeof(BASELINE_SEGMENT)) : NULL;
+    mb->searchmask = arena_alloc (&scan->arena, searchmask_size (region->size, scan->stride));
+    mb->matchlist = NULL;
+    mb->arena = &scan->arena;
+    mb->data_size = scan->data_size;
+    mb->stride = scan->stride;
+    mb->region_type = region->type;
+    mb->matches = candidate_count (region->size, mb->data_size, mb->stride);
+
+    if (!(mb->buffer || mb->baseline) || !mb->searchmask)
+    {
+        arena_release (mb->arena, mb->buffer, region->size);
+        arena_release (mb->arena, mb->baseline, BASELINE_SEGMENTS (region->size) * sizeof(BASELINE_SEGMENT));
+        arena_release (mb->arena, mb->searchmask, searchmask_size (region->size, scan->stride));
+        return FALSE;
+    }
+
+    // arena memory is zeroed, so only the candidates need setting
+    memset (mb->searchmask, 0xff, mb->matches / 8);
+    if (mb->matches % 8) mb->searchmask[mb->matches / 8] = (unsigned char)((1 << (mb->matches % 8)) - 1);
+    return TRUE;
+}
+
+/*
+ * Batched reads
+ *
+ * Reading every candidate with its own ReadProcessMemory call costs one syscall per address. A read plan collects the
+ * addresses to read, sorts them, widens each one to whole pages and merges neighbours that are at most `gap` bytes apart
+ * into runs of up to READ_PLAN_MAX_RUN bytes, which are then read with read_memory_runs (one ReadProcessMemory call per run
+ * on Windows, process_vm_readv batches of up to MAX_IOVECS runs on Linux). If a run cannot be read as a whole
+ * (e.g. it spans a page that is not mapped), its requests are retried one by one.
+ *
+ * The stats of a plan add up over every execute_read_plan call, so they can be used to tune the gap.
+ */
+
+#define READ_PLAN_MAX_RUN (1024*1024)
+
+typedef struct
+{
+    unsigned char *addr; //address to read in the process
+    unsigned int size; //number of bytes to read
+    unsigned char *data; //filled in by execute_read_plan: where the bytes were read to, or NULL if they could not be read
+} READ_REQUEST;
+
+typedef struct
+{
+    unsigned char *addr;
+    unsigned int index; //index of the request in READ_PLAN.requests
+} READ_ORDER;
+
+typedef struct
+{
+    PROC_HANDLE hProc;
+    unsigned int gap; //requests whose pages are at most this many bytes apart are read with one call
+    READ_REQUEST *requests; //in the order they were added
+    READ_ORDER *order; //requests sorted by address
+    READ_RUN *runs; //the runs of the last execute_read_plan
+    unsigned int *run_last; //run_last[r]: position in order of the first request after run r
+    unsigned int nruns; //number of runs of the last execute_read_plan
+    unsigned int count;
+    unsigned int capacity;
+    unsigned char *buffer;
+    size_t buffer_size;
+    READ_STATS stats;
+} READ_PLAN;
+
+#define READ_GAP PAGE_SIZE //default gap of read plans
+
+/**
+ * Function: create_read_plan
+ * 
+ * Description: Creates an empty read plan
+ *
+ * Input:
+ *   hProc - process handle of the process to read from
+ *   gap - requests whose pages are at most this many bytes apart are read with one call
+ *
+ * Output:
+ *   The read plan, or NULL if out of memory
+ */
+READ_PLAN* create_read_plan (PROC_HANDLE hProc, unsigned int gap)
+{
+    READ_PLAN *plan = calloc (1, sizeof(READ_PLAN));
+
+    if (plan)
+    {
+        plan->hProc = hProc;
+        plan->gap = gap;
+    }
+
+    return plan;
+}
+
+/**
+ * Function: reset_read_plan
+ * 
+ * Description: Removes all requests from a read plan so it can be reused (the stats are kept)
+ *
+ * Input:
+ *   *plan - the read plan
+ *   hProc - process handle of the process to read from next
+ */
+void reset_read_plan (READ_PLAN *plan, PROC_HANDLE hProc)
+{
+    plan->hProc = hProc;
+    plan->count = 0;
+}
+
+/**
+ * Function: free_read_plan
+ * 
+ * Description: Frees a read plan and everything it has read
+ *
+ * Input:
+ *   *plan - the read plan
+ */
+void free_read_plan (READ_PLAN *plan)
+{
+    if (plan)
+    {
+        free (plan->requests);
+        free (plan->order);
+        free (plan->runs);
+        free (plan->run_last);
+        free (plan->buffer);
+        free (plan);
+    }
+}
+
+/**
+ * Function: read_plan_add
+ * 
+ * Description: Adds an address to be read by the next execute_read_plan
+ *
+ * Input:
+ *   *plan - the read plan
+ *   addr - address in the process
+ *   size - number of bytes to read
+ *
+ * Output:
+ *   Index of the request in plan->requests, or -1 if out of memory
+ */
+int read_plan_add (READ_PLAN *plan, unsigned char *addr, unsigned int size)
+{
+    if (plan->count == plan->capacity)
+    {
+        unsigned int capacity = plan->capacity ? plan->capacity * 2 : 256;
+        READ_REQUEST *requests = realloc (plan->requests, capacity * sizeof(READ_REQUEST));
+        READ_ORDER *order;
+        READ_RUN *runs;
+        unsigned int *run_last;
+
+        if (!requests) return -1;
+        plan->requests = requests;
+
+        order = realloc (plan->order, capacity * sizeof(READ_ORDER));
+        if (!order) return -1;
+        plan->order = order;
+
+        // there are never more runs than requests
+        runs = realloc (plan->runs, capacity * sizeof(READ_RUN));
+        if (!runs) return -1;
+        plan->runs = runs;
+
+        run_last = realloc (plan->run_last, capacity * sizeof(unsigned int));
+        if (!run_last) return -1;
+        plan->run_last = run_last;
+
+        plan->capacity = capacity;
+    }
+
+    plan->requests[plan->count].addr = addr;
+    plan->requests[plan->count].size = size;
+    plan->requests[plan->count].data = NULL;
+    plan->order[plan->count].addr = addr;
+    plan->order[plan->count].index = plan->count;
+
+    return plan->count++;
+}
+
+static int compare_read_order (const void *a, const void *b)
+{
+    unsigned char *x = ((const READ_ORDER*)a)->addr;
+    unsigned char *y = ((const READ_ORDER*)b)->addr;
+
+    return (x < y) ? -1 : (x > y);
+}
+
+/**
+ * Function: next_read_run
+ * 
+ * Description: Finds the page-aligned run starting at a request and the requests it covers
+ *
+ * Input:
+ *   *plan - the read plan (with plan->order sorted)
+ *   first - position in plan->order of the first request of the run
+ *   **run_start, **run_end - receive the page-aligned bounds of the run
+ *
+ * Output:
+ *   Position in plan->order of the first request after the run
+ */
+static unsigned int next_read_run (READ_PLAN *plan, unsigned int first, unsigned char **run_start, unsigned char **run_end)
+{
+    READ_ORDER *order = plan->order;
+    unsigned int last;
+
+    *run_start = (unsigned char*)((uintptr_t)order[first].addr & ~(uintptr_t)(PAGE_SIZE - 1));
+    *run_end = (unsigned char*)(((uintptr_t)order[first].addr + plan->requests[order[first].index].size + PAGE_SIZE - 1) & ~(uintptr_t)(PAGE_SIZE - 1));
+
+    for (last = first + 1; last < plan->count; last++)
+    {
+        unsigned char *start = (unsigned char*)((uintptr_t)order[last].addr & ~(uintptr_t)(PAGE_SIZE - 1));
+        unsigned char *end = (unsigned char*)(((uintptr_t)order[last].addr + plan->requests[order[last].index].size + PAGE_SIZE - 1) & ~(uintptr_t)(PAGE_SIZE - 1));
+
+        if (start > *run_end + plan->gap || end - *run_start > READ_PLAN_MAX_RUN) break;
+        if (end > *run_end) *run_end = end;
+    }
+
+    return last;
+}
+
+/**
+ * Function: execute_read_plan
+ * 
+ * Description: Reads all requests of a read plan, coalescing them into page-aligned runs
+ *
+ * Input:
+ *   *plan - the read plan; afterwards plan->requests[i].data points at the bytes of request i (NULL if unreadable)
+ *
+ * Output:
+ *   The number of requests that could be read
+ */
+unsigned int execute_read_plan (READ_PLAN *plan)
+{
+    READ_REQUEST *req = plan->requests;
+    READ_ORDER *order = plan->order;
+    unsigned char *run_start, *run_end;
+    unsigned long long total = 0;
+    unsigned int first, last, i, r;
+    unsigned int nruns;
+    unsigned int done = 0;
+
+    // candidates are usually added in address order already
+    for (i = 1; i < plan->count; i++)
+    {
+        if (order[i-1].addr > order[i].addr)
+        {
+            qsort (order, plan->count, sizeof(READ_ORDER), compare_read_order);
+            break;
+        }
+    }
+
+    // work out the runs and size the buffer for all of them
+    nruns = 0;
+    for (first = 0; first < plan->count; first = last)
+    {
+        last = next_read_run (plan, first, &run_start, &run_end);
+        plan->runs[nruns].addr = run_start;
+        plan->runs[nruns].size = run_end - run_start;
+        plan->run_last[nruns] = last;
+        nruns++;
+        total += run_end - run_start;
+    }
+
+    if (total > plan->buffer_size)
+    {
+        free (plan->buffer);
+        plan->buffer = malloc (total);
+        plan->buffer_size = plan->buffer ? (size_t)total : 0;
+        if (!plan->buffer)
+        {
+            plan->nruns = 0;
+            return 0;
+        }
+    }
+    plan->nruns = nruns;
+
+    total = 0;
+    for (r = 0; r < nruns; r++)
+    {
+        plan->runs[r].dest = plan->buffer + total;
+        total += plan->runs[r].size;
+    }
+
+    plan->stats.syscalls += read_memory_runs (plan->hProc, plan->runs, nruns);
+
+    first = 0;
+    for (r = 0; r < nruns; r++)
+    {
+        READ_RUN *run = &plan->runs[r];
+        unsigned long long wanted = 0;
+
+        last = plan->run_last[r];
+        if (run->ok)
+        {
+            for (i = first; i < last; i++)
+            {
+                READ_REQUEST *q = &req[order[i].index];
+                q->data = run->dest + (q->addr - run->addr);
+                wanted += q->size;
+            }
+            plan->stats.bytes_read += run->size;
+            plan->stats.bytes_wasted += (run->size > wanted) ? run->size - wanted : 0;
+            done += last - first;
+        }
+        else
+        {
+            // part of the run is unreadable, so fall back to one call per request
+            for (i = first; i < last; i++)
+            {
+                READ_REQUEST *q = &req[order[i].index];
+                unsigned char *d = run->dest + (q->addr - run->addr);
+
+                q->data = NULL;
+                plan->stats.syscalls++;
+                if (read_memory (plan->hProc, q->addr, d, q->size) == q->size)
+                {
+                    q->data = d;
+                    plan->stats.bytes_read += q->size;
+                    done++;
+                }
+            }
+        }
+        first = last;
+    }
+
+    return done;
+}
+
+/*
+ * Compare kernels
+ *
+ * update_memblock used to test every offset with IS_IN_SEARCH and then switch on both data_size and the condition,
+ * which made a first scan bound by branch mispredictions instead of memory bandwidth. Each kernel below is specialized
+ * for one value type and one test (OP_*), so nothing is switched on per element. The SSE2/AVX2 kernels compare 16/32 bytes
+ * at a time and write the result straight into the searchmask with movemask; the scalar kernels are the fallback for
+ * other CPUs and for the tail of a chunk.
+ *
+ * compile_search turns a SEARCH_PARAMS into the kernel and operands for the scan's type once per scan, e.g. a float
+ * COND_EQUALS with an epsilon becomes OP_BETWEEN with the bounds value - epsilon and value + epsilon. Tests that only
+ * need equality of the bits (OP_EQ, OP_CHANGED, OP_UNCHANGED, OP_DIFF_EQ) have one kernel per size; ordered tests have
+ * one per type.
+ *
+ * The searchmask keeps one bit per candidate: bit k stands for the value at offset k * stride, where the stride is the
+ * alignment the scan was created with (the value size unless asked otherwise). A stride smaller than the value size
+ * also finds values at unaligned offsets, e.g. in packed structs; a kernel is given n candidates and reads the
+ * (n - 1) * stride + size bytes they cover.
+ */
+
+typedef unsigned int (*SCAN_KERNEL)(const unsigned char *cur, const unsigned char *prev, unsigned char *mask, unsigned int n, int stride, const TYPED_VALUE *args);
+
+// Candidate strides (alignments) there are kernels for
+enum { STRIDE_1, STRIDE_2, STRIDE_4, STRIDE_8, STRIDE_COUNT };
+
+// What a kernel tests, given the current value c, the previous value p and the operands v = args[0] and w = args[1]
+enum
+{
+    OP_ANY, //every value matches (the unknown scan)
+    OP_EQ, //c == v
+    OP_INC, //c > p
+    OP_DEC, //c < p
+    OP_BETWEEN, //v <= c <= w
+    OP_CHANGED, //c != p, bit for bit
+    OP_UNCHANGED, //c == p, bit for bit
+    OP_DIFF_EQ, //c - p == v, wrapping (integer types)
+    OP_DIFF_BETWEEN, //v <= c - p <= w (float types)
+    OP_COUNT
+};
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define POPCOUNT(x) __popcnt (x)
+#define CTZ(x) ctz32 (x)
+#define TARGET_AVX2
+static unsigned int ctz32 (unsigned int x)
+{
+    unsigned long i;
+    _BitScanForward (&i, x);
+    return i;
+}
+#else
+#define POPCOUNT(x) __builtin_popcount (x)
+#define CTZ(x) __builtin_ctz (x)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// Scalar kernels: walk one searchmask byte (8 candidates) at a time and only load the candidates whose bit is set, so empty
+// mask bytes cost a single test. They work for any stride and any n, which makes them the tail of the vector kernels too.
+#define SCALAR_KERNEL(name, type, field, test) \
+static unsigned int name (const unsigned char *cur, const unsigned char *prev, unsigned char *mask, unsigned int n, int stride, const TYPED_VALUE *args) \
+{ \
+    type v = args[0].field; \
+    type w = args[1].field; \
+    unsigned int i; \
+    unsigned int matches = 0; \
+    (void)v; (void)w; \
+    for (i = 0; i < n; i += 8) \
+    { \
+        unsigned int m = mask[i/8]; \
+        unsigned int left; \
+        if (n - i < 8) m &= (1u << (n - i)) - 1; \
+        left = m; \
+        while (left) \
+        { \
+            unsigned int j = CTZ (left); \
+            type c, p; \
+            left &= left - 1; \
+            memcpy (&c, cur + (size_t)(i + j) * stride, sizeof(type)); \
+            memcpy (&p, prev + (size_t)(i + j) * stride, sizeof(type)); \
+            (void)p; \
+            if (!(test)) m &= ~(1u << j); \
+        } \
+        mask[i/8] = (unsigned char)m; \
+        matches += POPCOUNT (m); \
+    } \
+    return matches; \
+}
+
+// The unknown scan: every candidate stays a candidate
+static unsigned int scan_any (const unsigned char *cur, const unsigned char *prev, unsigned char *mask, unsigned int n, int stride, const TYPED_VALUE *args)
+{
+    unsigned int i;
+    unsigned int matches = 0;
+
+    (void)cur; (void)prev; (void)stride; (void)args;
+    for (i = 0; i < n; i += 8)
+    {
+        unsigned int m = mask[i/8];
+        if (n - i < 8) m &= (1u << (n - i)) - 1;
+        matches += POPCOUNT (m);
+    }
+
+    return matches;
+}
+
+#define SCALAR_SIZE_KERNELS(size, type, field) \
+SCALAR_KERNEL (scalar_eq_##size,        type, field, c == v) \
+SCALAR_KERNEL (scalar_changed_##size,   type, field, c != p) \
+SCALAR_KERNEL (scalar_unchanged_##size, type, field, c == p) \
+SCALAR_KERNEL (scalar_diffeq_##size,    type, field, (type)(c - p) == v)
+
+#define SCALAR_ORDER_KERNELS(sfx, type) \
+SCALAR_KERNEL (scalar_inc_##sfx,     type, sfx, c > p) \
+SCALAR_KERNEL (scalar_dec_##sfx,     type, sfx, c < p) \
+SCALAR_KERNEL (scalar_between_##sfx, type, sfx, c >= v && c <= w)
+
+SCALAR_SIZE_KERNELS (1, unsigned char,      u8)
+SCALAR_SIZE_KERNELS (2, unsigned short,     u16)
+SCALAR_SIZE_KERNELS (4, unsigned int,       u32)
+SCALAR_SIZE_KERNELS (8, unsigned long long, u64)
+SCALAR_ORDER_KERNELS (u8,  unsigned char)
+SCALAR_ORDER_KERNELS (u16, unsigned short)
+SCALAR_ORDER_KERNELS (u32, unsigned int)
+SCALAR_ORDER_KERNELS (u64, unsigned long long)
+SCALAR_ORDER_KERNELS (i8,  signed char)
+SCALAR_ORDER_KERNELS (i16, short)
+SCALAR_ORDER_KERNELS (i32, int)
+SCALAR_ORDER_KERNELS (i64, long long)
+SCALAR_ORDER_KERNELS (f32, float)
+SCALAR_ORDER_KERNELS (f64, double)
+SCALAR_KERNEL (scalar_diffbetween_f32, float,  f32, c - p >= v && c - p <= w)
+SCALAR_KERNEL (scalar_diffbetween_f64, double, f64, c - p >= v && c - p <= w)
+
+/**
+ * Function: pack_odd_bits
+ *
+ * Description: Packs bits 1, 3, 5, ... 31 of x into the low 16 bits (the movemask of 2-byte elements has two bits per element)
+ */
+static unsigned int pack_odd_bits (unsigned int x)
+{
+    x = (x >> 1) & 0x55555555;
+    x = (x | (x >> 1)) & 0x33333333;
+    x = (x | (x >> 2)) & 0x0F0F0F0F;
+    x = (x | (x >> 4)) & 0x00FF00FF;
+    return (x | (x >> 8)) & 0x0000FFFF;
+}
+
+#ifdef HAVE_X86_SIMD
+#define LOAD128(p) _mm_loadu_si128 ((const __m128i*)(p))
+#define LOAD256(p) _mm256_loadu_si256 ((const __m256i*)(p))
+
+// Repeats an operand across a vector
+static __m128i splat128 (const TYPED_VALUE *arg, int size)
+{
+    unsigned char bytes[16];
+    int i;
+
+    for (i = 0; i < 16; i += size) memcpy (bytes + i, arg, size);
+    return LOAD128 (bytes);
+}
+
+TARGET_AVX2 static __m256i splat256 (const TYPED_VALUE *arg, int size)
+{
+    unsigned char bytes[32];
+    int i;
+
+    for (i = 0; i < 32; i += size) memcpy (bytes + i, arg, size);
+    return LOAD256 (bytes);
+}
+
+// Selects bytes first..first+count-1 of every size-byte lane
+static void lane_select (unsigned char *bytes, int len, int size, int first, int count)
+{
+    int i;
+
+    for (i = 0; i < len; i++) bytes[i] = (i % size >= first && i % size < first + count) ? 0xFF : 0;
+}
+
+/*
+ * The vector kernels are generated for every stride. A compare of two vectors gives one all-ones or all-zero lane per
+ * size-byte value starting at the load address; it is turned into one stride-byte element per candidate, whose top bit
+ * is the result, and the top bits are gathered into searchmask bits:
+ *
+ *   - stride == size: the lanes are the elements.
+ *   - stride > size: only the value at the start of each element is a candidate; its lane is shifted to the top. The
+ *     loads run stride - size bytes past the last value, so the last step needs one more candidate after it.
+ *   - stride < size: the values of neighbouring candidates overlap, so the data is compared size / stride times, from
+ *     loads that start stride bytes apart, and element r of every lane is taken from the r-th compare.
+ *
+ * cmp sees the current and previous values as c and p and the operands as v and w.
+ */
+static unsigned int sse2_candidate_bits (__m128i e, int size, int stride)
+{
+    if (stride > size)
+    {
+        const __m128i shift = _mm_cvtsi32_si128 ((stride - size) * 8);
+        if (stride == 2) e = _mm_sll_epi16 (e, shift);
+        if (stride == 4) e = _mm_sll_epi32 (e, shift);
+        if (stride == 8) e = _mm_sll_epi64 (e, shift);
+    }
+
+    switch (stride)
+    {
+        case 1: return (unsigned int)_mm_movemask_epi8 (e);
+        case 2: return pack_odd_bits ((unsigned int)_mm_movemask_epi8 (e));
+        case 4: return (unsigned int)_mm_movemask_ps (_mm_castsi128_ps (e));
+        default: return (unsigned int)_mm_movemask_pd (_mm_castsi128_pd (e));
+    }
+}
+
+// SSE2: 16 candidates (two searchmask bytes) per step
+#define SSE2_KERNEL(name, size, stride, tail, cmp) \
+static unsigned int name (const unsigned char *cur, const unsigned char *prev, unsigned char *mask, unsigned int n, int stride_, const TYPED_VALUE *args) \
+{ \
+    const __m128i v = splat128 (&args[0], size); \
+    const __m128i w = splat128 (&args[1], size); \
+    __m128i sel[(size > stride) ? size / stride : 1]; \
+    unsigned int i; \
+    unsigned int matches = 0; \
+    int part, r; \
+    (void)v; (void)w; (void)stride_; \
+    for (r = 0; r < size / stride; r++) \
+    { \
+        unsigned char bytes[16]; \
+        lane_select (bytes, 16, size, r * stride, stride); \
+        sel[r] = LOAD128 (bytes); \
+    } \
+    for (i = 0; i + 16 + (stride > size) <= n; i += 16) \
+    { \
+        unsigned short m; \
+        memcpy (&m, mask + i/8, sizeof(m)); \
+        if (m) \
+        { \
+            unsigned int bits = 0; \
+            for (part = 0; part < stride; part++) \
+            { \
+                const unsigned char *cp = cur + (size_t)i * stride + part * 16; \
+                const unsigned char *pp = prev + (size_t)i * stride + part * 16; \
+                __m128i e = _mm_setzero_si128 (); \
+                for (r = 0; r < ((size > stride) ? size / stride : 1); r++) \
+                { \
+                    const __m128i c = LOAD128 (cp + r * stride); \
+                    const __m128i p = LOAD128 (pp + r * stride); \
+                    (void)c; (void)p; \
+                    e = (size > stride) ? _mm_or_si128 (e, _mm_and_si128 (cmp, sel[r])) : (cmp); \
+                } \
+                bits |= sse2_candidate_bits (e, size, stride) << (part * 16 / stride); \
+            } \
+            m &= bits; \
+            memcpy (mask + i/8, &m, sizeof(m)); \
+            matches += POPCOUNT (m); \
+        } \
+    } \
+    return matches + tail (cur + (size_t)i * stride, prev + (size_t)i * stride, mask + i/8, n - i, stride, args); \
+}
+
+// SSE2 has no unsigned compare, so unsigned types flip the sign bit of both sides and use the signed one. It has no
+// 64-bit compares either; they are put together from the 32-bit halves.
+static __m128i sse2_cmpeq_epi64 (__m128i a, __m128i b)
+{
+    __m128i t = _mm_cmpeq_epi32 (a, b);
+    return _mm_and_si128 (t, _mm_shuffle_epi32 (t, 0xB1));
+}
+
+static __m128i sse2_cmpgt_epi64 (__m128i a, __m128i b)
+{
+    // high halves greater, or equal and the low halves greater unsigned; then copy the result of the high half to the low one
+    const __m128i sign = _mm_set1_epi32 (INT_MIN);
+    __m128i hi_gt = _mm_cmpgt_epi32 (a, b);
+    __m128i hi_eq = _mm_cmpeq_epi32 (a, b);
+    __m128i lo_gt = _mm_cmpgt_epi32 (_mm_xor_si128 (a, sign), _mm_xor_si128 (b, sign));
+    __m128i t = _mm_or_si128 (hi_gt, _mm_and_si128 (hi_eq, _mm_slli_epi64 (lo_gt, 32)));
+    return _mm_shuffle_epi32 (t, 0xF5);
+}
+
+#define SSE2_NOT(x) _mm_xor_si128 (x, _mm_set1_epi32 (-1))
+#define SSE2_EQ8(a, b)  _mm_cmpeq_epi8 (a, b)
+#define SSE2_EQ16(a, b) _mm_cmpeq_epi16 (a, b)
+#define SSE2_EQ32(a, b) _mm_cmpeq_epi32 (a, b)
+#define SSE2_EQ64(a, b) sse2_cmpeq_epi64 (a, b)
+#define SSE2_GT_I8(a, b)  _mm_cmpgt_epi8 (a, b)
+#define SSE2_GT_I16(a, b) _mm_cmpgt_epi16 (a, b)
+#define SSE2_GT_I32(a, b) _mm_cmpgt_epi32 (a, b)
+#define SSE2_GT_I64(a, b) sse2_cmpgt_epi64 (a, b)
+#define SSE2_GT_U8(a, b)  _mm_cmpgt_epi8 (_mm_xor_si128 (a, _mm_set1_epi8 (-128)), _mm_xor_si128 (b, _mm_set1_epi8 (-128)))
+#define SSE2_GT_U16(a, b) _mm_cmpgt_epi16 (_mm_xor_si128 (a, _mm_set1_epi16 (-32768)), _mm_xor_si128 (b, _mm_set1_epi16 (-32768)))
+#define SSE2_GT_U32(a, b) _mm_cmpgt_epi32 (_mm_xor_si128 (a, _mm_set1_epi32 (INT_MIN)), _mm_xor_si128 (b, _mm_set1_epi32 (INT_MIN)))
+#define SSE2_GT_U64(a, b) sse2_cmpgt_epi64 (_mm_xor_si128 (a, _mm_set1_epi64x (LLONG_MIN)), _mm_xor_si128 (b, _mm_set1_epi64x (LLONG_MIN)))
+#define SSE2_F(ps, x) _mm_castsi128_##ps (x)
+#define SSE2_I(ps, x) _mm_cast##ps##_si128 (x)
+
+#define SSE2_SIZE_KERNELS(size, bits, s) \
+SSE2_KERNEL (sse2_eq_##size##_s##s,        size, s, scalar_eq_##size,        SSE2_EQ##bits (c, v)) \
+SSE2_KERNEL (sse2_changed_##size##_s##s,   size, s, scalar_changed_##size,   SSE2_NOT (SSE2_EQ##bits (c, p))) \
+SSE2_KERNEL (sse2_unchanged_##size##_s##s, size, s, scalar_unchanged_##size, SSE2_EQ##bits (c, p)) \
+SSE2_KERNEL (sse2_diffeq_##size##_s##s,    size, s, scalar_diffeq_##size,    SSE2_EQ##bits (_mm_sub_epi##bits (c, p), v))
+
+#define SSE2_INT_KERNELS(sfx, size, s, GT) \
+SSE2_KERNEL (sse2_inc_##sfx##_s##s,     size, s, scalar_inc_##sfx,     GT (c, p)) \
+SSE2_KERNEL (sse2_dec_##sfx##_s##s,     size, s, scalar_dec_##sfx,     GT (p, c)) \
+SSE2_KERNEL (sse2_between_##sfx##_s##s, size, s, scalar_between_##sfx, SSE2_NOT (_mm_or_si128 (GT (v, c), GT (c, w))))
+
+// Float compares are false for NaN, so BETWEEN is written as two ordered compares rather than NOT (outside)
+#define SSE2_FLOAT_KERNELS(sfx, size, s, ps) \
+SSE2_KERNEL (sse2_inc_##sfx##_s##s,         size, s, scalar_inc_##sfx,         SSE2_I (ps, _mm_cmpgt_##ps (SSE2_F (ps, c), SSE2_F (ps, p)))) \
+SSE2_KERNEL (sse2_dec_##sfx##_s##s,         size, s, scalar_dec_##sfx,         SSE2_I (ps, _mm_cmplt_##ps (SSE2_F (ps, c), SSE2_F (ps, p)))) \
+SSE2_KERNEL (sse2_between_##sfx##_s##s,     size, s, scalar_between_##sfx,     SSE2_I (ps, _mm_and_##ps (_mm_cmpge_##ps (SSE2_F (ps, c), SSE2_F (ps, v)), _mm_cmple_##ps (SSE2_F (ps, c), SSE2_F (ps, w))))) \
+SSE2_KERNEL (sse2_diffbetween_##sfx##_s##s, size, s, scalar_diffbetween_##sfx, SSE2_I (ps, _mm_and_##ps (_mm_cmpge_##ps (_mm_sub_##ps (SSE2_F (ps, c), SSE2_F (ps, p)), SSE2_F (ps, v)), \
+                                                                                                         _mm_cmple_##ps (_mm_sub_##ps (SSE2_F (ps, c), SSE2_F (ps, p)), SSE2_F (ps, w)))))
+
+#define SSE2_STRIDE_KERNELS(s) \
+SSE2_SIZE_KERNELS (1, 8,  s) \
+SSE2_SIZE_KERNELS (2, 16, s) \
+SSE2_SIZE_KERNELS (4, 32, s) \
+SSE2_SIZE_KERNELS (8, 64, s) \
+SSE2_INT_KERNELS (u8,  1, s, SSE2_GT_U8) \
+SSE2_INT_KERNELS (u16, 2, s, SSE2_GT_U16) \
+SSE2_INT_KERNELS (u32, 4, s, SSE2_GT_U32) \
+SSE2_INT_KERNELS (u64, 8, s, SSE2_GT_U64) \
+SSE2_INT_KERNELS (i8,  1, s, SSE2_GT_I8) \
+SSE2_INT_KERNELS (i16, 2, s, SSE2_GT_I16) \
+SSE2_INT_KERNELS (i32, 4, s, SSE2_GT_I32) \
+SSE2_INT_KERNELS (i64, 8, s, SSE2_GT_I64) \
+SSE2_FLOAT_KERNELS (f32, 4, s, ps) \
+SSE2_FLOAT_KERNELS (f64, 8, s, pd)
+
+SSE2_STRIDE_KERNELS (1)
+SSE2_STRIDE_KERNELS (2)
+SSE2_STRIDE_KERNELS (4)
+SSE2_STRIDE_KERNELS (8)
+
+TARGET_AVX2 static unsigned int avx2_candidate_bits (__m256i e, int size, int stride)
+{
+    if (stride > size)
+    {
+        const __m128i shift = _mm_cvtsi32_si128 ((stride - size) * 8);
+        if (stride == 2) e = _mm256_sll_epi16 (e, shift);
+        if (stride == 4) e = _mm256_sll_epi32 (e, shift);
+        if (stride == 8) e = _mm256_sll_epi64 (e, shift);
+    }
+
+    switch (stride)
+    {
+        case 1: return (unsigned int)_mm256_movemask_epi8 (e);
+        case 2: return pack_odd_bits ((unsigned int)_mm256_movemask_epi8 (e));
+        case 4: return (unsigned int)_mm256_movemask_ps (_mm256_castsi256_ps (e));
+        default: return (unsigned int)_mm256_movemask_pd (_mm256_castsi256_pd (e));
+    }
+}
+
+// AVX2: same as SSE2 but 32 candidates (four searchmask bytes) per step, and with native 64-bit compares
+#define AVX2_KERNEL(name, size, stride, tail, cmp) \
+TARGET_AVX2 static unsigned int name (const unsigned char *cur, const unsigned char *prev, unsigned char *mask, unsigned int n, int stride_, const TYPED_VALUE *args) \
+{ \
+    const __m256i v = splat256 (&args[0], size); \
+    const __m256i w = splat256 (&args[1], size); \
+    __m256i sel[(size > stride) ? size / stride : 1]; \
+    unsigned int i; \
+    unsigned int matches = 0; \
+    int part, r; \
+    (void)v; (void)w; (void)stride_; \
+    for (r = 0; r < size / stride; r++) \
+    { \
+        unsigned char bytes[32]; \
+        lane_select (bytes, 32, size, r * stride, stride); \
+        sel[r] = LOAD256 (bytes); \
+    } \
+    for (i = 0; i + 32 + (stride > size) <= n; i += 32) \
+    { \
+        unsigned int m; \
+        memcpy (&m, mask + i/8, sizeof(m)); \
+        if (m) \
+        { \
+            unsigned int bits = 0; \
+            for (part = 0; part < stride; part++) \
+            { \
+                const unsigned char *cp = cur + (size_t)i * stride + part * 32; \
+                const unsigned char *pp = prev + (size_t)i * stride + part * 32; \
+                __m256i e = _mm256_setzero_si256 (); \
+                for (r = 0; r < ((size > stride) ? size / stride : 1); r++) \
+                { \
+                    const __m256i c = LOAD256 (cp + r * stride); \
+                    const __m256i p = LOAD256 (pp + r * stride); \
+                    (void)c; (void)p; \
+                    e = (size > stride) ? _mm256_or_si256 (e, _mm256_and_si256 (cmp, sel[r])) : (cmp); \
+                } \
+                bits |= avx2_candidate_bits (e, size, stride) << (part * 32 / stride); \
+            } \
+            m &= bits; \
+            memcpy (mask + i/8, &m, sizeof(m)); \
+            matches += POPCOUNT (m); \
+        } \
+    } \
+    return matches + tail (cur + (size_t)i * stride, prev + (size_t)i * stride, mask + i/8, n - i, stride, args); \
+}
+
+#define AVX2_NOT(x) _mm256_xor_si256 (x, _mm256_set1_epi32 (-1))
+#define AVX2_GT_I(bits, a, b) _mm256_cmpgt_epi##bits (a, b)
+#define AVX2_GT_U(bits, a, b) _mm256_cmpgt_epi##bits (_mm256_xor_si256 (a, AVX2_SIGN##bits), _mm256_xor_si256 (b, AVX2_SIGN##bits))
+#define AVX2_SIGN8  _mm256_set1_epi8 (-128)
+#define AVX2_SIGN16 _mm256_set1_epi16 (-32768)
+#define AVX2_SIGN32 _mm256_set1_epi32 (INT_MIN)
+#define AVX2_SIGN64 _mm256_set1_epi64x (LLONG_MIN)
+#define AVX2_F(ps, x) _mm256_castsi256_##ps (x)
+#define AVX2_I(ps, x) _mm256_cast##ps##_si256 (x)
+
+#define AVX2_SIZE_KERNELS(size, bits, s) \
+AVX2_KERNEL (avx2_eq_##size##_s##s,        size, s, sse2_eq_##size##_s##s,        _mm256_cmpeq_epi##bits (c, v)) \
+AVX2_KERNEL (avx2_changed_##size##_s##s,   size, s, sse2_changed_##size##_s##s,   AVX2_NOT (_mm256_cmpeq_epi##bits (c, p))) \
+AVX2_KERNEL (avx2_unchanged_##size##_s##s, size, s, sse2_unchanged_##size##_s##s, _mm256_cmpeq_epi##bits (c, p)) \
+AVX2_KERNEL (avx2_diffeq_##size##_s##s,    size, s, sse2_diffeq_##size##_s##s,    _mm256_cmpeq_epi##bits (_mm256_sub_epi##bits (c, p), v))
+
+#define AVX2_INT_KERNELS(sfx, size, bits, s, GT) \
+AVX2_KERNEL (avx2_inc_##sfx##_s##s,     size, s, sse2_inc_##sfx##_s##s,     GT (bits, c, p)) \
+AVX2_KERNEL (avx2_dec_##sfx##_s##s,     size, s, sse2_dec_##sfx##_s##s,     GT (bits, p, c)) \
+AVX2_KERNEL (avx2_between_##sfx##_s##s, size, s, sse2_between_##sfx##_s##s, AVX2_NOT (_mm256_or_si256 (GT (bits, v, c), GT (bits, c, w))))
+
+#define AVX2_FLOAT_KERNELS(sfx, size, s, ps) \
+AVX2_KERNEL (avx2_inc_##sfx##_s##s,         size, s, sse2_inc_##sfx##_s##s,         AVX2_I (ps, _mm256_cmp_##ps (AVX2_F (ps, c), AVX2_F (ps, p), _CMP_GT_OQ))) \
+AVX2_KERNEL (avx2_dec_##sfx##_s##s,         size, s, sse2_dec_##sfx##_s##s,         AVX2_I (ps, _mm256_cmp_##ps (AVX2_F (ps, c), AVX2_F (ps, p), _CMP_LT_OQ))) \
+AVX2_KERNEL (avx2_between_##sfx##_s##s,     size, s, sse2_between_##sfx##_s##s,     AVX2_I (ps, _mm256_and_##ps (_mm256_cmp_##ps (AVX2_F (ps, c), AVX2_F (ps, v), _CMP_GE_OQ), _mm256_cmp_##ps (AVX2_F (ps, c), AVX2_F (ps, w), _CMP_LE_OQ)))) \
+AVX2_KERNEL (avx2_diffbetween_##sfx##_s##s, size, s, sse2_diffbetween_##sfx##_s##s, AVX2_I (ps, _mm256_and_##ps (_mm256_cmp_##ps (_mm256_sub_##ps (AVX2_F (ps, c), AVX2_F (ps, p)), AVX2_F (ps, v), _CMP_GE_OQ), \
+                                                                                                                 _mm256_cmp_##ps (_mm256_sub_##ps (AVX2_F (ps, c), AVX2_F (ps, p)), AVX2_F (ps, w), _CMP_LE_OQ))))
+
+#define AVX2_STRIDE_KERNELS(s) \
+AVX2_SIZE_KERNELS (1, 8,  s) \
+AVX2_SIZE_KERNELS (2, 16, s) \
+AVX2_SIZE_KERNELS (4, 32, s) \
+AVX2_SIZE_KERNELS (8, 64, s) \
+AVX2_INT_KERNELS (u8,  1, 8,  s, AVX2_GT_U) \
+AVX2_INT_KERNELS (u16, 2, 16, s, AVX2_GT_U) \
+AVX2_INT_KERNELS (u32, 4, 32, s, AVX2_GT_U) \
+AVX2_INT_KERNELS (u64, 8, 64, s, AVX2_GT_U) \
+AVX2_INT_KERNELS (i8,  1, 8,  s, AVX2_GT_I) \
+AVX2_INT_KERNELS (i16, 2, 16, s, AVX2_GT_I) \
+AVX2_INT_KERNELS (i32, 4, 32, s, AVX2_GT_I) \
+AVX2_INT_KERNELS (i64, 8, 64, s, AVX2_GT_I) \
+AVX2_FLOAT_KERNELS (f32, 4, s, ps) \
+AVX2_FLOAT_KERNELS (f64, 8, s, pd)
+
+AVX2_STRIDE_KERNELS (1)
+AVX2_STRIDE_KERNELS (2)
+AVX2_STRIDE_KERNELS (4)
+AVX2_STRIDE_KERNELS (8)
+#endif
+
+enum { ISA_SCALAR, ISA_SSE2, ISA_AVX2, ISA_COUNT };
+
+// One row of scan_kernels, indexed by OP_*; s is the stride suffix of the vector kernels (empty for the scalar ones,
+// which take the stride as an argument)
+#define INT_KERNELS(isa, size, sfx, s) \
+    { scan_any, isa##_eq_##size##s, isa##_inc_##sfx##s, isa##_dec_##sfx##s, isa##_between_##sfx##s, isa##_changed_##size##s, isa##_unchanged_##size##s, isa##_diffeq_##size##s, NULL }
+#define FLOAT_KERNELS(isa, size, sfx, s) \
+    { scan_any, NULL, isa##_inc_##sfx##s, isa##_dec_##sfx##s, isa##_between_##sfx##s, isa##_changed_##size##s, isa##_unchanged_##size##s, NULL, isa##_diffbetween_##sfx##s }
+#define KERNEL_SET(isa, s) \
+    { INT_KERNELS (isa, 1, u8, s), INT_KERNELS (isa, 2, u16, s), INT_KERNELS (isa, 4, u32, s), INT_KERNELS (isa, 8, u64, s), \
+      INT_KERNELS (isa, 1, i8, s), INT_KERNELS (isa, 2, i16, s), INT_KERNELS (isa, 4, i32, s), INT_KERNELS (isa, 8, i64, s), \
+      FLOAT_KERNELS (isa, 4, f32, s), FLOAT_KERNELS (isa, 8, f64, s) }
+
+// Indexed by [isa][STRIDE_*][value type][OP_*]
+static const SCAN_KERNEL scan_kernels[ISA_COUNT][STRIDE_COUNT][TYPE_COUNT][OP_COUNT] =
+{
+    { KERNEL_SET (scalar, ), KERNEL_SET (scalar, ), KERNEL_SET (scalar, ), KERNEL_SET (scalar, ) },
+#ifdef HAVE_X86_SIMD
+    { KERNEL_SET (sse2, _s1), KERNEL_SET (sse2, _s2), KERNEL_SET (sse2, _s4), KERNEL_SET (sse2, _s8) },
+    { KERNEL_SET (avx2, _s1), KERNEL_SET (avx2, _s2), KERNEL_SET (avx2, _s4), KERNEL_SET (avx2, _s8) },
+#endif
+};
+
+/**
+ * Function: detect_isa
+ *
+ * Description: Find out (once) which of the kernel sets above the CPU we are running on supports
+ *
+ * Output:
+ *   ISA_AVX2, ISA_SSE2 or ISA_SCALAR
+ */
+static int detect_isa (void)
+{
+    static int isa = -1;
+
+    if (isa < 0)
+    {
+        isa = ISA_SCALAR;
+#ifdef HAVE_X86_SIMD
+#if defined(_MSC_VER)
+        {
+            int regs[4];
+            __cpuid (regs, 1);
+            if (regs[3] & (1 << 26)) isa = ISA_SSE2;
+            // AVX2 needs the CPU flag and the OS saving the YMM registers (OSXSAVE + XCR0 bits 1 and 2)
+            if ((regs[2] & (1 << 27)) && (_xgetbv (0) & 6) == 6)
+            {
+                __cpuidex (regs, 7, 0);
+                if (regs[1] & (1 << 5)) isa = ISA_AVX2;
+            }
+        }
+#else
+        __builtin_cpu_init ();
+        if (__builtin_cpu_supports ("sse2")) isa = ISA_SSE2;
+        if (__builtin_cpu_supports ("avx2")) isa = ISA_AVX2;
+#endif
+#endif
+    }
+
+    return isa;
+}
+
+/**
+ * Function: select_kernel
+ *
+ * Description: Pick the compare kernel for a value type, stride and test
+ *
+ * Input:
+ *   isa - the kernel set: detect_isa () for the widest instruction set the CPU has, or ISA_SCALAR for kernels that only
+ *         load the candidates still set in the searchmask
+ *   type - the value type of the scan
+ *   stride - the distance between candidates (1, 2, 4 or 8)
+ *   op - the test (OP_*)
+ *
+ * Output:
+ *   The kernel to run over each chunk read from the process
+ */
+static SCAN_KERNEL select_kernel (int isa, VALUE_TYPE type, int stride, int op)
+{
+    int s = (stride == 1) ? STRIDE_1 : (stride == 2) ? STRIDE_2 : (stride == 4) ? STRIDE_4 : STRIDE_8;
+
+    return scan_kernels[isa][s][type][op];
+}
+
+/*
+ * LZ4 block format, just enough of it for dumps and compressed baselines: a greedy compressor with a 64 KB hash table
+ * and a decompressor that checks every length against its buffers, since it reads from files. Process memory is mostly
+ * zero pages, pointers and repeated structures, which this compresses well at a few hundred MB/s.
+ */
+
+#define LZ4_HASH_BITS 14
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5 //a block ends with at least this many literals
+#define LZ4_MATCH_LIMIT 12 //and its last match starts at least this far from the end
+
+/**
+ * Function: lz4_bound
+ * 
+ * Description: The largest compressed size of n bytes
+ */
+size_t lz4_bound (size_t n)
+{
+    return n + n/255 + 16;
+}
+
+static unsigned char* lz4_put_length (unsigned char *op, size_t len)
+{
+    for (; len >= 255; len -= 255) *op++ = 255;
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+static unsigned char* lz4_put_sequence (unsigned char *op, const unsigned char *literals, size_t nlit, size_t offset, size_t match_len)
+{
+    unsigned char *token = op++;
+    size_t ml = match_len ? match_len - LZ4_MIN_MATCH : 0;
+
+    *token = (unsigned char)(((nlit < 15) ? nlit : 15) << 4);
+    if (nlit >= 15) op = lz4_put_length (op, nlit - 15);
+    memcpy (op, literals, nlit);
+    op += nlit;
+
+    // the last sequence has literals only
+    if (match_len)
+    {
+        *token |= (unsigned char)((ml < 15) ? ml : 15);
+        *op++ = (unsigned char)offset;
+        *op++ = (unsigned char)(offset >> 8);
+        if (ml >= 15) op = lz4_put_length (op, ml - 15);
+    }
+
+    return op;
+}
+
+/**
+ * Function: lz4_compress
+ * 
+ * Description: Compresses a buffer into one LZ4 block
+ *
+ * Input:
+ *   *src - the data
+ *   n - its size
+ *   *dst - receives the block; must hold lz4_bound (n) bytes
+ *   *table - scratch space of 1 << LZ4_HASH_BITS entries, zeroed before the first call; what earlier calls left in it
+ *            is only used as a hint, since every match is checked, so it need not be cleared for each buffer
+ *
+ * Output:
+ *   The size of the block
+ */
+size_t lz4_compress (const unsigned char *src, size_t n, unsigned char *dst, unsigned int *table)
+{
+    const unsigned char *ip = src;
+    const unsigned char *anchor = src;
+    const unsigned char *end = src + n;
+    unsigned char *op = dst;
+
+    if (n > LZ4_MATCH_LIMIT + LZ4_MIN_MATCH)
+    {
+        const unsigned char *ip_limit = end - LZ4_MATCH_LIMIT;
+        const unsigned char *match_end = end - LZ4_LAST_LITERALS;
+
+        ip++;
+        while (ip < ip_limit)
+        {
+            unsigned int seq, h;
+            const unsigned char *ref, *mp;
+
+            memcpy (&seq, ip, 4);
+            h = (seq * 2654435761u) >> (32 - LZ4_HASH_BITS);
+            ref = src + table[h];
+            table[h] = (unsigned int)(ip - src);
+            if (ref >= ip || ip - ref > 65535 || memcmp (ref, ip, 4) != 0)
+            {
+                // step faster through data that does not compress
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            while (ip > anchor && ref > src && ip[-1] == ref[-1])
+            {
+                ip--;
+                ref--;
+            }
+            mp = ip + LZ4_MIN_MATCH;
+            ref += LZ4_MIN_MATCH;
+            while (mp + 8 <= match_end)
+            {
+                unsigned long long a, b;
+                memcpy (&a, mp, 8);
+                memcpy (&b, ref, 8);
+                if (a != b) break;
+                mp += 8;
+                ref += 8;
+            }
+            while (mp < match_end && *mp == *ref)
+            {
+                mp++;
+                ref++;
+            }
+
+            op = lz4_put_sequence (op, anchor, ip - anchor, (size_t)(mp - ref), mp - ip);
+            ip = anchor = mp;
+        }
+    }
+
+    op = lz4_put_sequence (op, anchor, end - anchor, 0, 0);
+    return op - dst;
+}
+
+/**
+ * Function: lz4_decompress
+ * 
+ * Description: Decompresses one LZ4 block
+ *
+ * Input:
+ *   *src - the block
+ *   n - its size
+ *   *dst - receives the data
+ *   size - the size of the data
+ *
+ * Output:
+ *   TRUE if the block was valid and decompressed to exactly size bytes
+ */
+BOOL lz4_decompress (const unsigned char *src, size_t n, unsigned char *dst, size_t size)
+{
+    const unsigned char *ip = src;
+    const unsigned char *end = src + n;
+    unsigned char *op = dst;
+    unsigned char *op_end = dst + size;
+
+    while (ip < end)
+    {
+        unsigned int token = *ip++;
+        size_t len = token >> 4;
+        size_t offset;
+        unsigned char b;
+
+        if (len == 15)
+        {
+            do
+            {
+                if (ip >= end) return FALSE;
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        if (len > (size_t)(end - ip) || len > (size_t)(op_end - op)) return FALSE;
+        memcpy (op, ip, len);
+        op += len;
+        ip += len;
+        if (ip == end) break;
+
+        if (end - ip < 2) return FALSE;
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) return FALSE;
+
+        len = token & 15;
+        if (len == 15)
+        {
+            do
+            {
+                if (ip >= end) return FALSE;
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        len += LZ4_MIN_MATCH;
+        if (len > (size_t)(op_end - op)) return FALSE;
+
+        // byte by byte, since a match may overlap what it copies (offset < len repeats a pattern)
+        for (; len; len--, op++) *op = op[-(ptrdiff_t)offset];
+    }
+
+    return op == op_end;
+}
+
+#define SCAN_BUFFER_SIZE (BASELINE_PAGES*PAGE_SIZE) //size of each read_memory call (128 KB), and of a baseline segment
+#define SCAN_CHUNK_SIZE (8*SCAN_BUFFER_SIZE) //regions bigger than this are split into chunks that different threads can scan
+#define MAX_SCAN_THREADS 64
+
+// Something other than the process that an update can read the values from, such as a dump (see Offline scans).
+// Every scanning thread calls open for a state of its own, which read gets; read returns the bytes read like read_memory.
+typedef struct
+{
+    void* (*open)(void *param); //NULL on failure; if open is NULL, every thread reads with param as its state
+    size_t (*read)(void *state, const unsigned char *addr, unsigned char *buf, size_t size);
+    void (*close)(void *state); //may be NULL
+    void *param;
+} SCAN_SOURCE;
+
+// What each scanning thread owns, so that different threads never share a buffer
+typedef struct
+{
+    unsigned char *tempbuf; //SCAN_BUFFER_SIZE + 8 bytes
+    READ_PLAN *plan; //for sparse blocks; its stats also count the reads of dense blocks
+    unsigned char *prevbuf; //SCAN_BUFFER_SIZE + 8 bytes: the previous values of a segment of a compressed block
+    unsigned char *packbuf; //SCAN_BUFFER_SIZE + PAGE_SIZE bytes: a segment being compressed
+    unsigned int *table; //LZ4 hash table of the segments compressed by this thread
+    const SCAN_SOURCE *source; //where the values are read from, or NULL for the process of the block
+    void *state; //this thread's state of source
+} SCAN_CONTEXT;
+
+/**
+ * Function: create_scan_context
+ * 
+ * Description: Allocates the read buffer and read plan of one scanning thread
+ *
+ * Input:
+ *   *ctx - the context to fill in
+ *   gap - the gap of its read plan
+ *
+ * Output:
+ *   TRUE on success, FALSE if out of memory
+ */
+static BOOL create_scan_context (SCAN_CONTEXT *ctx, unsigned int gap)
+{
+    ctx->tempbuf = malloc (SCAN_BUFFER_SIZE + 8); //room for the start of the next values, see scan_range
+    ctx->plan = create_read_plan (NULL, gap);
+    ctx->prevbuf = malloc (SCAN_BUFFER_SIZE + 8);
+    ctx->packbuf = malloc (SCAN_BUFFER_SIZE + PAGE_SIZE);
+    ctx->table = calloc (1 << LZ4_HASH_BITS, sizeof(unsigned int));
+    ctx->source = NULL;
+    ctx->state = NULL;
+
+    return ctx->tempbuf && ctx->plan && ctx->prevbuf && ctx->packbuf && ctx->table;
+}
+
+/**
+ * Function: free_scan_context
+ * 
+ * Description: Frees what create_scan_context allocated and the state of its source, adding its read stats to *stats
+ *
+ * Input:
+ *   *ctx - the context to free
+ *   *stats - the stats to add to
+ */
+static void free_scan_context (SCAN_CONTEXT *ctx, READ_STATS *stats)
+{
+    if (ctx->plan)
+    {
+        stats->syscalls += ctx->plan->stats.syscalls;
+        stats->bytes_read += ctx->plan->stats.bytes_read;
+        stats->bytes_wasted += ctx->plan->stats.bytes_wasted;
+        stats->bytes_skipped += ctx->plan->stats.bytes_skipped;
+        stats->bytes_failed += ctx->plan->stats.bytes_failed;
+    }
+    free (ctx->tempbuf);
+    free (ctx->prevbuf);
+    free (ctx->packbuf);
+    free (ctx->table);
+    free_read_plan (ctx->plan);
+    if (ctx->state && ctx->source->close) ctx->source->close (ctx->state);
+}
+
+/*
+ * Compressed baselines
+ *
+ * A dense memory block keeps the value of every byte as the last scan saw it, so relative scans (increased, changed, ...)
+ * have something to compare with. After an unknown first scan that is a copy of the whole target, and scanning a 16 GB
+ * process took 16 GB more. A compressed scan (made with options->compressed set) keeps these values in segments of
+ * BASELINE_PAGES pages instead, each page compressed with LZ4 on its own. Pages that are all zero, and pages no candidate
+ * can be compared with any more, take no space at all, and pages that do not compress are stored raw. scan_range
+ * decompresses a segment into the prevbuf of its thread, compares, and compresses the values it read in place of the old
+ * ones, so no more than a segment per thread is ever decompressed. The cost is the compression, which the scan threads
+ * share; segments the process did not write to are kept as they are.
+ */
+
+/**
+ * Function: baseline_load
+ * 
+ * Description: Gets previous values of a block of a compressed scan
+ *
+ * Input:
+ *   *mb - the memory block
+ *   offset - offset into the block
+ *   len - number of bytes
+ *   *dst - receives the values
+ */
+void baseline_load (const MEMBLOCK *mb, size_t offset, size_t len, unsigned char *dst)
+{
+    unsigned char page[PAGE_SIZE];
+
+    while (len)
+    {
+        size_t p = offset / PAGE_SIZE;
+        const BASELINE_SEGMENT *seg = &mb->baseline[p / BASELINE_PAGES];
+        unsigned int k = p % BASELINE_PAGES;
+        unsigned int from = k ? seg->end[k-1] : 0;
+        unsigned int stored = seg->end[k] - from;
+        size_t skip = offset % PAGE_SIZE;
+        size_t n = (len < PAGE_SIZE - skip) ? len : PAGE_SIZE - skip;
+
+        if (stored == 0)
+        {
+            memset (dst, 0, n);
+        }
+        else if (stored == PAGE_SIZE)
+        {
+            memcpy (dst, seg->data + from + skip, n);
+        }
+        else if (n == PAGE_SIZE)
+        {
+            lz4_decompress (seg->data + from, stored, dst, PAGE_SIZE);
+        }
+        else
+        {
+            lz4_decompress (seg->data + from, stored, page, PAGE_SIZE);
+            memcpy (dst, page + skip, n);
+        }
+
+        dst += n;
+        offset += n;
+        len -= n;
+    }
+}
+
+/**
+ * Function: any_candidate
+ * 
+ * Description: Tests if any of the candidates first to last - 1 of a dense memory block is still in the search
+ */
+static BOOL any_candidate (const MEMBLOCK *mb, size_t first, size_t last)
+{
+    while (first < last)
+    {
+        if (first % 8 == 0 && last - first >= 8)
+        {
+            if (mb->searchmask[first / 8]) return TRUE;
+            first += 8;
+            continue;
+        }
+        if (IS_IN_SEARCH (mb, first)) return TRUE;
+        first++;
+    }
+
+    return FALSE;
+}
+
+/**
+ * Function: baseline_store
+ * 
+ * Description: Replaces the previous values of a segment of a block of a compressed scan
+ *
+ * Input:
+ *   *mb - the memory block
+ *   start - offset of the segment into the block (a multiple of SCAN_BUFFER_SIZE)
+ *   len - size of the segment
+ *   *values - the new values
+ *   *ctx - the buffers of the calling thread, which owns the segment and its candidates
+ *
+ * Output:
+ *   TRUE on success, FALSE if out of memory, in which case the segment holds zeroes
+ */
+static BOOL baseline_store (MEMBLOCK *mb, size_t start, size_t len, const unsigned char *values, SCAN_CONTEXT *ctx)
+{
+    BASELINE_SEGMENT *seg = &mb->baseline[start / SCAN_BUFFER_SIZE];
+    size_t count = candidate_count (mb->size, mb->data_size, mb->stride);
+    size_t first = start / mb->stride;
+    size_t last = ((start + len) / mb->stride < count) ? (start + len) / mb->stride : count;
+    unsigned int pos = 0;
+    unsigned int k;
+
+    free (seg->data);
+    seg->data = NULL;
+
+    for (k = 0; k < BASELINE_PAGES; k++)
+    {
+        const unsigned char *page = values + (size_t)k * PAGE_SIZE;
+        size_t from = start + (size_t)k * PAGE_SIZE;
+        size_t c0, c1, i;
+        unsigned long long bits = 0;
+
+        seg->end[k] = pos;
+        if (from >= start + len) continue;
+
+        // a page is needed while a candidate of the segment has a byte in it; the first page may also hold the end of a
+        // candidate of the segment before, which another thread owns
+        c0 = (from + 1 > (size_t)mb->data_size) ? (from + 1 - mb->data_size + mb->stride - 1) / mb->stride : 0;
+        c1 = (from + PAGE_SIZE + mb->stride - 1) / mb->stride;
+        if (c0 < first) c0 = first;
+        if (c1 > last) c1 = last;
+        if (!(k == 0 && mb->data_size > mb->stride) && !any_candidate (mb, c0, c1)) continue;
+
+        for (i = 0; i < PAGE_SIZE && bits == 0; i += 8)
+        {
+            unsigned long long w;
+            memcpy (&w, page + i, 8);
+            bits |= w;
+        }
+        if (bits == 0) continue;
+
+        i = lz4_compress (page, PAGE_SIZE, ctx->packbuf + pos, ctx->table);
+        if (i >= PAGE_SIZE)
+        {
+            memcpy (ctx->packbuf + pos, page, PAGE_SIZE);
+            i = PAGE_SIZE;
+        }
+        pos += (unsigned int)i;
+        seg->end[k] = pos;
+    }
+
+    if (pos == 0) return TRUE;
+
+    seg->data = malloc (pos);
+    if (!seg->data)
+    {
+        memset (seg->end, 0, sizeof(seg->end));
+        return FALSE;
+    }
+    memcpy (seg->data, ctx->packbuf, pos);
+
+    return TRUE;
+}
+
+/**
+ * Function: free_baseline
+ * 
+ * Description: Frees the previous values of a block of a compressed scan
+ *
+ * Input:
+ *   *mb - the memory block
+ */
+void free_baseline (MEMBLOCK *mb)
+{
+    size_t i;
+
+    for (i = 0; i < BASELINE_SEGMENTS (mb->size); i++)
+    {
+        free (mb->baseline[i].data);
+    }
+    arena_release (mb->arena, mb->baseline, BASELINE_SEGMENTS (mb->size) * sizeof(BASELINE_SEGMENT));
+    mb->baseline = NULL;
+}
+
+/**
+ * Function: get_baseline_size
+ * 
+ * Description: The memory the previous values of a compressed scan take, segment tables included
+ *
+ * Input:
+ *   *scan - the scan
+ *
+ * Output:
+ *   The size in bytes (0 if the scan is not compressed or every block is sparse)
+ */
+unsigned long long get_baseline_size (SCAN *scan)
+{
+    unsigned long long total = 0;
+    size_t b, i;
+
+    for (b = 0; b < scan->count; b++)
+    {
+        MEMBLOCK *mb = &scan->blocks[b];
+
+        if (!mb->baseline) continue;
+        for (i = 0; i < BASELINE_SEGMENTS (mb->size); i++)
+        {
+            total += sizeof(BASELINE_SEGMENT) + mb->baseline[i].end[BASELINE_PAGES-1];
+        }
+    }
+
+    return total;
+}
+
+/*
+ * Sparse match lists
+ *
+ * After the first narrowing scan most memory blocks keep only a handful of matches, but the full-size buffer and searchmask
+ * would still be kept and reread on every scan. Once a block has fewer than one match per SPARSE_THRESHOLD bytes it is
+ * compacted into a sorted array of (offset, previous value) and the buffer and searchmask are freed. Next scans of a sparse
+ * block only read the pages that hold a candidate, SPARSE_BATCH candidates at a time through a read plan.
+ */
+
+#define SPARSE_THRESHOLD 256
+#define SPARSE_BATCH 4096 //candidates read with one read plan
+
+typedef unsigned int (*SPARSE_KERNEL)(const MATCH *in, unsigned int n, MATCH *out, const READ_REQUEST *reads, const TYPED_VALUE *args);
+
+// Filters a batch of candidates, keeping the ones that were read and still match and storing their new value. out may equal in.
+#define SPARSE_KERNEL_DEF(name, type, field, test) \
+static unsigned int name (const MATCH *in, unsigned int n, MATCH *out, const READ_REQUEST *reads, const TYPED_VALUE *args) \
+{ \
+    type v = args[0].field; \
+    type w = args[1].field; \
+    unsigned int i; \
+    unsigned int kept = 0; \
+    (void)v; (void)w; \
+    for (i = 0; i < n; i++) \
+    { \
+        type c, p; \
+        if (!reads[i].data) continue; \
+        memcpy (&c, reads[i].data, sizeof(type)); \
+        memcpy (&p, &in[i].value, sizeof(type)); \
+        (void)p; \
+        out[kept].offset = in[i].offset; \
+        out[kept].value = 0; \
+        memcpy (&out[kept].value, &c, sizeof(type)); \
+        kept += (test) ? 1 : 0; \
+    } \
+    return kept; \
+}
+
+#define SPARSE_SIZE_KERNELS(size, type, field) \
+SPARSE_KERNEL_DEF (sparse_any_##size,       type, field, 1) \
+SPARSE_KERNEL_DEF (sparse_eq_##size,        type, field, c == v) \
+SPARSE_KERNEL_DEF (sparse_changed_##size,   type, field, c != p) \
+SPARSE_KERNEL_DEF (sparse_unchanged_##size, type, field, c == p) \
+SPARSE_KERNEL_DEF (sparse_diffeq_##size,    type, field, (type)(c - p) == v)
+
+#define SPARSE_ORDER_KERNELS(sfx, type) \
+SPARSE_KERNEL_DEF (sparse_inc_##sfx,     type, sfx, c > p) \
+SPARSE_KERNEL_DEF (sparse_dec_##sfx,     type, sfx, c < p) \
+SPARSE_KERNEL_DEF (sparse_between_##sfx, type, sfx, c >= v && c <= w)
+
+SPARSE_SIZE_KERNELS (1, unsigned char,      u8)
+SPARSE_SIZE_KERNELS (2, unsigned short,     u16)
+SPARSE_SIZE_KERNELS (4, unsigned int,       u32)
+SPARSE_SIZE_KERNELS (8, unsigned long long, u64)
+SPARSE_ORDER_KERNELS (u8,  unsigned char)
+SPARSE_ORDER_KERNELS (u16, unsigned short)
+SPARSE_ORDER_KERNELS (u32, unsigned int)
+SPARSE_ORDER_KERNELS (u64, unsigned long long)
+SPARSE_ORDER_KERNELS (i8,  signed char)
+SPARSE_ORDER_KERNELS (i16, short)
+SPARSE_ORDER_KERNELS (i32, int)
+SPARSE_ORDER_KERNELS (i64, long long)
+SPARSE_ORDER_KERNELS (f32, float)
+SPARSE_ORDER_KERNELS (f64, double)
+SPARSE_KERNEL_DEF (sparse_diffbetween_f32, float,  f32, c - p >= v && c - p <= w)
+SPARSE_KERNEL_DEF (sparse_diffbetween_f64, double, f64, c - p >= v && c - p <= w)
+
+// Indexed by [value type][OP_*], laid out like scan_kernels
+static const SPARSE_KERNEL sparse_kernels[TYPE_COUNT][OP_COUNT] =
+{
+    { sparse_any_1, sparse_eq_1, sparse_inc_u8,  sparse_dec_u8,  sparse_between_u8,  sparse_changed_1, sparse_unchanged_1, sparse_diffeq_1, NULL },
+    { sparse_any_2, sparse_eq_2, sparse_inc_u16, sparse_dec_u16, sparse_between_u16, sparse_changed_2, sparse_unchanged_2, sparse_diffeq_2, NULL },
+    { sparse_any_4, sparse_eq_4, sparse_inc_u32, sparse_dec_u32, sparse_between_u32, sparse_changed_4, sparse_unchanged_4, sparse_diffeq_4, NULL },
+    { sparse_any_8, sparse_eq_8, sparse_inc_u64, sparse_dec_u64, sparse_between_u64, sparse_changed_8, sparse_unchanged_8, sparse_diffeq_8, NULL },
+    { sparse_any_1, sparse_eq_1, sparse_inc_i8,  sparse_dec_i8,  sparse_between_i8,  sparse_changed_1, sparse_unchanged_1, sparse_diffeq_1, NULL },
+    { sparse_any_2, sparse_eq_2, sparse_inc_i16, sparse_dec_i16, sparse_between_i16, sparse_changed_2, sparse_unchanged_2, sparse_diffeq_2, NULL },
+    { sparse_any_4, sparse_eq_4, sparse_inc_i32, sparse_dec_i32, sparse_between_i32, sparse_changed_4, sparse_unchanged_4, sparse_diffeq_4, NULL },
+    { sparse_any_8, sparse_eq_8, sparse_inc_i64, sparse_dec_i64, sparse_between_i64, sparse_changed_8, sparse_unchanged_8, sparse_diffeq_8, NULL },
+    { sparse_any_4, NULL,        sparse_inc_f32, sparse_dec_f32, sparse_between_f32, sparse_changed_4, sparse_unchanged_4, NULL, sparse_diffbetween_f32 },
+    { sparse_any_8, NULL,        sparse_inc_f64, sparse_dec_f64, sparse_between_f64, sparse_changed_8, sparse_unchanged_8, NULL, sparse_diffbetween_f64 },
+};
+
+// A search ready to run: the kernels for the scan's value type and the operands they see as v and w
+typedef struct
+{
+    SCAN_KERNEL kernel; //for blocks with a buffer and searchmask
+    SCAN_KERNEL scalar; //the same test with the scalar kernel, for candidates already thinned out (see Group scans)
+    SPARSE_KERNEL sparse; //for sparse blocks
+    TYPED_VALUE args[2];
+    BOOL uses_prev; //the test compares with the previous values (all but OP_ANY, OP_EQ and OP_BETWEEN)
+} COMPILED_SEARCH;
+
+/**
+ * Function: widen_float
+ * 
+ * Description: Stores the bounds x - epsilon and x + epsilon in a float type
+ *
+ * Input:
+ *   type - TYPE_F32 or TYPE_F64
+ *   x - the value
+ *   epsilon - the tolerance
+ *   *bounds - receives the lower and upper bound
+ */
+static void widen_float (VALUE_TYPE type, double x, double epsilon, TYPED_VALUE *bounds)
+{
+    if (type == TYPE_F32)
+    {
+        bounds[0].f32 = (float)(x - epsilon);
+        bounds[1].f32 = (float)(x + epsilon);
+    }
+    else
+    {
+        bounds[0].f64 = x - epsilon;
+        bounds[1].f64 = x + epsilon;
+    }
+}
+
+/**
+ * Function: compile_search
+ * 
+ * Description: Turns a search into the kernels and operands for a value type, so scanning never switches on the type
+ *              or the condition
+ *
+ * Input:
+ *   type - the value type of the scan
+ *   stride - the distance between candidates
+ *   *search - the condition and its operands
+ *   *out - receives the compiled search
+ */
+void compile_search (VALUE_TYPE type, int stride, const SEARCH_PARAMS *search, COMPILED_SEARCH *out)
+{
+    BOOL is_float = value_types[type].is_float;
+    double a = 0;
+    int op;
+
+    if (is_float)
+    {
+        a = (type == TYPE_F32) ? search->a.f32 : search->a.f64;
+    }
+
+    memset (out->args, 0, sizeof(out->args));
+
+    switch (search->condition)
+    {
+        case COND_EQUALS:
+            // floats are compared within the epsilon
+            if (is_float)
+            {
+                op = OP_BETWEEN;
+                widen_float (type, a, search->epsilon, out->args);
+            }
+            else
+            {
+                op = OP_EQ;
+                out->args[0] = search->a;
+            }
+            break;
+        case COND_INCREASED: op = OP_INC; break;
+        case COND_DECREASED: op = OP_DEC; break;
+        case COND_BETWEEN:
+            op = OP_BETWEEN;
+            out->args[0] = search->a;
+            out->args[1] = search->b;
+            break;
+        case COND_CHANGED: op = OP_CHANGED; break;
+        case COND_UNCHANGED: op = OP_UNCHANGED; break;
+        case COND_INCREASED_BY:
+        case COND_DECREASED_BY:
+            if (is_float)
+            {
+                op = OP_DIFF_BETWEEN;
+                widen_float (type, (search->condition == COND_DECREASED_BY) ? -a : a, search->epsilon, out->args);
+            }
+            else
+            {
+                // decreased by N is increased by -N modulo the type's size
+                op = OP_DIFF_EQ;
+                out->args[0].u64 = (search->condition == COND_DECREASED_BY) ? 0 - search->a.u64 : search->a.u64;
+            }
+            break;
+        default:
+            op = OP_ANY;
+            break;
+    }
+
+    out->kernel = select_kernel (detect_isa (), type, stride, op);
+    out->scalar = select_kernel (ISA_SCALAR, type, stride, op);
+    out->sparse = sparse_kernels[type][op];
+    out->uses_prev = (op != OP_ANY && op != OP_EQ && op != OP_BETWEEN);
+}
+
+/**
+ * Function: compact_memblock
+ * 
+ * Description: Switches a memory block from the buffer and searchmask to a sparse match list if it has few enough matches
+ *
+ * Input:
+ *   *mb - a pointer to the memory block
+ */
+void compact_memblock (MEMBLOCK *mb)
+{
+    MATCH *list;
+    size_t index;
+    size_t count = candidate_count (mb->size, mb->data_size, mb->stride);
+    size_t n = 0;
+    unsigned char *values = NULL; //previous values of a segment of a compressed block
+    size_t segment = (size_t)-1; //the segment in values
+    size_t start = 0; //its offset
+
+    if (mb->matchlist || mb->matches >= mb->size / SPARSE_THRESHOLD)
+    {
+        return;
+    }
+
+    if (mb->baseline)
+    {
+        values = malloc (SCAN_BUFFER_SIZE + 8);
+        if (!values) return;
+    }
+
+    list = arena_alloc (mb->arena, mb->matches * sizeof(MATCH));
+    if (!list)
+    {
+        free (values);
+        return;
+    }
+
+    for (index = 0; index < count; index += 8)
+    {
+        unsigned int m = mb->searchmask[index/8];
+
+        // each set bit is one match; bits past the last candidate can be left over in snapshots of blocks that older
+        // versions cut short at a failed read
+        while (m)
+        {
+            unsigned int bit = CTZ (m);
+            unsigned long long value = 0;
+            size_t offset = (index + bit) * mb->stride;
+
+            m &= m - 1;
+
+            if (index + bit >= count) break;
+            if (values && offset / SCAN_BUFFER_SIZE != segment)
+            {
+                // with the start of the next segment, where the last values of this one end
+                segment = offset / SCAN_BUFFER_SIZE;
+                start = segment * SCAN_BUFFER_SIZE;
+                baseline_load (mb, start, (mb->size - start < SCAN_BUFFER_SIZE + 8) ? mb->size - start : SCAN_BUFFER_SIZE + 8, values);
+            }
+            memcpy (&value, values ? values + (offset - start) : mb->buffer + offset, mb->data_size);
+            list[n].offset = offset;
+            list[n].value = value;
+            n++;
+        }
+    }
+
+    if (mb->baseline) free_baseline (mb);
+    free (values);
+    arena_release (mb->arena, mb->buffer, mb->size);
+    arena_release (mb->arena, mb->searchmask, searchmask_size (mb->size, mb->stride));
+    mb->buffer = NULL;
+    mb->searchmask = NULL;
+    mb->matchlist = list;
+    mb->matches = n;
+}
+
+/**
+ * Function: any_page_written
+ * 
+ * Description: Tests if any page of part of a memory block may have been written to
+ *
+ * Input:
+ *   *written - a bit per page of the block
+ *   start - offset into the block
+ *   len - number of bytes
+ */
+static BOOL any_page_written (const unsigned char *written, size_t start, size_t len)
+{
+    size_t page;
+
+    for (page = start / PAGE_SIZE; page <= (start + len - 1) / PAGE_SIZE; page++)
+    {
+        if (written[page / 8] & (1 << (page % 8))) return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ * Function: read_block
+ * 
+ * Description: Reads part of a memory block from the source of the calling thread, or from the process if it has none
+ *
+ * Input:
+ *   *mb - the memory block
+ *   offset - offset into the block
+ *   *buf - receives the bytes
+ *   size - number of bytes
+ *   *ctx - the calling thread
+ *
+ * Output:
+ *   The number of bytes read, like read_memory
+ */
+static size_t read_block (MEMBLOCK *mb, size_t offset, unsigned char *buf, size_t size, SCAN_CONTEXT *ctx)
+{
+    if (ctx->source) return ctx->source->read (ctx->state, mb->addr + offset, buf, size);
+
+    return read_memory (mb->hProc, mb->addr + offset, buf, size);
+}
+
+/**
+ * Function: read_plan_from_source
+ * 
+ * Description: Does what execute_read_plan does, but reads every request from the source of the calling thread
+ *
+ * Input:
+ *   *plan - the read plan
+ *   *ctx - the calling thread
+ */
+static void read_plan_from_source (READ_PLAN *plan, SCAN_CONTEXT *ctx)
+{
+    size_t total = 0;
+    unsigned int i;
+
+    for (i = 0; i < plan->count; i++) total += plan->requests[i].size;
+    if (total > plan->buffer_size)
+    {
+        free (plan->buffer);
+        plan->buffer = malloc (total);
+        plan->buffer_size = plan->buffer ? total : 0;
+    }
+
+    total = 0;
+    for (i = 0; i < plan->count; i++)
+    {
+        READ_REQUEST *q = &plan->requests[i];
+
+        q->data = NULL;
+        if (!plan->buffer) continue;
+        if (ctx->source->read (ctx->state, q->addr, plan->buffer + total, q->size) == q->size)
+        {
+            q->data = plan->buffer + total;
+            plan->stats.bytes_read += q->size;
+        }
+        total += q->size;
+    }
+}
+
+/**
+ * Function: scan_sparse
+ * 
+ * Description: Updates a sparse memory block by reading only the pages that still hold a candidate
+ *
+ * Input:
+ *   *mb - a pointer to the memory block to be updated
+ *   *search - the compiled search (OP_ANY just refreshes the values of the candidates)
+ *   *ctx - the read plan of the calling thread
+ *   *written - a bit per page of the block, set if the page may have been written to since the last scan; candidates on
+ *              other pages are compared with the value they had then and not read (NULL: read them all)
+ *
+ * Output:
+ *   The number of candidates left in the match list
+ */
+static size_t scan_sparse (MEMBLOCK *mb, const COMPILED_SEARCH *search, SCAN_CONTEXT *ctx, const unsigned char *written)
+{
+    READ_REQUEST *reads = (READ_REQUEST *)ctx->tempbuf; //sparse blocks leave the buffer unused, and a batch fits in it
+    MATCH *list = mb->matchlist;
+    size_t n = mb->matches;
+    size_t kept = 0;
+    size_t i;
+    unsigned int j, r;
+
+    for (i = 0; i < n; i += SPARSE_BATCH)
+    {
+        unsigned int batch = (n - i > SPARSE_BATCH) ? SPARSE_BATCH : (unsigned int)(n - i);
+        reset_read_plan (ctx->plan, mb->hProc);
+        for (j = 0; j < batch; j++)
+        {
+            if (written && !any_page_written (written, list[i+j].offset, mb->data_size)) continue;
+            if (read_plan_add (ctx->plan, mb->addr + list[i+j].offset, mb->data_size) < 0) break;
+        }
+        if (j < batch)
+        {
+            // out of memory: the candidates not compared yet are kept as the last scan found them
+            memmove (list + kept, list + i, (n - i) * sizeof(MATCH));
+            kept += n - i;
+            break;
+        }
+
+        // candidates on pages that can no longer be read are dropped
+        if (ctx->plan->count && ctx->source) read_plan_from_source (ctx->plan, ctx);
+        else if (ctx->plan->count) execute_read_plan (ctx->plan);
+        if (ctx->plan->count == batch)
+        {
+            kept += search->sparse (list + i, batch, list + kept, ctx->plan->requests, search->args);
+            continue;
+        }
+
+        // the values of clean candidates are their previous values; the kernel reads each one before it writes the
+        // candidate it keeps, which is never further on in the list
+        r = 0;
+        for (j = 0; j < batch; j++)
+        {
+            if (any_page_written (written, list[i+j].offset, mb->data_size))
+            {
+                reads[j] = ctx->plan->requests[r++];
+                continue;
+            }
+            reads[j].addr = mb->addr + list[i+j].offset;
+            reads[j].size = mb->data_size;
+            reads[j].data = (unsigned char *)&list[i+j].value;
+        }
+        ctx->plan->stats.bytes_skipped += (unsigned long long)(batch - r) * mb->data_size;
+        kept += search->sparse (list + i, batch, list + kept, reads, search->args);
+    }
+
+    return kept;
+}
+
+/**
+ * Function: read_written_pages
+ * 
+ * Description: Fills a buffer with part of a memory block like read_memory would, but only reads the pages written to
+ *              since the last scan, in one read_memory_runs call; the other pages are copied from the previous values,
+ *              which they still hold
+ *
+ * Input:
+ *   *mb - the memory block
+ *   start - offset into the block, page aligned
+ *   len - number of bytes
+ *   *written - a bit per page of the block, set if it may have been written to
+ *   *prev - the previous values of the bytes
+ *   *buf - where to put the bytes
+ *   *ctx - the buffers of the calling thread; the reads are added to the stats of its plan
+ *
+ * Output:
+ *   TRUE if every page that had to be read could be read
+ */
+static BOOL read_written_pages (MEMBLOCK *mb, size_t start, size_t len, const unsigned char *written, const unsigned char *prev,
+                                unsigned char *buf, SCAN_CONTEXT *ctx)
+{
+    READ_RUN runs[SCAN_BUFFER_SIZE / PAGE_SIZE + 2];
+    unsigned int nruns = 0;
+    unsigned int r;
+    size_t pos = start;
+
+    while (pos < start + len)
+    {
+        size_t page = pos / PAGE_SIZE;
+        size_t next = (page + 1) * PAGE_SIZE;
+
+        if (next > start + len) next = start + len;
+        if (!(written[page / 8] & (1 << (page % 8))))
+        {
+            memcpy (buf + (pos - start), prev + (pos - start), next - pos);
+            ctx->plan->stats.bytes_skipped += next - pos;
+        }
+        else if (nruns && runs[nruns-1].addr + runs[nruns-1].size == mb->addr + pos)
+        {
+            runs[nruns-1].size += next - pos;
+        }
+        else
+        {
+            runs[nruns].addr = mb->addr + pos;
+            runs[nruns].size = next - pos;
+            runs[nruns].dest = buf + (pos - start);
+            nruns++;
+        }
+        pos = next;
+    }
+
+    if (nruns == 0) return TRUE;
+
+    if (ctx->source)
+    {
+        for (r = 0; r < nruns; r++) runs[r].ok = read_block (mb, runs[r].addr - mb->addr, runs[r].dest, runs[r].size, ctx) == runs[r].size;
+    }
+    else ctx->plan->stats.syscalls += read_memory_runs (mb->hProc, runs, nruns);
+    for (r = 0; r < nruns; r++)
+    {
+        if (!runs[r].ok) return FALSE;
+        ctx->plan->stats.bytes_read += runs[r].size;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Function: read_readable_pages
+ * 
+ * Description: Reads part of a memory block that could not be read in one go, as far as it can be read, and takes the
+ *              candidates of the range that touch a page that cannot be read out of the search. In the buffer, such pages
+ *              hold their previous values (zeroes past the range), so the kernels see no change there.
+ *
+ * Input:
+ *   *mb - the memory block
+ *   start - offset into the block
+ *   len - number of bytes of the range, which the calling thread owns
+ *   extra - number of bytes after the range to read as well
+ *   done - number of bytes at the start already read into the buffer
+ *   *prev - the previous values of the range
+ *   *buf - where to put the bytes
+ *   *ctx - the buffers of the calling thread; the reads are added to the stats of its plan
+ */
+static void read_readable_pages (MEMBLOCK *mb, size_t start, size_t len, size_t extra, size_t done, const unsigned char *prev,
+                                 unsigned char *buf, SCAN_CONTEXT *ctx)
+{
+    size_t count = candidate_count (mb->size, mb->data_size, mb->stride);
+    size_t first = (start + mb->stride - 1) / mb->stride; //first candidate of the range
+    size_t pos = start + done;
+
+    while (pos < start + len + extra)
+    {
+        size_t end = start + len + extra;
+        size_t next = (pos / PAGE_SIZE + 1) * PAGE_SIZE;
+        size_t got, k, last;
+
+        // a partial read stops at the first page it cannot read
+        got = read_block (mb, pos, buf + (pos - start), end - pos, ctx);
+        ctx->plan->stats.syscalls++;
+        ctx->plan->stats.bytes_read += got;
+        if (got)
+        {
+            pos += got;
+            continue;
+        }
+
+        if (next > end) next = end;
+        ctx->plan->stats.bytes_failed += next - pos;
+        if (pos < start + len)
+        {
+            size_t own = ((next < start + len) ? next : start + len) - pos;
+            memcpy (buf + (pos - start), prev + (pos - start), own);
+            memset (buf + (pos - start) + own, 0, next - pos - own);
+        }
+        else
+        {
+            memset (buf + (pos - start), 0, next - pos);
+        }
+
+        // the candidates whose value has a byte in [pos, next)
+        k = (pos + 1 > (size_t)mb->data_size) ? (pos + 1 - mb->data_size + mb->stride - 1) / mb->stride : 0;
+        if (k < first) k = first;
+        last = (start + len + mb->stride - 1) / mb->stride;
+        if (last > count) last = count;
+        for (; k < last && k * mb->stride < next; k++)
+        {
+            REMOVE_FROM_SEARCH (mb, k);
+        }
+
+        pos = next;
+    }
+}
+
+/**
+ * Function: scan_range
+ * 
+ * Description: Reads part of a memory block from the process and updates its searchmask and buffer for that part (or its whole match list if it is sparse)
+ *
+ * Input:
+ *   *mb - a pointer to the memory block to be updated
+ *   start - offset into the memory block to start at (a multiple of 8 * stride)
+ *   len - number of bytes to scan
+ *   *search - the compiled search
+ *   *ctx - the buffers of the calling thread
+ *   *seam - the previous values of the bytes right after the range, if another thread may update them at the same time
+ *           (NULL if the range ends at the end of the block or is the only one)
+ *   *written - a bit per page of the block, set if the page may have been written to since the last scan; only those
+ *              pages are read (NULL to read them all)
+ *
+ * Output:
+ *   The number of matches in the range
+ *
+ * Notes:
+ *   With a stride smaller than the value size, the last values of a range run into the next one, so each read takes the
+ *   size - stride bytes after it too. Candidates on pages that cannot be read are dropped and the rest of the range is
+ *   still scanned (see read_readable_pages).
+ */
+static size_t scan_range (MEMBLOCK *mb, size_t start, size_t len, const COMPILED_SEARCH *search, SCAN_CONTEXT *ctx, const unsigned char *seam, const unsigned char *written)
+{
+    unsigned char *tempbuf = ctx->tempbuf;
+    size_t count = candidate_count (mb->size, mb->data_size, mb->stride);
+    size_t overlap = (mb->data_size > mb->stride) ? mb->data_size - mb->stride : 0;
+    size_t bytes_left = len;
+    size_t total_read = start;
+    size_t matches = 0;
+
+    if (mb->matchlist)
+    {
+        return scan_sparse (mb, search, ctx, written);
+    }
+
+    while (bytes_left)
+    {
+        size_t bytes_to_read = (bytes_left > SCAN_BUFFER_SIZE) ? SCAN_BUFFER_SIZE : bytes_left;
+        size_t end = total_read + bytes_to_read;
+        size_t extra = (mb->size - end < overlap) ? mb->size - end : overlap;
+        size_t first = total_read / mb->stride;
+        size_t last = (end / mb->stride < count) ? end / mb->stride : count;
+        unsigned int n = (last > first) ? (unsigned int)(last - first) : 0;
+        unsigned char *prev = mb->baseline ? ctx->prevbuf : mb->buffer + total_read;
+        unsigned char *mask = mb->searchmask + first/8;
+        const unsigned char *cur = tempbuf;
+        size_t found;
+
+        if (mb->baseline && !search->uses_prev && !written)
+        {
+            // nothing looks at the previous values
+            memset (prev, 0, bytes_to_read + extra);
+        }
+        else if (mb->baseline)
+        {
+            // the segment, and the bytes after it that its last values run into
+            baseline_load (mb, total_read, bytes_to_read, prev);
+            if (extra && seam && end == start + len) memcpy (prev + bytes_to_read, seam, extra);
+            else if (extra) baseline_load (mb, end, extra, prev + bytes_to_read);
+        }
+
+        if (written && !any_page_written (written, total_read, bytes_to_read + extra))
+        {
+            // the values are still the ones in the buffer
+            cur = prev;
+            ctx->plan->stats.bytes_skipped += bytes_to_read + extra;
+        }
+        else if (written)
+        {
+            if (!read_written_pages (mb, total_read, bytes_to_read + extra, written, prev, tempbuf, ctx))
+            {
+                read_readable_pages (mb, total_read, bytes_to_read, extra, 0, prev, tempbuf, ctx);
+            }
+        }
+        else
+        {
+            size_t bytes_read = read_block (mb, total_read, tempbuf, bytes_to_read + extra, ctx);
+            ctx->plan->stats.syscalls++;
+            ctx->plan->stats.bytes_read += bytes_read;
+            if (bytes_read != bytes_to_read + extra)
+            {
+                // e.g. a guard page, or memory the process unmapped since the last scan
+                read_readable_pages (mb, total_read, bytes_to_read, extra, bytes_read, prev, tempbuf, ctx);
+            }
+        }
+
+        if (seam && extra && end == start + len && n >= 8 && !mb->baseline)
+        {
+            // the last 8 candidates are compared with a copy of their previous values that ends in the seam
+            unsigned char edge[8*8 + 8];
+
+            memcpy (edge, prev + (size_t)(n - 8) * mb->stride, 8 * mb->stride);
+            memcpy (edge + 8 * mb->stride, seam, extra);
+            found = search->kernel (cur, prev, mask, n - 8, mb->stride, search->args);
+            found += search->kernel (cur + (size_t)(n - 8) * mb->stride, edge, mask + (n - 8)/8, 8, mb->stride, search->args);
+        }
+        else
+        {
+            found = search->kernel (cur, prev, mask, n, mb->stride, search->args);
+        }
+
+        if (mb->baseline)
+        {
+            // a segment nothing wrote to keeps what it holds; one that cannot be stored loses its candidates
+            if (cur != prev && !baseline_store (mb, total_read, bytes_to_read, cur, ctx))
+            {
+                memset (mask, 0, (n + 7) / 8);
+                found = 0;
+            }
+        }
+        else if (cur != prev)
+        {
+            memcpy (prev, tempbuf, bytes_to_read);
+        }
+        matches += found;
+
+        bytes_left -= bytes_to_read;
+        total_read += bytes_to_read;
+    }
+
+    return matches;
+}
+
+/**
+ * Function: update_memblock
+ * 
+ * Description: Updates an individual memory block structure based on a given memory scan/search condition
+ *
+ * Input:
+ *   *mb - a pointer to the memory block to be updated
+ *   *search - the compiled search (see compile_search)
+ *   *stats - the read stats to add the reads to
+ */
+void update_memblock (MEMBLOCK *mb, const COMPILED_SEARCH *search, READ_STATS *stats)
+{
+    SCAN_CONTEXT ctx;
+
+    if (mb->matches > 0)
+    {
+        if (create_scan_context (&ctx, READ_GAP))
+        {
+            mb->matches = scan_range (mb, 0, mb->size, search, &ctx, NULL, NULL);
+            compact_memblock (mb);
+        }
+        free_scan_context (&ctx, stats);
+    }
+}
+
+/*
+ * Parallel scan engine
+ *
+ * update_scan splits every memory block that still has matches into SCAN_CHUNK_SIZE items. Each worker thread starts with
+ * a contiguous share of the items (by bytes, not by count) in its own queue and takes items from the front of it. A worker
+ * whose queue runs dry steals the back half of another worker's queue, so one huge heap region does not leave the other
+ * cores idle. Items never share a searchmask byte, so workers only need a lock around the queues.
+ *
+ * Match counts are kept per item and added up in list order once all workers are done, which gives the same result as
+ * calling update_memblock on every block serially.
+ *
+ * Scan limits: update_scan_limited stops handing out items once a time or byte budget is used up or its progress
+ * callback asks it to, and returns with the items it did not get to put aside in scan->pending. Those still hold the
+ * matches and values of the scan before, so the results are partial but consistent: every match is either tested
+ * against the new condition or left as the last scan found it. Each item saved the previous values after it (its seam)
+ * when the update started, so resume_scan can run the rest later as if it had never stopped. An update with a new
+ * condition drops what is pending instead, and then reads every page, since the pages skipped were never compared.
+ *
+ * Consistent scans: while the workers read a running process, a value can change between two reads of the same scan,
+ * or while it is read, so relative conditions see some values from before and some from after. With the consistent
+ * option of the scan set (see SCAN_OPTIONS), update_scan suspends the process, looks up the written pages, copies
+ * every page the items will read into a staging buffer (STAGE_BATCH bytes per read_memory_runs call) and resumes it;
+ * the workers then compare from the copy while the process runs. The buffer is allocated and touched before the
+ * process is suspended, so the pause is only the copy of the pages (of the written ones, for an incremental scan),
+ * and scan->pause_stats says how long it was. max_pause counts from the signal that stops the process, so the wait
+ * for its threads and the lookup of the written pages are part of it. A process whose threads do not all stop within
+ * it is left running and nothing is copied; once it is used up, the blocks not looked up yet are read whole, nothing
+ * more is copied, the process is resumed right away and the pages not copied are read from it as usual. Only
+ * consistent scans are incremental: the written pages can only be looked up safely with the process stopped, so
+ * updates that do not stop it read every page.
+ */
+
+#define PROGRESS_INTERVAL 100 //milliseconds between calls of the progress callback
+
+typedef struct
+{
+    MEMBLOCK *mb;
+    size_t start; //offset into the memory block
+    size_t len;
+    size_t matches;
+    unsigned char seam[8]; //previous values of the bytes after the item, for values that run into the next item
+    const unsigned char *written; //bit per page of the block, set if it may have been written to (NULL: read it all)
+    BOOL done; //scanned by a worker
+    size_t before; //matches of the item when it was put aside, for items of a pending scan
+} SCAN_ITEM;
+
+typedef struct
+{
+    LOCK lock;
+    unsigned int head; //next item the owner takes
+    unsigned int tail; //one past the last item in this queue
+} SCAN_QUEUE;
+
+// How far an update_scan_limited has got, as its progress callback sees it
+typedef struct
+{
+    unsigned long long bytes_done; //bytes of the items scanned (a sparse block counts the pages it reads)
+    unsigned long long bytes_total;
+    unsigned int items_done;
+    unsigned int items_total;
+    unsigned int blocks; //memory blocks (regions) being scanned
+    double seconds; //since the update started
+    double rate; //bytes per second so far
+    double eta; //seconds left at that rate
+} SCAN_PROGRESS;
+
+// Called every PROGRESS_INTERVAL or so from the thread that called update_scan_limited; FALSE stops the scan
+typedef BOOL (*SCAN_PROGRESS_PROC)(const SCAN_PROGRESS *progress, void *param);
+
+typedef struct
+{
+    double seconds; //no item is started after this long (0: no limit)
+    unsigned long long bytes; //nor after this many bytes were scanned (0: no limit)
+    SCAN_PROGRESS_PROC progress; //NULL for none
+    void *param; //passed to progress
+} SCAN_LIMITS;
+
+// The undone part of an update (see SCAN.pending)
+typedef struct SCAN_PENDING
+{
+    COMPILED_SEARCH search;
+    SCAN_ITEM *items;
+    unsigned int count;
+    unsigned char *written; //the page bits the items point into, or NULL
+    unsigned long long bytes; //bytes of the items, weighed as in SCAN_PROGRESS
+} SCAN_PENDING;
+
+typedef struct
+{
+    SCAN_ITEM *items;
+    SCAN_QUEUE queues[MAX_SCAN_THREADS];
+    int nthreads;
+    COMPILED_SEARCH search;
+    const SCAN_LIMITS *limits; //NULL for none
+    const SCAN_SOURCE *source; //NULL to read the process
+    unsigned int gap; //gap of the read plans of the workers
+    unsigned long long start; //clock_ns () when the workers started
+    unsigned long long last_report; //clock_ns () of the last call of the progress callback
+    BOOL stop; //a limit was reached: no more items are taken
+    LOCK progress_lock; //guards stop and progress
+    SCAN_PROGRESS progress;
+} SCAN_JOB;
+
+typedef struct
+{
+    SCAN_JOB *job;
+    int id;
+    READ_STATS stats; //reads done by this worker
+} SCAN_WORKER;
+
+/**
+ * Function: take_scan_item
+ * 
+ * Description: Gets the next item for a worker, stealing the back half of another worker's queue if its own is empty
+ *
+ * Input:
+ *   *job - the scan being run
+ *   id - the worker asking for an item
+ *   *index - receives the index of the item to scan
+ *
+ * Output:
+ *   TRUE if an item was found, FALSE if every queue is empty
+ */
+static BOOL take_scan_item (SCAN_JOB *job, int id, unsigned int *index)
+{
+    SCAN_QUEUE *own = &job->queues[id];
+    BOOL found = FALSE;
+    int i;
+
+    lock_enter (&own->lock);
+    if (own->head < own->tail)
+    {
+        *index = own->head++;
+        found = TRUE;
+    }
+    lock_leave (&own->lock);
+
+    for (i = 1; i < job->nthreads && !found; i++)
+    {
+        SCAN_QUEUE *victim = &job->queues[(id + i) % job->nthreads];
+        unsigned int first = 0, last = 0;
+
+        lock_enter (&victim->lock);
+        if (victim->head < victim->tail)
+        {
+            last = victim->tail;
+            first = last - (last - victim->head + 1) / 2;
+            victim->tail = first;
+        }
+        lock_leave (&victim->lock);
+
+        if (first < last)
+        {
+            lock_enter (&own->lock);
+            own->head = first + 1;
+            own->tail = last;
+            lock_leave (&own->lock);
+
+            *index = first;
+            found = TRUE;
+        }
+    }
+
+    return found;
+}
+
+/**
+ * Function: scan_stopped
+ * 
+ * Description: Tells a worker whether a limit stopped the scan
+ */
+static BOOL scan_stopped (SCAN_JOB *job)
+{
+    BOOL stop;
+
+    if (!job->limits) return FALSE;
+    lock_enter (&job->progress_lock);
+    stop = job->stop;
+    lock_leave (&job->progress_lock);
+
+    return stop;
+}
+
+/**
+ * Function: report_progress
+ * 
+ * Description: Counts a scanned item, stops the scan if a budget is used up, and calls the progress callback if it
+ *              is time to and this is the calling thread
+ *
+ * Input:
+ *   *job - the scan being run
+ *   *item - the item just scanned
+ *   caller - TRUE on the thread that called update_scan_limited
+ */
+static void report_progress (SCAN_JOB *job, const SCAN_ITEM *item, BOOL caller)
+{
+    const SCAN_LIMITS *limits = job->limits;
+    unsigned long long now;
+    SCAN_PROGRESS progress;
+    BOOL report = FALSE;
+
+    if (!limits) return;
+    now = clock_ns ();
+
+    lock_enter (&job->progress_lock);
+    job->progress.bytes_done += item->len;
+    job->progress.items_done++;
+    if (limits->bytes && job->progress.bytes_done >= limits->bytes) job->stop = TRUE;
+    if (limits->seconds > 0 && now - job->start >= limits->seconds * 1e9) job->stop = TRUE;
+    if (caller && limits->progress && now - job->last_report >= PROGRESS_INTERVAL * 1000000ULL)
+    {
+        job->last_report = now;
+        progress = job->progress;
+        report = TRUE;
+    }
+    lock_leave (&job->progress_lock);
+
+    if (report)
+    {
+        progress.seconds = (now - job->start) / 1e9;
+        progress.rate = progress.seconds > 0 ? progress.bytes_done / progress.seconds : 0;
+        progress.eta = progress.rate > 0 ? (progress.bytes_total - progress.bytes_done) / progress.rate : 0;
+        if (!limits->progress (&progress, limits->param))
+        {
+            lock_enter (&job->progress_lock);
+            job->stop = TRUE;
+            lock_leave (&job->progress_lock);
+        }
+    }
+}
+
+/**
+ * Function: scan_worker
+ * 
+ * Description: Thread function --- Scans items until there are none left to take or steal, or a limit stops the scan
+ *
+ * Input:
+ *   param - a pointer to the SCAN_WORKER for this thread
+ */
+static THREAD_PROC (scan_worker, param)
+{
+    SCAN_WORKER *worker = param;
+    SCAN_JOB *job = worker->job;
+    SCAN_CONTEXT ctx;
+    unsigned int index;
+
+    if (create_scan_context (&ctx, job->gap) && (!job->source || (ctx.state = job->source->open ? job->source->open (job->source->param) :
+                                                                      job->source->param) != NULL))
+    {
+        ctx.source = job->source;
+        while (!scan_stopped (job) && take_scan_item (job, worker->id, &index))
+        {
+            SCAN_ITEM *item = &job->items[index];
+            const unsigned char *seam = (item->start + item->len < item->mb->size) ? item->seam : NULL;
+            item->matches = scan_range (item->mb, item->start, item->len, &job->search, &ctx, seam, item->written);
+            item->done = TRUE;
+            report_progress (job, item, worker->id == 0);
+        }
+    }
+    free_scan_context (&ctx, &worker->stats);
+
+    return THREAD_RETURN;
+}
+
+/**
+ * Function: get_scan_thread_count
+ * 
+ * Description: Number of worker threads to scan with: threads, or one per processor if that is 0 (see SCAN_OPTIONS)
+ */
+static int get_scan_thread_count (int threads)
+{
+    int n = threads;
+
+    if (n <= 0)
+    {
+        n = cpu_count ();
+    }
+
+    return (n < 1) ? 1 : (n > MAX_SCAN_THREADS) ? MAX_SCAN_THREADS : n;
+}
+
+
+/**
+ * Function: free_scan_pending
+ * 
+ * Description: Drops the undone part of a scan, leaving its matches as the scan before found them. The next update
+ *              reads every page, since those of the undone part were never compared.
+ *
+ * Input:
+ *   *scan - the scan
+ */
+void free_scan_pending (SCAN *scan)
+{
+    if (scan->pending)
+    {
+        free (scan->pending->items);
+        free (scan->pending->written);
+        free (scan->pending);
+        scan->pending = NULL;
+        scan->tracking = FALSE;
+    }
+}
+
+/**
+ * Function: free_scan
+ * 
+ * Description: Frees all the scan data and closes the process handle
+ *
+ * Input:
+ *   *scan - the scan
+ */
+void free_scan (SCAN *scan)
+{
+    size_t b;
+
+    close_process (scan->hProc);
+    free_scan_pending (scan);
+    for (b = 0; b < scan->count; b++)
+    {
+        if (scan->blocks[b].baseline) free_baseline (&scan->blocks[b]);
+    }
+    arena_free (&scan->arena);
+
+    if (scan->snapshot)
+    {
+        unmap_file (scan->snapshot);
+        free (scan->snapshot);
+    }
+
+    free (scan);
+}
+
+/**
+ * Function: default_region_filter
+ * 
+ * Description: Sets up a region filter that keeps every readable and writable region, in address order
+ *
+ * Input:
+ *   *filter - the filter
+ */
+void default_region_filter (REGION_FILTER *filter)
+{
+    memset (filter, 0, sizeof(REGION_FILTER));
+    filter->protect = REGION_READ | REGION_WRITE;
+}
+
+/**
+ * Function: default_scan_options
+ * 
+ * Description: Sets up the options scans get when none are given: one thread per processor, incremental updates, plain
+ *              previous values, no suspension
+ *
+ * Input:
+ *   *options - the options
+ */
+void default_scan_options (SCAN_OPTIONS *options)
+{
+    memset (options, 0, sizeof(SCAN_OPTIONS));
+    options->incremental = TRUE;
+    options->gap = READ_GAP;
+}
+
+/**
+ * Function: set_scan_options
+ * 
+ * Description: Gives a new scan its options
+ *
+ * Input:
+ *   *scan - the scan
+ *   *options - the options, or NULL for the defaults (see default_scan_options)
+ */
+static void set_scan_options (SCAN *scan, const SCAN_OPTIONS *options)
+{
+    if (options) scan->options = *options;
+    else default_scan_options (&scan->options);
+    scan->compressed = scan->options.compressed;
+}
+
+/**
+ * Function: find_module
+ * 
+ * Description: Finds the module an address is in
+ *
+ * Output:
+ *   The index of the module, or -1 if the address is not in one
+ */
+static int find_module (const MODULE *modules, int n, unsigned long long addr)
+{
+    int lo = 0, hi = n - 1;
+
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+
+        if (addr < (uintptr_t)modules[mid].base) hi = mid - 1;
+        else if (addr >= (uintptr_t)modules[mid].base + modules[mid].size) lo = mid + 1;
+        else return mid;
+    }
+
+    return -1;
+}
+
+/**
+ * Function: region_passes_filter
+ * 
+ * Description: Tests a region against a region filter
+ *
+ * Input:
+ *   *filter - the filter
+ *   *region - the region
+ *   *modules - the modules of the process in address order, only used if the filter names a module
+ *   nmodules - number of modules
+ */
+static BOOL region_passes_filter (const REGION_FILTER *filter, const REGION *region, const MODULE *modules, int nmodules)
+{
+    int i;
+
+    if ((region->protect & filter->protect) != filter->protect) return FALSE;
+    if (region->protect & filter->protect_not) return FALSE;
+    if (filter->types && !(region->type & filter->types)) return FALSE;
+    if (region->base < filter->from) return FALSE;
+    if (filter->to && region->base + region->size > filter->to) return FALSE;
+    if (region->size < filter->min_size) return FALSE;
+    if (filter->max_size && region->size > filter->max_size) return FALSE;
+
+    if (filter->module[0])
+    {
+        for (i = 0; i < nmodules && modules[i].base <= region->base; i++)
+        {
+            if (region->base < modules[i].base + modules[i].size) return strcmp (modules[i].name, filter->module) == 0;
+        }
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Function: create_scan
+ * 
+ * Description: Get the process handle and map out all virtual pages which we can write to using list_regions, creating a memory block for each of them
+ *
+ * Input:
+ *   pid - the process identifier to be scanned
+ *   type - the type of value to be searched for
+ *   alignment - the distance between candidate addresses: 1, 2, 4 or 8, or 0 for the size of the type. Values are only
+ *               found at addresses that are a multiple of it (counted from the start of their region).
+ *   *filter - the regions to scan, or NULL for every readable and writable region (see default_region_filter)
+ *   *options - the settings of the scan, or NULL for the defaults (see default_scan_options); they are copied
+ *
+ * Output:
+ *   The scan, or NULL if the process could not be opened, has no memory passing the filter or the alignment is not valid
+ */
+SCAN* create_scan (unsigned int pid, VALUE_TYPE type, int alignment, const REGION_FILTER *filter, const SCAN_OPTIONS *options)
+{
+    SCAN *scan;
+    REGION *regions;
+    MODULE *modules = NULL;
+    REGION_FILTER writable;
+    int count, nmodules = 0, i;
+
+    PROC_HANDLE hProc;
+
+    if (alignment != 0 && alignment != 1 && alignment != 2 && alignment != 4 && alignment != 8) return NULL;
+
+    if (!filter)
+    {
+        default_region_filter (&writable);
+        filter = &writable;
+    }
+
+    hProc = open_process (pid);
+    if (!hProc) return NULL;
+
+    scan = calloc (1, sizeof(SCAN));
+    if (!scan)
+    {
+        close_process (hProc);
+        return NULL;
+    }
+    scan->hProc = hProc;
+    scan->type = type;
+    scan->data_size = value_types[type].size;
+    scan->stride = alignment ? alignment : scan->data_size;
+    scan->prioritize = filter->prioritize;
+    set_scan_options (scan, options);
+    arena_init (&scan->arena);
+
+    count = list_regions (hProc, &regions);
+    if (filter->module[0]) nmodules = list_modules (hProc, &modules);
+    scan->blocks = arena_alloc (&scan->arena, (count > 0 ? count : 1) * sizeof(MEMBLOCK));
+    for (i = 0; i < count && scan->blocks; i++)
+    {
+        if (region_passes_filter (filter, &regions[i], modules, nmodules) &&
+            init_memblock (&scan->blocks[scan->count], scan, &regions[i]))
+        {
+            scan->count++;
+        }
+    }
+    free (regions);
+    free (modules);
+
+    if (!scan->count)
+    {
+        free_scan (scan);
+        return NULL;
+    }
+
+    return scan;
+}
+
+/*
+ * Signature search
+ *
+ * Finds arrays of bytes with wildcards, e.g. "48 8B ?? ?? 89" or "4? 8B 0D", in every readable region of a process (code
+ * and read-only data included, unlike create_scan which only keeps writable regions). Candidates are found with a cheap
+ * filter and then compared with the whole pattern:
+ *
+ *   - with AVX2 and several patterns, a shuffle filter in the style of Hyperscan's Teddy tests up to AOB_TABLE_PATTERNS
+ *     of them at once. The patterns are sorted into 8 buckets, and every byte of the input gets a bit per bucket that
+ *     stays set only if the nibbles of the AOB_FINGERPRINT bytes starting there are possible in one of the bucket's
+ *     fingerprints (a window of each pattern without ?? bytes, picked by pick_anchors). Larger sets take one pass per
+ *     table, which is still several times cheaper than a pass per pattern.
+ *   - patterns without such a window, and all patterns without AVX2, are filtered on their own by two anchor bytes, as
+ *     rare as pick_anchors can find, testing 16/32 candidate starts at once with SSE2/AVX2.
+ *
+ * The regions are cut into AOB_CHUNK_SIZE items that the scan threads take from a shared counter. Every item is read once,
+ * together with enough of the next one to see patterns that cross the boundary, and all the patterns are run over it
+ * while it is still in cache, so searching for dozens of signatures costs one pass over memory.
+ */
+
+#define AOB_MAX_LEN 256
+#define AOB_CHUNK_SIZE (256*1024)
+#define AOB_FINGERPRINT 3 //bytes per pattern tested by the shuffle filter
+#define AOB_BUCKETS 8
+#define AOB_PADDING 64 //zeroed bytes after the data read, so the vector loads of the shuffle filter can run past its end
+#define AOB_MULTI_MIN 4 //fewer patterns than this are filtered one by one, which is faster
+#define AOB_TABLE_PATTERNS 16 //more patterns than this per table let too many false positives through
+#define AOB_MAX_PATTERNS 64 //patterns ui_aob_search asks for at most
+#define AOB_PRINT_LIMIT 32 //addresses ui_aob_search prints per pattern
+
+typedef struct
+{
+    unsigned char bytes[AOB_MAX_LEN]; //pattern bytes, with the wildcard bits cleared
+    unsigned char mask[AOB_MAX_LEN]; //bits of each byte that have to match: 0xFF, 0xF0/0x0F for a wildcard nibble, 0x00 for ??
+    size_t len;
+    size_t anchor[2]; //offsets of the two bytes the filter tests (the same offset twice if only one byte is not a wildcard)
+    size_t window; //offset of the AOB_FINGERPRINT bytes the shuffle filter tests
+    unsigned char **results; //addresses where the pattern was found, in address order
+    size_t count;
+    size_t capacity;
+} AOB_PATTERN;
+
+typedef struct
+{
+    unsigned char *addr; //first candidate start of the item
+    size_t len; //number of candidate starts in the item
+    size_t avail; //bytes from addr to the end of the region
+} AOB_ITEM;
+
+typedef struct
+{
+    unsigned char lo[AOB_FINGERPRINT][16]; //bucket bits of the patterns that allow each low nibble at each fingerprint byte
+    unsigned char hi[AOB_FINGERPRINT][16]; //the same for the high nibble
+    const int *order; //indices of the table's patterns, bucket by bucket (points into AOB_JOB.order)
+    int first[AOB_BUCKETS + 1]; //bucket b holds order[first[b]] to order[first[b+1]-1]
+} AOB_TABLE;
+
+typedef struct
+{
+    PROC_HANDLE hProc;
+    AOB_PATTERN *patterns;
+    int count;
+    size_t max_len; //longest pattern
+    int *order; //pattern indices; the first nshuffled are found by the shuffle filter, the rest one by one
+    int nshuffled;
+    AOB_TABLE *tables; //AOB_TABLE_PATTERNS or fewer of the shuffled patterns each
+    int ntables;
+    AOB_ITEM *items;
+    size_t nitems;
+    size_t next; //next item to take
+    unsigned long long bytes_searched;
+    LOCK lock; //guards next, bytes_searched and the results of the patterns
+} AOB_JOB;
+
+typedef struct
+{
+    size_t *offsets;
+    size_t count;
+    size_t capacity;
+} AOB_HITS;
+
+typedef void (*AOB_FILTER)(const unsigned char *buf, size_t from, size_t to, const AOB_PATTERN *p, AOB_HITS *hits);
+
+/**
+ * Function: hex_digit
+ * 
+ * Description: Value of a hexadecimal digit
+ *
+ * Output:
+ *   0 to 15, or -1 if c is not a hexadecimal digit
+ */
+static int hex_digit (char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * Function: anchor_score
+ * 
+ * Description: How well a pattern byte filters candidates; bytes that are everywhere in code and data score lower
+ */
+static int anchor_score (const AOB_PATTERN *p, size_t i)
+{
+    unsigned char b = p->bytes[i];
+
+    if (p->mask[i] == 0) return 0;
+    if (p->mask[i] != 0xFF) return 1;
+    if (b == 0x00 || b == 0xFF || b == 0xCC || b == 0x90 || b == 0x48 || b == 0x8B || b == 0x89) return 2;
+    return 3;
+}
+
+/**
+ * Function: pick_anchors
+ * 
+ * Description: Chooses the two bytes the filter tests: the first best scoring byte, and the last best scoring one of the rest
+ *              (far apart bytes are less likely to be correlated), and the fingerprint window of the shuffle filter
+ *
+ * Input:
+ *   *p - a parsed pattern
+ *
+ * Output:
+ *   FALSE if every byte of the pattern is a wildcard
+ */
+static BOOL pick_anchors (AOB_PATTERN *p)
+{
+    size_t i;
+    int best = 0, second = 0;
+
+    for (i = 0; i < p->len; i++)
+    {
+        if (anchor_score (p, i) > best)
+        {
+            best = anchor_score (p, i);
+            p->anchor[0] = i;
+        }
+    }
+    if (best == 0) return FALSE;
+
+    // the fingerprint is the best scoring window; a wildcard byte lets every input byte through, so it costs a lot
+    best = INT_MIN;
+    for (i = 0; i + AOB_FINGERPRINT <= p->len || i == 0; i++)
+    {
+        int score = 0;
+        size_t k;
+
+        for (k = i; k < i + AOB_FINGERPRINT; k++) score += (k < p->len && anchor_score (p, k) > 0) ? anchor_score (p, k) : -8;
+        if (score > best)
+        {
+            best = score;
+            p->window = i;
+        }
+    }
+
+    p->anchor[1] = p->anchor[0];
+    for (i = 0; i < p->len; i++)
+    {
+        if (i != p->anchor[0] && anchor_score (p, i) > 0 && anchor_score (p, i) >= second)
+        {
+            second = anchor_score (p, i);
+            p->anchor[1] = i;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * Function: parse_aob
+ * 
+ * Description: Parses a byte pattern such as "48 8B ?? ?? 89". Bytes are two hex digits and may be written without spaces;
+ *              a '?' in place of a digit is a wildcard nibble, and "??" or a single '?' between spaces a wildcard byte
+ *
+ * Input:
+ *   *text - the pattern
+ *   *pattern - receives the pattern, with no results
+ *
+ * Output:
+ *   TRUE if the pattern is valid, has at most AOB_MAX_LEN bytes and at least one that is not a wildcard
+ */
+BOOL parse_aob (const char *text, AOB_PATTERN *pattern)
+{
+    const char *s = text;
+
+    memset (pattern, 0, sizeof(AOB_PATTERN));
+
+    while (*s)
+    {
+        int hi, lo;
+
+        if (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n')
+        {
+            s++;
+            continue;
+        }
+
+        if (s[0] == '?' && (s[1] == 0 || s[1] == ' ' || s[1] == '\t' || s[1] == '\r' || s[1] == '\n'))
+        {
+            hi = lo = -1;
+            s += 1;
+        }
+        else
+        {
+            if (s[1] == 0) return FALSE;
+            hi = hex_digit (s[0]);
+            lo = hex_digit (s[1]);
+            if ((hi < 0 && s[0] != '?') || (lo < 0 && s[1] != '?')) return FALSE;
+            s += 2;
+        }
+
+        if (pattern->len == AOB_MAX_LEN) return FALSE;
+        pattern->bytes[pattern->len] = (unsigned char)(((hi < 0) ? 0 : hi << 4) | ((lo < 0) ? 0 : lo));
+        pattern->mask[pattern->len] = (unsigned char)(((hi < 0) ? 0 : 0xF0) | ((lo < 0) ? 0 : 0x0F));
+        pattern->len++;
+    }
+
+    return pick_anchors (pattern);
+}
+
+/**
+ * Function: free_aob_results
+ * 
+ * Description: Frees the results of a pattern, so it can be searched for again
+ */
+void free_aob_results (AOB_PATTERN *pattern)
+{
+    free (pattern->results);
+    pattern->results = NULL;
+    pattern->count = 0;
+    pattern->capacity = 0;
+}
+
+/**
+ * Function: aob_add
+ * 
+ * Description: Appends an offset to a list of hits
+ */
+static void aob_add (AOB_HITS *hits, size_t offset)
+{
+    if (hits->count == hits->capacity)
+    {
+        size_t capacity = hits->capacity ? hits->capacity * 2 : 256;
+        size_t *grown = realloc (hits->offsets, capacity * sizeof(size_t));
+        if (!grown) return;
+        hits->offsets = grown;
+        hits->capacity = capacity;
+    }
+    hits->offsets[hits->count++] = offset;
+}
+
+/**
+ * Function: aob_verify
+ * 
+ * Description: Compares the bytes at a candidate start with the whole pattern
+ */
+static BOOL aob_verify (const unsigned char *buf, const AOB_PATTERN *p)
+{
+    size_t i;
+
+    for (i = 0; i < p->len; i++)
+    {
+        if ((buf[i] & p->mask[i]) != p->bytes[i]) return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Function: aob_filter_scalar
+ * 
+ * Description: Finds the pattern at the candidate starts from..to-1 of buf, which holds at least to + len - 1 bytes
+ *
+ * Input:
+ *   *buf - the bytes read
+ *   from, to - the range of candidate starts
+ *   *p - the pattern
+ *   *hits - receives the offsets where the pattern was found
+ */
+static void aob_filter_scalar (const unsigned char *buf, size_t from, size_t to, const AOB_PATTERN *p, AOB_HITS *hits)
+{
+    const size_t a0 = p->anchor[0], a1 = p->anchor[1];
+    size_t i;
+
+    for (i = from; i < to; i++)
+    {
+        if ((buf[i + a0] & p->mask[a0]) == p->bytes[a0] && (buf[i + a1] & p->mask[a1]) == p->bytes[a1] && aob_verify (buf + i, p))
+        {
+            aob_add (hits, i);
+        }
+    }
+}
+
+#ifdef HAVE_X86_SIMD
+// The loads at i + anchor stay inside buf: anchor < len, so i + anchor + 15 (or 31) < to + len - 1
+static void aob_filter_sse2 (const unsigned char *buf, size_t from, size_t to, const AOB_PATTERN *p, AOB_HITS *hits)
+{
+    const size_t a0 = p->anchor[0], a1 = p->anchor[1];
+    const __m128i m0 = _mm_set1_epi8 ((char)p->mask[a0]), b0 = _mm_set1_epi8 ((char)p->bytes[a0]);
+    const __m128i m1 = _mm_set1_epi8 ((char)p->mask[a1]), b1 = _mm_set1_epi8 ((char)p->bytes[a1]);
+    size_t i;
+
+    for (i = from; i + 16 <= to; i += 16)
+    {
+        const __m128i e0 = _mm_cmpeq_epi8 (_mm_and_si128 (LOAD128 (buf + i + a0), m0), b0);
+        const __m128i e1 = _mm_cmpeq_epi8 (_mm_and_si128 (LOAD128 (buf + i + a1), m1), b1);
+        unsigned int bits = (unsigned int)_mm_movemask_epi8 (_mm_and_si128 (e0, e1));
+
+        while (bits)
+        {
+            size_t at = i + CTZ (bits);
+            bits &= bits - 1;
+            if (aob_verify (buf + at, p)) aob_add (hits, at);
+        }
+    }
+    aob_filter_scalar (buf, i, to, p, hits);
+}
+
+TARGET_AVX2 static void aob_filter_avx2 (const unsigned char *buf, size_t from, size_t to, const AOB_PATTERN *p, AOB_HITS *hits)
+{
+    const size_t a0 = p->anchor[0], a1 = p->anchor[1];
+    const __m256i m0 = _mm256_set1_epi8 ((char)p->mask[a0]), b0 = _mm256_set1_epi8 ((char)p->bytes[a0]);
+    const __m256i m1 = _mm256_set1_epi8 ((char)p->mask[a1]), b1 = _mm256_set1_epi8 ((char)p->bytes[a1]);
+    size_t i;
+
+    for (i = from; i + 32 <= to; i += 32)
+    {
+        const __m256i e0 = _mm256_cmpeq_epi8 (_mm256_and_si256 (LOAD256 (buf + i + a0), m0), b0);
+        const __m256i e1 = _mm256_cmpeq_epi8 (_mm256_and_si256 (LOAD256 (buf + i + a1), m1), b1);
+        unsigned int bits = (unsigned int)_mm256_movemask_epi8 (_mm256_and_si256 (e0, e1));
+
+        while (bits)
+        {
+            size_t at = i + CTZ (bits);
+            bits &= bits - 1;
+            if (aob_verify (buf + at, p)) aob_add (hits, at);
+        }
+    }
+    aob_filter_sse2 (buf, i, to, p, hits);
+}
+
+/**
+ * Function: aob_shuffle_avx2
+ * 
+ * Description: Finds all the patterns of a table in buf at once with the shuffle filter
+ *
+ * Input:
+ *   *buf - the bytes read, followed by at least 64 bytes of padding
+ *   n - the number of bytes read
+ *   *job - the search
+ *   *t - the table of the patterns to find
+ *   *starts - the number of candidate starts of every pattern
+ *   *hits - receives the offsets where each pattern was found
+ */
+TARGET_AVX2 static void aob_shuffle_avx2 (const unsigned char *buf, size_t n, const AOB_JOB *job, const AOB_TABLE *t, const size_t *starts, AOB_HITS *hits)
+{
+    const __m256i nibble = _mm256_set1_epi8 (0x0F);
+    const __m256i zero = _mm256_setzero_si256 ();
+    __m256i lo[AOB_FINGERPRINT], hi[AOB_FINGERPRINT];
+    unsigned char buckets[32];
+    size_t j;
+    int f;
+
+    for (f = 0; f < AOB_FINGERPRINT; f++)
+    {
+        lo[f] = _mm256_broadcastsi128_si256 (LOAD128 (t->lo[f]));
+        hi[f] = _mm256_broadcastsi128_si256 (LOAD128 (t->hi[f]));
+    }
+
+    for (j = 0; j < n; j += 32)
+    {
+        __m256i r = _mm256_set1_epi8 (-1);
+        unsigned int bits;
+
+        for (f = 0; f < AOB_FINGERPRINT; f++)
+        {
+            const __m256i d = LOAD256 (buf + j + f);
+            r = _mm256_and_si256 (r, _mm256_shuffle_epi8 (lo[f], _mm256_and_si256 (d, nibble)));
+            r = _mm256_and_si256 (r, _mm256_shuffle_epi8 (hi[f], _mm256_and_si256 (_mm256_srli_epi16 (d, 4), nibble)));
+        }
+
+        bits = ~(unsigned int)_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (r, zero));
+        if (!bits) continue;
+
+        // every set bit of a byte is a bucket whose patterns may have their fingerprint there
+        _mm256_storeu_si256 ((__m256i*)buckets, r);
+        while (bits)
+        {
+            size_t at = j + CTZ (bits);
+            unsigned int b = buckets[CTZ (bits)];
+
+            bits &= bits - 1;
+            while (b)
+            {
+                int bucket = CTZ (b), i;
+
+                b &= b - 1;
+                for (i = t->first[bucket]; i < t->first[bucket + 1]; i++)
+                {
+                    int k = t->order[i];
+                    const AOB_PATTERN *p = &job->patterns[k];
+
+                    if (at >= p->window && at - p->window < starts[k] && aob_verify (buf + at - p->window, p))
+                    {
+                        aob_add (&hits[k], at - p->window);
+                    }
+                }
+            }
+        }
+    }
+}
+#endif
+
+/**
+ * Function: select_aob_filter
+ * 
+ * Description: The widest filter the CPU supports
+ */
+static AOB_FILTER select_aob_filter (void)
+{
+#ifdef HAVE_X86_SIMD
+    switch (detect_isa ())
+    {
+        case ISA_AVX2: return aob_filter_avx2;
+        case ISA_SSE2: return aob_filter_sse2;
+    }
+#endif
+    return aob_filter_scalar;
+}
+
+// A pattern's place in the fingerprint order: its fingerprint bytes, each with its mask above it, and its index
+typedef struct
+{
+    int key[AOB_FINGERPRINT];
+    int index;
+} AOB_SORT_KEY;
+
+static int compare_fingerprints (const void *a, const void *b)
+{
+    const AOB_SORT_KEY *x = a;
+    const AOB_SORT_KEY *y = b;
+    int f;
+
+    for (f = 0; f < AOB_FINGERPRINT; f++)
+    {
+        if (x->key[f] != y->key[f]) return x->key[f] - y->key[f];
+    }
+
+    // equal fingerprints stay in pattern order
+    return x->index - y->index;
+}
+
+/**
+ * Function: has_fingerprint
+ * 
+ * Description: Whether the shuffle filter can find a pattern, i.e. its fingerprint window has no ?? bytes
+ */
+static BOOL has_fingerprint (const AOB_PATTERN *p)
+{
+    size_t f;
+
+    if (p->window + AOB_FINGERPRINT > p->len) return FALSE;
+    for (f = 0; f < AOB_FINGERPRINT; f++)
+    {
+        if (p->mask[p->window + f] == 0) return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Function: build_aob_tables
+ * 
+ * Description: Decides which patterns the shuffle filter finds and builds its tables. The patterns are sorted by fingerprint
+ *              and cut into tables and buckets in that order, so similar fingerprints share a bucket, which keeps the
+ *              nibbles a bucket allows (and so its false positives) few
+ *
+ * Input:
+ *   *job - the search; receives order, nshuffled, tables and ntables
+ *
+ * Output:
+ *   FALSE if out of memory
+ */
+static BOOL build_aob_tables (AOB_JOB *job)
+{
+    AOB_SORT_KEY *keys;
+    int b, f, i, k, n, t;
+
+    job->order = malloc (job->count * sizeof(int));
+    if (!job->order) return FALSE;
+
+    for (k = 0; k < job->count; k++)
+    {
+        if (has_fingerprint (&job->patterns[k])) job->order[job->nshuffled++] = k;
+    }
+    for (k = 0, i = job->nshuffled; k < job->count; k++)
+    {
+        if (!has_fingerprint (&job->patterns[k])) job->order[i++] = k;
+    }
+
+    if (job->nshuffled < AOB_MULTI_MIN || detect_isa () != ISA_AVX2)
+    {
+        job->nshuffled = 0;
+        return TRUE;
+    }
+
+    job->ntables = (job->nshuffled + AOB_TABLE_PATTERNS - 1) / AOB_TABLE_PATTERNS;
+    job->tables = calloc (job->ntables, sizeof(AOB_TABLE));
+    if (!job->tables) return FALSE;
+
+    // qsort has no context argument, so the keys it compares carry the fingerprints
+    keys = malloc (job->nshuffled * sizeof(AOB_SORT_KEY));
+    if (!keys) return FALSE;
+    for (i = 0; i < job->nshuffled; i++)
+    {
+        const AOB_PATTERN *p = &job->patterns[job->order[i]];
+
+        for (f = 0; f < AOB_FINGERPRINT; f++) keys[i].key[f] = p->bytes[p->window + f] | p->mask[p->window + f] << 8;
+        keys[i].index = job->order[i];
+    }
+    qsort (keys, job->nshuffled, sizeof(AOB_SORT_KEY), compare_fingerprints);
+    for (i = 0; i < job->nshuffled; i++) job->order[i] = keys[i].index;
+    free (keys);
+
+    for (t = 0; t < job->ntables; t++)
+    {
+        AOB_TABLE *table = &job->tables[t];
+        int start = job->nshuffled * t / job->ntables;
+        int count = job->nshuffled * (t + 1) / job->ntables - start;
+
+        table->order = job->order + start;
+        for (b = 0; b <= AOB_BUCKETS; b++) table->first[b] = count * b / AOB_BUCKETS;
+
+        for (b = 0; b < AOB_BUCKETS; b++)
+        {
+            for (i = table->first[b]; i < table->first[b + 1]; i++)
+            {
+                const AOB_PATTERN *p = &job->patterns[table->order[i]];
+
+                for (f = 0; f < AOB_FINGERPRINT; f++)
+                {
+                    unsigned char m = p->mask[p->window + f];
+                    unsigned char v = p->bytes[p->window + f];
+
+                    for (n = 0; n < 16; n++)
+                    {
+                        if ((n & (m & 0x0F)) == (v & 0x0F)) table->lo[f][n] |= 1 << b;
+                        if ((n & (m >> 4)) == (v >> 4)) table->hi[f][n] |= 1 << b;
+                    }
+                }
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * Function: aob_worker
+ * 
+ * Description: Thread function --- Reads items and runs every pattern over them until there are none left
+ *
+ * Input:
+ *   param - a pointer to the AOB_JOB
+ */
+static THREAD_PROC (aob_worker, param)
+{
+    AOB_JOB *job = param;
+    AOB_FILTER filter = select_aob_filter ();
+    AOB_HITS *hits = calloc (job->count, sizeof(AOB_HITS));
+    size_t *starts = malloc (job->count * sizeof(size_t));
+    unsigned char *buf = malloc (AOB_CHUNK_SIZE + job->max_len + AOB_PADDING);
+
+    while (hits && starts && buf)
+    {
+        AOB_ITEM *item;
+        size_t want, got, i;
+        int k;
+
+        lock_enter (&job->lock);
+        item = (job->next < job->nitems) ? &job->items[job->next++] : NULL;
+        lock_leave (&job->lock);
+        if (!item) break;
+
+        // read the item plus the start of the next one, and only search the part that was actually read
+        want = item->len + job->max_len - 1;
+        if (want > item->avail) want = item->avail;
+        got = read_memory (job->hProc, item->addr, buf, want);
+        memset (buf + got, 0, AOB_PADDING);
+
+        for (k = 0; k < job->count; k++)
+        {
+            starts[k] = (got >= job->patterns[k].len) ? got - job->patterns[k].len + 1 : 0;
+            if (starts[k] > item->len) starts[k] = item->len;
+            hits[k].count = 0;
+        }
+
+#ifdef HAVE_X86_SIMD
+        for (k = 0; k < job->ntables; k++)
+        {
+            aob_shuffle_avx2 (buf, got, job, &job->tables[k], starts, hits);
+        }
+#endif
+        for (k = job->nshuffled; k < job->count; k++)
+        {
+            filter (buf, 0, starts[job->order[k]], &job->patterns[job->order[k]], &hits[job->order[k]]);
+        }
+
+        lock_enter (&job->lock);
+        for (k = 0; k < job->count; k++)
+        {
+            AOB_PATTERN *p = &job->patterns[k];
+
+            if (p->count + hits[k].count > p->capacity)
+            {
+                size_t capacity = (p->count + hits[k].count) * 2;
+                unsigned char **grown = realloc (p->results, capacity * sizeof(unsigned char*));
+                if (grown)
+                {
+                    p->results = grown;
+                    p->capacity = capacity;
+                }
+            }
+            for (i = 0; i < hits[k].count && p->count < p->capacity; i++)
+            {
+                p->results[p->count++] = item->addr + hits[k].offsets[i];
+            }
+        }
+        job->bytes_searched += (got < item->len) ? got : item->len;
+        lock_leave (&job->lock);
+    }
+
+    if (hits)
+    {
+        int k;
+        for (k = 0; k < job->count; k++) free (hits[k].offsets);
+    }
+    free (hits);
+    free (starts);
+    free (buf);
+
+    return THREAD_RETURN;
+}
+
+static int compare_addresses (const void *a, const void *b)
+{
+    const unsigned char *x = *(unsigned char* const*)a;
+    const unsigned char *y = *(unsigned char* const*)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Function: aob_search
+ * 
+ * Description: Searches every readable region of a process for a set of byte patterns in one pass, using the scan threads
+ *
+ * Input:
+ *   hProc - the process to search
+ *   *patterns - the patterns from parse_aob; their results are replaced
+ *   count - the number of patterns
+ *   *options - options->threads is the number of threads to search with; NULL for the defaults
+ *
+ * Output:
+ *   The number of bytes searched (regions or parts of regions that could not be read are skipped)
+ */
+unsigned long long aob_search (PROC_HANDLE hProc, AOB_PATTERN *patterns, int count, const SCAN_OPTIONS *options)
+{
+    AOB_JOB job;
+    THREAD threads[MAX_SCAN_THREADS];
+    BOOL started[MAX_SCAN_THREADS];
+    REGION *regions;
+    int nregions, r, k, t, nthreads;
+
+    memset (&job, 0, sizeof(job));
+    job.hProc = hProc;
+    job.patterns = patterns;
+    job.count = count;
+    job.max_len = 1;
+    for (k = 0; k < count; k++)
+    {
+        free_aob_results (&patterns[k]);
+        if (patterns[k].len > job.max_len) job.max_len = patterns[k].len;
+    }
+
+    nregions = list_regions (hProc, &regions);
+    for (r = 0; r < nregions; r++)
+    {
+        if (regions[r].protect & REGION_READ) job.nitems += (regions[r].size + AOB_CHUNK_SIZE - 1) / AOB_CHUNK_SIZE;
+    }
+    job.items = malloc ((job.nitems ? job.nitems : 1) * sizeof(AOB_ITEM));
+    if (!job.items)
+    {
+        free (regions);
+        return 0;
+    }
+
+    job.nitems = 0;
+    for (r = 0; r < nregions; r++)
+    {
+        size_t start;
+
+        if (!(regions[r].protect & REGION_READ)) continue;
+        for (start = 0; start < regions[r].size; start += AOB_CHUNK_SIZE)
+        {
+            AOB_ITEM *item = &job.items[job.nitems++];
+            item->addr = regions[r].base + start;
+            item->avail = regions[r].size - start;
+            item->len = (item->avail > AOB_CHUNK_SIZE) ? AOB_CHUNK_SIZE : item->avail;
+        }
+    }
+    free (regions);
+
+    nthreads = get_scan_thread_count (options ? options->threads : 0);
+    if ((size_t)nthreads > job.nitems) nthreads = job.nitems ? (int)job.nitems : 1;
+
+    // the calling thread is one of the workers
+    if (!build_aob_tables (&job))
+    {
+        free (job.tables);
+        free (job.order);
+        free (job.items);
+        return 0;
+    }
+
+    lock_init (&job.lock);
+    for (t = 1; t < nthreads; t++)
+    {
+        started[t] = thread_start (&threads[t], aob_worker, &job);
+    }
+    aob_worker (&job);
+    for (t = 1; t < nthreads; t++)
+    {
+        if (started[t]) thread_join (threads[t]);
+    }
+    lock_free (&job.lock);
+    free (job.tables);
+    free (job.order);
+
+    // items finish in any order
+    for (k = 0; k < count; k++)
+    {
+        qsort (patterns[k].results, patterns[k].count, sizeof(unsigned char*), compare_addresses);
+    }
+
+    free (job.items);
+
+    return job.bytes_searched;
+}
+
+/*
+ * Scan snapshots
+ *
+ * A scan can be saved to a binary file and loaded again later, e.g. to resume after a crash. The file is
+ *
+ *   SNAPSHOT_HEADER (padded to a page)
+ *   SNAPSHOT_REGION table, one entry per memory block (padded to a page)
+ *   for every block: its buffer and searchmask, or its match list if it is sparse, each starting on a page boundary
+ *
+ * Blocks without matches are left out. load_scan maps the file instead of reading it, so the memory blocks point
+ * straight into the mapping and loading only costs the region table. The mapping is copy on write: scanning a loaded
+ * scan changes its values and searchmasks in memory only, and the file stays as it was saved until save_scan replaces
+ * it, so it can still be resumed from if the scanner crashes.
+ */
+
+#define SNAPSHOT_MAGIC "MSCANSNP"
+#define SNAPSHOT_VERSION 4 //1 had 32-bit match offsets, 2 had 32-bit match values and no value type, 3 had no stride
+
+typedef struct
+{
+    char magic[8]; //SNAPSHOT_MAGIC
+    unsigned int version; //SNAPSHOT_VERSION
+    unsigned int value_type; //VALUE_TYPE
+    unsigned int data_size;
+    unsigned int stride; //alignment of the candidates
+    unsigned int pid; //process the scan was made on
+    unsigned int region_count;
+    unsigned long long table_offset;
+} SNAPSHOT_HEADER;
+
+typedef struct
+{
+    unsigned long long addr;
+    unsigned long long size;
+    unsigned long long matches;
+    unsigned long long buffer_offset; //0 if the block is sparse
+    unsigned long long searchmask_offset; //0 if the block is sparse
+    unsigned long long matchlist_offset; //0 unless the block is sparse
+} SNAPSHOT_REGION;
+
+#define ALIGN_PAGE(x) (((x) + PAGE_SIZE - 1) & ~(unsigned long long)(PAGE_SIZE - 1))
+
+/**
+ * Function: write_padded
+ * 
+ * Description: Writes a blob to a snapshot file followed by zeros up to the next page boundary
+ *
+ * Output:
+ *   TRUE if everything was written
+ */
+static BOOL write_padded (FILE *f, const void *data, unsigned long long size)
+{
+    static const unsigned char zeros[PAGE_SIZE];
+    unsigned long long pad = ALIGN_PAGE (size) - size;
+
+    if (size && fwrite (data, 1, size, f) != size) return FALSE;
+    return pad == 0 || fwrite (zeros, 1, pad, f) == pad;
+}
+
+/**
+ * Function: save_scan
+ * 
+ * Description: Saves a scan to a snapshot file. The file is written under a temporary name and renamed at the end, so a
+ *              crash while saving leaves any older snapshot intact.
+ *
+ * Input:
+ *   *scan - the scan
+ *   *path - the file to save to
+ *
+ * Output:
+ *   TRUE on success
+ */
+BOOL save_scan (SCAN *scan, const char *path)
+{
+    SNAPSHOT_HEADER header;
+    SNAPSHOT_REGION *table;
+    unsigned long long offset;
+    char tmp_path[1024];
+    MEMBLOCK *mb;
+    BOOL ok = TRUE;
+    unsigned int n = 0, i;
+    size_t b;
+    FILE *f;
+    unsigned char *values = NULL; //a segment of a compressed block
+
+    // blocks without matches are never scanned again, so they are left out
+    for (b = 0; b < scan->count; b++)
+    {
+        if (scan->blocks[b].matches > 0) n++;
+    }
+
+    table = calloc (n ? n : 1, sizeof(SNAPSHOT_REGION));
+    if (!table) return FALSE;
+
+    // lay out the blobs after the header and the table
+    offset = ALIGN_PAGE (sizeof(SNAPSHOT_HEADER)) + ALIGN_PAGE ((unsigned long long)n * sizeof(SNAPSHOT_REGION));
+    for (b = 0, i = 0; b < scan->count; b++)
+    {
+        mb = &scan->blocks[b];
+        if (mb->matches == 0) continue;
+        table[i].addr = (uintptr_t)mb->addr;
+        table[i].size = mb->size;
+        table[i].matches = mb->matches;
+        if (mb->matchlist)
+        {
+            table[i].matchlist_offset = offset;
+            offset += ALIGN_PAGE ((unsigned long long)mb->matches * sizeof(MATCH));
+        }
+        else
+        {
+            table[i].buffer_offset = offset;
+            offset += ALIGN_PAGE (mb->size);
+            table[i].searchmask_offset = offset;
+            offset += ALIGN_PAGE (searchmask_size (mb->size, mb->stride));
+        }
+        i++;
+    }
+
+    memset (&header, 0, sizeof(header));
+    memcpy (header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.value_type = scan->type;
+    header.data_size = scan->data_size;
+    header.stride = scan->stride;
+    header.pid = scan->hProc ? process_id (scan->hProc) : 0; //0 for a scan of a dump whose process is gone
+    header.region_count = n;
+    header.table_offset = ALIGN_PAGE (sizeof(SNAPSHOT_HEADER));
+
+    if (scan->compressed)
+    {
+        values = malloc (SCAN_BUFFER_SIZE);
+        if (!values)
+        {
+            free (table);
+            return FALSE;
+        }
+    }
+
+    snprintf (tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    f = fopen (tmp_path, "wb");
+    if (!f)
+    {
+        free (table);
+        free (values);
+        return FALSE;
+    }
+    setvbuf (f, NULL, _IOFBF, 1024*1024);
+
+    ok = write_padded (f, &header, sizeof(header)) && write_padded (f, table, (unsigned long long)n * sizeof(SNAPSHOT_REGION));
+    for (b = 0; b < scan->count && ok; b++)
+    {
+        mb = &scan->blocks[b];
+        if (mb->matches == 0) continue;
+        if (mb->matchlist)
+        {
+            ok = write_padded (f, mb->matchlist, (unsigned long long)mb->matches * sizeof(MATCH));
+        }
+        else if (mb->baseline)
+        {
+            // a compressed block is saved decompressed, a segment at a time (blocks are whole pages, so nothing is padded
+            // before the end)
+            size_t start;
+
+            for (start = 0; start < mb->size && ok; start += SCAN_BUFFER_SIZE)
+            {
+                size_t len = (mb->size - start < SCAN_BUFFER_SIZE) ? mb->size - start : SCAN_BUFFER_SIZE;
+                baseline_load (mb, start, len, values);
+                ok = write_padded (f, values, len);
+            }
+            ok = ok && write_padded (f, mb->searchmask, searchmask_size (mb->size, mb->stride));
+        }
+        else
+        {
+            ok = write_padded (f, mb->buffer, mb->size) && write_padded (f, mb->searchmask, searchmask_size (mb->size, mb->stride));
+        }
+    }
+
+    if (fclose (f) != 0) ok = FALSE;
+    free (table);
+    free (values);
+
+    if (ok)
+    {
+        remove (path);
+        ok = rename (tmp_path, path) == 0;
+    }
+    if (!ok)
+    {
+        remove (tmp_path);
+    }
+
+    return ok;
+}
+
+/**
+ * Function: snapshot_blob_fits
+ * 
+ * Description: Tells if count items of a given size at offset lie inside a mapped snapshot and start on a page boundary
+ */
+static BOOL snapshot_blob_fits (const MAPPED_FILE *map, unsigned long long offset, unsigned long long count, size_t size)
+{
+    return offset > 0 && offset % PAGE_SIZE == 0 && offset <= map->size && (map->size - offset) / size >= count;
+}
+
+/**
+ * Function: load_scan
+ * 
+ * Description: Loads a scan saved with save_scan by mapping the file, and opens the process to continue scanning it
+ *
+ * Input:
+ *   *path - the snapshot file
+ *   pid - the process to continue the scan on (0 = the process the snapshot was made on)
+ *   *options - the settings of the scan, or NULL for the defaults (see default_scan_options). Its previous values stay
+ *              in the file, so options->compressed is not used.
+ *
+ * Output:
+ *   The scan, or NULL on failure
+ */
+SCAN* load_scan (const char *path, unsigned int pid, const SCAN_OPTIONS *options)
+{
+    MAPPED_FILE *map = malloc (sizeof(MAPPED_FILE));
+    SNAPSHOT_HEADER *header;
+    SNAPSHOT_REGION *table;
+    SCAN *scan;
+    PROC_HANDLE hProc;
+    unsigned int i;
+    BOOL ok;
+
+    if (!map || !map_file (path, map, TRUE))
+    {
+        printf ("Failed to open snapshot %s\r\n", path);
+        free (map);
+        return NULL;
+    }
+
+    header = (SNAPSHOT_HEADER*)map->base;
+    ok = map->size >= sizeof(SNAPSHOT_HEADER) && memcmp (header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0 &&
+         header->version == SNAPSHOT_VERSION && header->value_type < TYPE_COUNT && (int)header->data_size == value_types[header->value_type].size &&
+         (header->stride == 1 || header->stride == 2 || header->stride == 4 || header->stride == 8) &&
+         header->table_offset % PAGE_SIZE == 0 && header->table_offset <= map->size &&
+         (map->size - header->table_offset) / sizeof(SNAPSHOT_REGION) >= header->region_count;
+    table = ok ? (SNAPSHOT_REGION*)(map->base + header->table_offset) : NULL;
+
+    // every blob must lie inside the file on a page boundary, and a block cannot have more matches than candidates
+    for (i = 0; ok && i < header->region_count; i++)
+    {
+        const SNAPSHOT_REGION *region = &table[i];
+        unsigned long long candidates = candidate_count (region->size, header->data_size, header->stride);
+
+        ok = region->size > 0 && region->size <= SIZE_MAX && region->matches <= candidates;
+        if (ok && region->matchlist_offset)
+        {
+            ok = region->buffer_offset == 0 && region->searchmask_offset == 0 && snapshot_blob_fits (map, region->matchlist_offset,
+                 region->matches, sizeof(MATCH));
+        }
+        else if (ok)
+        {
+            ok = snapshot_blob_fits (map, region->buffer_offset, region->size, 1) &&
+                 snapshot_blob_fits (map, region->searchmask_offset, searchmask_size (region->size, header->stride), 1);
+        }
+    }
+
+    if (!ok)
+    {
+        printf ("%s is not a snapshot\r\n", path);
+        unmap_file (map);
+        free (map);
+        return NULL;
+    }
+
+    if (header->region_count == 0)
+    {
+        printf ("%s has no matches\r\n", path);
+        unmap_file (map);
+        free (map);
+        return NULL;
+    }
+
+    hProc = open_process (pid ? pid : header->pid);
+    scan = hProc ? calloc (1, sizeof(SCAN)) : NULL;
+    if (!scan)
+    {
+        if (hProc) close_process (hProc);
+        unmap_file (map);
+        free (map);
+        return NULL;
+    }
+    scan->hProc = hProc;
+    scan->type = header->value_type;
+    scan->data_size = header->data_size;
+    scan->stride = header->stride;
+    scan->snapshot = map;
+    set_scan_options (scan, options);
+    scan->compressed = FALSE;
+    arena_init (&scan->arena);
+
+    scan->blocks = arena_alloc (&scan->arena, header->region_count * sizeof(MEMBLOCK));
+    if (!scan->blocks)
+    {
+        free_scan (scan);
+        return NULL;
+    }
+
+    for (i = 0; i < header->region_count; i++)
+    {
+        MEMBLOCK *mb = &scan->blocks[i];
+
+        mb->hProc = hProc;
+        mb->addr = (unsigned char*)(uintptr_t)table[i].addr;
+        mb->size = table[i].size;
+        mb->matches = table[i].matches;
+        mb->data_size = header->data_size;
+        mb->stride = header->stride;
+        mb->arena = &scan->arena;
+        if (table[i].matchlist_offset)
+        {
+            mb->matchlist = (MATCH*)(map->base + table[i].matchlist_offset);
+        }
+        else
+        {
+            mb->buffer = map->base + table[i].buffer_offset;
+            mb->searchmask = map->base + table[i].searchmask_offset;
+        }
+    }
+    scan->count = header->region_count;
+
+    return scan;
+}
+
+
+/**
+ * Function: block_priority
+ * 
+ * Description: The order update_scan takes a block in when the scan is prioritized: private memory (heaps and stacks,
+ *              where most values live) first, then the data of executables and libraries, then mapped files
+ */
+static size_t block_priority (const MEMBLOCK *mb)
+{
+    return (mb->region_type == REGION_MAPPED) ? 2 : (mb->region_type == REGION_IMAGE) ? 1 : 0;
+}
+
+/**
+ * Function: count_bits
+ * 
+ * Description: Counts the matches among candidates first to last - 1 of a dense block
+ */
+static unsigned long long count_bits (const MEMBLOCK *mb, size_t first, size_t last)
+{
+    unsigned long long n = 0;
+    size_t i = first;
+
+    for (; i < last && i % 32; i++) n += IS_IN_SEARCH (mb, i) ? 1 : 0;
+    for (; i + 32 <= last; i += 32)
+    {
+        unsigned int word;
+        memcpy (&word, mb->searchmask + i / 8, sizeof(word));
+        n += POPCOUNT (word);
+    }
+    for (; i < last; i++) n += IS_IN_SEARCH (mb, i) ? 1 : 0;
+
+    return n;
+}
+
+/**
+ * Function: item_matches
+ * 
+ * Description: Counts the matches an item of a scan holds now
+ */
+static size_t item_matches (const SCAN_ITEM *item)
+{
+    const MEMBLOCK *mb = item->mb;
+    size_t count = candidate_count (mb->size, mb->data_size, mb->stride);
+    size_t last = (item->start + item->len + mb->stride - 1) / mb->stride;
+
+    if (mb->matchlist) return mb->matches;
+
+    return (size_t)count_bits (mb, item->start / mb->stride, last < count ? last : count);
+}
+
+/**
+ * Function: run_scan_job
+ * 
+ * Description: Runs the items of an update on the worker threads, adds up their matches and puts the items a limit
+ *              left undone in scan->pending
+ *
+ * Input:
+ *   *scan - the scan
+ *   *job - the job, with its items, search and limits set
+ *   nitems - number of items
+ *   total_bytes - their bytes, weighed as in SCAN_PROGRESS
+ *   *written - the page bits the items point into, or NULL; owned by the scan from now on
+ *   resumed - TRUE if the items are those of scan->pending, which they replace
+ *
+ * Output:
+ *   TRUE if every item was scanned
+ */
+static BOOL run_scan_job (SCAN *scan, SCAN_JOB *job, unsigned int nitems, unsigned long long total_bytes,
+                          unsigned char *written, BOOL resumed)
+{
+    SCAN_WORKER workers[MAX_SCAN_THREADS];
+    THREAD threads[MAX_SCAN_THREADS];
+    BOOL started[MAX_SCAN_THREADS];
+    SCAN_PENDING *pending = NULL;
+    unsigned long long share_bytes = 0;
+    unsigned int i, undone = 0;
+    MEMBLOCK *mb;
+    int t;
+
+    // give every worker a contiguous run of items holding about the same number of bytes
+    job->nthreads = get_scan_thread_count (scan->options.threads);
+    job->gap = scan->options.gap;
+    if ((unsigned int)job->nthreads > nitems) job->nthreads = nitems;
+
+    i = 0;
+    for (t = 0; t < job->nthreads; t++)
+    {
+        unsigned long long target = total_bytes * (t + 1) / job->nthreads;
+
+        lock_init (&job->queues[t].lock);
+        job->queues[t].head = i;
+        while (i < nitems && (share_bytes < target || t == job->nthreads - 1))
+        {
+            share_bytes += job->items[i++].len;
+        }
+        job->queues[t].tail = i;
+    }
+
+    memset (&job->progress, 0, sizeof(job->progress));
+    job->progress.bytes_total = total_bytes;
+    job->progress.items_total = nitems;
+    for (i = 0; i < nitems; i++)
+    {
+        job->items[i].done = FALSE;
+        if (i == 0 || job->items[i].mb != job->items[i-1].mb) job->progress.blocks++;
+    }
+    job->stop = FALSE;
+    job->start = job->last_report = clock_ns ();
+    lock_init (&job->progress_lock);
+
+    // worker 0 runs on this thread
+    for (t = 0; t < job->nthreads; t++)
+    {
+        workers[t].job = job;
+        workers[t].id = t;
+        memset (&workers[t].stats, 0, sizeof(READ_STATS));
+        started[t] = (t == 0) ? FALSE : thread_start (&threads[t], scan_worker, &workers[t]);
+    }
+    scan_worker (&workers[0]);
+    for (t = 1; t < job->nthreads; t++)
+    {
+        if (started[t])
+        {
+            thread_join (threads[t]);
+        }
+    }
+    lock_free (&job->progress_lock);
+
+    // if a thread could not be created, its items were stolen by the others, so every item has been scanned by now
+    // unless a limit stopped the scan
+    for (t = 0; t < job->nthreads; t++)
+    {
+        lock_free (&job->queues[t].lock);
+        scan->read_stats.syscalls += workers[t].stats.syscalls;
+        scan->read_stats.bytes_read += workers[t].stats.bytes_read;
+        scan->read_stats.bytes_wasted += workers[t].stats.bytes_wasted;
+        scan->read_stats.bytes_skipped += workers[t].stats.bytes_skipped;
+        scan->read_stats.bytes_failed += workers[t].stats.bytes_failed;
+    }
+
+    // the final numbers, which the callback may not have seen
+    if (job->limits && job->limits->progress)
+    {
+        job->progress.seconds = (clock_ns () - job->start) / 1e9;
+        job->progress.rate = job->progress.seconds > 0 ? job->progress.bytes_done / job->progress.seconds : 0;
+        job->progress.eta = 0;
+        job->limits->progress (&job->progress, job->limits->param);
+    }
+
+    for (i = 0; i < nitems; i++)
+    {
+        SCAN_ITEM *item = &job->items[i];
+
+        if (item->done) continue;
+        if (!resumed) item->before = item_matches (item);
+        item->matches = item->before;
+        undone++;
+    }
+    if (undone)
+    {
+        pending = calloc (1, sizeof(SCAN_PENDING));
+        if (pending) pending->items = malloc (undone * sizeof(SCAN_ITEM));
+        if (pending && !pending->items)
+        {
+            free (pending);
+            pending = NULL;
+        }
+    }
+
+    // merge the results in list order; a first run counts all the matches of its blocks, a resumed one what changed
+    i = 0;
+    while (i < nitems)
+    {
+        BOOL complete = TRUE;
+
+        mb = job->items[i].mb;
+        if (!resumed) mb->matches = 0;
+        for (; i < nitems && job->items[i].mb == mb; i++)
+        {
+            mb->matches += job->items[i].matches - (resumed ? job->items[i].before : 0);
+            if (!job->items[i].done)
+            {
+                complete = FALSE;
+                if (pending) pending->items[pending->count++] = job->items[i];
+            }
+        }
+        if (complete) compact_memblock (mb);
+    }
+
+    if (resumed)
+    {
+        free (scan->pending->items);
+        free (scan->pending);
+        scan->pending = NULL;
+    }
+    else free_scan_pending (scan);
+
+    if (pending)
+    {
+        pending->search = job->search;
+        pending->written = written;
+        for (i = 0; i < pending->count; i++) pending->bytes += pending->items[i].len;
+        scan->pending = pending;
+    }
+    else
+    {
+        // without memory to keep the undone items, the scan goes on as if they were dropped
+        if (undone) scan->tracking = FALSE;
+        free (written);
+    }
+
+    free (job->items);
+
+    return undone == 0;
+}
+
+/**
+ * Function: pause_over
+ * 
+ * Description: Tells if max_pause (of SCAN_OPTIONS) is used up, or will be within margin nanoseconds, for a process
+ *              suspended at clock_ns () time paused
+ */
+static BOOL pause_over (double max_pause, unsigned long long paused, unsigned long long margin)
+{
+    return max_pause > 0 && clock_ns () + margin - paused >= max_pause * 1e6;
+}
+
+#define STAGE_BATCH (2*1024*1024) //bytes a consistent scan copies per read_memory_runs call, between checks of max_pause
+#define STAGE_RUNS 1024 //runs per read_memory_runs call
+
+// The copies a consistent scan makes while the process is suspended; the SCAN_SOURCE state of the update
+typedef struct
+{
+    SCAN *scan; //its process for the pages that were not copied, its options and its stats
+    READ_RUN *runs; //page aligned runs of at most SCAN_CHUNK_SIZE bytes in address order, with their place in data
+    unsigned int count;
+    unsigned int capacity;
+    unsigned char *data; //room for all the runs, touched before the process is suspended (alloc_pages)
+    size_t size;
+    size_t allocated;
+    unsigned char *copied; //bit per page of data, set once the page is copied
+    READ_RUN batch[STAGE_RUNS]; //pages waiting for the next read_memory_runs call
+    unsigned int nbatch;
+    size_t batch_bytes;
+    unsigned long long paused; //clock_ns () when the process was suspended
+    unsigned long long flush_time; //nanoseconds the last flush_stage took to copy its batch
+    BOOL stopped; //max_pause was reached, so nothing more is copied
+} SCAN_STAGE;
+
+/**
+ * Function: compare_runs
+ * 
+ * Description: qsort callback: orders READ_RUNs by address
+ */
+static int compare_runs (const void *a, const void *b)
+{
+    const READ_RUN *x = a, *y = b;
+
+    return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+/**
+ * Function: find_stage_run
+ * 
+ * Description: Finds the run of a stage that holds an address
+ *
+ * Output:
+ *   The run, or NULL if no run holds it
+ */
+static const READ_RUN* find_stage_run (const SCAN_STAGE *stage, const unsigned char *addr)
+{
+    unsigned int lo = 0, hi = stage->count;
+
+    // the last run starting at or below addr
+    while (lo < hi)
+    {
+        unsigned int mid = lo + (hi - lo) / 2;
+        if (stage->runs[mid].addr <= addr) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo == 0 || addr >= stage->runs[lo-1].addr + stage->runs[lo-1].size) return NULL;
+
+    return &stage->runs[lo-1];
+}
+
+/**
+ * Function: flush_stage
+ * 
+ * Description: Copies the pages waiting in the batch of a stage from the process, and stops the copying once max_pause
+ *              is reached
+ */
+static void flush_stage (SCAN_STAGE *stage)
+{
+    unsigned int r;
+    size_t page;
+
+    if (stage->nbatch)
+    {
+        unsigned long long start = clock_ns ();
+
+        stage->scan->read_stats.syscalls += read_memory_runs (stage->scan->hProc, stage->batch, stage->nbatch);
+        stage->flush_time = clock_ns () - start;
+        for (r = 0; r < stage->nbatch; r++)
+        {
+            if (!stage->batch[r].ok) continue; //read from the process later, where it fails again
+            for (page = (stage->batch[r].dest - stage->data) / PAGE_SIZE; page < (stage->batch[r].dest - stage->data + stage->batch[r].size) / PAGE_SIZE; page++)
+            {
+                stage->copied[page / 8] |= 1 << (page % 8);
+            }
+            stage->scan->pause_stats.bytes_staged += stage->batch[r].size;
+        }
+        stage->nbatch = 0;
+        stage->batch_bytes = 0;
+    }
+
+    // stops before the copy that would go past max_pause, as long as it takes as long as the one before
+    if (pause_over (stage->scan->options.max_pause, stage->paused, stage->flush_time)) stage->stopped = TRUE;
+}
+
+/**
+ * Function: stage_page
+ * 
+ * Description: Adds a page to a stage: to the runs while they are being laid out (data is NULL), and otherwise to the
+ *              pages to copy. Pages already added are skipped.
+ *
+ * Output:
+ *   FALSE if out of memory
+ */
+static BOOL stage_page (SCAN_STAGE *stage, unsigned char *page)
+{
+    READ_RUN *last;
+    const READ_RUN *run;
+    unsigned char *dest;
+    size_t index;
+
+    if (!stage->data)
+    {
+        last = stage->count ? &stage->runs[stage->count - 1] : NULL;
+        if (last && page >= last->addr && page < last->addr + last->size) return TRUE;
+        if (last && page == last->addr + last->size && last->size < SCAN_CHUNK_SIZE)
+        {
+            last->size += PAGE_SIZE;
+            return TRUE;
+        }
+
+        if (stage->count == stage->capacity)
+        {
+            unsigned int capacity = stage->capacity ? stage->capacity * 2 : 1024;
+            READ_RUN *runs = realloc (stage->runs, capacity * sizeof(READ_RUN));
+
+            if (!runs) return FALSE;
+            stage->runs = runs;
+            stage->capacity = capacity;
+        }
+        last = &stage->runs[stage->count++];
+        last->addr = page;
+        last->size = PAGE_SIZE;
+        return TRUE;
+    }
+
+    run = find_stage_run (stage, page);
+    if (!run) return TRUE;
+    dest = run->dest + (page - run->addr);
+    index = (dest - stage->data) / PAGE_SIZE;
+    if (stage->copied[index / 8] & (1 << (index % 8))) return TRUE;
+    if (stage->stopped)
+    {
+        stage->scan->pause_stats.bytes_left += PAGE_SIZE;
+        return TRUE;
+    }
+
+    last = stage->nbatch ? &stage->batch[stage->nbatch - 1] : NULL;
+    if (last && page >= last->addr && page < last->addr + last->size) return TRUE;
+    if (last && page == last->addr + last->size && dest == last->dest + last->size)
+    {
+        last->size += PAGE_SIZE;
+    }
+    else
+    {
+        if (stage->nbatch == STAGE_RUNS) flush_stage (stage);
+        last = &stage->batch[stage->nbatch++];
+        last->addr = page;
+        last->size = PAGE_SIZE;
+        last->dest = dest;
+    }
+    stage->batch_bytes += PAGE_SIZE;
+    if (stage->batch_bytes >= STAGE_BATCH) flush_stage (stage);
+
+    return TRUE;
+}
+
+/**
+ * Function: stage_item
+ * 
+ * Description: Adds the pages an item will read to a stage
+ *
+ * Input:
+ *   *stage - the stage
+ *   *item - the item
+ *   *written - the page bits of its block, to only add the pages written to, or NULL for all of them
+ *
+ * Output:
+ *   FALSE if out of memory
+ */
+static BOOL stage_item (SCAN_STAGE *stage, const SCAN_ITEM *item, const unsigned char *written)
+{
+    const MEMBLOCK *mb = item->mb;
+    BOOL ok = TRUE;
+    size_t k, offset;
+
+    if (mb->matchlist)
+    {
+        // the pages of the candidates, as scan_sparse reads them
+        for (k = 0; k < mb->matches && ok; k++)
+        {
+            size_t first = mb->matchlist[k].offset;
+
+            if (written && !any_page_written (written, first, mb->data_size)) continue;
+            for (offset = first - first % PAGE_SIZE; offset < first + mb->data_size && ok; offset += PAGE_SIZE)
+            {
+                ok = stage_page (stage, mb->addr + offset);
+            }
+        }
+    }
+    else
+    {
+        // the pages of the item, and those the values of its last candidates run into
+        size_t end = item->start + item->len + ((mb->data_size > mb->stride) ? mb->data_size - mb->stride : 0);
+
+        if (end > mb->size) end = mb->size;
+        for (offset = item->start; offset < end && ok; offset += PAGE_SIZE)
+        {
+            if (written && !any_page_written (written, offset, 1)) continue;
+            ok = stage_page (stage, mb->addr + offset);
+        }
+    }
+
+    return ok;
+}
+
+/**
+ * Function: create_stage
+ * 
+ * Description: Lays out the runs of every page the items of an update may read, allocates the staging buffer for them
+ *              and touches it, so that the copies later do not have to wait for the OS to map the pages
+ *
+ * Input:
+ *   *stage - the stage to fill in
+ *   *scan - the scan being updated
+ *   *items - the items
+ *   nitems - number of items
+ *
+ * Output:
+ *   TRUE on success; otherwise the stage is empty and every page is read from the process
+ */
+static BOOL create_stage (SCAN_STAGE *stage, SCAN *scan, const SCAN_ITEM *items, unsigned int nitems)
+{
+    BOOL ok = TRUE;
+    unsigned int i;
+    size_t offset = 0;
+
+    memset (stage, 0, sizeof(SCAN_STAGE));
+    stage->scan = scan;
+
+    for (i = 0; i < nitems && ok; i++) ok = stage_item (stage, &items[i], NULL);
+
+    // prioritized scans take the blocks out of address order
+    if (ok && stage->count) qsort (stage->runs, stage->count, sizeof(READ_RUN), compare_runs);
+    for (i = 0; i < stage->count; i++)
+    {
+        stage->runs[i].dest = NULL;
+        stage->size += stage->runs[i].size;
+    }
+
+    stage->allocated = (stage->size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    stage->data = (ok && stage->size) ? alloc_pages (stage->allocated, TRUE) : NULL;
+    stage->copied = stage->data ? calloc ((stage->size / PAGE_SIZE + 7) / 8, 1) : NULL;
+    if (!stage->copied)
+    {
+        if (stage->data) free_pages (stage->data, stage->allocated);
+        free (stage->runs);
+        scan->pause_stats.bytes_left = stage->size;
+        memset (stage, 0, sizeof(SCAN_STAGE));
+        stage->scan = scan;
+        return FALSE;
+    }
+
+    memset (stage->data, 0, stage->size);
+    for (i = 0; i < stage->count; i++)
+    {
+        stage->runs[i].dest = stage->data + offset;
+        offset += stage->runs[i].size;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Function: free_stage
+ * 
+ * Description: Frees what create_stage allocated
+ */
+static void free_stage (SCAN_STAGE *stage)
+{
+    if (stage->data) free_pages (stage->data, stage->allocated);
+    free (stage->copied);
+    free (stage->runs);
+}
+
+/**
+ * Function: read_stage
+ * 
+ * Description: SCAN_SOURCE read of a stage: the pages copied while the process was suspended, and from the process the
+ *              ones that were not
+ */
+static size_t read_stage (void *state, const unsigned char *addr, unsigned char *buf, size_t size)
+{
+    const SCAN_STAGE *stage = state;
+    size_t done = 0;
+
+    while (done < size)
+    {
+        const unsigned char *at = addr + done;
+        const READ_RUN *run = find_stage_run (stage, at);
+        const unsigned char *src;
+        size_t index, n;
+
+        if (!run) return done + read_memory (stage->scan->hProc, at, buf + done, size - done);
+        src = run->dest + (at - run->addr);
+        index = (src - stage->data) / PAGE_SIZE;
+        if (!(stage->copied[index / 8] & (1 << (index % 8))))
+        {
+            return done + read_memory (stage->scan->hProc, at, buf + done, size - done);
+        }
+
+        // up to the end of the page
+        n = PAGE_SIZE - (size_t)((uintptr_t)at % PAGE_SIZE);
+        if (n > size - done) n = size - done;
+        memcpy (buf + done, src, n);
+        done += n;
+    }
+
+    return done;
+}
+
+/**
+ * Function: start_update
+ * 
+ * Description: Splits the blocks of a scan that still have matches into items and runs them (see update_scan_limited
+ *              and update_scan_source)
+ *
+ * Input:
+ *   *scan - the scan
+ *   *search - the condition and its operands, in the scan's value type
+ *   *limits - the budgets and the progress callback, or NULL for none
+ *   *source - where to read the values from, or NULL for the process
+ *
+ * Output:
+ *   TRUE if the whole scan was updated
+ */
+static BOOL start_update (SCAN *scan, const SEARCH_PARAMS *search, const SCAN_LIMITS *limits, const SCAN_SOURCE *source)
+{
+    SCAN_JOB job;
+    SCAN_STAGE stage;
+    SCAN_SOURCE staged;
+    BOOL consistent = !source && scan->options.consistent;
+    BOOL incremental = consistent && scan->options.incremental; //the written pages can only be looked up suspended
+    BOOL suspended = FALSE, staging, done;
+    unsigned long long paused = 0;
+    unsigned int nitems = 0, i, j;
+    unsigned long long total_bytes = 0;
+    unsigned char *written = NULL; //bit per page of the blocks, if writes have been tracked since the last scan
+    size_t written_size = 0;
+    MEMBLOCK *mb;
+    size_t b;
+
+    memset (&scan->read_stats, 0, sizeof(READ_STATS));
+    memset (&scan->pause_stats, 0, sizeof(PAUSE_STATS));
+    free_scan_pending (scan);
+    compile_search (scan->type, scan->stride, search, &job.search);
+    job.limits = limits;
+    job.source = source;
+
+    // split the blocks that still have matches into items
+    for (b = 0; b < scan->count; b++)
+    {
+        mb = &scan->blocks[b];
+        if (mb->matches > 0) nitems += mb->matchlist ? 1 : (unsigned int)((mb->size + SCAN_CHUNK_SIZE - 1) / SCAN_CHUNK_SIZE);
+    }
+    if (nitems == 0) return TRUE;
+
+    job.items = malloc (nitems * sizeof(SCAN_ITEM));
+    if (!job.items && source) return FALSE;
+    if (!job.items)
+    {
+        scan->tracking = FALSE;
+        for (b = 0; b < scan->count; b++) update_memblock (&scan->blocks[b], &job.search, &scan->read_stats);
+        return TRUE;
+    }
+
+    // the values a source gives were never tracked, and the process may have written anything since
+    if (incremental && scan->tracking)
+    {
+        for (b = 0; b < scan->count; b++)
+        {
+            mb = &scan->blocks[b];
+            if (mb->matches > 0) written_size += ((mb->size + PAGE_SIZE - 1) / PAGE_SIZE + 7) / 8;
+        }
+        written = malloc (written_size ? written_size : 1);
+        written_size = 0;
+    }
+
+    // with prioritize, the items of private blocks come first, so the first worker starts on the heaps
+    nitems = 0;
+    for (b = 0; b < scan->count * (scan->prioritize ? 3 : 1); b++)
+    {
+        const unsigned char *block_written = NULL;
+        size_t start;
+
+        mb = &scan->blocks[b % scan->count];
+        if (mb->matches == 0) continue;
+        if (scan->prioritize && block_priority (mb) != b / scan->count) continue;
+        if (written)
+        {
+            block_written = written + written_size;
+            written_size += ((mb->size + PAGE_SIZE - 1) / PAGE_SIZE + 7) / 8;
+        }
+        for (start = 0; start < mb->size; start += SCAN_CHUNK_SIZE)
+        {
+            SCAN_ITEM *item = &job.items[nitems++];
+            item->mb = mb;
+            item->start = start;
+            item->len = (mb->size - start > SCAN_CHUNK_SIZE) ? SCAN_CHUNK_SIZE : mb->size - start;
+            item->matches = 0;
+            item->written = block_written;
+            if (!mb->matchlist && start + item->len < mb->size)
+            {
+                // saved before any thread overwrites them
+                size_t seam = mb->size - (start + item->len);
+                if (seam > sizeof(item->seam)) seam = sizeof(item->seam);
+                if (mb->baseline) baseline_load (mb, start + item->len, seam, item->seam);
+                else memcpy (item->seam, mb->buffer + start + item->len, seam);
+            }
+            if (mb->matchlist)
+            {
+                // a sparse block is a single item, weighed by the pages it will read rather than by its size
+                item->len = (mb->matches < mb->size / PAGE_SIZE) ? mb->matches * PAGE_SIZE : mb->size;
+                total_bytes += item->len;
+                break;
+            }
+            total_bytes += item->len;
+        }
+    }
+
+    // the written pages are looked up and tracking starts again with the process suspended: a write that fell between
+    // the two would be cleared without ever being seen. The pages are then copied before resuming it.
+    staging = consistent && create_stage (&stage, scan, job.items, nitems);
+    if (consistent)
+    {
+        paused = clock_ns ();
+        suspended = suspend_process (scan->hProc, scan->options.max_pause > 0 ?
+                                     paused + (unsigned long long)(scan->options.max_pause * 1e6) : 0);
+    }
+
+    // the blocks not looked up before max_pause are read whole
+    for (i = 0; i < nitems; i++)
+    {
+        SCAN_ITEM *item = &job.items[i];
+
+        if (item->start != 0 || !item->written) continue;
+        if (!suspended || pause_over (scan->options.max_pause, paused, 0) || !get_written_pages (scan->hProc, item->mb->addr, item->mb->size, written + (item->written - written)))
+        {
+            for (j = i; j < nitems && job.items[j].mb == item->mb; j++) job.items[j].written = NULL;
+        }
+    }
+
+    // from here on, writes show up at the next scan
+    scan->tracking = incremental && suspended && track_writes (scan->hProc);
+
+    if (consistent)
+    {
+        stage.paused = paused;
+        stage.stopped = !suspended || pause_over (scan->options.max_pause, paused, 0);
+        for (i = 0; i < nitems && staging && !stage.stopped; i++)
+        {
+            staging = stage_item (&stage, &job.items[i], job.items[i].written);
+        }
+        if (staging) flush_stage (&stage);
+    }
+    // timed before resuming: the process it wakes can take the processor first
+    if (consistent)
+    {
+        scan->pause_stats.suspended = suspended;
+        scan->pause_stats.pause = (clock_ns () - paused) / 1e6;
+    }
+    if (suspended) resume_process (scan->hProc);
+
+    if (consistent)
+    {
+        // the pages max_pause left out are only counted, with the process running again
+        for (; i < nitems && staging; i++) staging = stage_item (&stage, &job.items[i], job.items[i].written);
+
+        staged.open = NULL;
+        staged.read = read_stage;
+        staged.close = NULL;
+        staged.param = &stage;
+        job.source = &staged;
+    }
+
+    done = run_scan_job (scan, &job, nitems, total_bytes, written, FALSE);
+    if (consistent) free_stage (&stage);
+
+    return done;
+}
+
+/**
+ * Function: update_scan_limited
+ * 
+ * Description: Updates all the scan data based on a given memory scan/search condition, using a pool of worker threads,
+ *              within limits (see Scan limits)
+ *
+ * Input:
+ *   *scan - the scan
+ *   *search - the condition and its operands, in the scan's value type
+ *   *limits - the budgets and the progress callback, or NULL for none
+ *
+ * Output:
+ *   TRUE if the whole scan was updated, FALSE if a limit stopped it and the rest is in scan->pending, or the scan has
+ *   no process (see create_dump_scan)
+ *
+ * Notes:
+ *   Only the updates of a consistent scan use the pages the process wrote to (see track_writes). Looking them up and
+ *   starting to track again are two steps, and a write between them would be cleared without being seen, so they are
+ *   done while the process is suspended, which only a consistent scan does. Such an update reads only the written
+ *   pages again and compares the others with the values kept from the last scan, so a big heap that is mostly left
+ *   alone costs a fraction of the I/O. Every other update, or one that could not suspend the process, reads every
+ *   page and never stops the process.
+ */
+BOOL update_scan_limited (SCAN *scan, const SEARCH_PARAMS *search, const SCAN_LIMITS *limits)
+{
+    if (!scan->hProc) return FALSE;
+
+    return start_update (scan, search, limits, NULL);
+}
+
+/**
+ * Function: update_scan_source
+ * 
+ * Description: Updates a scan like update_scan, but reads the values from a source instead of the process, e.g. a dump
+ *              (see Offline scans). Relative conditions compare them with the values the last update found, wherever
+ *              those came from.
+ *
+ * Input:
+ *   *scan - the scan
+ *   *search - the condition and its operands, in the scan's value type
+ *   *source - where to read the values from
+ *
+ * Output:
+ *   TRUE on success, FALSE if out of memory
+ */
+BOOL update_scan_source (SCAN *scan, const SEARCH_PARAMS *search, const SCAN_SOURCE *source)
+{
+    BOOL ok = start_update (scan, search, NULL, source);
+
+    // only a thread that could not start leaves items undone here, and those must not be resumed on the process
+    if (scan->pending)
+    {
+        free_scan_pending (scan);
+        ok = FALSE;
+    }
+
+    return ok;
+}
+
+/**
+ * Function: update_scan
+ * 
+ * Description: Updates all the scan data based on a given memory scan/search condition, using a pool of worker threads
+ *              (see update_scan_limited)
+ *
+ * Input:
+ *   *scan - the scan
+ *   *search - the condition and its operands, in the scan's value type
+ */
+void update_scan (SCAN *scan, const SEARCH_PARAMS *search)
+{
+    update_scan_limited (scan, search, NULL);
+}
+
+/**
+ * Function: resume_scan
+ * 
+ * Description: Scans the part of an update that a limit left undone, within new limits
+ *
+ * Input:
+ *   *scan - the scan
+ *   *limits - the budgets and the progress callback, or NULL for none
+ *
+ * Output:
+ *   TRUE if nothing is left undone, FALSE if a limit stopped it again and the rest is still in scan->pending
+ */
+BOOL resume_scan (SCAN *scan, const SCAN_LIMITS *limits)
+{
+    SCAN_JOB job;
+    SCAN_PENDING *pending = scan->pending;
+
+    memset (&scan->read_stats, 0, sizeof(READ_STATS));
+    if (!pending) return TRUE;
+
+    job.search = pending->search;
+    job.limits = limits;
+    job.source = NULL;
+    job.items = pending->items;
+    pending->items = NULL;
+
+    return run_scan_job (scan, &job, pending->count, pending->bytes, pending->written, TRUE);
+}
+
+/**
+ * Function: get_pending_bytes
+ * 
+ * Description: The bytes left to scan by resume_scan, weighed as in SCAN_PROGRESS (0 if nothing is pending)
+ */
+unsigned long long get_pending_bytes (const SCAN *scan)
+{
+    return scan->pending ? scan->pending->bytes : 0;
+}
+
+/*
+ * Memory dumps
+ *
+ * dump_process copies every readable region of a process to a file, DUMP_BLOCK_SIZE bytes at a time. The main thread
+ * reads blocks into a ring of DUMP_SLOTS buffers and a writer thread compresses (optionally) and writes them in order,
+ * so reading, compressing and writing overlap and memory use does not grow with the size of the process. The file is
+ *
+ *   DUMP_HEADER (padded to a page)
+ *   the blocks in address order: raw blocks are padded to a page, compressed ones (LZ4 block format) are packed
+ *   DUMP_REGION table, one entry per region
+ *   DUMP_BLOCK table, one entry per block
+ *
+ * The tables go at the end because the size of a compressed block is only known once it is written; the header is
+ * written again last with their offset. open_dump maps the file and read_dump only decompresses the blocks it needs,
+ * so viewing a part of a dump of any size is immediate.
+ */
+
+#define DUMP_MAGIC "MSCANDMP"
+#define DUMP_VERSION 1
+#define DUMP_BLOCK_SIZE (1024*1024)
+#define DUMP_SLOTS 4 //blocks in flight between the reader and the writer
+#define DUMP_VIEW_LINES 16 //lines of 16 bytes ui_view_dump shows at a time
+
+#define DUMP_COMPRESSED 1 //DUMP_HEADER flags: blocks may be compressed
+
+#define DUMP_BLOCK_LZ4 1 //DUMP_BLOCK flags: the block is compressed
+#define DUMP_BLOCK_UNREADABLE 2 //the block could not be read from the process; nothing is stored for it
+
+typedef struct
+{
+    char magic[8]; //DUMP_MAGIC
+    unsigned int version; //DUMP_VERSION
+    unsigned int flags; //DUMP_COMPRESSED
+    unsigned int pid; //process that was dumped
+    unsigned int block_size; //DUMP_BLOCK_SIZE when it was written
+    unsigned int region_count;
+    unsigned int reserved;
+    unsigned long long block_count;
+    unsigned long long region_offset; //file offset of the DUMP_REGION table (0 while the dump is being written)
+    unsigned long long block_offset; //file offset of the DUMP_BLOCK table
+    unsigned long long bytes; //bytes of process memory in the dump
+} DUMP_HEADER;
+
+typedef struct
+{
+    unsigned long long addr;
+    unsigned long long size;
+    unsigned long long first_block; //index of its first DUMP_BLOCK; a region has ceil (size / block_size) blocks
+    unsigned int protect; //REGION_READ | REGION_WRITE | REGION_EXEC
+    unsigned int reserved;
+} DUMP_REGION;
+
+typedef struct
+{
+    unsigned long long offset; //file offset of the data
+    unsigned int stored_size; //bytes stored in the file
+    unsigned int flags; //DUMP_BLOCK_LZ4, DUMP_BLOCK_UNREADABLE
+} DUMP_BLOCK;
+
+// One buffer of the ring between dump_process and the writer thread
+typedef struct
+{
+    unsigned char *data; //DUMP_BLOCK_SIZE bytes read from the process
+    unsigned int size; //bytes in data
+    BOOL ok; //FALSE if the read failed
+} DUMP_SLOT;
+
+typedef struct
+{
+    FILE *f;
+    BOOL compress;
+    DUMP_SLOT slots[DUMP_SLOTS];
+    SEMAPHORE free_slots; //slots the reader may fill
+    SEMAPHORE full_slots; //slots the writer may write
+    DUMP_BLOCK *blocks; //filled in by the writer
+    unsigned long long block_count;
+    unsigned long long offset; //file offset of the next block
+    BOOL failed; //set by the writer if a write failed
+} DUMP_WRITER;
+
+/**
+ * Function: dump_writer
+ * 
+ * Description: Thread that compresses and writes the blocks of a dump in order, as the reader hands them over
+ *
+ * Input:
+ *   param - the DUMP_WRITER
+ */
+static THREAD_PROC (dump_writer, param)
+{
+    DUMP_WRITER *w = param;
+    unsigned char *packed = w->compress ? malloc (lz4_bound (DUMP_BLOCK_SIZE)) : NULL;
+    unsigned int *table = w->compress ? calloc (1 << LZ4_HASH_BITS, sizeof(unsigned int)) : NULL;
+    unsigned long long i;
+
+    for (i = 0; i < w->block_count; i++)
+    {
+        DUMP_SLOT *slot = &w->slots[i % DUMP_SLOTS];
+        DUMP_BLOCK *block = &w->blocks[i];
+
+        semaphore_wait (&w->full_slots);
+
+        block->offset = w->offset;
+        block->stored_size = 0;
+        block->flags = 0;
+        if (!slot->ok)
+        {
+            block->flags = DUMP_BLOCK_UNREADABLE;
+        }
+        else if (!w->failed)
+        {
+            size_t n = (packed && table) ? lz4_compress (slot->data, slot->size, packed, table) : slot->size;
+
+            // blocks that do not get smaller are stored raw; in a dump without compression they stay page aligned
+            if (n < slot->size)
+            {
+                block->flags = DUMP_BLOCK_LZ4;
+                block->stored_size = (unsigned int)n;
+                if (fwrite (packed, 1, n, w->f) != n) w->failed = TRUE;
+                w->offset += n;
+            }
+            else if (w->compress)
+            {
+                block->stored_size = slot->size;
+                if (fwrite (slot->data, 1, slot->size, w->f) != slot->size) w->failed = TRUE;
+                w->offset += slot->size;
+            }
+            else
+            {
+                block->stored_size = slot->size;
+                if (!write_padded (w->f, slot->data, slot->size)) w->failed = TRUE;
+                w->offset += ALIGN_PAGE (slot->size);
+            }
+        }
+
+        semaphore_post (&w->free_slots);
+    }
+
+    free (packed);
+    free (table);
+    return THREAD_RETURN;
+}
+
+/**
+ * Function: dump_process
+ * 
+ * Description: Writes every readable region of a process to a dump file (see Memory dumps). The file is written under a
+ *              temporary name and renamed at the end, like snapshots.
+ *
+ * Input:
+ *   hProc - the process
+ *   *path - the file to write
+ *   compress - compress the blocks
+ *   *header - receives the header of the dump
+ *
+ * Output:
+ *   TRUE on success
+ */
+BOOL dump_process (PROC_HANDLE hProc, const char *path, BOOL compress, DUMP_HEADER *header)
+{
+    DUMP_WRITER w;
+    DUMP_REGION *table;
+    REGION *regions;
+    THREAD writer;
+    char tmp_path[1024];
+    unsigned long long block = 0;
+    unsigned int n = 0, k;
+    int nregions, r;
+    BOOL ok = TRUE;
+
+    memset (header, 0, sizeof(DUMP_HEADER));
+    memset (&w, 0, sizeof(w));
+
+    nregions = list_regions (hProc, &regions);
+    table = calloc (nregions ? nregions : 1, sizeof(DUMP_REGION));
+    if (!table)
+    {
+        free (regions);
+        return FALSE;
+    }
+    for (r = 0; r < nregions; r++)
+    {
+        if (!(regions[r].protect & REGION_READ)) continue;
+        table[n].addr = (uintptr_t)regions[r].base;
+        table[n].size = regions[r].size;
+        table[n].protect = regions[r].protect;
+        table[n].first_block = block;
+        block += (regions[r].size + DUMP_BLOCK_SIZE - 1) / DUMP_BLOCK_SIZE;
+        n++;
+    }
+    free (regions);
+
+    w.compress = compress;
+    w.block_count = block;
+    w.blocks = malloc ((block ? block : 1) * sizeof(DUMP_BLOCK));
+    for (k = 0; k < DUMP_SLOTS; k++)
+    {
+        w.slots[k].data = malloc (DUMP_BLOCK_SIZE);
+        if (!w.slots[k].data) ok = FALSE;
+    }
+
+    memcpy (header->magic, DUMP_MAGIC, sizeof(header->magic));
+    header->version = DUMP_VERSION;
+    header->flags = compress ? DUMP_COMPRESSED : 0;
+    header->pid = process_id (hProc);
+    header->block_size = DUMP_BLOCK_SIZE;
+    header->region_count = n;
+    header->block_count = block;
+
+    snprintf (tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    w.f = (ok && w.blocks) ? fopen (tmp_path, "wb") : NULL;
+    if (!w.f)
+    {
+        for (k = 0; k < DUMP_SLOTS; k++) free (w.slots[k].data);
+        free (w.blocks);
+        free (table);
+        return FALSE;
+    }
+    setvbuf (w.f, NULL, _IOFBF, 1024*1024);
+
+    // the header is written again at the end, with the table offsets
+    ok = write_padded (w.f, header, sizeof(DUMP_HEADER));
+    w.offset = ALIGN_PAGE (sizeof(DUMP_HEADER));
+
+    semaphore_init (&w.free_slots, DUMP_SLOTS);
+    semaphore_init (&w.full_slots, 0);
+    if (ok && thread_start (&writer, dump_writer, &w))
+    {
+        block = 0;
+        for (k = 0; k < n; k++)
+        {
+            unsigned long long offset;
+
+            for (offset = 0; offset < table[k].size; offset += DUMP_BLOCK_SIZE)
+            {
+                DUMP_SLOT *slot = &w.slots[block++ % DUMP_SLOTS];
+
+                semaphore_wait (&w.free_slots);
+                slot->size = (unsigned int)((table[k].size - offset < DUMP_BLOCK_SIZE) ? table[k].size - offset : DUMP_BLOCK_SIZE);
+                // once a write failed the rest is only handed over to let the writer finish
+                slot->ok = !w.failed && read_memory (hProc, (unsigned char*)(uintptr_t)(table[k].addr + offset), slot->data, slot->size) == slot->size;
+                if (slot->ok) header->bytes += slot->size;
+                semaphore_post (&w.full_slots);
+            }
+        }
+        thread_join (writer);
+        ok = !w.failed;
+    }
+    else
+    {
+        ok = FALSE;
+    }
+    semaphore_free (&w.free_slots);
+    semaphore_free (&w.full_slots);
+
+    header->region_offset = w.offset;
+    header->block_offset = w.offset + (unsigned long long)n * sizeof(DUMP_REGION);
+    ok = ok && fwrite (table, sizeof(DUMP_REGION), n, w.f) == n &&
+         fwrite (w.blocks, sizeof(DUMP_BLOCK), (size_t)w.block_count, w.f) == w.block_count &&
+         fseek (w.f, 0, SEEK_SET) == 0 && fwrite (header, sizeof(DUMP_HEADER), 1, w.f) == 1;
+    if (fclose (w.f) != 0) ok = FALSE;
+
+    for (k = 0; k < DUMP_SLOTS; k++) free (w.slots[k].data);
+    free (w.blocks);
+    free (table);
+
+    if (ok)
+    {
+        remove (path);
+        ok = rename (tmp_path, path) == 0;
+    }
+    if (!ok)
+    {
+        remove (tmp_path);
+    }
+
+    return ok;
+}
+
+// A dump opened for reading with open_dump
+typedef struct
+{
+    MAPPED_FILE map;
+    DUMP_HEADER *header;
+    DUMP_REGION *regions; //in address order
+    DUMP_BLOCK *blocks;
+    unsigned char *cache; //the last block decompressed
+    unsigned long long cached_block; //its index, or block_count if none
+} DUMP_VIEW;
+
+/**
+ * Function: close_dump
+ * 
+ * Description: Closes a dump opened with open_dump
+ */
+void close_dump (DUMP_VIEW *view)
+{
+    unmap_file (&view->map);
+    free (view->cache);
+    free (view);
+}
+
+/**
+ * Function: open_dump
+ * 
+ * Description: Maps a dump written by dump_process and checks its tables
+ *
+ * Input:
+ *   *path - the dump file
+ *
+ * Output:
+ *   The dump, or NULL if the file could not be opened or is not a dump
+ */
+DUMP_VIEW* open_dump (const char *path)
+{
+    DUMP_VIEW *view = calloc (1, sizeof(DUMP_VIEW));
+    DUMP_HEADER *h;
+    unsigned long long i;
+    BOOL ok = TRUE;
+
+    if (!view || !map_file (path, &view->map, FALSE))
+    {
+        free (view);
+        return NULL;
+    }
+
+    h = (DUMP_HEADER*)view->map.base;
+    if (view->map.size < sizeof(DUMP_HEADER) || memcmp (h->magic, DUMP_MAGIC, sizeof(h->magic)) != 0 || h->version != DUMP_VERSION ||
+        h->block_size == 0 || h->block_size > 64*1024*1024 ||
+        h->region_offset > view->map.size || (view->map.size - h->region_offset) / sizeof(DUMP_REGION) < h->region_count ||
+        h->block_offset > view->map.size || (view->map.size - h->block_offset) / sizeof(DUMP_BLOCK) < h->block_count)
+    {
+        unmap_file (&view->map);
+        free (view);
+        return NULL;
+    }
+    view->header = h;
+    view->regions = (DUMP_REGION*)(view->map.base + h->region_offset);
+    view->blocks = (DUMP_BLOCK*)(view->map.base + h->block_offset);
+    view->cached_block = h->block_count;
+
+    // every block must lie inside the file, and the blocks of every region inside the block table
+    for (i = 0; ok && i < h->block_count; i++)
+    {
+        DUMP_BLOCK *block = &view->blocks[i];
+        ok = block->offset <= view->map.size && block->stored_size <= view->map.size - block->offset && block->stored_size <= h->block_size;
+    }
+    for (i = 0; ok && i < h->region_count; i++)
+    {
+        DUMP_REGION *region = &view->regions[i];
+        ok = region->first_block <= h->block_count && region->size / h->block_size + (region->size % h->block_size != 0) <= h->block_count - region->first_block;
+    }
+
+    view->cache = ok ? malloc (h->block_size) : NULL;
+    if (!view->cache)
+    {
+        close_dump (view);
+        return NULL;
+    }
+
+    return view;
+}
+
+/**
+ * Function: read_dump
+ * 
+ * Description: Reads process memory back from a dump, decompressing only the blocks it touches
+ *
+ * Input:
+ *   *view - the dump
+ *   addr - address in the dumped process
+ *   *buf - receives the bytes
+ *   size - the number of bytes
+ *
+ * Output:
+ *   The number of bytes read; less than size where the range leaves the dumped memory or reaches a block that could not
+ *   be read from the process or is damaged
+ */
+size_t read_dump (DUMP_VIEW *view, unsigned long long addr, unsigned char *buf, size_t size)
+{
+    const DUMP_HEADER *h = view->header;
+    size_t done = 0;
+
+    while (done < size)
+    {
+        unsigned int lo = 0, hi = h->region_count;
+        const DUMP_REGION *region;
+        const DUMP_BLOCK *block;
+        const unsigned char *data;
+        unsigned long long offset, block_start, index;
+        size_t block_len, n;
+
+        // the last region starting at or below addr
+        while (lo < hi)
+        {
+            unsigned int mid = lo + (hi - lo) / 2;
+            if (view->regions[mid].addr <= addr) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo == 0) break;
+        region = &view->regions[lo - 1];
+        if (addr - region->addr >= region->size) break;
+
+        offset = addr - region->addr;
+        index = region->first_block + offset / h->block_size;
+        block = &view->blocks[index];
+        block_start = offset - offset % h->block_size;
+        block_len = (size_t)((region->size - block_start < h->block_size) ? region->size - block_start : h->block_size);
+        if (block->flags & DUMP_BLOCK_UNREADABLE) break;
+
+        if (block->flags & DUMP_BLOCK_LZ4)
+        {
+            if (view->cached_block != index)
+            {
+                view->cached_block = h->block_count;
+                if (!lz4_decompress (view->map.base + block->offset, block->stored_size, view->cache, block_len)) break;
+                view->cached_block = index;
+            }
+            data = view->cache;
+        }
+        else
+        {
+            if (block->stored_size != block_len) break;
+            data = view->map.base + block->offset;
+        }
+
+        offset -= block_start;
+        n = (size_t)((block_len - offset < size - done) ? block_len - offset : size - done);
+        memcpy (buf + done, data + offset, n);
+        done += n;
+        addr += n;
+    }
+
+    return done;
+}
+
+/*
+ * Offline scans
+ *
+ * A dump is a snapshot of the whole process, so a series of them taken a moment apart (capture_dumps) can be scanned
+ * later, in any order and as often as needed, without the process. create_dump_scan makes a scan of the regions of a
+ * dump, and update_scan_dump runs an update on the worker threads like update_scan, but reads the values from a dump:
+ * a relative condition then compares that dump with the one the update before read. Any two snapshots can be compared
+ * that way, e.g. "unknown" on the first, "unchanged" on the second, "increased" on the fifth, or a next scan with
+ * "unknown" to go back to the values of an earlier one without dropping matches. Every thread reads the dump through
+ * a view of its own, which shares the mapped file but not the block it last decompressed, and the blocks of a dump
+ * written without compression are read straight from the mapping.
+ *
+ * A scan made of a dump keeps the process open if it still runs, so it can be continued live; if it does not, only
+ * dump updates, results and snapshots work on it.
+ */
+
+/**
+ * Function: open_dump_reader
+ * 
+ * Description: SCAN_SOURCE open of a dump: a copy of the view with a decompression cache of its own
+ *
+ * Input:
+ *   param - the DUMP_VIEW
+ */
+static void* open_dump_reader (void *param)
+{
+    const DUMP_VIEW *view = param;
+    DUMP_VIEW *reader = malloc (sizeof(DUMP_VIEW));
+
+    if (!reader) return NULL;
+    *reader = *view;
+    reader->cache = malloc (view->header->block_size);
+    reader->cached_block = view->header->block_count;
+    if (!reader->cache)
+    {
+        free (reader);
+        return NULL;
+    }
+
+    return reader;
+}
+
+/**
+ * Function: read_dump_reader
+ * 
+ * Description: SCAN_SOURCE read of a dump (see read_dump)
+ */
+static size_t read_dump_reader (void *state, const unsigned char *addr, unsigned char *buf, size_t size)
+{
+    return read_dump (state, (uintptr_t)addr, buf, size);
+}
+
+/**
+ * Function: close_dump_reader
+ * 
+ * Description: SCAN_SOURCE close of a dump: frees what open_dump_reader allocated, leaving the view open
+ */
+static void close_dump_reader (void *state)
+{
+    DUMP_VIEW *reader = state;
+
+    free (reader->cache);
+    free (reader);
+}
+
+/**
+ * Function: create_dump_scan
+ * 
+ * Description: Creates a scan of the regions of a dump, like create_scan does for a process. The first update has to
+ *              come from update_scan_dump.
+ *
+ * Input:
+ *   *view - the dump
+ *   type - the type of value to be searched for
+ *   alignment - the distance between candidate addresses: 1, 2, 4 or 8, or 0 for the size of the type
+ *   *filter - the regions to scan, or NULL for every readable and writable region. Dumps do not record the type of a
+ *             region, so filter->types is not used, and filter->module only works while the process still runs.
+ *   *options - the settings of the scan, or NULL for the defaults (see default_scan_options)
+ *
+ * Output:
+ *   The scan, or NULL if the dump has no memory passing the filter or the alignment is not valid
+ */
+SCAN* create_dump_scan (DUMP_VIEW *view, VALUE_TYPE type, int alignment, const REGION_FILTER *filter,
+                        const SCAN_OPTIONS *options)
+{
+    SCAN *scan;
+    MODULE *modules = NULL;
+    REGION_FILTER any_type;
+    int nmodules = 0;
+    unsigned int i;
+
+    if (alignment != 0 && alignment != 1 && alignment != 2 && alignment != 4 && alignment != 8) return NULL;
+
+    if (filter) any_type = *filter;
+    else default_region_filter (&any_type);
+    any_type.types = 0;
+
+    scan = calloc (1, sizeof(SCAN));
+    if (!scan) return NULL;
+
+    // the process may be gone by now
+    scan->hProc = open_process (view->header->pid);
+    scan->type = type;
+    scan->data_size = value_types[type].size;
+    scan->stride = alignment ? alignment : scan->data_size;
+    scan->prioritize = any_type.prioritize;
+    set_scan_options (scan, options);
+    arena_init (&scan->arena);
+
+    if (any_type.module[0] && scan->hProc) nmodules = list_modules (scan->hProc, &modules);
+    scan->blocks = arena_alloc (&scan->arena, (view->header->region_count ? view->header->region_count : 1) * sizeof(MEMBLOCK));
+    for (i = 0; i < view->header->region_count && scan->blocks; i++)
+    {
+        REGION region;
+
+        region.base = (unsigned char*)(uintptr_t)view->regions[i].addr;
+        region.size = (size_t)view->regions[i].size;
+        region.protect = (int)view->regions[i].protect;
+        region.type = 0;
+        if (region_passes_filter (&any_type, &region, modules, nmodules) && init_memblock (&scan->blocks[scan->count], scan, &region))
+        {
+            scan->count++;
+        }
+    }
+    free (modules);
+
+    if (!scan->count)
+    {
+        free_scan (scan);
+        return NULL;
+    }
+
+    return scan;
+}
+
+/**
+ * Function: update_scan_dump
+ * 
+ * Description: Updates a scan with the values of a dump instead of the process (see Offline scans)
+ *
+ * Input:
+ *   *scan - the scan, made by create_dump_scan or of the process that was dumped
+ *   *search - the condition and its operands, in the scan's value type
+ *   *view - the dump
+ *
+ * Output:
+ *   TRUE on success, FALSE if out of memory
+ */
+BOOL update_scan_dump (SCAN *scan, const SEARCH_PARAMS *search, DUMP_VIEW *view)
+{
+    SCAN_SOURCE source;
+
+    source.open = open_dump_reader;
+    source.read = read_dump_reader;
+    source.close = close_dump_reader;
+    source.param = view;
+
+    return update_scan_source (scan, search, &source);
+}
+
+/**
+ * Function: get_capture_path
+ * 
+ * Description: The file name of dump number index of a capture_dumps series: "<prefix>.<index>.dmp"
+ */
+void get_capture_path (const char *prefix, int index, char *path, size_t size)
+{
+    snprintf (path, size, "%s.%d.dmp", prefix, index);
+}
+
+/**
+ * Function: capture_dumps
+ * 
+ * Description: Dumps a process count times, interval milliseconds apart (from the start of one dump to the start of
+ *              the next, or right after the last one if it took longer), to the files get_capture_path names
+ *
+ * Input:
+ *   hProc - the process
+ *   *prefix - start of the file names
+ *   count - number of dumps
+ *   interval - milliseconds between the dumps
+ *   compress - compress the blocks
+ *   *bytes - receives the bytes of process memory in the last dump, or NULL
+ *
+ * Output:
+ *   The number of dumps written; the series stops at the first that fails
+ */
+int capture_dumps (PROC_HANDLE hProc, const char *prefix, int count, unsigned int interval, BOOL compress, unsigned long long *bytes)
+{
+    DUMP_HEADER header;
+    char path[1024];
+    unsigned long long next = clock_ns ();
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (i) sleep_until (next);
+        next = clock_ns () + interval * 1000000ULL;
+        get_capture_path (prefix, i, path, sizeof(path));
+        if (!dump_process (hProc, path, compress, &header)) break;
+        if (bytes) *bytes = header.bytes;
+    }
+
+    return i;
+}
+
+/**
+ * Function: poke
+ * 
+ * Description: Update a given memory address with a new value
+ *
+ * Input:
+ *   hProc - process handle of the process which the memory address is in
+ *   data_size - the data size of the value to be updated (1, 2, 4 or 8 bytes)
+ *   addr - the hexadecimal memory address to be updated
+ *   *val - the new value the address is to be updated with
+ */
+void poke (PROC_HANDLE hProc, int data_size, unsigned char *addr, const TYPED_VALUE *val)
+{
+    if (!write_memory (hProc, addr, val, data_size))
+    {
+        printf ("poke failed\r\n");
+    }
+}
+
+/**
+ * Function: peek
+ * 
+ * Description: View the value of a given memory address
+ *
+ * Input:
+ *   hProc - process handle of the process which the memory address is in
+ *   data_size - the data size of the value to be viewed (1, 2, 4 or 8 bytes)
+ *   addr - the hexadecimal memory address to be viewed
+ */
+TYPED_VALUE peek (PROC_HANDLE hProc, int data_size, unsigned char *addr)
+{
+    TYPED_VALUE val;
+
+    memset (&val, 0, sizeof(val));
+
+    if (read_memory (hProc, addr, &val, data_size) != (size_t)data_size)
+    {
+        printf ("peek failed\r\n");
+    }
+
+    return val;
+}
+
+// Walks the matches of a scan in address order (see first_match)
+typedef struct
+{
+    SCAN *scan;
+    size_t block; //memory block to look in
+    size_t index; //next candidate (dense blocks) or match list entry (sparse blocks) to look at in it
+    unsigned char values[2*PAGE_SIZE]; //previous values of a compressed block from values_offset on
+    size_t values_offset; //(size_t)-1 if values holds none of the block
+} MATCH_ITERATOR;
+
+/**
+ * Function: first_match
+ * 
+ * Description: Starts walking the matches of a scan; next_match then gives them one by one
+ *
+ * Input:
+ *   *it - the iterator
+ *   *scan - the scan, which must not be updated while it is walked
+ */
+void first_match (MATCH_ITERATOR *it, SCAN *scan)
+{
+    it->scan = scan;
+    it->block = 0;
+    it->index = 0;
+    it->values_offset = (size_t)-1;
+}
+
+/**
+ * Function: next_match
+ * 
+ * Description: Gives the next match of a scan, without reading the process
+ *
+ * Input:
+ *   *it - the iterator
+ *   **addr - receives the address of the match
+ *   *value - receives the value the last scan found there, zero extended
+ *
+ * Output:
+ *   TRUE if there was another match
+ */
+BOOL next_match (MATCH_ITERATOR *it, unsigned char **addr, TYPED_VALUE *value)
+{
+    while (it->block < it->scan->count)
+    {
+        MEMBLOCK *mb = &it->scan->blocks[it->block];
+
+        if (mb->matchlist && it->index < mb->matches)
+        {
+            *addr = mb->addr + mb->matchlist[it->index].offset;
+            value->u64 = mb->matchlist[it->index].value;
+            it->index++;
+            return TRUE;
+        }
+
+        if (!mb->matchlist && mb->matches > 0)
+        {
+            size_t count = candidate_count (mb->size, mb->data_size, mb->stride);
+
+            while (it->index < count)
+            {
+                size_t index = it->index++;
+
+                if (index % 8 == 0 && mb->searchmask[index / 8] == 0)
+                {
+                    it->index = index + 8;
+                    continue;
+                }
+                if (IS_IN_SEARCH (mb, index))
+                {
+                    size_t offset = index * mb->stride;
+
+                    *addr = mb->addr + offset;
+                    value->u64 = 0;
+                    if (!mb->baseline)
+                    {
+                        memcpy (value, mb->buffer + offset, mb->data_size);
+                        return TRUE;
+                    }
+                    if (it->values_offset != (offset & ~(size_t)(PAGE_SIZE - 1)))
+                    {
+                        // the page of the value and the next one, which the value may run into
+                        it->values_offset = offset & ~(size_t)(PAGE_SIZE - 1);
+                        baseline_load (mb, it->values_offset, (mb->size - it->values_offset < sizeof(it->values)) ?
+                                       mb->size - it->values_offset : sizeof(it->values), it->values);
+                    }
+                    memcpy (value, it->values + (offset - it->values_offset), mb->data_size);
+                    return TRUE;
+                }
+            }
+        }
+
+        it->block++;
+        it->index = 0;
+        it->values_offset = (size_t)-1;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Result cursors
+ *
+ * After an unknown scan a process has billions of matches, so they are shown a page at a time rather than all at once.
+ * A cursor numbers the matches of a scan in address order and moves a MATCH_ITERATOR to any of them without walking the
+ * ones before it. It finds the block from the match counts of the blocks, and the candidate in a dense block with a rank
+ * directory: the number of matches before every RANK_SPAN candidates, so only the searchmask bytes of one span are
+ * counted. A block's directory is built the first time a seek lands in it, so opening a cursor and showing its first
+ * page costs nothing however many matches there are. Sparse blocks need no directory, their match list is an array.
+ */
+
+#define RANK_SPAN 4096 //candidates per entry of a rank directory (512 searchmask bytes)
+#define MATCH_PAGE 50 //matches per page when browsing them
+
+typedef struct
+{
+    SCAN *scan; //must not be updated while the cursor is open
+    unsigned long long *first; //number of the first match of each block, and the total after the last block
+    unsigned long long **ranks; //per dense block once needed: matches before each span of RANK_SPAN candidates
+} MATCH_CURSOR;
+
+// Matches of a scan in one region or one module (see group_matches)
+typedef struct
+{
+    unsigned char *base;
+    unsigned long long size;
+    unsigned long long first; //number of its first match
+    unsigned long long matches;
+    char module[64]; //name of the module, empty for memory outside modules
+} MATCH_GROUP;
+
+/**
+ * Function: open_match_cursor
+ * 
+ * Description: Numbers the matches of a scan so that seek_match can go to any of them
+ *
+ * Input:
+ *   *scan - the scan, which must not be updated until the cursor is closed
+ *
+ * Output:
+ *   The cursor, or NULL if out of memory
+ */
+MATCH_CURSOR* open_match_cursor (SCAN *scan)
+{
+    MATCH_CURSOR *c = calloc (1, sizeof(MATCH_CURSOR));
+    size_t b;
+
+    if (!c) return NULL;
+    c->scan = scan;
+    c->first = malloc ((scan->count + 1) * sizeof(unsigned long long));
+    c->ranks = calloc (scan->count ? scan->count : 1, sizeof(unsigned long long*));
+    if (!c->first || !c->ranks)
+    {
+        free (c->first);
+        free (c->ranks);
+        free (c);
+        return NULL;
+    }
+
+    c->first[0] = 0;
+    for (b = 0; b < scan->count; b++)
+    {
+        c->first[b+1] = c->first[b] + scan->blocks[b].matches;
+    }
+
+    return c;
+}
+
+/**
+ * Function: close_match_cursor
+ * 
+ * Description: Frees a cursor and its rank directories
+ *
+ * Input:
+ *   *c - the cursor, or NULL
+ */
+void close_match_cursor (MATCH_CURSOR *c)
+{
+    size_t b;
+
+    if (!c) return;
+    for (b = 0; b < c->scan->count; b++) free (c->ranks[b]);
+    free (c->ranks);
+    free (c->first);
+    free (c);
+}
+
+/**
+ * Function: get_cursor_total
+ * 
+ * Description: The number of matches a cursor numbers
+ */
+unsigned long long get_cursor_total (const MATCH_CURSOR *c)
+{
+    return c->first[c->scan->count];
+}
+
+/**
+ * Function: build_ranks
+ * 
+ * Description: Builds the rank directory of a dense block
+ *
+ * Output:
+ *   The directory, one entry per span and one for the whole block, or NULL if out of memory
+ */
+static unsigned long long* build_ranks (const MEMBLOCK *mb)
+{
+    size_t count = candidate_count (mb->size, mb->data_size, mb->stride);
+    size_t spans = (count + RANK_SPAN - 1) / RANK_SPAN;
+    unsigned long long *ranks = malloc ((spans + 1) * sizeof(unsigned long long));
+    size_t s;
+
+    if (!ranks) return NULL;
+
+    ranks[0] = 0;
+    for (s = 0; s < spans; s++)
+    {
+        size_t last = (s + 1) * RANK_SPAN;
+        ranks[s+1] = ranks[s] + count_bits (mb, s * RANK_SPAN, last < count ? last : count);
+    }
+
+    return ranks;
+}
+
+/**
+ * Function: seek_match
+ * 
+ * Description: Moves an iterator to a match, so that next_match gives that match and the ones after it
+ *
+ * Input:
+ *   *c - the cursor
+ *   n - the number of the match, from 0 (address order)
+ *   *it - the iterator, which is started on the cursor's scan
+ *
+ * Output:
+ *   TRUE if there is such a match (if not the iterator is at the end), FALSE also if out of memory
+ */
+BOOL seek_match (MATCH_CURSOR *c, unsigned long long n, MATCH_ITERATOR *it)
+{
+    SCAN *scan = c->scan;
+    size_t lo = 0, hi = scan->count;
+    unsigned long long *ranks;
+    unsigned long long r;
+    MEMBLOCK *mb;
+    size_t count, index;
+
+    first_match (it, scan);
+    it->block = scan->count;
+    if (n >= get_cursor_total (c)) return FALSE;
+
+    // the last block whose first match is at most n, which has matches since n is below the total
+    while (hi - lo > 1)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (c->first[mid] <= n) lo = mid;
+        else hi = mid;
+    }
+    mb = &scan->blocks[lo];
+    r = n - c->first[lo];
+
+    if (mb->matchlist)
+    {
+        it->block = lo;
+        it->index = (size_t)r;
+        return TRUE;
+    }
+
+    if (!c->ranks[lo]) c->ranks[lo] = build_ranks (mb);
+    ranks = c->ranks[lo];
+    if (!ranks) return FALSE;
+
+    // the span holding match r, then its candidate, counting the searchmask a word and then a bit at a time
+    count = candidate_count (mb->size, mb->data_size, mb->stride);
+    lo = 0;
+    hi = (count + RANK_SPAN - 1) / RANK_SPAN;
+    while (hi - lo > 1)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (ranks[mid] <= r) lo = mid;
+        else hi = mid;
+    }
+    r -= ranks[lo];
+    index = lo * RANK_SPAN;
+    while (index + 32 <= count)
+    {
+        unsigned long long in_word = count_bits (mb, index, index + 32);
+        if (in_word > r) break;
+        r -= in_word;
+        index += 32;
+    }
+    for (; index < count; index++)
+    {
+        if (IS_IN_SEARCH (mb, index) && r-- == 0) break;
+    }
+    if (index >= count) return FALSE;
+
+    it->block = mb - scan->blocks;
+    it->index = index;
+    return TRUE;
+}
+
+static int compare_numbers (const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long*)a;
+    unsigned long long y = *(const unsigned long long*)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Function: sample_matches
+ * 
+ * Description: Picks match numbers at random, without repeats, for seek_match
+ *
+ * Input:
+ *   *c - the cursor
+ *   n - how many to pick; all the matches if there are not more than that
+ *   seed - seed of the random numbers, any value but 0
+ *   *numbers - receives the numbers in increasing order, room for n
+ *
+ * Output:
+ *   The number of numbers picked
+ */
+size_t sample_matches (const MATCH_CURSOR *c, size_t n, unsigned long long seed, unsigned long long *numbers)
+{
+    unsigned long long total = get_cursor_total (c);
+    unsigned long long x = seed ? seed : 88172645463325252ull; //xorshift64 state
+    size_t count = 0, i, kept;
+
+    if (total <= n)
+    {
+        for (count = 0; count < total; count++) numbers[count] = count;
+        return count;
+    }
+
+    // draw what is missing, sort and drop repeats until there are n; with n below the total few draws repeat
+    while (count < n)
+    {
+        for (; count < n; count++)
+        {
+            x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+            numbers[count] = x % total;
+        }
+        qsort (numbers, count, sizeof(unsigned long long), compare_numbers);
+        for (i = 1, kept = 1; i < count; i++)
+        {
+            if (numbers[i] != numbers[kept-1]) numbers[kept++] = numbers[i];
+        }
+        count = kept;
+    }
+
+    return count;
+}
+
+/**
+ * Function: group_matches
+ * 
+ * Description: Counts the matches of a scan per region, or per module with all the memory outside modules as one group
+ *
+ * Input:
+ *   *c - the cursor
+ *   by_module - TRUE for one group per module, FALSE for one per memory block
+ *   **groups - receives the groups that have matches, in address order (the group outside modules last); free them
+ *
+ * Output:
+ *   The number of groups, or -1 if out of memory
+ */
+int group_matches (const MATCH_CURSOR *c, BOOL by_module, MATCH_GROUP **groups)
+{
+    SCAN *scan = c->scan;
+    MODULE *modules = NULL;
+    int nmodules, count = 0, outside = -1, m;
+    size_t b;
+
+    *groups = calloc (scan->count + 1, sizeof(MATCH_GROUP));
+    if (!*groups) return -1;
+    nmodules = scan->hProc ? list_modules (scan->hProc, &modules) : 0;
+
+    for (b = 0; b < scan->count; b++)
+    {
+        MEMBLOCK *mb = &scan->blocks[b];
+        MATCH_GROUP *g;
+
+        if (!mb->matches) continue;
+        m = find_module (modules, nmodules, (uintptr_t)mb->addr);
+
+        // the blocks of a module are next to each other, those outside modules are not
+        if (by_module && m < 0 && outside >= 0) g = &(*groups)[outside];
+        else if (by_module && m >= 0 && count > 0 && strcmp ((*groups)[count-1].module, modules[m].name) == 0 &&
+                 (*groups)[count-1].base == modules[m].base) g = &(*groups)[count-1];
+        else
+        {
+            g = &(*groups)[count++];
+            g->first = c->first[b];
+            if (by_module && m < 0) outside = count - 1;
+            if (m >= 0) snprintf (g->module, sizeof(g->module), "%s", modules[m].name);
+            if (by_module && m >= 0)
+            {
+                g->base = modules[m].base;
+                g->size = modules[m].size;
+            }
+            else if (!by_module) g->base = mb->addr;
+        }
+        if (!by_module || m < 0) g->size += mb->size;
+        g->matches += mb->matches;
+    }
+    free (modules);
+
+    // the memory outside modules is spread between them; it goes last
+    if (outside >= 0 && outside != count - 1)
+    {
+        MATCH_GROUP rest = (*groups)[outside];
+        memmove (&(*groups)[outside], &(*groups)[outside + 1], (count - 1 - outside) * sizeof(MATCH_GROUP));
+        (*groups)[count - 1] = rest;
+    }
+
+    return count;
+}
+
+#define PRINT_BATCH 4096 //matches read with one read plan when printing
+
+/**
+ * Function: format_value
+ * 
+ * Description: Formats a value as hexadecimal followed by its decimal value in its type
+ *
+ * Input:
+ *   type - the type of the value
+ *   *data - the raw bytes of the value
+ *   *out - receives the text
+ *   out_size - size of out
+ */
+void format_value (VALUE_TYPE type, const void *data, char *out, size_t out_size)
+{
+    TYPED_VALUE v;
+    int size = value_types[type].size;
+
+    memset (&v, 0, sizeof(v));
+    memcpy (&v, data, size);
+
+    switch (type)
+    {
+        case TYPE_I8:  snprintf (out, out_size, "0x%0*llx (%d)", size*2, v.u64, v.i8); break;
+        case TYPE_I16: snprintf (out, out_size, "0x%0*llx (%d)", size*2, v.u64, v.i16); break;
+        case TYPE_I32: snprintf (out, out_size, "0x%0*llx (%d)", size*2, v.u64, v.i32); break;
+        case TYPE_I64: snprintf (out, out_size, "0x%0*llx (%lld)", size*2, v.u64, v.i64); break;
+        case TYPE_F32: snprintf (out, out_size, "0x%0*llx (%g)", size*2, v.u64, v.f32); break;
+        case TYPE_F64: snprintf (out, out_size, "0x%0*llx (%.15g)", size*2, v.u64, v.f64); break;
+        default:       snprintf (out, out_size, "0x%0*llx (%llu)", size*2, v.u64, v.u64); break;
+    }
+}
+
+/**
+ * Function: format_number
+ * 
+ * Description: Formats a value as a plain number in its type, e.g. for scripts to read back ("nan", "inf" and "-inf"
+ *              for floats that are not numbers)
+ *
+ * Input:
+ *   type - the type of the value
+ *   *v - the value
+ *   *out - receives the text
+ *   out_size - size of out
+ */
+void format_number (VALUE_TYPE type, const TYPED_VALUE *v, char *out, size_t out_size)
+{
+    double f = (type == TYPE_F32) ? v->f32 : v->f64;
+
+    if (value_types[type].is_float && f != f)
+    {
+        snprintf (out, out_size, "nan");
+        return;
+    }
+    if (value_types[type].is_float && f - f != 0)
+    {
+        snprintf (out, out_size, (f > 0) ? "inf" : "-inf");
+        return;
+    }
+
+    switch (type)
+    {
+        case TYPE_U8:  snprintf (out, out_size, "%u", v->u8); break;
+        case TYPE_U16: snprintf (out, out_size, "%u", v->u16); break;
+        case TYPE_U32: snprintf (out, out_size, "%u", v->u32); break;
+        case TYPE_I8:  snprintf (out, out_size, "%d", v->i8); break;
+        case TYPE_I16: snprintf (out, out_size, "%d", v->i16); break;
+        case TYPE_I32: snprintf (out, out_size, "%d", v->i32); break;
+        case TYPE_I64: snprintf (out, out_size, "%lld", v->i64); break;
+        case TYPE_F32: snprintf (out, out_size, "%.9g", v->f32); break;
+        case TYPE_F64: snprintf (out, out_size, "%.17g", v->f64); break;
+        default:       snprintf (out, out_size, "%llu", v->u64); break;
+    }
+}
+
+/**
+ * Function: print_read_plan
+ * 
+ * Description: Reads a batch of matches with one read plan and prints them in the order they were added
+ *
+ * Input:
+ *   *plan - the read plan holding the addresses of the matches
+ *   type - the type of the values
+ *   *out - where to print them
+ */
+static void print_read_plan (READ_PLAN *plan, VALUE_TYPE type, FILE *out)
+{
+    unsigned int i;
+
+    execute_read_plan (plan);
+
+    for (i = 0; i < plan->count; i++)
+    {
+        char text[64];
+
+        if (plan->requests[i].data)
+        {
+            format_value (type, plan->requests[i].data, text, sizeof(text));
+            fprintf (out, "0x%08llx: %s \r\n", (unsigned long long)(uintptr_t)plan->requests[i].addr, text);
+        }
+        else
+        {
+            fprintf (out, "0x%08llx: peek failed\r\n", (unsigned long long)(uintptr_t)plan->requests[i].addr);
+        }
+    }
+
+    reset_read_plan (plan, plan->hProc);
+}
+
+/**
+ * Function: print_cursor_matches
+ * 
+ * Description: Print out matches by their numbers, reading their values in batches; the reads are kept in
+ *              scan->print_stats
+ *
+ * Input:
+ *   *cursor - a cursor on the scan
+ *   *numbers - the numbers of the matches to print, in increasing order, or NULL for count matches from first on
+ *   first - the number of the first match to print if numbers is NULL, from 0 (see Result cursors)
+ *   count - how many to print at most (ULLONG_MAX for all of them)
+ *   *out - where to print them (stdout for the screen); if a match cannot be added to the read plan even when it is
+ *          empty, the printing stops there with an out of memory line
+ */
+void print_cursor_matches (MATCH_CURSOR *cursor, const unsigned long long *numbers, unsigned long long first,
+                           unsigned long long count, FILE *out)
+{
+    SCAN *scan = cursor->scan;
+    MATCH_ITERATOR it;
+    unsigned char *addr;
+    TYPED_VALUE value;
+    READ_PLAN *plan;
+    unsigned long long i;
+
+    plan = create_read_plan (scan->hProc, scan->options.gap);
+    if (!plan) return;
+
+    for (i = 0; i < count; i++)
+    {
+        if ((numbers || i == 0) && !seek_match (cursor, numbers ? numbers[i] : first, &it)) break;
+        if (!next_match (&it, &addr, &value)) break;
+        if (read_plan_add (plan, addr, scan->data_size) < 0)
+        {
+            // out of memory: the matches planned so far are printed, which empties the plan, and this one is tried again
+            print_read_plan (plan, scan->type, out);
+            if (read_plan_add (plan, addr, scan->data_size) < 0)
+            {
+                fprintf (out, "Out of memory, stopped at 0x%08llx\r\n", (unsigned long long)(uintptr_t)addr);
+                break;
+            }
+        }
+        if (plan->count == PRINT_BATCH) print_read_plan (plan, scan->type, out);
+    }
+    print_read_plan (plan, scan->type, out);
+
+    fprintf (out, "%llu reads, %llu bytes read, %llu bytes wasted\r\n", plan->stats.syscalls, plan->stats.bytes_read, plan->stats.bytes_wasted);
+    scan->print_stats = plan->stats;
+    free_read_plan (plan);
+}
+
+/**
+ * Function: print_matches
+ * 
+ * Description: Print out a page of the matches to our search in a particular scan (see print_cursor_matches)
+ *
+ * Input:
+ *   *scan - the scan
+ *   first - the number of the first match to print, from 0
+ *   count - how many to print at most (ULLONG_MAX for all of them)
+ *   *out - where to print them (stdout for the screen)
+ */
+void print_matches (SCAN *scan, unsigned long long first, unsigned long long count, FILE *out)
+{
+    MATCH_CURSOR *cursor = open_match_cursor (scan);
+
+    if (cursor)
+    {
+        print_cursor_matches (cursor, NULL, first, count, out);
+        close_match_cursor (cursor);
+    }
+}
+
+/**
+ * Function: get_match_count
+ * 
+ * Description: Print out the number of matches to our search in a particular scan to the screen
+ *
+ * Input:
+ *   *scan - the scan
+ */
+unsigned long long get_match_count (SCAN *scan)
+{
+    unsigned long long count = 0;
+    size_t b;
+
+    for (b = 0; b < scan->count; b++)
+    {
+        count += scan->blocks[b].matches;
+    }
+
+    return count;
+}
+
+/*
+ * Watch mode
+ *
+ * A watch polls a fixed set of addresses at a steady rate and writes a line for every value that changed since the
+ * previous poll:
+ *
+ *   <microseconds since the start> <address> <value>
+ *
+ * The addresses go into one read plan, so neighbouring ones are read together page by page. The runs of the plan are
+ * worked out once when the watch starts and every poll then reads them with read_memory_runs into the plan's buffer,
+ * which is compared with a copy of the previous poll WATCH_CHUNK bytes at a time; only the addresses in chunks that
+ * differ are looked at. Most memory does not change between two polls, so a poll costs a few system calls and a
+ * memcmp of the pages read, which keeps 100k addresses at 1 kHz well under a core. Polls are paced by absolute
+ * deadlines, so a late poll does not shift the ones after it; polls that could not start before the next deadline
+ * are skipped and counted.
+ */
+
+#define WATCH_CHUNK 64
+
+typedef struct
+{
+    PROC_HANDLE hProc;
+    VALUE_TYPE type;
+    int data_size;
+    READ_PLAN *plan; //one request per address
+    unsigned int count;
+    unsigned char *previous; //the plan's buffer as of the last poll that read each run
+    BOOL *run_read; //whether each run of the plan has been read yet
+} WATCH;
+
+typedef struct
+{
+    unsigned long long polls;
+    unsigned long long skipped; //polls dropped because the previous one overran its period
+    unsigned long long events; //changes written
+    unsigned long long elapsed_ns;
+    unsigned long long busy_ns; //time spent reading, comparing and writing
+    unsigned long long max_poll_ns; //longest poll
+    unsigned long long late_ns; //sum of how late the polls started
+    unsigned long long max_late_ns;
+    unsigned long long jitter_ns; //sum of how far every interval between two polls was from the period
+    READ_STATS reads;
+} WATCH_STATS;
+
+/**
+ * Function: create_watch
+ * 
+ * Description: Creates an empty watch
+ *
+ * Input:
+ *   hProc - the process to watch
+ *   type - the type of the watched values
+ *
+ * Output:
+ *   The watch, or NULL if out of memory
+ */
+WATCH* create_watch (PROC_HANDLE hProc, VALUE_TYPE type)
+{
+    WATCH *w = calloc (1, sizeof(WATCH));
+
+    if (!w) return NULL;
+    w->hProc = hProc;
+    w->type = type;
+    w->data_size = value_types[type].size;
+    w->plan = create_read_plan (hProc, READ_GAP);
+    if (!w->plan)
+    {
+        free (w);
+        return NULL;
+    }
+
+    return w;
+}
+
+/**
+ * Function: free_watch
+ * 
+ * Description: Frees a watch
+ */
+void free_watch (WATCH *w)
+{
+    if (w)
+    {
+        free_read_plan (w->plan);
+        free (w->previous);
+        free (w->run_read);
+        free (w);
+    }
+}
+
+/**
+ * Function: watch_add
+ * 
+ * Description: Adds an address to a watch that has not been run yet
+ *
+ * Output:
+ *   TRUE on success, FALSE if out of memory
+ */
+BOOL watch_add (WATCH *w, unsigned char *addr)
+{
+    if (read_plan_add (w->plan, addr, w->data_size) < 0) return FALSE;
+    w->count++;
+    return TRUE;
+}
+
+/**
+ * Function: watch_add_scan
+ * 
+ * Description: Adds every match of a scan to a watch
+ *
+ * Output:
+ *   TRUE on success, FALSE if out of memory
+ */
+BOOL watch_add_scan (WATCH *w, SCAN *scan)
+{
+    size_t b, i;
+
+    for (b = 0; b < scan->count; b++)
+    {
+        MEMBLOCK *mb = &scan->blocks[b];
+
+        if (mb->matchlist)
+        {
+            for (i = 0; i < mb->matches; i++)
+            {
+                if (!watch_add (w, mb->addr + mb->matchlist[i].offset)) return FALSE;
+            }
+            continue;
+        }
+
+        for (i = 0; i < candidate_count (mb->size, mb->data_size, mb->stride); i++)
+        {
+            if (IS_IN_SEARCH(mb,i) && !watch_add (w, mb->addr + i * mb->stride)) return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/**
+ * Function: prepare_watch
+ * 
+ * Description: Lays out the runs of a watch's read plan and takes the first values
+ *
+ * Output:
+ *   TRUE on success, FALSE if out of memory
+ */
+static BOOL prepare_watch (WATCH *w)
+{
+    READ_PLAN *plan = w->plan;
+    unsigned int r;
+
+    // also sorts plan->order, which poll_watch relies on
+    execute_read_plan (plan);
+    if (plan->count && !plan->buffer) return FALSE;
+
+    w->previous = malloc (plan->buffer_size ? plan->buffer_size : 1);
+    w->run_read = calloc (plan->nruns ? plan->nruns : 1, sizeof(BOOL));
+    if (!w->previous || !w->run_read) return FALSE;
+
+    for (r = 0; r < plan->nruns; r++)
+    {
+        READ_RUN *run = &plan->runs[r];
+
+        // a run that failed as a whole may still have had some of its addresses read one by one; they start from the next poll
+        w->run_read[r] = run->ok;
+        if (run->ok) memcpy (w->previous + (run->dest - plan->buffer), run->dest, run->size);
+    }
+
+    return TRUE;
+}
+
+/**
+ * Function: poll_watch
+ * 
+ * Description: Reads every address of a watch once and writes the changes
+ *
+ * Input:
+ *   *w - the watch (prepared with prepare_watch)
+ *   t_us - time stamp of the changes
+ *   *out - where the changes are written
+ *   *stats - receives the read counts
+ *
+ * Output:
+ *   The number of changes
+ */
+static unsigned int poll_watch (WATCH *w, unsigned long long t_us, FILE *out, WATCH_STATS *stats)
+{
+    READ_PLAN *plan = w->plan;
+    unsigned int changes = 0;
+    unsigned int first = 0, r;
+
+    stats->reads.syscalls += read_memory_runs (plan->hProc, plan->runs, plan->nruns);
+
+    for (r = 0; r < plan->nruns; first = plan->run_last[r], r++)
+    {
+        READ_RUN *run = &plan->runs[r];
+        unsigned char *prev = w->previous + (run->dest - plan->buffer);
+        unsigned int last = plan->run_last[r];
+        unsigned int k = first; //first address that may overlap the chunk
+        unsigned int reported = first; //addresses before this one were already compared in an earlier chunk
+        size_t c;
+
+        if (!run->ok) continue;
+        stats->reads.bytes_read += run->size;
+        if (!w->run_read[r])
+        {
+            memcpy (prev, run->dest, run->size);
+            w->run_read[r] = TRUE;
+            continue;
+        }
+
+        for (c = 0; c < run->size; c += WATCH_CHUNK)
+        {
+            size_t n = (run->size - c < WATCH_CHUNK) ? run->size - c : WATCH_CHUNK;
+            unsigned int j;
+
+            if (memcmp (run->dest + c, prev + c, n) == 0) continue;
+
+            // the addresses are sorted, so the ones overlapping this chunk follow the ones before it
+            while (k < last && (size_t)(plan->requests[plan->order[k].index].addr - run->addr) + w->data_size <= c) k++;
+            if (reported < k) reported = k;
+            for (j = reported; j < last; j++)
+            {
+                size_t offset = plan->requests[plan->order[j].index].addr - run->addr;
+
+                if (offset >= c + n) break;
+                if (memcmp (run->dest + offset, prev + offset, w->data_size) != 0)
+                {
+                    char text[64];
+
+                    format_value (w->type, run->dest + offset, text, sizeof(text));
+                    fprintf (out, "%llu 0x%08llx %s\n", t_us, (unsigned long long)(uintptr_t)plan->requests[plan->order[j].index].addr, text);
+                    changes++;
+                }
+            }
+            reported = j;
+            memcpy (prev + c, run->dest + c, n);
+        }
+    }
+
+    return changes;
+}
+
+BOOL run_watch (WATCH *w, unsigned int rate, double seconds, FILE *out, WATCH_STATS *stats)
+{
+    unsigned long long period = 1000000000ull / (rate ? rate : 1);
+    unsigned long long start, end, deadline, last = 0;
+
+    memset (stats, 0, sizeof(WATCH_STATS));
+    if (!w->previous && !prepare_watch (w)) return FALSE;
+
+    start = clock_ns ();
+    end = start + (unsigned long long)(seconds * 1e9);
+    for (deadline = start; deadline < end; deadline += period)
+    {
+        unsigned long long woke, done;
+
+        sleep_until (deadline);
+        woke = clock_ns ();
+
+        // drop the polls that are already overdue rather than running them back to back
+        if (woke - deadline >= period)
+        {
+            unsigned long long behind = (woke - deadline) / period;
+            stats->skipped += behind;
+            deadline += behind * period;
+        }
+
+        stats->events += poll_watch (w, (woke - start) / 1000, out, stats);
+        done = clock_ns ();
+
+        stats->polls++;
+        stats->busy_ns += done - woke;
+        if (done - woke > stats->max_poll_ns) stats->max_poll_ns = done - woke;
+        stats->late_ns += woke - deadline;
+        if (woke - deadline > stats->max_late_ns) stats->max_late_ns = woke - deadline;
+        if (last)
+        {
+            stats->jitter_ns += (woke - last > period) ? woke - last - period : period - (woke - last);
+        }
+        last = woke;
+    }
+    fflush (out);
+    stats->elapsed_ns = clock_ns () - start;
+
+    return TRUE;
+}
+
+/*
+ * Freezing values
+ *
+ * A freeze table holds addresses whose values are kept constant. A thread of its own passes over the table FREEZE_RATE
+ * times a second (or at the rate given to create_freeze_table): it reads every frozen address through one read plan,
+ * and writes back, in one batch, only the values that differ, so a table of thousands of values the target leaves
+ * alone costs one or two reads per pass. A value that had been applied but is found changed again means the target
+ * wrote to it; those are counted per entry as fights. The UI and the API change the table under its lock, and the
+ * read plan is rebuilt at the next pass.
+ */
+
+#define FREEZE_RATE 2000 //passes per second, so a value the target overwrites is restored within half a millisecond
+#define FREEZE_IDLE_NS 10000000ull //time between passes while the table is empty or none of it can be read
+
+typedef struct
+{
+    unsigned char *addr;
+    VALUE_TYPE type;
+    TYPED_VALUE value; //the value it is frozen at
+    BOOL applied; //the value has been seen or written at least once
+    unsigned long long fights; //times the target changed it after it was applied
+} FREEZE_ENTRY;
+
+typedef struct
+{
+    unsigned long long passes;
+    unsigned long long writes; //values written back
+    unsigned long long fights; //values the target changed after they were applied
+    unsigned long long failures; //values that could not be read or written
+    unsigned long long busy_ns; //time spent in passes
+    unsigned long long max_pass_ns; //longest pass
+    READ_STATS reads;
+} FREEZE_STATS;
+
+typedef struct
+{
+    PROC_HANDLE hProc;
+    unsigned long long period; //nanoseconds between passes
+    LOCK lock; //guards everything below
+    FREEZE_ENTRY *entries; //sorted by address
+    unsigned int count;
+    unsigned int capacity;
+    BOOL changed; //entries were added or removed since the read plan was built
+    BOOL stop;
+    FREEZE_STATS stats;
+    READ_PLAN *plan; //one request per entry, in entry order; only used by the thread
+    READ_RUN *writes; //one per entry; only used by the thread
+    unsigned int *write_entry; //entry of every write; only used by the thread
+    THREAD thread;
+} FREEZE_TABLE;
+
+/**
+ * Function: freeze_pass
+ * 
+ * Description: Reads every frozen value once and writes back the ones that differ; called with the table locked
+ *
+ * Output:
+ *   The number of values that could be read
+ */
+static unsigned int freeze_pass (FREEZE_TABLE *t)
+{
+    READ_PLAN *plan = t->plan;
+    unsigned int nwrites = 0;
+    unsigned int nread;
+    unsigned int i;
+
+    if (t->changed)
+    {
+        READ_RUN *writes = realloc (t->writes, (t->count ? t->count : 1) * sizeof(READ_RUN));
+        unsigned int *write_entry;
+
+        if (!writes) return 0;
+        t->writes = writes;
+        write_entry = realloc (t->write_entry, (t->count ? t->count : 1) * sizeof(unsigned int));
+        if (!write_entry) return 0;
+        t->write_entry = write_entry;
+        reset_read_plan (plan, t->hProc);
+        for (i = 0; i < t->count; i++)
+        {
+            if (read_plan_add (plan, t->entries[i].addr, value_types[t->entries[i].type].size) < 0) return 0;
+        }
+        t->changed = FALSE;
+    }
+
+    nread = execute_read_plan (plan);
+    for (i = 0; i < t->count; i++)
+    {
+        FREEZE_ENTRY *e = &t->entries[i];
+        int size = value_types[e->type].size;
+        const unsigned char *data = plan->requests[i].data;
+
+        // a value that cannot be read is not written either, e.g. after the memory was freed
+        if (!data)
+        {
+            t->stats.failures++;
+            continue;
+        }
+        if (memcmp (data, &e->value, size) == 0)
+        {
+            e->applied = TRUE;
+            continue;
+        }
+        if (e->applied)
+        {
+            e->fights++;
+            t->stats.fights++;
+        }
+
+        t->writes[nwrites].addr = e->addr;
+        t->writes[nwrites].size = size;
+        t->writes[nwrites].dest = (unsigned char*)&e->value;
+        t->write_entry[nwrites] = i;
+        nwrites++;
+    }
+
+    if (nwrites)
+    {
+        write_memory_runs (t->hProc, t->writes, nwrites);
+    }
+
+    for (i = 0; i < nwrites; i++)
+    {
+        if (t->writes[i].ok)
+        {
+            t->entries[t->write_entry[i]].applied = TRUE;
+            t->stats.writes++;
+        }
+        else
+        {
+            t->stats.failures++;
+        }
+    }
+
+    return nread;
+}
+
+/**
+ * Function: freeze_thread
+ * 
+ * Description: The thread of a freeze table; passes over the table at its rate until free_freeze_table stops it
+ *
+ * Input:
+ *   param - the FREEZE_TABLE
+ */
+static THREAD_PROC (freeze_thread, param)
+{
+    FREEZE_TABLE *t = param;
+    unsigned long long deadline = clock_ns ();
+
+    while (1)
+    {
+        unsigned long long start, took;
+        BOOL idle;
+
+        lock_enter (&t->lock);
+        if (t->stop)
+        {
+            lock_leave (&t->lock);
+            break;
+        }
+        idle = t->count == 0;
+        start = clock_ns ();
+        if (!idle)
+        {
+            // nothing could be read (the process has probably exited): slow down until that changes
+            idle = freeze_pass (t) == 0;
+            took = clock_ns () - start;
+            t->stats.passes++;
+            t->stats.busy_ns += took;
+            if (took > t->stats.max_pass_ns) t->stats.max_pass_ns = took;
+            t->stats.reads = t->plan->stats;
+        }
+        lock_leave (&t->lock);
+
+        // keep to the rate, but do not try to catch up on passes that were missed
+        deadline += idle ? FREEZE_IDLE_NS : t->period;
+        if (deadline < start) deadline = start;
+        sleep_until (deadline);
+    }
+
+    return THREAD_RETURN;
+}
+
+/**
+ * Function: create_freeze_table
+ * 
+ * Description: Creates an empty freeze table and starts its thread
+ *
+ * Input:
+ *   hProc - the process the values are in
+ *   rate - passes per second (0 = FREEZE_RATE)
+ *
+ * Output:
+ *   The freeze table, or NULL on failure
+ */
+FREEZE_TABLE* create_freeze_table (PROC_HANDLE hProc, unsigned int rate)
+{
+    FREEZE_TABLE *t = calloc (1, sizeof(FREEZE_TABLE));
+
+    if (!t) return NULL;
+    t->hProc = hProc;
+    t->period = 1000000000ull / (rate ? rate : FREEZE_RATE);
+    t->plan = create_read_plan (hProc, READ_GAP);
+    if (!t->plan)
+    {
+        free (t);
+        return NULL;
+    }
+
+    lock_init (&t->lock);
+    if (!thread_start (&t->thread, freeze_thread, t))
+    {
+        lock_free (&t->lock);
+        free_read_plan (t->plan);
+        free (t);
+        return NULL;
+    }
+
+    return t;
+}
+
+/**
+ * Function: free_freeze_table
+ * 
+ * Description: Stops the thread of a freeze table and frees it; the values are left as they are
+ */
+void free_freeze_table (FREEZE_TABLE *t)
+{
+    if (!t) return;
+
+    lock_enter (&t->lock);
+    t->stop = TRUE;
+    lock_leave (&t->lock);
+    thread_join (t->thread);
+
+    lock_free (&t->lock);
+    free_read_plan (t->plan);
+    free (t->writes);
+    free (t->write_entry);
+    free (t->entries);
+    free (t);
+}
+
+/**
+ * Function: freeze_value
+ * 
+ * Description: Freezes an address at a value, or changes the value of an address that is already frozen
+ *
+ * Input:
+ *   *t - the freeze table
+ *   addr - the address
+ *   type - the type of the value
+ *   *value - the value
+ *
+ * Output:
+ *   TRUE on success, FALSE if out of memory
+ */
+BOOL freeze_value (FREEZE_TABLE *t, unsigned char *addr, VALUE_TYPE type, const TYPED_VALUE *value)
+{
+    unsigned int lo = 0, hi, i;
+    FREEZE_ENTRY *e;
+
+    lock_enter (&t->lock);
+
+    // first entry at or after addr; addresses are usually added in order, so try the end first
+    hi = t->count;
+    if (t->count && t->entries[t->count - 1].addr < addr) lo = t->count;
+    while (lo < hi)
+    {
+        unsigned int mid = lo + (hi - lo) / 2;
+        if (t->entries[mid].addr < addr) lo = mid + 1;
+        else hi = mid;
+    }
+    i = lo;
+
+    if (i == t->count || t->entries[i].addr != addr)
+    {
+        if (t->count == t->capacity)
+        {
+            unsigned int capacity = t->capacity ? t->capacity * 2 : 64;
+            FREEZE_ENTRY *entries = realloc (t->entries, capacity * sizeof(FREEZE_ENTRY));
+
+            if (!entries)
+            {
+                lock_leave (&t->lock);
+                return FALSE;
+            }
+            t->entries = entries;
+            t->capacity = capacity;
+        }
+        memmove (&t->entries[i + 1], &t->entries[i], (t->count - i) * sizeof(FREEZE_ENTRY));
+        t->count++;
+        t->entries[i].addr = addr;
+        t->entries[i].fights = 0;
+        t->changed = TRUE;
+    }
+    else if (t->entries[i].type != type)
+    {
+        t->changed = TRUE;
+    }
+
+    e = &t->entries[i];
+    e->type = type;
+    memset (&e->value, 0, sizeof(e->value));
+    memcpy (&e->value, value, value_types[type].size);
+    e->applied = FALSE;
+    lock_leave (&t->lock);
+
+    return TRUE;
+}
+
+/**
+ * Function: unfreeze_value
+ * 
+ * Description: Removes an address from a freeze table (0 removes all of them)
+ *
+ * Output:
+ *   The number of entries removed
+ */
+unsigned int unfreeze_value (FREEZE_TABLE *t, unsigned char *addr)
+{
+    unsigned int i, kept = 0, removed;
+
+    lock_enter (&t->lock);
+    for (i = 0; i < t->count; i++)
+    {
+        if (addr && t->entries[i].addr != addr) t->entries[kept++] = t->entries[i];
+    }
+    removed = t->count - kept;
+    t->count = kept;
+    if (removed) t->changed = TRUE;
+    lock_leave (&t->lock);
+
+    return removed;
+}
+
+
+/*
+ * Pointer scans
+ *
+ * The addresses update_scan finds change every time the target runs, but the data they belong to can usually be reached
+ * from a module through the same chain of pointers, e.g. [[game.exe+0x1d2a8]+0x10]+0x8. A pointer scan finds such
+ * chains for an address in two steps:
+ *
+ *   - build_pointer_map reads every writable region once, with the scan threads, and keeps every aligned pointer-sized
+ *     value that points into writable memory as a (value, address) pair. Each thread sorts what it finds by value into
+ *     runs of PTRMAP_RUN_ENTRIES pointers and the runs are merged at the end. Given a file, the runs go to disk, and the
+ *     merged map is written to the file and mapped, so memory use does not grow with the target and the map can be
+ *     searched again later with open_pointer_map.
+ *   - pointer_scan walks back from the address breadth first. The pointers to anything up to max_offset bytes below an
+ *     address are one binary search away in the map, and every pointer stored inside a module ends a path. Each level is
+ *     shared out between the scan threads. An address is only followed from the first level it is reached at, which
+ *     keeps the search from going round in circles; max_depth, max_paths and max_nodes bound it further.
+ *
+ * Most paths found lead through data that only happens to point the right way. Scanning again after the target was
+ * restarted and keeping the paths found both times (intersect_pointer_paths) leaves the ones worth using.
+ */
+
+#define PTRMAP_MAGIC "MSCANPTR"
+#define PTRMAP_VERSION 1
+#define PTRMAP_CHUNK_SIZE (1024*1024) //bytes a thread reads at a time
+#define PTRMAP_RUN_ENTRIES (1024*1024) //pointers a thread collects before sorting them into a run
+#define PTRMAP_MERGE_BUFFER 4096 //pointers written to the map file at a time
+#define PTRSCAN_MAX_DEPTH 8
+#define PTRSCAN_DEPTH 4 //defaults of ui_pointer_scan
+#define PTRSCAN_OFFSET 0x1000
+#define PTRSCAN_PATHS 100000
+#define PTRSCAN_NODES 10000000
+#define PTRSCAN_BATCH 256 //addresses of a level a thread takes at a time
+#define PTRSCAN_PRINT_LIMIT 32 //paths ui_pointer_scan prints
+
+// A pointer in the target: value is stored at addr
+typedef struct
+{
+    unsigned long long value;
+    unsigned long long addr;
+} PTR_ENTRY;
+
+typedef struct
+{
+    char magic[8]; //PTRMAP_MAGIC
+    unsigned int version; //PTRMAP_VERSION
+    unsigned int pid; //process the map was built from
+    unsigned long long count; //pointers, from the first page boundary after the header
+    unsigned long long module_offset; //file offset of the PTRMAP_MODULE table
+    unsigned int module_count;
+    unsigned int pointer_size;
+} PTRMAP_HEADER;
+
+typedef struct
+{
+    unsigned long long base;
+    unsigned long long size;
+    char name[64];
+} PTRMAP_MODULE;
+
+typedef struct
+{
+    PTR_ENTRY *entries; //sorted by value, then address; read-only if mapped
+    unsigned long long count;
+    MODULE *modules; //in address order
+    int nmodules;
+    unsigned int pid;
+    BOOL mapped; //entries are in map
+    MAPPED_FILE map;
+} PTR_MAP;
+
+typedef struct
+{
+    unsigned long long start;
+    unsigned long long end;
+} PTR_RANGE;
+
+// A sorted run of pointers, in memory or in the spill file of build_pointer_map
+typedef struct
+{
+    PTR_ENTRY *entries; //read-only if it is in the spill file
+    unsigned long long first; //index of its first pointer in the spill file
+    unsigned long long count;
+    unsigned long long next; //next pointer to merge
+} PTR_RUN;
+
+typedef struct
+{
+    PROC_HANDLE hProc;
+    REGION *items; //PTRMAP_CHUNK_SIZE or smaller parts of the writable regions
+    size_t nitems;
+    size_t next; //next item to take
+    PTR_RANGE *ranges; //writable memory, in address order, adjacent regions merged
+    int nranges;
+    PTR_RUN *runs;
+    int nruns;
+    int run_capacity;
+    FILE *spill; //file the runs are written to, or NULL to keep them in memory
+    unsigned long long spilled; //pointers written to spill
+    unsigned long long bytes_read;
+    BOOL failed; //out of memory or disk
+    LOCK lock; //guards everything from next on
+} PTRMAP_JOB;
+
+// A pointer path: follow the pointer at the module's base + base_offset, add offsets[0], follow the pointer there, ...
+typedef struct
+{
+    int module; //index into the modules of the POINTER_PATHS
+    int depth; //number of offsets, i.e. of pointers followed
+    unsigned long long base_offset;
+    unsigned int offsets[PTRSCAN_MAX_DEPTH];
+} POINTER_PATH;
+
+typedef struct
+{
+    POINTER_PATH *paths;
+    size_t count;
+    size_t capacity;
+    MODULE *modules;
+    int nmodules;
+} POINTER_PATHS;
+
+typedef struct
+{
+    int max_depth; //most pointers in a path, up to PTRSCAN_MAX_DEPTH
+    unsigned int max_offset; //largest offset added after following a pointer
+    size_t max_paths; //the scan stops once it has found this many paths
+    size_t max_nodes; //addresses the scan may follow in all
+} PTRSCAN_PARAMS;
+
+// An address the scan reached: the address of a pointer (or the target, for the first level)
+typedef struct
+{
+    unsigned long long addr;
+    unsigned int offset; //added to the value of the pointer to get to the parent
+    unsigned int parent; //index of the parent in the level before
+} PTR_NODE;
+
+typedef struct
+{
+    PTR_NODE *nodes;
+    size_t count;
+    size_t capacity;
+} PTR_NODES;
+
+typedef struct
+{
+    const PTR_MAP *map;
+    const PTR_NODE *level; //the addresses to find pointers to
+    size_t nlevel;
+    unsigned int max_offset;
+    size_t next; //next address of the level to take
+    PTR_NODES statics; //pointers found inside modules, parent being the index in level
+    PTR_NODES others; //all other pointers found
+    BOOL failed;
+    LOCK lock; //guards everything from next on
+} PTRSCAN_JOB;
+
+static int compare_ptr_entries (const void *a, const void *b)
+{
+    const PTR_ENTRY *x = a;
+    const PTR_ENTRY *y = b;
+
+    if (x->value != y->value) return (x->value > y->value) ? 1 : -1;
+    return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+/**
+ * Function: in_ptr_ranges
+ * 
+ * Description: Tests if a value points into one of a sorted list of ranges
+ *
+ * Input:
+ *   *hint - the range found last time, tried first since pointers next to each other tend to point to the same region
+ */
+static BOOL in_ptr_ranges (const PTR_RANGE *ranges, int n, unsigned long long value, int *hint)
+{
+    int lo = 0, hi = n - 1;
+
+    if (value >= ranges[*hint].start && value < ranges[*hint].end) return TRUE;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+
+        if (value < ranges[mid].start) hi = mid - 1;
+        else if (value >= ranges[mid].end) lo = mid + 1;
+        else
+        {
+            *hint = mid;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ * Function: flush_ptr_run
+ * 
+ * Description: Sorts the pointers a thread collected and adds them to the job as a run
+ *
+ * Input:
+ *   *job - the map being built
+ *   *found - the pointers; the job keeps the buffer if the runs stay in memory
+ *   count - the number of pointers
+ *   more - the thread has more to collect
+ *
+ * Output:
+ *   The buffer to collect the next pointers in (NULL if more is FALSE, or on failure)
+ */
+static PTR_ENTRY* flush_ptr_run (PTRMAP_JOB *job, PTR_ENTRY *found, size_t count, BOOL more)
+{
+    PTR_RUN *run = NULL;
+
+    qsort (found, count, sizeof(PTR_ENTRY), compare_ptr_entries);
+
+    lock_enter (&job->lock);
+    if (job->nruns == job->run_capacity)
+    {
+        PTR_RUN *grown = realloc (job->runs, (job->run_capacity ? job->run_capacity * 2 : 64) * sizeof(PTR_RUN));
+        if (grown)
+        {
+            job->runs = grown;
+            job->run_capacity = job->run_capacity ? job->run_capacity * 2 : 64;
+        }
+    }
+    if (job->nruns < job->run_capacity)
+    {
+        run = &job->runs[job->nruns];
+        run->entries = NULL;
+        run->first = job->spilled;
+        run->count = count;
+        if (job->spill)
+        {
+            if (fwrite (found, sizeof(PTR_ENTRY), count, job->spill) != count) run = NULL;
+            job->spilled += count;
+        }
+        else
+        {
+            run->entries = found;
+        }
+    }
+    if (run) job->nruns++;
+    else job->failed = TRUE;
+    lock_leave (&job->lock);
+
+    // a run kept in memory owns the buffer now
+    if (run && run->entries)
+    {
+        found = more ? malloc (PTRMAP_RUN_ENTRIES * sizeof(PTR_ENTRY)) : NULL;
+        if (more && !found) job->failed = TRUE;
+        return found;
+    }
+    if (!run || !more)
+    {
+        free (found);
+        return NULL;
+    }
+    return found;
+}
+
+/**
+ * Function: ptrmap_worker
+ * 
+ * Description: Thread function --- Reads items of a PTRMAP_JOB and collects the pointers into writable memory in them
+ *              until there are no items left
+ *
+ * Input:
+ *   param - a pointer to the PTRMAP_JOB
+ */
+static THREAD_PROC (ptrmap_worker, param)
+{
+    PTRMAP_JOB *job = param;
+    unsigned char *buf = malloc (PTRMAP_CHUNK_SIZE);
+    PTR_ENTRY *found = malloc (PTRMAP_RUN_ENTRIES * sizeof(PTR_ENTRY));
+    unsigned long long lo = job->ranges[0].start;
+    unsigned long long span = job->ranges[job->nranges-1].end - lo;
+    size_t nfound = 0;
+    int hint = 0;
+
+    while (buf && found)
+    {
+        const uintptr_t *words = (const uintptr_t*)buf;
+        REGION *item;
+        size_t got, i;
+
+        lock_enter (&job->lock);
+        item = (job->next < job->nitems && !job->failed) ? &job->items[job->next++] : NULL;
+        lock_leave (&job->lock);
+        if (!item) break;
+
+        got = read_memory (job->hProc, item->base, buf, item->size);
+        for (i = 0; i < got / sizeof(uintptr_t); i++)
+        {
+            unsigned long long value = words[i];
+
+            // most words are small numbers or zero, which one comparison rules out
+            if (value - lo >= span || !in_ptr_ranges (job->ranges, job->nranges, value, &hint)) continue;
+
+            found[nfound].value = value;
+            found[nfound].addr = (uintptr_t)item->base + i * sizeof(uintptr_t);
+            if (++nfound == PTRMAP_RUN_ENTRIES)
+            {
+                found = flush_ptr_run (job, found, nfound, TRUE);
+                nfound = 0;
+                if (!found) break;
+            }
+        }
+
+        lock_enter (&job->lock);
+        job->bytes_read += got;
+        lock_leave (&job->lock);
+    }
+
+    if (!buf || !found)
+    {
+        lock_enter (&job->lock);
+        job->failed = TRUE;
+        lock_leave (&job->lock);
+    }
+    if (found && nfound)
+    {
+        found = flush_ptr_run (job, found, nfound, FALSE);
+    }
+    free (found);
+    free (buf);
+
+    return THREAD_RETURN;
+}
+
+/**
+ * Function: sift_ptr_runs
+ * 
+ * Description: Moves a run down a heap of runs ordered by their next pointer
+ */
+static void sift_ptr_runs (int *heap, int n, int i, const PTR_RUN *runs)
+{
+    while (1)
+    {
+        int smallest = i;
+        int c;
+
+        for (c = 2 * i + 1; c <= 2 * i + 2 && c < n; c++)
+        {
+            const PTR_RUN *x = &runs[heap[c]];
+            const PTR_RUN *y = &runs[heap[smallest]];
+
+            if (compare_ptr_entries (&x->entries[x->next], &y->entries[y->next]) < 0) smallest = c;
+        }
+        if (smallest == i) return;
+
+        c = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = c;
+        i = smallest;
+    }
+}
+
+/**
+ * Function: merge_ptr_runs
+ * 
+ * Description: Merges sorted runs of pointers into one sorted array or file
+ *
+ * Input:
+ *   *runs - the runs, with their entries set
+ *   nruns - the number of runs
+ *   *out - where to merge them to, or NULL to write them to f
+ *   *f - the file to write them to if out is NULL
+ *
+ * Output:
+ *   TRUE on success
+ */
+static BOOL merge_ptr_runs (PTR_RUN *runs, int nruns, PTR_ENTRY *out, FILE *f)
+{
+    PTR_ENTRY buffer[PTRMAP_MERGE_BUFFER];
+    int *heap = malloc ((nruns ? nruns : 1) * sizeof(int));
+    size_t nbuf = 0;
+    BOOL ok = TRUE;
+    int n = 0, r;
+
+    if (!heap) return FALSE;
+
+    for (r = 0; r < nruns; r++)
+    {
+        runs[r].next = 0;
+        if (runs[r].count) heap[n++] = r;
+    }
+    for (r = n / 2 - 1; r >= 0; r--)
+    {
+        sift_ptr_runs (heap, n, r, runs);
+    }
+
+    while (n > 0 && ok)
+    {
+        PTR_RUN *top = &runs[heap[0]];
+        const PTR_ENTRY *e = &top->entries[top->next++];
+
+        if (out)
+        {
+            *out++ = *e;
+        }
+        else
+        {
+            buffer[nbuf++] = *e;
+            if (nbuf == PTRMAP_MERGE_BUFFER)
+            {
+                ok = fwrite (buffer, sizeof(PTR_ENTRY), nbuf, f) == nbuf;
+                nbuf = 0;
+            }
+        }
+
+        if (top->next == top->count) heap[0] = heap[--n];
+        sift_ptr_runs (heap, n, 0, runs);
+    }
+
+    if (ok && nbuf) ok = fwrite (buffer, sizeof(PTR_ENTRY), nbuf, f) == nbuf;
+    free (heap);
+
+    return ok;
+}
+
+/**
+ * Function: free_pointer_map
+ * 
+ * Description: Frees a pointer map, unmapping its file if it has one
+ */
+void free_pointer_map (PTR_MAP *map)
+{
+    if (!map) return;
+
+    if (map->mapped) unmap_file (&map->map);
+    else free (map->entries);
+    free (map->modules);
+    free (map);
+}
+
+/**
+ * Function: open_pointer_map
+ * 
+ * Description: Maps a pointer map written by build_pointer_map
+ *
+ * Input:
+ *   *path - the map file
+ *
+ * Output:
+ *   The pointer map, or NULL if the file is missing or not a pointer map of this build
+ */
+PTR_MAP* open_pointer_map (const char *path)
+{
+    PTR_MAP *map = calloc (1, sizeof(PTR_MAP));
+    PTRMAP_HEADER *header;
+    PTRMAP_MODULE *table;
+    int i;
+
+    if (!map) return NULL;
+    if (!map_file (path, &map->map, FALSE))
+    {
+        free (map);
+        return NULL;
+    }
+    map->mapped = TRUE;
+
+    header = (PTRMAP_HEADER*)map->map.base;
+    if (map->map.size < PAGE_SIZE || memcmp (header->magic, PTRMAP_MAGIC, 8) != 0 || header->version != PTRMAP_VERSION ||
+        header->pointer_size != sizeof(uintptr_t) || header->count > (map->map.size - PAGE_SIZE) / sizeof(PTR_ENTRY) ||
+        header->module_offset < PAGE_SIZE + header->count * sizeof(PTR_ENTRY) || header->module_offset > map->map.size ||
+        header->module_count > (map->map.size - header->module_offset) / sizeof(PTRMAP_MODULE))
+    {
+        free_pointer_map (map);
+        return NULL;
+    }
+
+    map->entries = (PTR_ENTRY*)(map->map.base + PAGE_SIZE);
+    map->count = header->count;
+    map->pid = header->pid;
+    map->modules = malloc ((header->module_count ? header->module_count : 1) * sizeof(MODULE));
+    if (!map->modules)
+    {
+        free_pointer_map (map);
+        return NULL;
+    }
+
+    table = (PTRMAP_MODULE*)(map->map.base + header->module_offset);
+    for (i = 0; i < (int)header->module_count; i++)
+    {
+        map->modules[i].base = (unsigned char*)(uintptr_t)table[i].base;
+        map->modules[i].size = (size_t)table[i].size;
+        memcpy (map->modules[i].name, table[i].name, sizeof(map->modules[i].name));
+        map->modules[i].name[sizeof(map->modules[i].name) - 1] = 0;
+    }
+    map->nmodules = header->module_count;
+
+    return map;
+}
+
+/**
+ * Function: write_pointer_map
+ * 
+ * Description: Merges the runs of a finished PTRMAP_JOB into a map file
+ *
+ * Output:
+ *   TRUE on success
+ */
+static BOOL write_pointer_map (PTRMAP_JOB *job, const char *path, const MODULE *modules, int nmodules)
+{
+    PTRMAP_HEADER header;
+    PTRMAP_MODULE entry;
+    FILE *f = fopen (path, "wb");
+    BOOL ok;
+    int i;
+
+    if (!f) return FALSE;
+
+    memset (&header, 0, sizeof(header));
+    memcpy (header.magic, PTRMAP_MAGIC, 8);
+    header.version = PTRMAP_VERSION;
+    header.pid = process_id (job->hProc);
+    header.count = job->spilled;
+    header.module_offset = PAGE_SIZE + job->spilled * sizeof(PTR_ENTRY);
+    header.module_count = nmodules;
+    header.pointer_size = sizeof(uintptr_t);
+
+    ok = write_padded (f, &header, sizeof(header)) && merge_ptr_runs (job->runs, job->nruns, NULL, f);
+    for (i = 0; i < nmodules && ok; i++)
+    {
+        memset (&entry, 0, sizeof(entry));
+        entry.base = (uintptr_t)modules[i].base;
+        entry.size = modules[i].size;
+        memcpy (entry.name, modules[i].name, sizeof(entry.name));
+        ok = fwrite (&entry, sizeof(entry), 1, f) == 1;
+    }
+
+    return (fclose (f) == 0) && ok;
+}
+
+/**
+ * Function: build_pointer_map
+ * 
+ * Description: Finds every pointer into writable memory stored in writable memory of a process, using the scan threads
+ *
+ * Input:
+ *   hProc - the process
+ *   *path - a file to build the map in, so it does not have to fit in memory, or NULL to build it in memory
+ *   *bytes_read - receives the number of bytes read from the process
+ *   *options - options->threads is the number of threads to read with; NULL for the defaults
+ *
+ * Output:
+ *   The pointer map, or NULL on failure
+ */
+PTR_MAP* build_pointer_map (PROC_HANDLE hProc, const char *path, unsigned long long *bytes_read, const SCAN_OPTIONS *options)
+{
+    PTRMAP_JOB job;
+    PTR_MAP *map = NULL;
+    THREAD threads[MAX_SCAN_THREADS];
+    BOOL started[MAX_SCAN_THREADS];
+    MODULE *modules;
+    REGION *regions;
+    MAPPED_FILE spill_map;
+    char spill_path[1024];
+    int nregions, nmodules, r, t, nthreads;
+
+    memset (&job, 0, sizeof(job));
+    job.hProc = hProc;
+    *bytes_read = 0;
+
+    nregions = list_regions (hProc, &regions);
+    nmodules = list_modules (hProc, &modules);
+    job.ranges = malloc ((nregions ? nregions : 1) * sizeof(PTR_RANGE));
+    for (r = 0; r < nregions && job.ranges; r++)
+    {
+        if ((regions[r].protect & (REGION_READ | REGION_WRITE)) != (REGION_READ | REGION_WRITE)) continue;
+
+        if (job.nranges && job.ranges[job.nranges-1].end == (uintptr_t)regions[r].base)
+        {
+            job.ranges[job.nranges-1].end += regions[r].size;
+        }
+        else
+        {
+            job.ranges[job.nranges].start = (uintptr_t)regions[r].base;
+            job.ranges[job.nranges].end = (uintptr_t)regions[r].base + regions[r].size;
+            job.nranges++;
+        }
+        job.nitems += (regions[r].size + PTRMAP_CHUNK_SIZE - 1) / PTRMAP_CHUNK_SIZE;
+    }
+
+    job.items = malloc ((job.nitems ? job.nitems : 1) * sizeof(REGION));
+    if (!job.ranges || !job.items || job.nranges == 0)
+    {
+        free (job.ranges);
+        free (job.items);
+        free (regions);
+        free (modules);
+        return NULL;
+    }
+
+    job.nitems = 0;
+    for (r = 0; r < nregions; r++)
+    {
+        size_t start;
+
+        if ((regions[r].protect & (REGION_READ | REGION_WRITE)) != (REGION_READ | REGION_WRITE)) continue;
+        for (start = 0; start < regions[r].size; start += PTRMAP_CHUNK_SIZE)
+        {
+            REGION *item = &job.items[job.nitems++];
+            item->base = regions[r].base + start;
+            item->size = (regions[r].size - start > PTRMAP_CHUNK_SIZE) ? PTRMAP_CHUNK_SIZE : regions[r].size - start;
+            item->protect = regions[r].protect;
+        }
+    }
+    free (regions);
+
+    if (path)
+    {
+        snprintf (spill_path, sizeof(spill_path), "%s.runs", path);
+        job.spill = fopen (spill_path, "w+b");
+        job.failed = !job.spill;
+    }
+
+    nthreads = get_scan_thread_count (options ? options->threads : 0);
+    if ((size_t)nthreads > job.nitems) nthreads = (int)job.nitems;
+
+    // the calling thread is one of the workers
+    lock_init (&job.lock);
+    for (t = 1; t < nthreads; t++)
+    {
+        started[t] = !job.failed && thread_start (&threads[t], ptrmap_worker, &job);
+    }
+    if (!job.failed) ptrmap_worker (&job);
+    for (t = 1; t < nthreads; t++)
+    {
+        if (started[t]) thread_join (threads[t]);
+    }
+    lock_free (&job.lock);
+    *bytes_read = job.bytes_read;
+
+    if (job.spill)
+    {
+        // the spilled runs are merged from a read-only mapping of the spill file straight into the map file
+        BOOL ok = fclose (job.spill) == 0 && !job.failed;
+
+        if (ok && job.spilled && map_file (spill_path, &spill_map, FALSE))
+        {
+            for (r = 0; r < job.nruns; r++)
+            {
+                job.runs[r].entries = (PTR_ENTRY*)spill_map.base + job.runs[r].first;
+            }
+            ok = write_pointer_map (&job, path, modules, nmodules);
+            unmap_file (&spill_map);
+        }
+        else if (ok)
+        {
+            ok = job.spilled == 0 && write_pointer_map (&job, path, modules, nmodules);
+        }
+        remove (spill_path);
+
+        if (ok) map = open_pointer_map (path);
+    }
+    else if (!job.failed)
+    {
+        unsigned long long total = 0;
+
+        for (r = 0; r < job.nruns; r++)
+        {
+            total += job.runs[r].count;
+        }
+
+        map = calloc (1, sizeof(PTR_MAP));
+        if (map)
+        {
+            map->entries = malloc ((total ? total : 1) * sizeof(PTR_ENTRY));
+            map->count = total;
+            map->pid = process_id (hProc);
+            map->modules = modules;
+            map->nmodules = nmodules;
+            modules = NULL;
+            if (!map->entries || !merge_ptr_runs (job.runs, job.nruns, map->entries, NULL))
+            {
+                free_pointer_map (map);
+                map = NULL;
+            }
+        }
+    }
+
+    if (!job.spill)
+    {
+        for (r = 0; r < job.nruns; r++)
+        {
+            free (job.runs[r].entries);
+        }
+    }
+    free (job.runs);
+    free (job.items);
+    free (job.ranges);
+    free (modules);
+
+    return map;
+}
+
+/**
+ * Function: add_ptr_node
+ * 
+ * Description: Appends a node to a growable list of nodes
+ *
+ * Output:
+ *   TRUE on success
+ */
+static BOOL add_ptr_node (PTR_NODES *list, unsigned long long addr, unsigned int offset, unsigned int parent)
+{
+    if (list->count == list->capacity)
+    {
+        size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+        PTR_NODE *grown = realloc (list->nodes, capacity * sizeof(PTR_NODE));
+
+        if (!grown) return FALSE;
+        list->nodes = grown;
+        list->capacity = capacity;
+    }
+
+    list->nodes[list->count].addr = addr;
+    list->nodes[list->count].offset = offset;
+    list->nodes[list->count].parent = parent;
+    list->count++;
+    return TRUE;
+}
+
+/**
+ * Function: append_ptr_nodes
+ * 
+ * Description: Appends a list of nodes to another one
+ *
+ * Output:
+ *   TRUE on success
+ */
+static BOOL append_ptr_nodes (PTR_NODES *list, const PTR_NODES *more)
+{
+    size_t i;
+
+    for (i = 0; i < more->count; i++)
+    {
+        if (!add_ptr_node (list, more->nodes[i].addr, more->nodes[i].offset, more->nodes[i].parent)) return FALSE;
+    }
+
+    return TRUE;
+}
+
+static int compare_ptr_nodes (const void *a, const void *b)
+{
+    const PTR_NODE *x = a;
+    const PTR_NODE *y = b;
+
+    if (x->addr != y->addr) return (x->addr > y->addr) ? 1 : -1;
+    if (x->parent != y->parent) return (x->parent > y->parent) ? 1 : -1;
+    return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+/**
+ * Function: ptrscan_worker
+ * 
+ * Description: Thread function --- Finds the pointers to the addresses of a level of a pointer scan, a batch of
+ *              PTRSCAN_BATCH addresses at a time, until the level is done
+ *
+ * Input:
+ *   param - a pointer to the PTRSCAN_JOB
+ */
+static THREAD_PROC (ptrscan_worker, param)
+{
+    PTRSCAN_JOB *job = param;
+    const PTR_MAP *map = job->map;
+    PTR_NODES statics, others;
+    BOOL ok = TRUE;
+
+    memset (&statics, 0, sizeof(statics));
+    memset (&others, 0, sizeof(others));
+
+    while (ok)
+    {
+        size_t first, last, i;
+
+        lock_enter (&job->lock);
+        first = job->next;
+        last = (job->nlevel - first > PTRSCAN_BATCH) ? first + PTRSCAN_BATCH : job->nlevel;
+        job->next = last;
+        lock_leave (&job->lock);
+        if (first >= last) break;
+
+        statics.count = 0;
+        others.count = 0;
+        for (i = first; i < last && ok; i++)
+        {
+            unsigned long long addr = job->level[i].addr;
+            unsigned long long lowest = (addr > job->max_offset) ? addr - job->max_offset : 0;
+            unsigned long long lo = 0, hi = map->count;
+
+            // the first pointer to lowest or above
+            while (lo < hi)
+            {
+                unsigned long long mid = (lo + hi) / 2;
+
+                if (map->entries[mid].value < lowest) lo = mid + 1;
+                else hi = mid;
+            }
+
+            for (; lo < map->count && map->entries[lo].value <= addr && ok; lo++)
+            {
+                const PTR_ENTRY *e = &map->entries[lo];
+                PTR_NODES *list = (find_module (map->modules, map->nmodules, e->addr) >= 0) ? &statics : &others;
+
+                ok = add_ptr_node (list, e->addr, (unsigned int)(addr - e->value), (unsigned int)i);
+            }
+        }
+
+        lock_enter (&job->lock);
+        ok = ok && append_ptr_nodes (&job->statics, &statics) && append_ptr_nodes (&job->others, &others);
+        if (!ok) job->failed = TRUE;
+        lock_leave (&job->lock);
+    }
+
+    free (statics.nodes);
+    free (others.nodes);
+
+    return THREAD_RETURN;
+}
+
+/*
+ * Open addressing set of the addresses a pointer scan has reached, so that each is followed once
+ */
+typedef struct
+{
+    unsigned long long *slots; //0 is an empty slot; no pointer points to address 0
+    size_t capacity; //a power of 2
+    size_t count;
+} PTR_SET;
+
+/**
+ * Function: ptr_set_add
+ * 
+ * Description: Adds an address to a PTR_SET, growing it to keep it at most half full
+ *
+ * Output:
+ *   1 if the address was added, 0 if it was there already, -1 if out of memory
+ */
+static int ptr_set_add (PTR_SET *set, unsigned long long addr)
+{
+    size_t i;
+
+    if ((set->count + 1) * 2 > set->capacity)
+    {
+        PTR_SET grown;
+        size_t k;
+
+        grown.capacity = set->capacity ? set->capacity * 2 : 4096;
+        grown.count = 0;
+        grown.slots = calloc (grown.capacity, sizeof(unsigned long long));
+        if (!grown.slots) return -1;
+        for (k = 0; k < set->capacity; k++)
+        {
+            if (set->slots[k]) ptr_set_add (&grown, set->slots[k]);
+        }
+        free (set->slots);
+        *set = grown;
+    }
+
+    // Fibonacci hashing; pointers are 8-byte aligned, so their low bits tell little
+    i = (size_t)((addr * 0x9E3779B97F4A7C15ull) >> 20) & (set->capacity - 1);
+    while (set->slots[i])
+    {
+        if (set->slots[i] == addr) return 0;
+        i = (i + 1) & (set->capacity - 1);
+    }
+    set->slots[i] = addr;
+    set->count++;
+
+    return 1;
+}
+
+/**
+ * Function: free_pointer_paths
+ * 
+ * Description: Frees the paths and modules of a POINTER_PATHS and empties it
+ */
+void free_pointer_paths (POINTER_PATHS *paths)
+{
+    free (paths->paths);
+    free (paths->modules);
+    memset (paths, 0, sizeof(POINTER_PATHS));
+}
+
+/**
+ * Function: add_pointer_path
+ * 
+ * Description: Appends a copy of a path to a POINTER_PATHS
+ *
+ * Output:
+ *   TRUE on success
+ */
+static BOOL add_pointer_path (POINTER_PATHS *paths, const POINTER_PATH *path)
+{
+    if (paths->count == paths->capacity)
+    {
+        size_t capacity = paths->capacity ? paths->capacity * 2 : 256;
+        POINTER_PATH *grown = realloc (paths->paths, capacity * sizeof(POINTER_PATH));
+
+        if (!grown) return FALSE;
+        paths->paths = grown;
+        paths->capacity = capacity;
+    }
+
+    paths->paths[paths->count++] = *path;
+    return TRUE;
+}
+
+/**
+ * Function: pointer_scan
+ * 
+ * Description: Finds pointer paths from modules to an address, using the scan threads for every level
+ *
+ * Input:
+ *   *map - the pointer map of the process
+ *   target - the address to find paths to
+ *   *params - the bounds of the search
+ *   *options - options->threads is the number of threads to search with; NULL for the defaults
+ *   *out - receives the paths, shortest first, and a copy of the modules of the map
+ *
+ * Output:
+ *   The number of paths found
+ */
+size_t pointer_scan (const PTR_MAP *map, unsigned long long target, const PTRSCAN_PARAMS *params, const SCAN_OPTIONS *options,
+                     POINTER_PATHS *out)
+{
+    PTR_NODES levels[PTRSCAN_MAX_DEPTH];
+    THREAD threads[MAX_SCAN_THREADS];
+    BOOL started[MAX_SCAN_THREADS];
+    PTR_SET visited;
+    PTRSCAN_JOB job;
+    int max_depth = (params->max_depth < PTRSCAN_MAX_DEPTH) ? params->max_depth : PTRSCAN_MAX_DEPTH;
+    int depth, t, nthreads = get_scan_thread_count (options ? options->threads : 0);
+    BOOL ok;
+
+    memset (out, 0, sizeof(POINTER_PATHS));
+    memset (levels, 0, sizeof(levels));
+    memset (&visited, 0, sizeof(visited));
+
+    out->modules = malloc ((map->nmodules ? map->nmodules : 1) * sizeof(MODULE));
+    ok = out->modules && add_ptr_node (&levels[0], target, 0, 0) && ptr_set_add (&visited, target) >= 0;
+    if (out->modules) memcpy (out->modules, map->modules, map->nmodules * sizeof(MODULE));
+    out->nmodules = map->nmodules;
+
+    for (depth = 0; ok && depth < max_depth && levels[depth].count && out->count < params->max_paths; depth++)
+    {
+        size_t i;
+
+        memset (&job, 0, sizeof(job));
+        job.map = map;
+        job.level = levels[depth].nodes;
+        job.nlevel = levels[depth].count;
+        job.max_offset = params->max_offset;
+
+        // the calling thread is one of the workers
+        lock_init (&job.lock);
+        for (t = 1; t < nthreads && (size_t)t * PTRSCAN_BATCH < job.nlevel; t++)
+        {
+            started[t] = thread_start (&threads[t], ptrscan_worker, &job);
+        }
+        ptrscan_worker (&job);
+        while (--t > 0)
+        {
+            if (started[t]) thread_join (threads[t]);
+        }
+        lock_free (&job.lock);
+        ok = !job.failed;
+
+        // batches finish in any order; sorting keeps the results the same from one run to the next
+        qsort (job.statics.nodes, job.statics.count, sizeof(PTR_NODE), compare_ptr_nodes);
+        qsort (job.others.nodes, job.others.count, sizeof(PTR_NODE), compare_ptr_nodes);
+
+        for (i = 0; i < job.statics.count && ok && out->count < params->max_paths; i++)
+        {
+            const PTR_NODE *hit = &job.statics.nodes[i];
+            const PTR_NODE *node = &levels[depth].nodes[hit->parent];
+            POINTER_PATH path;
+            int k;
+
+            memset (&path, 0, sizeof(path));
+            path.module = find_module (map->modules, map->nmodules, hit->addr);
+            path.base_offset = hit->addr - (uintptr_t)map->modules[path.module].base;
+            path.depth = depth + 1;
+            path.offsets[0] = hit->offset;
+            for (k = depth; k > 0; k--)
+            {
+                path.offsets[depth - k + 1] = node->offset;
+                node = &levels[k-1].nodes[node->parent];
+            }
+            ok = add_pointer_path (out, &path);
+        }
+
+        for (i = 0; i < job.others.count && ok && depth + 1 < max_depth && visited.count < params->max_nodes; i++)
+        {
+            const PTR_NODE *n = &job.others.nodes[i];
+            int added = ptr_set_add (&visited, n->addr);
+
+            ok = added >= 0 && (added == 0 || add_ptr_node (&levels[depth+1], n->addr, n->offset, n->parent));
+        }
+
+        free (job.statics.nodes);
+        free (job.others.nodes);
+    }
+
+    for (depth = 0; depth < PTRSCAN_MAX_DEPTH; depth++)
+    {
+        free (levels[depth].nodes);
+    }
+    free (visited.slots);
+
+    return out->count;
+}
+
+/**
+ * Function: compare_pointer_paths
+ * 
+ * Description: Orders paths by module index, base offset, depth and offsets
+ */
+static int compare_pointer_paths (const void *a, const void *b)
+{
+    const POINTER_PATH *x = a;
+    const POINTER_PATH *y = b;
+    int k;
+
+    if (x->module != y->module) return (x->module > y->module) ? 1 : -1;
+    if (x->base_offset != y->base_offset) return (x->base_offset > y->base_offset) ? 1 : -1;
+    if (x->depth != y->depth) return (x->depth > y->depth) ? 1 : -1;
+    for (k = 0; k < x->depth; k++)
+    {
+        if (x->offsets[k] != y->offsets[k]) return (x->offsets[k] > y->offsets[k]) ? 1 : -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Function: intersect_pointer_paths
+ * 
+ * Description: Keeps only the paths that are also in another set, e.g. from a scan made after the target restarted.
+ *              Modules are matched by name, since their addresses change between runs.
+ *
+ * Input:
+ *   *paths - the paths to filter
+ *   *other - the paths to keep them if they are in
+ *
+ * Output:
+ *   The number of paths kept, or (size_t)-1 if out of memory (paths is left as it was)
+ */
+size_t intersect_pointer_paths (POINTER_PATHS *paths, const POINTER_PATHS *other)
+{
+    POINTER_PATH *sorted = malloc ((other->count ? other->count : 1) * sizeof(POINTER_PATH));
+    int *to_other = malloc ((paths->nmodules ? paths->nmodules : 1) * sizeof(int));
+    size_t kept = 0, i;
+    int m, o;
+
+    if (!sorted || !to_other)
+    {
+        free (sorted);
+        free (to_other);
+        return (size_t)-1;
+    }
+
+    memcpy (sorted, other->paths, other->count * sizeof(POINTER_PATH));
+    qsort (sorted, other->count, sizeof(POINTER_PATH), compare_pointer_paths);
+
+    for (m = 0; m < paths->nmodules; m++)
+    {
+        to_other[m] = -1;
+        for (o = 0; o < other->nmodules && to_other[m] < 0; o++)
+        {
+            if (strcmp (paths->modules[m].name, other->modules[o].name) == 0) to_other[m] = o;
+        }
+    }
+
+    for (i = 0; i < paths->count; i++)
+    {
+        POINTER_PATH key = paths->paths[i];
+
+        key.module = to_other[key.module];
+        if (key.module >= 0 && bsearch (&key, sorted, other->count, sizeof(POINTER_PATH), compare_pointer_paths))
+        {
+            paths->paths[kept++] = paths->paths[i];
+        }
+    }
+    paths->count = kept;
+
+    free (sorted);
+    free (to_other);
+
+    return kept;
+}
+
+/**
+ * Function: format_pointer_path
+ * 
+ * Description: Writes a path as text, e.g. "libgame.so+0x1d2a8 0x10 0x8": the module and offset of the first pointer,
+ *              then the offset added after following each pointer
+ */
+void format_pointer_path (const POINTER_PATHS *paths, size_t i, char *out, size_t out_size)
+{
+    const POINTER_PATH *p = &paths->paths[i];
+    size_t len;
+    int k;
+
+    len = snprintf (out, out_size, "%s+0x%llx", paths->modules[p->module].name, p->base_offset);
+    for (k = 0; k < p->depth && len < out_size; k++)
+    {
+        len += snprintf (out + len, out_size - len, " 0x%x", p->offsets[k]);
+    }
+}
+
+/**
+ * Function: save_pointer_paths
+ * 
+ * Description: Writes paths to a text file, one per line as format_pointer_path writes them
+ *
+ * Output:
+ *   TRUE on success
+ */
+BOOL save_pointer_paths (const POINTER_PATHS *paths, const char *path)
+{
+    FILE *f = fopen (path, "w");
+    char line[1024];
+    size_t i;
+
+    if (!f) return FALSE;
+
+    for (i = 0; i < paths->count; i++)
+    {
+        format_pointer_path (paths, i, line, sizeof(line));
+        fprintf (f, "%s\n", line);
+    }
+
+    return fclose (f) == 0;
+}
+
+/**
+ * Function: load_pointer_paths
+ * 
+ * Description: Reads paths saved with save_pointer_paths; the modules only get their names. Lines that are not paths
+ *              are skipped.
+ *
+ * Output:
+ *   TRUE on success
+ */
+BOOL load_pointer_paths (const char *path, POINTER_PATHS *paths)
+{
+    FILE *f = fopen (path, "r");
+    char line[1024];
+    BOOL ok = TRUE;
+
+    memset (paths, 0, sizeof(POINTER_PATHS));
+    if (!f) return FALSE;
+
+    while (ok && fgets (line, sizeof(line), f))
+    {
+        POINTER_PATH p;
+        char *plus = strstr (line, "+0x");
+        char *s;
+        int m;
+
+        if (!plus) continue;
+        *plus = 0;
+
+        memset (&p, 0, sizeof(p));
+        p.base_offset = strtoull (plus + 3, &s, 16);
+        while (p.depth < PTRSCAN_MAX_DEPTH && *s != '\n' && *s)
+        {
+            char *end;
+            unsigned long offset = strtoul (s, &end, 16);
+
+            if (end == s) break;
+            p.offsets[p.depth++] = (unsigned int)offset;
+            s = end;
+        }
+        if (p.depth == 0) continue;
+
+        // names are kept as long as MODULE has room for
+        if (strlen (line) >= sizeof(paths->modules[0].name)) line[sizeof(paths->modules[0].name) - 1] = 0;
+        for (m = 0; m < paths->nmodules && strcmp (paths->modules[m].name, line) != 0; m++);
+        if (m == paths->nmodules)
+        {
+            MODULE *grown = realloc (paths->modules, (m + 1) * sizeof(MODULE));
+
+            ok = grown != NULL;
+            if (!ok) break;
+            paths->modules = grown;
+            memset (&paths->modules[m], 0, sizeof(MODULE));
+            strcpy (paths->modules[m].name, line);
+            paths->nmodules++;
+        }
+        p.module = m;
+        ok = add_pointer_path (paths, &p);
+    }
+
+    fclose (f);
+    if (!ok) free_pointer_paths (paths);
+
+    return ok;
+}
+
+/*
+ * Group scans
+ *
+ * A group scan looks for a struct rather than a single value. Its template lists up to GROUP_MAX_FIELDS fields, each a
+ * value type at an offset from the start of the struct with a condition of its own, e.g. "u32@0 100; f32@8 between
+ * -1000 1000; f32@12" for a struct with 100 in its first field and a float between -1000 and 1000 at offset 8 (the float
+ * at offset 12 has no condition and is only kept for the next scans). Every candidate start, a multiple of the
+ * template's alignment counted from the start of its region, is tested against all the fields in one pass over memory,
+ * instead of one scan per field and intersecting the addresses by hand:
+ *
+ *   - the most selective field (an equals on a value other than zero, then a between, then an equals on zero) is tested
+ *     first, over every candidate of a chunk, with the vector kernel a normal scan of its type would use;
+ *   - the other fields are tested with the scalar kernels, which only load the candidates still set in the searchmask,
+ *     so they cost next to nothing once the first field has thrown most of them out.
+ *
+ * The regions are chosen with a REGION_FILTER as in create_scan and cut into GROUP_CHUNK_SIZE items that the scan threads
+ * take from a shared counter, as in the signature search; each item is read with the template's size past its end so
+ * that structs crossing the boundary are seen. Next scans only read the structs still matching, GROUP_BATCH of them at a
+ * time through a read plan, and test every field with its own condition against its previous value.
+ */
+
+#define GROUP_MAX_FIELDS 16
+#define GROUP_MAX_SIZE 4096 //bytes a template may cover
+#define GROUP_CHUNK_SIZE (256*1024)
+#define GROUP_BATCH 4096 //structs read with one read plan by the next scans
+
+typedef struct
+{
+    VALUE_TYPE type;
+    unsigned int offset; //from the start of the struct
+    SEARCH_PARAMS search; //condition of the first scan; COND_UNCONDITIONAL to only keep the value
+} GROUP_FIELD;
+
+typedef struct
+{
+    GROUP_FIELD fields[GROUP_MAX_FIELDS];
+    int count;
+    int alignment; //distance between candidate starts: 1, 2, 4 or 8
+    unsigned int size; //bytes from the start of the struct to the end of its last field
+} GROUP_TEMPLATE;
+
+typedef struct
+{
+    PROC_HANDLE hProc; //process handle of the process being scanned
+    GROUP_TEMPLATE tmpl;
+    SCAN_OPTIONS options; //its threads and read gap are used
+    unsigned long long *records; //count records of 1 + tmpl.count words: the address of a match, then each field's value
+    size_t count; //number of matches
+} GROUP_SCAN;
+
+typedef struct
+{
+    unsigned char *addr; //first candidate start of the item
+    size_t len; //bytes of candidate starts in the item
+    size_t avail; //bytes from addr to the end of the region
+    unsigned long long *records; //matches in the item, in address order (see GROUP_SCAN)
+    size_t count;
+} GROUP_ITEM;
+
+typedef struct
+{
+    PROC_HANDLE hProc;
+    const GROUP_TEMPLATE *tmpl;
+    COMPILED_SEARCH tests[GROUP_MAX_FIELDS]; //compiled condition of each field
+    int order[GROUP_MAX_FIELDS]; //the fields with a condition, the one tested with the vector kernel first
+    int ntests;
+    GROUP_ITEM *items;
+    size_t nitems;
+    size_t next; //next item to take
+    unsigned long long bytes_searched;
+    BOOL failed; //a worker ran out of memory, so matches were lost
+    LOCK lock; //guards next, bytes_searched and failed
+} GROUP_JOB;
+
+/**
+ * Function: field_selectivity
+ * 
+ * Description: Guesses how few candidates a first scan condition lets through, to pick the field tested first
+ *
+ * Output:
+ *   Higher for fewer: 3 for an equals on a value other than zero, 2 for a between, 1 for an equals on zero, 0 otherwise
+ */
+static int field_selectivity (const GROUP_FIELD *field)
+{
+    switch (field->search.condition)
+    {
+        case COND_EQUALS: return field->search.a.u64 != 0 ? 3 : 1;
+        case COND_BETWEEN: return 2;
+        default: return 0;
+    }
+}
+
+/**
+ * Function: group_record_width
+ * 
+ * Description: The number of words a match of a template takes in GROUP_SCAN.records
+ */
+static size_t group_record_width (const GROUP_TEMPLATE *tmpl)
+{
+    return 1 + tmpl->count;
+}
+
+/**
+ * Function: group_worker
+ * 
+ * Description: Thread function --- Reads items and tests every candidate start in them against the template until there
+ *              are none left
+ *
+ * Input:
+ *   param - a pointer to the GROUP_JOB
+ */
+static THREAD_PROC (group_worker, param)
+{
+    GROUP_JOB *job = param;
+    const GROUP_TEMPLATE *tmpl = job->tmpl;
+    size_t width = group_record_width (tmpl);
+    size_t max_candidates = GROUP_CHUNK_SIZE / tmpl->alignment;
+    unsigned char *buf = malloc (GROUP_CHUNK_SIZE + tmpl->size);
+    unsigned char *mask = malloc (max_candidates / 8 + 1);
+
+    if (!buf || !mask)
+    {
+        lock_enter (&job->lock);
+        job->failed = TRUE;
+        lock_leave (&job->lock);
+    }
+
+    while (buf && mask)
+    {
+        GROUP_ITEM *item;
+        size_t want, got, n, index;
+        unsigned int matches = 0;
+        int t, f;
+
+        lock_enter (&job->lock);
+        item = (job->next < job->nitems && !job->failed) ? &job->items[job->next++] : NULL;
+        lock_leave (&job->lock);
+        if (!item) break;
+
+        // read the item plus the rest of the structs that start in it; only structs read as a whole are candidates
+        want = item->len + tmpl->size - 1;
+        if (want > item->avail) want = item->avail;
+        got = read_memory (job->hProc, item->addr, buf, want);
+        n = (got >= tmpl->size) ? (got - tmpl->size) / tmpl->alignment + 1 : 0;
+        if (n > (item->len + tmpl->alignment - 1) / tmpl->alignment) n = (item->len + tmpl->alignment - 1) / tmpl->alignment;
+        memset (mask, 0xFF, (n + 7) / 8);
+
+        for (t = 0; t < job->ntests && n; t++)
+        {
+            const COMPILED_SEARCH *test = &job->tests[job->order[t]];
+            const unsigned char *values = buf + tmpl->fields[job->order[t]].offset;
+            SCAN_KERNEL kernel = (t == 0) ? test->kernel : test->scalar;
+
+            matches = kernel (values, values, mask, (unsigned int)n, tmpl->alignment, test->args);
+            if (!matches) break;
+        }
+
+        if (n && matches)
+        {
+            item->records = malloc (matches * width * sizeof(unsigned long long));
+            for (index = 0; index < n && item->records; index += 8)
+            {
+                unsigned int m = mask[index/8];
+
+                while (m)
+                {
+                    unsigned int bit = CTZ (m);
+                    size_t start = (index + bit) * tmpl->alignment;
+                    unsigned long long *record = item->records + item->count * width;
+
+                    m &= m - 1;
+                    if (index + bit >= n) break;
+
+                    record[0] = (unsigned long long)(uintptr_t)(item->addr + start);
+                    for (f = 0; f < tmpl->count; f++)
+                    {
+                        record[1 + f] = 0;
+                        memcpy (&record[1 + f], buf + start + tmpl->fields[f].offset, value_types[tmpl->fields[f].type].size);
+                    }
+                    item->count++;
+                }
+            }
+        }
+
+        lock_enter (&job->lock);
+        job->bytes_searched += (got < item->len) ? got : item->len;
+        if (n && matches && !item->records) job->failed = TRUE;
+        lock_leave (&job->lock);
+    }
+
+    free (buf);
+    free (mask);
+
+    return THREAD_RETURN;
+}
+
+/**
+ * Function: free_group_scan
+ * 
+ * Description: Frees a group scan and closes its process handle
+ *
+ * Input:
+ *   *group - the group scan, or NULL
+ */
+void free_group_scan (GROUP_SCAN *group)
+{
+    if (group)
+    {
+        close_process (group->hProc);
+        free (group->records);
+        free (group);
+    }
+}
+
+/**
+ * Function: group_scan
+ * 
+ * Description: Finds every struct in a process that matches a template, testing all its fields in one pass, using the
+ *              scan threads
+ *
+ * Input:
+ *   pid - the process identifier to be scanned
+ *   *tmpl - the template from parse_group_template. At least one field needs a condition, and only equals and between
+ *           can be tested on a first scan.
+ *   *filter - the regions to scan, or NULL for every readable and writable region (see default_region_filter)
+ *   *options - the settings of the scan, or NULL for the defaults (see default_scan_options)
+ *
+ * Output:
+ *   The group scan, or NULL if the template cannot be scanned for, the process could not be opened or out of memory
+ */
+GROUP_SCAN* group_scan (unsigned int pid, const GROUP_TEMPLATE *tmpl, const REGION_FILTER *filter, const SCAN_OPTIONS *options)
+{
+    GROUP_SCAN *group;
+    GROUP_JOB job;
+    THREAD threads[MAX_SCAN_THREADS];
+    BOOL started[MAX_SCAN_THREADS];
+    REGION *regions;
+    MODULE *modules = NULL;
+    REGION_FILTER writable;
+    size_t width = group_record_width (tmpl), i, total = 0;
+    int nregions, nmodules = 0, r, f, t, nthreads;
+
+    memset (&job, 0, sizeof(job));
+    for (f = 0; f < tmpl->count; f++)
+    {
+        SEARCH_CONDITION c = tmpl->fields[f].search.condition;
+
+        if (c == COND_UNCONDITIONAL) continue;
+        if (c != COND_EQUALS && c != COND_BETWEEN) return NULL;
+
+        compile_search (tmpl->fields[f].type, tmpl->alignment, &tmpl->fields[f].search, &job.tests[f]);
+        // the most selective field goes first, the others in template order
+        job.order[job.ntests++] = f;
+        if (field_selectivity (&tmpl->fields[f]) > field_selectivity (&tmpl->fields[job.order[0]]))
+        {
+            job.order[job.ntests-1] = job.order[0];
+            job.order[0] = f;
+        }
+    }
+    if (!job.ntests) return NULL;
+
+    if (!filter)
+    {
+        default_region_filter (&writable);
+        filter = &writable;
+    }
+
+    group = calloc (1, sizeof(GROUP_SCAN));
+    if (!group) return NULL;
+    group->tmpl = *tmpl;
+    if (options) group->options = *options;
+    else default_scan_options (&group->options);
+    group->hProc = open_process (pid);
+    if (!group->hProc)
+    {
+        free (group);
+        return NULL;
+    }
+    job.hProc = group->hProc;
+    job.tmpl = &group->tmpl;
+
+    nregions = list_regions (group->hProc, &regions);
+    if (filter->module[0]) nmodules = list_modules (group->hProc, &modules);
+    for (r = 0; r < nregions; r++)
+    {
+        if (region_passes_filter (filter, &regions[r], modules, nmodules)) job.nitems += (regions[r].size + GROUP_CHUNK_SIZE - 1) / GROUP_CHUNK_SIZE;
+    }
+    job.items = calloc (job.nitems ? job.nitems : 1, sizeof(GROUP_ITEM));
+    if (!job.items)
+    {
+        free (regions);
+        free (modules);
+        free_group_scan (group);
+        return NULL;
+    }
+
+    job.nitems = 0;
+    for (r = 0; r < nregions; r++)
+    {
+        size_t start;
+
+        if (!region_passes_filter (filter, &regions[r], modules, nmodules)) continue;
+        for (start = 0; start < regions[r].size; start += GROUP_CHUNK_SIZE)
+        {
+            GROUP_ITEM *item = &job.items[job.nitems++];
+            item->addr = regions[r].base + start;
+            item->avail = regions[r].size - start;
+            item->len = (item->avail > GROUP_CHUNK_SIZE) ? GROUP_CHUNK_SIZE : item->avail;
+        }
+    }
+    free (regions);
+    free (modules);
+
+    nthreads = get_scan_thread_count (options ? options->threads : 0);
+    if ((size_t)nthreads > job.nitems) nthreads = job.nitems ? (int)job.nitems : 1;
+
+    // the calling thread is one of the workers
+    lock_init (&job.lock);
+    for (t = 1; t < nthreads; t++)
+    {
+        started[t] = thread_start (&threads[t], group_worker, &job);
+    }
+    group_worker (&job);
+    for (t = 1; t < nthreads; t++)
+    {
+        if (started[t]) thread_join (threads[t]);
+    }
+    lock_free (&job.lock);
+
+    // items finish in any order, but taken in item order their matches are in address order
+    for (i = 0; i < job.nitems; i++) total += job.items[i].count;
+    group->records = job.failed ? NULL : malloc ((total ? total : 1) * width * sizeof(unsigned long long));
+    for (i = 0; i < job.nitems; i++)
+    {
+        if (group->records && job.items[i].count)
+        {
+            memcpy (group->records + group->count * width, job.items[i].records, job.items[i].count * width * sizeof(unsigned long long));
+            group->count += job.items[i].count;
+        }
+        free (job.items[i].records);
+    }
+    free (job.items);
+
+    if (!group->records)
+    {
+        free_group_scan (group);
+        return NULL;
+    }
+
+    return group;
+}
+
+/**
+ * Function: update_group_scan
+ * 
+ * Description: Reads the structs that still match a group scan and keeps the ones whose fields all pass their next scan
+ *              condition, storing their new values
+ *
+ * Input:
+ *   *group - the group scan
+ *   *searches - one search per field of the template, in template order; COND_UNCONDITIONAL keeps any value
+ *
+ * Output:
+ *   FALSE if out of memory; the structs not tested yet are then kept with their values from the scan before
+ */
+BOOL update_group_scan (GROUP_SCAN *group, const SEARCH_PARAMS *searches)
+{
+    const GROUP_TEMPLATE *tmpl = &group->tmpl;
+    COMPILED_SEARCH tests[GROUP_MAX_FIELDS];
+    size_t width = group_record_width (tmpl);
+    size_t i, kept = 0;
+    READ_PLAN *plan;
+    BOOL ok = TRUE;
+    int f;
+
+    plan = create_read_plan (group->hProc, group->options.gap);
+    if (!plan) return FALSE;
+
+    for (f = 0; f < tmpl->count; f++)
+    {
+        compile_search (tmpl->fields[f].type, tmpl->alignment, &searches[f], &tests[f]);
+    }
+
+    for (i = 0; i < group->count; i += GROUP_BATCH)
+    {
+        size_t n = (group->count - i < GROUP_BATCH) ? group->count - i : GROUP_BATCH;
+        size_t j;
+
+        reset_read_plan (plan, group->hProc);
+        for (j = 0; j < n && ok; j++)
+        {
+            ok = read_plan_add (plan, (unsigned char*)(uintptr_t)group->records[(i + j) * width], tmpl->size) >= 0;
+        }
+        if (!ok)
+        {
+            memmove (group->records + kept * width, group->records + i * width, (group->count - i) * width * sizeof(unsigned long long));
+            kept += group->count - i;
+            break;
+        }
+        execute_read_plan (plan);
+
+        for (j = 0; j < n; j++)
+        {
+            unsigned long long *record = group->records + (i + j) * width;
+            const unsigned char *data = plan->requests[j].data; //NULL if the struct can no longer be read
+            unsigned char mask = 1;
+
+            // one candidate per kernel call: the scalar kernels test it against the previous value in the record
+            for (f = 0; f < tmpl->count && data && mask; f++)
+            {
+                if (searches[f].condition == COND_UNCONDITIONAL) continue;
+                tests[f].scalar (data + tmpl->fields[f].offset, (const unsigned char*)&record[1 + f], &mask, 1, tmpl->alignment, tests[f].args);
+            }
+            if (!data || !mask) continue;
+
+            memmove (group->records + kept * width, record, sizeof(unsigned long long));
+            for (f = 0; f < tmpl->count; f++)
+            {
+                group->records[kept * width + 1 + f] = 0;
+                memcpy (&group->records[kept * width + 1 + f], data + tmpl->fields[f].offset, value_types[tmpl->fields[f].type].size);
+            }
+            kept++;
+        }
+    }
+
+    group->count = kept;
+    free_read_plan (plan);
+
+    return ok;
+}
+
+/**
+ * Function: format_group_values
+ * 
+ * Description: Formats the values of the fields of a match of a group scan as numbers (see format_number), separated by
+ *              spaces
+ *
+ * Input:
+ *   *group - the group scan
+ *   index - the match
+ *   *out - receives the text
+ *   out_size - size of out
+ */
+void format_group_values (const GROUP_SCAN *group, size_t index, char *out, size_t out_size)
+{
+    const unsigned long long *record = group->records + index * group_record_width (&group->tmpl);
+    size_t len = 0;
+    int f;
+
+    out[0] = 0;
+    for (f = 0; f < group->tmpl.count && len + 1 < out_size; f++)
+    {
+        TYPED_VALUE v;
+
+        memset (&v, 0, sizeof(v));
+        memcpy (&v, &record[1 + f], value_types[group->tmpl.fields[f].type].size);
+        if (f) out[len++] = ' ';
+        format_number (group->tmpl.fields[f].type, &v, out + len, out_size - len);
+        len += strlen (out + len);
+    }
+}
+
+/**
+ * Function: str2int
+ * 
+ * Description: Utility function --- Convert a string to an integer
+ *
+ * Input:
+ *   *s - the string to be converted. This can be in base 16 format (/0x[0-9a-fA-F]+/) or base 10 format (/\d+/)
+ */
+unsigned long long str2int (char *s)
+{
+    int base = 10;
+
+    if (s[0] == '0' && s[1] == 'x')
+    {
+        base = 16;
+        s += 2;
+    }
+
+    return strtoull (s, NULL, base);
+}
+
+/**
+ * Function: parse_value
+ * 
+ * Description: Utility function --- Convert a string to a value of a given type. Integers can be in base 16 format
+ *              (/0x[0-9a-fA-F]+/) or base 10 format (/-?\d+/), floats in any format strtod accepts.
+ *
+ * Input:
+ *   type - the type of the value
+ *   *s - the string to be converted
+ *   *val - receives the value
+ *
+ * Output:
+ *   TRUE if the string is a number that fits in the type
+ */
+BOOL parse_value (VALUE_TYPE type, const char *s, TYPED_VALUE *val)
+{
+    int bits = value_types[type].size * 8;
+    char *end;
+
+    memset (val, 0, sizeof(*val));
+
+    if (value_types[type].is_float)
+    {
+        double d = strtod (s, &end);
+        if (type == TYPE_F32) val->f32 = (float)d;
+        else val->f64 = d;
+    }
+    else if (value_types[type].is_signed && s[0] == '-')
+    {
+        long long x = strtoll (s, &end, 10);
+        if (bits < 64 && x < -(1LL << (bits - 1))) return FALSE;
+        memcpy (val, &x, bits / 8);
+    }
+    else
+    {
+        BOOL hex = (s[0] == '0' && s[1] == 'x');
+        const char *digits = hex ? s + 2 : s;
+        unsigned long long x;
+
+        // strtoull takes "-5" as 2^64 - 5, which only the range check below would catch for the narrower types
+        if (digits[strspn (digits, " \t")] == '-') return FALSE;
+        x = strtoull (digits, &end, hex ? 16 : 10);
+        if (bits < 64 && (x >> (value_types[type].is_signed ? bits - 1 : bits)) != 0 && !(hex && (x >> bits) == 0)) return FALSE;
+        val->u64 = x;
+    }
+
+    return end != s && strspn (end, " \t\r\n") == strlen (end);
+}
+
+/**
+ * Function: parse_type
+ * 
+ * Description: Utility function --- Convert a type name (u8 ... u64, i8 ... i64, f32, f64) to a value type. The data
+ *              sizes 1, 2, 4 and 8 stand for the unsigned types, as before there were types.
+ *
+ * Input:
+ *   *s - the string to be converted
+ *
+ * Output:
+ *   The type, or TYPE_COUNT if the string is not a type
+ */
+VALUE_TYPE parse_type (const char *s)
+{
+    int t;
+    size_t len = strcspn (s, " \t\r\n");
+
+    for (t = 0; t < TYPE_COUNT; t++)
+    {
+        if (strlen (value_types[t].name) == len && strncmp (s, value_types[t].name, len) == 0) return (VALUE_TYPE)t;
+    }
+
+    switch (str2int ((char*)s))
+    {
+        case 1: return TYPE_U8;
+        case 2: return TYPE_U16;
+        case 4: return TYPE_U32;
+        case 8: return TYPE_U64;
+        default: return TYPE_COUNT;
+    }
+}
+
+/**
+ * Function: parse_region_filter
+ * 
+ * Description: Utility function --- Convert a list of words to a region filter, starting from default_region_filter:
+ *                private, mapped, image - the region types to keep (any of those given)
+ *                +r, +w, +x / -r, -w, -x - a protection a region must / must not have
+ *                module=<file name> - only the regions of a module
+ *                from=<address>, to=<address> - only regions inside these bounds
+ *                min=<size>, max=<size> - only regions of these sizes
+ *                priority - scan private regions first (see REGION_FILTER)
+ *              e.g. "private min=0x10000 priority" or "module=game.exe -x"
+ *
+ * Input:
+ *   *s - the string to be converted
+ *   *filter - receives the filter
+ *
+ * Output:
+ *   TRUE if every word was understood
+ */
+BOOL parse_region_filter (const char *s, REGION_FILTER *filter)
+{
+    char word[128];
+    int len;
+
+    default_region_filter (filter);
+
+    while (sscanf (s, " %127s%n", word, &len) == 1)
+    {
+        s += len;
+
+        if (strcmp (word, "private") == 0) filter->types |= REGION_PRIVATE;
+        else if (strcmp (word, "mapped") == 0) filter->types |= REGION_MAPPED;
+        else if (strcmp (word, "image") == 0) filter->types |= REGION_IMAGE;
+        else if (strcmp (word, "priority") == 0) filter->prioritize = TRUE;
+        else if ((word[0] == '+' || word[0] == '-') && word[2] == 0 && strchr ("rwx", word[1]))
+        {
+            int bit = (word[1] == 'r') ? REGION_READ : (word[1] == 'w') ? REGION_WRITE : REGION_EXEC;
+
+            filter->protect = (word[0] == '+') ? filter->protect | bit : filter->protect & ~bit;
+            filter->protect_not = (word[0] == '-') ? filter->protect_not | bit : filter->protect_not & ~bit;
+        }
+        else if (strncmp (word, "module=", 7) == 0 && strlen (word + 7) < sizeof(filter->module)) strcpy (filter->module, word + 7);
+        else if (strncmp (word, "from=", 5) == 0) filter->from = (unsigned char*)(uintptr_t)str2int (word + 5);
+        else if (strncmp (word, "to=", 3) == 0) filter->to = (unsigned char*)(uintptr_t)str2int (word + 3);
+        else if (strncmp (word, "min=", 4) == 0) filter->min_size = (size_t)str2int (word + 4);
+        else if (strncmp (word, "max=", 4) == 0) filter->max_size = (size_t)str2int (word + 4);
+        else return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Function: parse_search
+ * 
+ * Description: Utility function --- Convert a condition and its operands to a search, e.g. "equals 100", "between 10 20",
+ *              "increased_by 5", "changed" or "unknown" (see condition_names). A value alone means equals. On float
+ *              types, equals and the *_by conditions take an epsilon after the value: "equals 1.5 0.01".
+ *
+ * Input:
+ *   type - the value type of the scan
+ *   *s - the string to be converted
+ *   *search - receives the search
+ *
+ * Output:
+ *   TRUE if the string is a condition with the operands it needs, and nothing else
+ */
+BOOL parse_search (VALUE_TYPE type, const char *s, SEARCH_PARAMS *search)
+{
+    char word[4][64];
+    int words = 0, operands, len;
+    size_t c;
+    TYPED_VALUE eps;
+
+    memset (search, 0, sizeof(*search));
+
+    while (words < 4 && sscanf (s, " %63s%n", word[words], &len) == 1)
+    {
+        s += len;
+        words++;
+    }
+    if (words == 0 || strspn (s, " \t\r\n") != strlen (s)) return FALSE;
+
+    for (c = 0; c < CONDITION_COUNT && strcmp (word[0], condition_names[c]) != 0; c++);
+    if (c == CONDITION_COUNT)
+    {
+        search->condition = COND_EQUALS;
+        return words == 1 && parse_value (type, word[0], &search->a);
+    }
+
+    search->condition = (SEARCH_CONDITION)c;
+    operands = (c == COND_BETWEEN) ? 2 : (c == COND_EQUALS || c == COND_INCREASED_BY || c == COND_DECREASED_BY) ? 1 : 0;
+    if (operands == 1 && words == 3 && value_types[type].is_float)
+    {
+        if (!parse_value (TYPE_F64, word[2], &eps)) return FALSE;
+        search->epsilon = eps.f64;
+        words--;
+    }
+
+    if (words != operands + 1) return FALSE;
+    if (operands >= 1 && !parse_value (type, word[1], &search->a)) return FALSE;
+    if (operands == 2 && !parse_value (type, word[2], &search->b)) return FALSE;
+
+    return TRUE;
+}
+
+/**
+ * Function: parse_group_template
+ * 
+ * Description: Utility function --- Convert a struct template to the fields of a group scan (see Group scans). The
+ *              fields are separated by ';', each a type, '@', its offset in the struct and optionally a first scan
+ *              condition (see parse_search): "u32@0 100; f32@8 between -1000 1000; f32@12". The alignment of the struct
+ *              is the size of its largest field if every field is aligned to its size, and 1 otherwise, unless an
+ *              "align=<1|2|4|8>" item says otherwise.
+ *
+ * Input:
+ *   *s - the string to be converted
+ *   *tmpl - receives the template
+ *
+ * Output:
+ *   TRUE if the string is a template of 1 to GROUP_MAX_FIELDS valid fields within GROUP_MAX_SIZE bytes
+ */
+BOOL parse_group_template (const char *s, GROUP_TEMPLATE *tmpl)
+{
+    char item[256];
+    char name[16];
+    BOOL aligned = TRUE;
+    int largest = 1, f;
+
+    memset (tmpl, 0, sizeof(*tmpl));
+
+    while (*s)
+    {
+        size_t len = strcspn (s, ";");
+        GROUP_FIELD *field;
+        char *at, *end;
+        unsigned long offset;
+
+        if (len >= sizeof(item)) return FALSE;
+        memcpy (item, s, len);
+        item[len] = 0;
+        s += len + (s[len] == ';');
+        if (item[strspn (item, " \t\r\n")] == 0) continue;
+
+        if (sscanf (item, " align=%d", &tmpl->alignment) == 1)
+        {
+            if (tmpl->alignment != 1 && tmpl->alignment != 2 && tmpl->alignment != 4 && tmpl->alignment != 8) return FALSE;
+            continue;
+        }
+
+        at = strchr (item, '@');
+        if (!at || tmpl->count == GROUP_MAX_FIELDS) return FALSE;
+        *at = 0;
+        field = &tmpl->fields[tmpl->count];
+        if (sscanf (item, " %15s", name) != 1) return FALSE;
+        field->type = parse_type (name);
+        if (field->type == TYPE_COUNT) return FALSE;
+
+        offset = strtoul (at + 1, &end, (at[1] == '0' && at[2] == 'x') ? 16 : 10);
+        if (end == at + 1 || offset + value_types[field->type].size > GROUP_MAX_SIZE) return FALSE;
+        field->offset = (unsigned int)offset;
+        if (end[strspn (end, " \t\r\n")] != 0 && !parse_search (field->type, end, &field->search)) return FALSE;
+        tmpl->count++;
+    }
+    if (tmpl->count == 0) return FALSE;
+
+    for (f = 0; f < tmpl->count; f++)
+    {
+        unsigned int size = value_types[tmpl->fields[f].type].size;
+
+        if (tmpl->fields[f].offset + size > tmpl->size) tmpl->size = tmpl->fields[f].offset + size;
+        if (tmpl->fields[f].offset % size) aligned = FALSE;
+        if ((int)size > largest) largest = size;
+    }
+    if (!tmpl->alignment) tmpl->alignment = aligned ? largest : 1;
+
+    return TRUE;
+}
+
+/**
+ * Function: parse_group_searches
+ * 
+ * Description: Utility function --- Convert the next scan conditions of a group scan, one per field of its template in
+ *              template order, separated by ';' (see parse_search): "unchanged; increased; ; decreased". Empty or
+ *              missing conditions mean unknown, so the field keeps any value.
+ *
+ * Input:
+ *   *tmpl - the template of the group scan
+ *   *s - the string to be converted
+ *   *searches - receives one search per field
+ *
+ * Output:
+ *   TRUE if every condition is valid and there are no more than the template has fields
+ */
+BOOL parse_group_searches (const GROUP_TEMPLATE *tmpl, const char *s, SEARCH_PARAMS *searches)
+{
+    char item[256];
+    int f = 0;
+
+    memset (searches, 0, tmpl->count * sizeof(SEARCH_PARAMS));
+
+    while (*s)
+    {
+        size_t len = strcspn (s, ";");
+
+        if (len >= sizeof(item) || f == tmpl->count) return FALSE;
+        memcpy (item, s, len);
+        item[len] = 0;
+        s += len + (s[len] == ';');
+        if (item[strspn (item, " \t\r\n")] != 0 && !parse_search (tmpl->fields[f].type, item, &searches[f])) return FALSE;
+        f++;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Benchmarks
+ *
+ * "memory_scanner bench [heap=<MB>] [regions=<n>] [density=<share>] [mutations=<n>] [runs=<n>]" starts a copy of itself
+ * as a synthetic target (run_bench_target) and measures the scanner against it. A process may always read the memory of
+ * its own children, so this needs no privileges. It times create_scan, the setup of a scan (create_scan and a first
+ * unknown scan), first scans of each type and condition, next scans after the target changed some values,
+ * print_matches and dumps, and prints one line of JSON per result:
+ *
+ *   {"bench":"first_scan","type":"u32","alignment":4,"condition":"equals","runs":3,"seconds":0.041,"best":0.039,...}
+ *
+ * "seconds" is the median of the runs and "best" the fastest; the rate (GB/s) is worked out from the median. Each line
+ * also has the bytes read, the system calls, the matches and the peak memory of the scanner so far, so the output of two
+ * commits can be compared line by line. The setup runs before every other scan, so its peak memory is that of setting
+ * up a scan of the whole target.
+ *
+ * The target fills its regions with random u32 values, a `density` share of them BENCH_VALUE, and answers "m <n>" by
+ * changing n random values (a third each incremented, set to BENCH_VALUE and set to a random value) and printing "ok".
+ */
+
+#define BENCH_VALUE 57 //the value searched for; it fits every type
+#define BENCH_UPPER 67 //upper bound of the between scans
+#define BENCH_MAX_RUNS 32
+#define BENCH_DUMP_FILE "memory_scanner_bench.dump" //written in the current directory and deleted again
+
+typedef struct
+{
+    unsigned int heap_mb; //memory of the target
+    unsigned int regions; //number of regions it is split into
+    double density; //share of its u32 values that are BENCH_VALUE
+    unsigned int mutations; //values the target changes before each next scan
+    unsigned int runs; //times each benchmark is run
+} BENCH_PARAMS;
+
+typedef struct
+{
+    VALUE_TYPE type;
+    int alignment; //0 for natural
+    SEARCH_CONDITION first;
+    SEARCH_CONDITION next; //the condition timed after the target changed, for next scans
+} BENCH_CASE;
+
+static const BENCH_CASE bench_first_scans[] =
+{
+    { TYPE_U8,  0, COND_EQUALS, COND_UNCONDITIONAL }, { TYPE_U16, 0, COND_EQUALS, COND_UNCONDITIONAL },
+    { TYPE_U32, 0, COND_EQUALS, COND_UNCONDITIONAL }, { TYPE_U64, 0, COND_EQUALS, COND_UNCONDITIONAL },
+    { TYPE_F32, 0, COND_EQUALS, COND_UNCONDITIONAL }, { TYPE_F64, 0, COND_EQUALS, COND_UNCONDITIONAL },
+    { TYPE_I32, 0, COND_BETWEEN, COND_UNCONDITIONAL }, { TYPE_U32, 1, COND_EQUALS, COND_UNCONDITIONAL },
+    { TYPE_U8,  0, COND_UNCONDITIONAL, COND_UNCONDITIONAL }, { TYPE_U32, 0, COND_UNCONDITIONAL, COND_UNCONDITIONAL },
+};
+
+static const BENCH_CASE bench_next_scans[] =
+{
+    { TYPE_U32, 0, COND_EQUALS, COND_EQUALS }, { TYPE_U32, 0, COND_UNCONDITIONAL, COND_CHANGED },
+    { TYPE_U32, 0, COND_UNCONDITIONAL, COND_UNCHANGED }, { TYPE_U32, 0, COND_UNCONDITIONAL, COND_INCREASED },
+};
+
+/**
+ * Function: run_bench_target
+ * 
+ * Description: The synthetic target of the benchmarks, run as "memory_scanner bench-target <MB> <regions> <density>".
+ *              Allocates and fills the regions, prints "ready" and then changes values whenever it is asked to, until
+ *              its input ends.
+ *
+ * Input:
+ *   argc, *argv[] - the command line
+ *
+ * Output:
+ *   The exit code
+ */
+int run_bench_target (int argc, char *argv[])
+{
+    unsigned long long x = 88172645463325252ull; //xorshift64 state, the same every run
+    unsigned long long threshold;
+    unsigned int **regions;
+    unsigned int nregions, r;
+    size_t region_size, per_region, i;
+    char line[64];
+
+    if (argc != 5) return 1;
+    nregions = (unsigned int)strtoul (argv[3], NULL, 10);
+    if (nregions == 0) return 1;
+    region_size = (size_t)strtoull (argv[2], NULL, 10) * 1024 * 1024 / nregions / PAGE_SIZE * PAGE_SIZE;
+    if (region_size == 0) region_size = PAGE_SIZE;
+    per_region = region_size / sizeof(unsigned int);
+    threshold = (unsigned long long)(strtod (argv[4], NULL) * 4294967296.0);
+
+    regions = malloc (nregions * sizeof(unsigned int*));
+    if (!regions) return 1;
+    for (r = 0; r < nregions; r++)
+    {
+#ifdef _WIN32
+        regions[r] = alloc_pages (region_size, FALSE);
+#else
+        // Linux merges neighbouring mappings into one region, so each one gives its last page back to keep them apart
+        regions[r] = alloc_pages (region_size + PAGE_SIZE, FALSE);
+        if (regions[r]) free_pages ((unsigned char*)regions[r] + region_size, PAGE_SIZE);
+#endif
+        if (!regions[r]) return 1;
+
+        for (i = 0; i < per_region; i++)
+        {
+            x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+            regions[r][i] = ((x >> 32) < threshold) ? BENCH_VALUE : (unsigned int)x;
+        }
+    }
+
+    printf ("ready\n");
+    fflush (stdout);
+
+    while (fgets (line, sizeof(line), stdin) && line[0] == 'm')
+    {
+        unsigned long n = strtoul (line + 1, NULL, 10);
+
+        while (n--)
+        {
+            unsigned int *v;
+
+            x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+            v = &regions[(x >> 40) % nregions][(x & 0xffffffffu) % per_region];
+            switch ((x >> 32) % 3)
+            {
+                case 0: (*v)++; break;
+                case 1: *v = BENCH_VALUE; break;
+                default: *v = (unsigned int)(x >> 8); break;
+            }
+        }
+        printf ("ok\n");
+        fflush (stdout);
+    }
+
+    return 0;
+}
+
+/**
+ * Function: bench_mutate
+ * 
+ * Description: Has the benchmark target change some of its values and waits until it has
+ */
+static BOOL bench_mutate (CHILD *target, unsigned int n)
+{
+    char line[64];
+
+    fprintf (target->in, "m %u\n", n);
+    fflush (target->in);
+    return fgets (line, sizeof(line), target->out) && strncmp (line, "ok", 2) == 0;
+}
+
+/**
+ * Function: bench_search
+ * 
+ * Description: The search a benchmark does for a condition: BENCH_VALUE, or from it to BENCH_UPPER for COND_BETWEEN
+ */
+static void bench_search (VALUE_TYPE type, SEARCH_CONDITION condition, SEARCH_PARAMS *search)
+{
+    char value[16];
+
+    memset (search, 0, sizeof(SEARCH_PARAMS));
+    search->condition = condition;
+    snprintf (value, sizeof(value), "%d", BENCH_VALUE);
+    parse_value (type, value, &search->a);
+    snprintf (value, sizeof(value), "%d", BENCH_UPPER);
+    parse_value (type, value, &search->b);
+}
+
+/**
+ * Function: bench_times
+ * 
+ * Description: Sorts the times of the runs of a benchmark and gives the median and the fastest, in seconds
+ */
+static void bench_times (unsigned long long *ns, unsigned int runs, double *median, double *best)
+{
+    unsigned int i, j;
+
+    for (i = 1; i < runs; i++)
+    {
+        for (j = i; j > 0 && ns[j-1] > ns[j]; j--)
+        {
+            unsigned long long t = ns[j];
+            ns[j] = ns[j-1];
+            ns[j-1] = t;
+        }
+    }
+
+    *median = ns[runs / 2] / 1e9;
+    *best = ns[0] / 1e9;
+}
+
+/**
+ * Function: bench_print
+ * 
+ * Description: Prints the end of a result line: the times, the reads and the peak memory
+ */
+static void bench_print (unsigned long long *ns, unsigned int runs, const READ_STATS *stats, unsigned long long matches)
+{
+    double median, best;
+
+    bench_times (ns, runs, &median, &best);
+    printf ("\"runs\":%u,\"seconds\":%.6f,\"best\":%.6f,\"bytes_read\":%llu,\"bytes_skipped\":%llu,\"gbps\":%.3f,"
+            "\"syscalls\":%llu,\"matches\":%llu,\"peak_rss_kb\":%llu}\n", runs, median, best, stats->bytes_read,
+            stats->bytes_skipped, median > 0 ? stats->bytes_read / median / 1e9 : 0.0, stats->syscalls, matches,
+            (unsigned long long)peak_memory () / 1024);
+    fflush (stdout);
+}
+
+/**
+ * Function: run_benchmarks
+ * 
+ * Description: Starts the benchmark target and runs every benchmark against it (see Benchmarks)
+ *
+ * Input:
+ *   *params - the size and behaviour of the target and the number of runs
+ *
+ * Output:
+ *   TRUE if the target could be started and scanned
+ */
+BOOL run_benchmarks (const BENCH_PARAMS *params)
+{
+    unsigned long long ns[BENCH_MAX_RUNS];
+    char heap[32], nregions[32], density[32];
+    char *args[] = { "bench-target", heap, nregions, density, NULL };
+    char line[64];
+    CHILD target;
+    SEARCH_PARAMS search;
+    READ_STATS stats;
+    SCAN *scan;
+    FILE *null;
+    unsigned long long bytes = 0, setup_matches = 0;
+    unsigned int runs = (params->runs < 1) ? 1 : (params->runs > BENCH_MAX_RUNS) ? BENCH_MAX_RUNS : params->runs;
+    unsigned int r;
+    size_t c, b;
+    int compress;
+
+    snprintf (heap, sizeof(heap), "%u", params->heap_mb);
+    snprintf (nregions, sizeof(nregions), "%u", params->regions);
+    snprintf (density, sizeof(density), "%g", params->density);
+    memset (&target, 0, sizeof(target));
+    if (!start_self (&target, args) || !fgets (line, sizeof(line), target.out) || strncmp (line, "ready", 5) != 0)
+    {
+        fprintf (stderr, "Failed to start the benchmark target\n");
+        stop_child (&target);
+        return FALSE;
+    }
+
+    // create_scan: listing the regions and allocating a buffer for each
+    memset (&stats, 0, sizeof(stats));
+    for (r = 0; r < runs; r++)
+    {
+        unsigned long long start = clock_ns ();
+
+        scan = create_scan (target.pid, TYPE_U32, 0, NULL, NULL);
+        ns[r] = clock_ns () - start;
+        if (!scan)
+        {
+            fprintf (stderr, "Failed to scan the benchmark target (pid %u)\n", target.pid);
+            stop_child (&target);
+            return FALSE;
+        }
+        for (b = 0, bytes = 0; b < scan->count; b++) bytes += scan->blocks[b].size;
+        if (r == runs - 1)
+        {
+            printf ("{\"bench\":\"config\",\"heap_mb\":%u,\"regions\":%u,\"density\":%g,\"mutations\":%u,\"threads\":%d,"
+                    "\"blocks\":%llu,\"bytes\":%llu}\n", params->heap_mb, params->regions, params->density,
+                    params->mutations, get_scan_thread_count (0), (unsigned long long)scan->count, bytes);
+        }
+        free_scan (scan);
+    }
+    printf ("{\"bench\":\"create_scan\",\"type\":\"u32\",");
+    bench_print (ns, runs, &stats, 0);
+
+    // setup: create_scan and the first unknown scan that fills the buffers, before anything else grows the peak memory
+    bench_search (TYPE_U32, COND_UNCONDITIONAL, &search);
+    for (r = 0; r < runs; r++)
+    {
+        unsigned long long start = clock_ns ();
+
+        scan = create_scan (target.pid, TYPE_U32, 0, NULL, NULL);
+        if (!scan) break;
+        update_scan (scan, &search);
+        ns[r] = clock_ns () - start;
+        stats = scan->read_stats;
+        setup_matches = get_match_count (scan);
+        free_scan (scan);
+    }
+    if (r == runs)
+    {
+        printf ("{\"bench\":\"setup\",\"type\":\"u32\",\"condition\":\"unknown\",");
+        bench_print (ns, runs, &stats, setup_matches);
+    }
+
+    // first scans, read straight from the target
+    for (c = 0; c < sizeof(bench_first_scans) / sizeof(BENCH_CASE); c++)
+    {
+        const BENCH_CASE *bc = &bench_first_scans[c];
+        unsigned long long matches = 0;
+
+        bench_search (bc->type, bc->first, &search);
+        for (r = 0; r < runs; r++)
+        {
+            unsigned long long start;
+
+            scan = create_scan (target.pid, bc->type, bc->alignment, NULL, NULL);
+            if (!scan) break;
+            start = clock_ns ();
+            update_scan (scan, &search);
+            ns[r] = clock_ns () - start;
+            stats = scan->read_stats;
+            matches = get_match_count (scan);
+            free_scan (scan);
+        }
+        if (r < runs) continue;
+
+        printf ("{\"bench\":\"first_scan\",\"type\":\"%s\",\"alignment\":%d,\"condition\":\"%s\",", value_types[bc->type].name,
+                bc->alignment ? bc->alignment : value_types[bc->type].size, condition_names[bc->first]);
+        bench_print (ns, runs, &stats, matches);
+    }
+
+    // next scans, after the target changed some values
+    for (c = 0; c < sizeof(bench_next_scans) / sizeof(BENCH_CASE); c++)
+    {
+        const BENCH_CASE *bc = &bench_next_scans[c];
+        unsigned long long matches = 0;
+        BOOL incremental = FALSE;
+
+        for (r = 0; r < runs; r++)
+        {
+            unsigned long long start;
+
+            scan = create_scan (target.pid, bc->type, bc->alignment, NULL, NULL);
+            if (!scan) break;
+            bench_search (bc->type, bc->first, &search);
+            update_scan (scan, &search);
+            if (!bench_mutate (&target, params->mutations))
+            {
+                free_scan (scan);
+                break;
+            }
+
+            incremental = scan->tracking;
+            bench_search (bc->type, bc->next, &search);
+            start = clock_ns ();
+            update_scan (scan, &search);
+            ns[r] = clock_ns () - start;
+            stats = scan->read_stats;
+            matches = get_match_count (scan);
+            free_scan (scan);
+        }
+        if (r < runs) continue;
+
+        printf ("{\"bench\":\"next_scan\",\"type\":\"%s\",\"alignment\":%d,\"first\":\"%s\",\"condition\":\"%s\","
+                "\"incremental\":%s,", value_types[bc->type].name, bc->alignment ? bc->alignment : value_types[bc->type].size,
+                condition_names[bc->first], condition_names[bc->next], incremental ? "true" : "false");
+        bench_print (ns, runs, &stats, matches);
+    }
+
+    // print_matches of an equals scan, printing to nowhere
+    null = fopen (NULL_DEVICE, "w");
+    bench_search (TYPE_U32, COND_EQUALS, &search);
+    scan = null ? create_scan (target.pid, TYPE_U32, 0, NULL, NULL) : NULL;
+    if (scan)
+    {
+        update_scan (scan, &search);
+        for (r = 0; r < runs; r++)
+        {
+            unsigned long long start = clock_ns ();
+
+            print_matches (scan, 0, ULLONG_MAX, null);
+            ns[r] = clock_ns () - start;
+        }
+        printf ("{\"bench\":\"print_matches\",\"type\":\"u32\",");
+        bench_print (ns, runs, &scan->print_stats, get_match_count (scan));
+        free_scan (scan);
+    }
+    if (null) fclose (null);
+
+    // dumps of the whole target, raw and compressed
+    for (compress = 0; compress < 2; compress++)
+    {
+        DUMP_HEADER header;
+        PROC_HANDLE hProc = open_process (target.pid);
+
+        if (!hProc) break;
+        for (r = 0; r < runs; r++)
+        {
+            unsigned long long start = clock_ns ();
+
+            if (!dump_process (hProc, BENCH_DUMP_FILE, compress, &header)) break;
+            ns[r] = clock_ns () - start;
+        }
+        close_process (hProc);
+        remove (BENCH_DUMP_FILE);
+        if (r < runs) continue;
+
+        // the block table is the end of the file
+        memset (&stats, 0, sizeof(stats));
+        stats.bytes_read = header.bytes;
+        printf ("{\"bench\":\"dump\",\"compress\":%s,\"file_bytes\":%llu,", compress ? "true" : "false",
+                header.block_offset + header.block_count * sizeof(DUMP_BLOCK));
+        bench_print (ns, runs, &stats, 0);
+    }
+
+    stop_child (&target);
+    return TRUE;
+}
+
+/**
+ * Function: parse_bench_params
+ * 
+ * Description: Reads the options of "memory_scanner bench", e.g. "heap=1024 regions=64 runs=5"
+ *
+ * Input:
+ *   argc, *argv[] - the options
+ *   *params - receives them, with defaults for those not given
+ *
+ * Output:
+ *   TRUE if every option was understood
+ */
+BOOL parse_bench_params (int argc, char *argv[], BENCH_PARAMS *params)
+{
+    int i;
+
+    params->heap_mb = 256;
+    params->regions = 16;
+    params->density = 0.001;
+    params->mutations = 1000;
+    params->runs = 3;
+
+    for (i = 0; i < argc; i++)
+    {
+        if (sscanf (argv[i], "heap=%u", &params->heap_mb) == 1) continue;
+        if (sscanf (argv[i], "regions=%u", &params->regions) == 1) continue;
+        if (sscanf (argv[i], "density=%lf", &params->density) == 1) continue;
+        if (sscanf (argv[i], "mutations=%u", &params->mutations) == 1) continue;
+        if (sscanf (argv[i], "runs=%u", &params->runs) == 1) continue;
+        return FALSE;
+    }
+
+    return params->heap_mb > 0 && params->regions > 0;
+}
+
+/*
+ * Batch mode
+ *
+ * "memory_scanner batch <script|-> [json|csv]" runs a script of scan steps without asking anything and prints what each
+ * step did, as JSON Lines (the default) or CSV, so that scans can be driven and checked by other programs. One command
+ * per line, and '#' starts a comment:
+ *
+ *   pid <pid>                      the process to scan
+ *   type <type>                    value type of the next new scan (u8 ... u64, i8 ... i64, f32, f64; u32 at first)
+ *   align <n>                      alignment of the next new scan (0 = natural, 1, 2, 4 or 8)
+ *   regions <words>                region filter of the next new scan (see parse_region_filter)
+ *   scan <search>                  a new scan: "unknown", a value, "equals <v>" or "between <a> <b>" (see parse_search)
+ *   next <search>                  a next scan with any condition, e.g. "decreased", "increased_by 5" or "changed"
+ *   results [limit [from]]         the matches (all of them, or limit from match number from on, counting from 0) with
+ *                                  the values the last scan found
+ *   sample <n> [seed]              n matches picked at random, in address order
+ *   summary region|module          the match count of every region, or of every module and of the memory outside them
+ *   save <file>, load <file>       a snapshot of the scan (see save_scan); load continues on the pid given, if any
+ *   poke <address> <value>         writes a value of the scan's type
+ *   sleep <ms>                     waits, e.g. for the target to change values
+ *   threads <n>, incremental on|off   set the threads and incremental updates of the scans (see SCAN_OPTIONS);
+ *                                  only consistent scans are incremental
+ *   compress on|off                keep the previous values of the next new scans compressed
+ *   consistent on|off [ms]         suspend the process while the scans copy its values, for at most ms (0 for no
+ *                                  limit): each scan then gives a pause record (see Consistent scans in Parallel scan
+ *                                  engine)
+ *   budget <seconds> [MB]          limits of the scans from now on (0 for none): a scan that runs out stops early and
+ *                                  gives a pending record with the bytes left as its value (see Scan limits)
+ *   resume                         scans what the last scan left undone, within the budget
+ *   group <template>               a new group scan for a struct (see parse_group_template), in the regions given
+ *   group_next <searches>          a next scan of the group, one condition per field (see parse_group_searches)
+ *   group_results [limit]          its matches, with the values of the fields separated by spaces
+ *   capture <prefix> <n> <ms> [compress]   n dumps of the process, ms apart, to <prefix>.0.dmp and on (see capture_dumps)
+ *   dump_scan <file> <search>      a new scan of a dump, with the type, alignment and regions given (see Offline scans)
+ *   dump_next <file> <search>      a next scan that reads the values from a dump instead of the process
+ *
+ * Each command gives one record, e.g. {"line":4,"command":"scan","matches":1520,"seconds":0.041}, and results gives one
+ * more per match: {"line":6,"command":"match","address":"0x7f3a1c2d0010","value":100}. summary gives one per region or
+ * module, with its base address, match count and module name as the value, and capture the number of dumps written as
+ * its value. A pause record has the time the process was suspended as its seconds and the bytes left to read from the
+ * running process as its value. CSV has the columns line,
+ * command, matches, seconds, address, value and error, left empty where they do not apply. The first command that fails
+ * gives a record with an error and ends the run.
+ *
+ * The console UI and this mode share the same engine, and a program can use it directly by including this file with
+ * MEMORY_SCANNER_LIBRARY defined: create_scan, update_scan and free_scan on a SCAN, parse_search for the conditions and
+ * first_match/next_match to walk the results. The settings of a scan are the SCAN_OPTIONS given to create_scan, and the
+ * stats of its last update are kept on it, so scans on different threads do not get in each other's way. Two scans
+ * of the same process with incremental updates share its record of written pages, though (see track_writes), so they
+ * should not both use it.
+ */
+
+// State of a batch run (see run_batch)
+typedef struct
+{
+    FILE *out;
+    BOOL csv; //CSV records instead of JSON Lines
+    unsigned int line; //line of the script being run
+    unsigned int pid; //0 until a pid command
+    VALUE_TYPE type; //settings of the next new scan
+    int alignment;
+    REGION_FILTER filter;
+    SCAN_OPTIONS options; //settings of the scans, the current one included
+    SCAN_LIMITS limits; //budget of the scans
+    SCAN *scan; //NULL until a scan or load command
+    GROUP_SCAN *group; //NULL until a group command
+} BATCH;
+
+/**
+ * Function: batch_print_string
+ * 
+ * Description: Prints a string as a JSON string or a CSV field, quoted and escaped as needed
+ */
+static void batch_print_string (BATCH *b, const char *s)
+{
+    fputc ('"', b->out);
+    for (; *s; s++)
+    {
+        if (b->csv && *s == '"') fputs ("\"\"", b->out);
+        else if (!b->csv && (*s == '"' || *s == '\\')) fprintf (b->out, "\\%c", *s);
+        else if (!b->csv && (unsigned char)*s < 0x20) fprintf (b->out, "\\u%04x", *s);
+        else fputc (*s, b->out);
+    }
+    fputc ('"', b->out);
+}
+
+/**
+ * Function: batch_print
+ * 
+ * Description: Prints one record of a batch run
+ *
+ * Input:
+ *   *b - the batch run
+ *   *command - the command the record is about ("match" for the matches of results)
+ *   matches - the match count, or -1 if there is none to print
+ *   seconds - the time the command took, or a negative number if it is not timed
+ *   *addr, *value - the address and value (formatted with format_number) of a match or poke, or NULL
+ *   *error - why the command failed, or NULL
+ */
+static void batch_print (BATCH *b, const char *command, long long matches, double seconds, const unsigned char *addr,
+                         const char *value, const char *error)
+{
+    // values that are not numbers ("nan", "inf") have to be strings in JSON
+    BOOL quote = value && strspn (value, "+-0123456789.e") != strlen (value);
+
+    if (b->csv)
+    {
+        fprintf (b->out, "%u,%s,", b->line, command);
+        if (matches >= 0) fprintf (b->out, "%lld", matches);
+        fputc (',', b->out);
+        if (seconds >= 0) fprintf (b->out, "%.6f", seconds);
+        fputc (',', b->out);
+        if (addr) fprintf (b->out, "0x%llx", (unsigned long long)(uintptr_t)addr);
+        fprintf (b->out, ",%s,", value ? value : "");
+        if (error) batch_print_string (b, error);
+        fputc ('\n', b->out);
+        return;
+    }
+
+    fprintf (b->out, "{\"line\":%u,\"command\":\"%s\"", b->line, command);
+    if (matches >= 0) fprintf (b->out, ",\"matches\":%lld", matches);
+    if (seconds >= 0) fprintf (b->out, ",\"seconds\":%.6f", seconds);
+    if (addr) fprintf (b->out, ",\"address\":\"0x%llx\"", (unsigned long long)(uintptr_t)addr);
+    if (value) fprintf (b->out, quote ? ",\"value\":\"%s\"" : ",\"value\":%s", value);
+    if (error)
+    {
+        fputs (",\"error\":", b->out);
+        batch_print_string (b, error);
+    }
+    fputs ("}\n", b->out);
+}
+
+/**
+ * Function: batch_print_scan
+ * 
+ * Description: Prints the record of a scan, next or resume command, a pending record if a limit stopped it and a pause
+ *              record if it was a consistent scan
+ */
+static void batch_print_scan (BATCH *b, const char *command, unsigned long long start)
+{
+    char text[32];
+
+    batch_print (b, command, (long long)get_match_count (b->scan), (clock_ns () - start) / 1e9, NULL, NULL, NULL);
+    if (b->scan->pending)
+    {
+        snprintf (text, sizeof(text), "%llu", get_pending_bytes (b->scan));
+        batch_print (b, "pending", -1, -1, NULL, text, NULL);
+    }
+    if (b->scan->options.consistent && b->scan->hProc)
+    {
+        snprintf (text, sizeof(text), "%llu", b->scan->pause_stats.bytes_left);
+        batch_print (b, "pause", -1, b->scan->pause_stats.pause / 1e3, NULL, text, NULL);
+    }
+}
+
+/**
+ * Function: batch_command
+ * 
+ * Description: Runs one command of a batch script and prints its records (see Batch mode)
+ *
+ * Input:
+ *   *b - the batch run
+ *   *command - the first word of the line
+ *   *args - the rest of the line, without leading and trailing blanks
+ *
+ * Output:
+ *   NULL if the command worked, otherwise why it failed
  */
+static const char* batch_command (BATCH *b, const char *command, const char *args)
+{
+    SEARCH_PARAMS search;
+    TYPED_VALUE val;
+    char text[64];
+    unsigned long long start;
+
+    if (strcmp (command, "pid") == 0)
+    {
+        if (sscanf (args, "%u", &b->pid) != 1 || b->pid == 0) return "expected a process id";
+    }
+    else if (strcmp (command, "type") == 0)
+    {
+        b->type = parse_type (args);
+        if (b->type == TYPE_COUNT)
+        {
+            b->type = TYPE_U32;
+            return "expected a type (u8 ... u64, i8 ... i64, f32, f64)";
+        }
+    }
+    else if (strcmp (command, "align") == 0)
+    {
+        if (sscanf (args, "%d", &b->alignment) != 1 || (b->alignment != 0 && b->alignment != 1 && b->alignment != 2 &&
+            b->alignment != 4 && b->alignment != 8)) return "expected an alignment of 0, 1, 2, 4 or 8";
+    }
+    else if (strcmp (command, "regions") == 0)
+    {
+        if (!parse_region_filter (args, &b->filter)) return "invalid region filter";
+    }
+    else if (strcmp (command, "threads") == 0)
+    {
+        if (sscanf (args, "%d", &b->options.threads) != 1 || b->options.threads < 0) return "expected a number of threads";
+        if (b->scan) b->scan->options.threads = b->options.threads;
+    }
+    else if (strcmp (command, "incremental") == 0)
+    {
+        if (strcmp (args, "on") != 0 && strcmp (args, "off") != 0) return "expected on or off";
+        b->options.incremental = strcmp (args, "on") == 0;
+        if (b->scan) b->scan->options.incremental = b->options.incremental;
+    }
+    else if (strcmp (command, "compress") == 0)
+    {
+        if (strcmp (args, "on") != 0 && strcmp (args, "off") != 0) return "expected on or off";
+        b->options.compressed = strcmp (args, "on") == 0;
+    }
+    else if (strcmp (command, "consistent") == 0)
+    {
+        char mode[8];
+        double ms = 0;
+
+        if (sscanf (args, "%7s %lf", mode, &ms) < 1 || (strcmp (mode, "on") != 0 && strcmp (mode, "off") != 0) || ms < 0)
+        {
+            return "expected on or off, and a pause in milliseconds";
+        }
+        b->options.consistent = strcmp (mode, "on") == 0;
+        b->options.max_pause = ms;
+        if (b->scan)
+        {
+            b->scan->options.consistent = b->options.consistent;
+            b->scan->options.max_pause = ms;
+        }
+    }
+    else if (strcmp (command, "sleep") == 0)
+    {
+        unsigned int ms;
+
+        if (sscanf (args, "%u", &ms) != 1) return "expected a time in milliseconds";
+        sleep_until (clock_ns () + ms * 1000000ULL);
+    }
+    else if (strcmp (command, "scan") == 0)
+    {
+        if (b->pid == 0) return "no pid given";
+        if (!parse_search (b->type, args, &search)) return "invalid search";
+        if (search.condition != COND_UNCONDITIONAL && search.condition != COND_EQUALS && search.condition != COND_BETWEEN)
+        {
+            return "a new scan has no previous values to compare with";
+        }
+        if (b->scan) free_scan (b->scan);
+
+        start = clock_ns ();
+        b->scan = create_scan (b->pid, b->type, b->alignment, &b->filter, &b->options);
+        if (!b->scan) return "could not open the process";
+        update_scan_limited (b->scan, &search, &b->limits);
+        batch_print_scan (b, command, start);
+        return NULL;
+    }
+    else if (strcmp (command, "next") == 0)
+    {
+        if (!b->scan) return "no scan yet";
+        if (!b->scan->hProc) return "the process of the dump is gone";
+        if (!parse_search (b->scan->type, args, &search)) return "invalid search";
+
+        start = clock_ns ();
+        update_scan_limited (b->scan, &search, &b->limits);
+        batch_print_scan (b, command, start);
+        return NULL;
+    }
+    else if (strcmp (command, "resume") == 0)
+    {
+        if (!b->scan) return "no scan yet";
+        if (!b->scan->pending) return "no stopped scan to resume";
 
-#include <windows.h>
-#include <stdio.h>
+        start = clock_ns ();
+        resume_scan (b->scan, &b->limits);
+        batch_print_scan (b, command, start);
+        return NULL;
+    }
+    else if (strcmp (command, "budget") == 0)
+    {
+        unsigned long long mb = 0;
 
-#define IS_IN_SEARCH(mb,offset) (mb->searchmask[(offset)/8] & (1<<((offset)%8)))
-#define REMOVE_FROM_SEARCH(mb,offset) mb->searchmask[(offset)/8] &= ~(1<<((offset)%8));
+        if (sscanf (args, "%lf %llu", &b->limits.seconds, &mb) < 1 || b->limits.seconds < 0)
+        {
+            b->limits.seconds = 0;
+            return "expected seconds and optionally MB";
+        }
+        b->limits.bytes = mb << 20;
+    }
+    else if (strcmp (command, "results") == 0 || strcmp (command, "sample") == 0)
+    {
+        MATCH_ITERATOR it;
+        MATCH_CURSOR *cursor;
+        unsigned char *addr;
+        unsigned long long limit = ULLONG_MAX, from = 0, seed = 1, n = 0;
+        unsigned long long *numbers = NULL;
+        size_t count = 0, i;
+        BOOL sample = command[0] == 's';
 
-// Memory structure of each memory block found using VirtualQueryEx
-typedef struct _MEMBLOCK
-{
-    HANDLE hProc; //process handle of the process this memory block is in (seems wasteful to store this multiple times unless we are scanning more than 1 process at a time)
-    unsigned char *addr; //pointer to hexadecimal address this memory block starts in
-    int size; //size of this memory block
-    unsigned char *buffer;
+        if (!b->scan) return "no scan yet";
+        if (sample && (sscanf (args, "%llu %llu", &limit, &seed) < 1 || limit > SIZE_MAX / sizeof(unsigned long long)))
+        {
+            return "expected a number of matches and optionally a seed";
+        }
+        if (!sample && args[0] && sscanf (args, "%llu %llu", &limit, &from) < 1) return "expected a number of matches";
 
-    unsigned char *searchmask;
-    int matches; //number of matches to the value we are searching for in this memory block
-    int data_size; //data size of the value we are scanning for (i.e. 1 byte, 2 bytes, or 4 bytes)
+        cursor = open_match_cursor (b->scan);
+        if (cursor && sample)
+        {
+            numbers = malloc ((limit ? limit : 1) * sizeof(unsigned long long));
+            if (numbers) count = sample_matches (cursor, (size_t)limit, seed, numbers);
+        }
+        if (!cursor || (sample && !numbers))
+        {
+            close_match_cursor (cursor);
+            return "out of memory";
+        }
 
-    struct _MEMBLOCK *next; //using linked list: link to next item
-} MEMBLOCK;
+        // a sample seeks to each of its matches, results only to the first one
+        for (i = 0; sample ? i < count : n < limit; i++)
+        {
+            if ((sample || i == 0) && !seek_match (cursor, sample ? numbers[i] : from, &it)) break;
+            if (!next_match (&it, &addr, &val)) break;
+            format_number (b->scan->type, &val, text, sizeof(text));
+            batch_print (b, "match", -1, -1, addr, text, NULL);
+            n++;
+        }
+        batch_print (b, command, (long long)get_cursor_total (cursor), -1, NULL, NULL, NULL);
+        free (numbers);
+        close_match_cursor (cursor);
+        return NULL;
+    }
+    else if (strcmp (command, "summary") == 0)
+    {
+        MATCH_CURSOR *cursor;
+        MATCH_GROUP *groups;
+        int count, g;
 
-// The type of search we are doing
-typedef enum 
-{
-    COND_UNCONDITIONAL, //match on every address (this happens if we use the unknown scan initially)
-    COND_EQUALS, //exact match
+        if (!b->scan) return "no scan yet";
+        if (strcmp (args, "region") != 0 && strcmp (args, "module") != 0) return "expected region or module";
 
-    COND_INCREASED, //increased value by unknown amount
-    COND_DECREASED, //decreased value by unknown amount
-} SEARCH_CONDITION;
+        cursor = open_match_cursor (b->scan);
+        count = cursor ? group_matches (cursor, args[0] == 'm', &groups) : -1;
+        if (count < 0)
+        {
+            close_match_cursor (cursor);
+            return "out of memory";
+        }
+        for (g = 0; g < count; g++)
+        {
+            batch_print (b, args, (long long)groups[g].matches, -1, groups[g].base, groups[g].module[0] ? groups[g].module : NULL, NULL);
+        }
+        batch_print (b, command, (long long)get_cursor_total (cursor), -1, NULL, NULL, NULL);
+        free (groups);
+        close_match_cursor (cursor);
+        return NULL;
+    }
+    else if (strcmp (command, "save") == 0)
+    {
+        if (!b->scan) return "no scan yet";
+        if (!args[0] || !save_scan (b->scan, args)) return "could not save the snapshot";
+    }
+    else if (strcmp (command, "load") == 0)
+    {
+        SCAN *loaded = args[0] ? load_scan (args, b->pid, &b->options) : NULL;
 
+        if (!loaded) return "could not load the snapshot";
+        if (b->scan) free_scan (b->scan);
+        b->scan = loaded;
+        batch_print (b, command, (long long)get_match_count (b->scan), -1, NULL, NULL, NULL);
+        return NULL;
+    }
+    else if (strcmp (command, "poke") == 0)
+    {
+        char address[64];
+        unsigned char *addr;
 
-// Enable or disable a privilege in an access token
-// source: http://msdn.microsoft.com/en-us/library/aa446619(VS.85).aspx
-BOOL SetPrivilege(
-    HANDLE hToken,          // access token handle
-    LPCTSTR lpszPrivilege,  // name of privilege to enable/disable
-    BOOL bEnablePrivilege   // to enable or disable privilege
-    )
+        if (!b->scan) return "no scan yet";
+        if (!b->scan->hProc) return "the process of the dump is gone";
+        if (sscanf (args, "%63s %63s", address, text) != 2 || !parse_value (b->scan->type, text, &val))
+        {
+            return "expected an address and a value";
+        }
+        addr = (unsigned char*)(uintptr_t)str2int (address);
+        if (!write_memory (b->scan->hProc, addr, &val, b->scan->data_size)) return "could not write the value";
+        format_number (b->scan->type, &val, text, sizeof(text));
+        batch_print (b, command, -1, -1, addr, text, NULL);
+        return NULL;
+    }
+    else if (strcmp (command, "group") == 0)
+    {
+        GROUP_TEMPLATE tmpl;
+
+        if (b->pid == 0) return "no pid given";
+        if (!parse_group_template (args, &tmpl)) return "invalid struct template";
+        free_group_scan (b->group);
+
+        start = clock_ns ();
+        b->group = group_scan (b->pid, &tmpl, &b->filter, &b->options);
+        if (!b->group) return "could not scan for the template (no equals or between condition, or no process)";
+        batch_print (b, command, (long long)b->group->count, (clock_ns () - start) / 1e9, NULL, NULL, NULL);
+        return NULL;
+    }
+    else if (strcmp (command, "group_next") == 0)
+    {
+        SEARCH_PARAMS searches[GROUP_MAX_FIELDS];
+
+        if (!b->group) return "no group scan yet";
+        if (!parse_group_searches (&b->group->tmpl, args, searches)) return "invalid searches";
+
+        start = clock_ns ();
+        if (!update_group_scan (b->group, searches)) return "out of memory";
+        batch_print (b, command, (long long)b->group->count, (clock_ns () - start) / 1e9, NULL, NULL, NULL);
+        return NULL;
+    }
+    else if (strcmp (command, "group_results") == 0)
+    {
+        char values[GROUP_MAX_FIELDS * 32];
+        unsigned long long limit = ULLONG_MAX;
+        size_t i;
+
+        if (!b->group) return "no group scan yet";
+        if (args[0] && sscanf (args, "%llu", &limit) != 1) return "expected a number of matches";
+
+        for (i = 0; i < b->group->count && i < limit; i++)
+        {
+            format_group_values (b->group, i, values, sizeof(values));
+            batch_print (b, "match", -1, -1, (unsigned char*)(uintptr_t)b->group->records[i * group_record_width (&b->group->tmpl)],
+                         values, NULL);
+        }
+        batch_print (b, command, (long long)b->group->count, -1, NULL, NULL, NULL);
+        return NULL;
+    }
+    else if (strcmp (command, "capture") == 0)
+    {
+        char prefix[260], mode[16] = "";
+        unsigned int interval;
+        int count, written;
+        PROC_HANDLE hProc;
+
+        if (b->pid == 0) return "no pid given";
+        if (sscanf (args, "%259s %d %u %15s", prefix, &count, &interval, mode) < 3 || count < 1 ||
+            (mode[0] && strcmp (mode, "compress") != 0)) return "expected a prefix, a number of dumps, milliseconds and optionally compress";
+
+        hProc = open_process (b->pid);
+        if (!hProc) return "could not open the process";
+        start = clock_ns ();
+        written = capture_dumps (hProc, prefix, count, interval, mode[0] != 0, NULL);
+        close_process (hProc);
+        if (written < count) return "could not write a dump";
+        snprintf (text, sizeof(text), "%d", written);
+        batch_print (b, command, -1, (clock_ns () - start) / 1e9, NULL, text, NULL);
+        return NULL;
+    }
+    else if (strcmp (command, "dump_scan") == 0 || strcmp (command, "dump_next") == 0)
+    {
+        char path[260];
+        DUMP_VIEW *view;
+        BOOL next = command[5] == 'n';
+        BOOL ok;
+        int n;
+
+        if (next && !b->scan) return "no scan yet";
+        if (sscanf (args, "%259s %n", path, &n) != 1) return "expected a dump file and a search";
+        if (!parse_search (next ? b->scan->type : b->type, args + n, &search)) return "invalid search";
+        if (!next && search.condition != COND_UNCONDITIONAL && search.condition != COND_EQUALS && search.condition != COND_BETWEEN)
+        {
+            return "a new scan has no previous values to compare with";
+        }
+        view = open_dump (path);
+        if (!view) return "not a dump";
+
+        start = clock_ns ();
+        if (!next)
+        {
+            if (b->scan) free_scan (b->scan);
+            b->scan = create_dump_scan (view, b->type, b->alignment, &b->filter, &b->options);
+        }
+        ok = b->scan && update_scan_dump (b->scan, &search, view);
+        close_dump (view);
+        if (!b->scan) return "no region of the dump passes the filter";
+        if (!ok) return "out of memory";
+        batch_print_scan (b, command, start);
+        return NULL;
+    }
+    else return "unknown command";
+
+    batch_print (b, command, -1, -1, NULL, NULL, NULL);
+    return NULL;
+}
+
+/**
+ * Function: run_batch
+ * 
+ * Description: Runs a batch script (see Batch mode)
+ *
+ * Input:
+ *   *script - the script
+ *   *out - where the records go
+ *   csv - TRUE for CSV records, FALSE for JSON Lines
+ *
+ * Output:
+ *   TRUE if every command worked
+ */
+BOOL run_batch (FILE *script, FILE *out, BOOL csv)
 {
-	TOKEN_PRIVILEGES tp;
-	LUID luid;
+    BATCH b;
+    char line[1024];
+    char command[32];
+    const char *error = NULL;
 
-	if ( !LookupPrivilegeValue(
-			NULL,            // lookup privilege on local system
-			lpszPrivilege,   // privilege to lookup
-			&luid ) )        // receives LUID of privilege
-	{
-		printf("LookupPrivilegeValue error: %u\n", GetLastError() );
-		return FALSE;
-	}
+    memset (&b, 0, sizeof(b));
+    b.out = out;
+    b.csv = csv;
+    b.type = TYPE_U32;
+    default_region_filter (&b.filter);
+    default_scan_options (&b.options);
 
-	tp.PrivilegeCount = 1;
-	tp.Privileges[0].Luid = luid;
-	if (bEnablePrivilege)
-		tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
-	else
-		tp.Privileges[0].Attributes = 0;
+    if (csv) fprintf (out, "line,command,matches,seconds,address,value,error\n");
 
-	// Enable the privilege or disable all privileges.
+    while (!error && fgets (line, sizeof(line), script))
+    {
+        char *args;
+        size_t len;
+        int n;
 
-	if ( !AdjustTokenPrivileges(
-		   hToken,
-		   FALSE,
-		   &tp,
-		   sizeof(TOKEN_PRIVILEGES),
-		   (PTOKEN_PRIVILEGES) NULL,
-		   (PDWORD) NULL) )
-	{
-		  printf("AdjustTokenPrivileges error: %u\n", GetLastError() );
-		  return FALSE;
-	}
+        b.line++;
+        line[strcspn (line, "#\r\n")] = 0;
+        if (sscanf (line, " %31s%n", command, &n) != 1) continue;
 
-	if (GetLastError() == ERROR_NOT_ALL_ASSIGNED)
+        args = line + n + strspn (line + n, " \t");
+        for (len = strlen (args); len > 0 && (args[len-1] == ' ' || args[len-1] == '\t'); len--) args[len-1] = 0;
 
-	{
-		  printf("The token does not have the specified privilege. \n");
-		  return FALSE;
-	}
+        error = batch_command (&b, command, args);
+        if (error) batch_print (&b, command, -1, -1, NULL, NULL, error);
+        fflush (out);
+    }
 
-	return TRUE;
+    if (b.scan) free_scan (b.scan);
+    free_group_scan (b.group);
+
+    return error == NULL;
 }
 
+#ifndef MEMORY_SCANNER_LIBRARY
+
 /**
- * Function: create_memblock
+ * Function: ui_read_value
  * 
- * Description: Creates an individual block of memory that stores data of each individual virtual page. 
+ * Description: UI function --- Asks for a value of the scan's type
  *
  * Input:
- *   hProc - process handle of the process this memory block is in
- *   *meminfo - a pointer to the Windows MEMORY_BASIC_INFORMATION structure returned by VirtualQueryEx
- *   data_size - data size of the value we are scanning for (i.e. 1 byte, 2 bytes, or 4 bytes)
+ *   *prompt - what to ask for
+ *   type - the type of the value
+ *   *val - receives the value
  *
  * Output:
- *   The created memory block structure
+ *   TRUE if a valid value was entered
  */
-MEMBLOCK* create_memblock (HANDLE hProc, MEMORY_BASIC_INFORMATION *meminfo, int data_size)
+BOOL ui_read_value (const char *prompt, VALUE_TYPE type, TYPED_VALUE *val)
 {
-    MEMBLOCK *mb = malloc (sizeof(MEMBLOCK));
+    char s[64];
 
-    if (mb)
+    printf ("%s", prompt);
+    fgets (s,sizeof(s),stdin);
+    printf ("\r\n");
+    if (!parse_value (type, s, val))
     {
-        mb->hProc = hProc;
-        mb->addr = meminfo->BaseAddress;
-        mb->size = meminfo->RegionSize;
-        mb->buffer = malloc (meminfo->RegionSize);
-        mb->searchmask = malloc (meminfo->RegionSize/8);
-        memset (mb->searchmask, 0xff, meminfo->RegionSize/8);
-        mb->matches = meminfo->RegionSize;
-        mb->data_size = data_size;
-        mb->next = NULL;
+        printf ("Not a valid %s value\r\n", value_types[type].name);
+        return FALSE;
     }
 
-    return mb;
+    return TRUE;
 }
 
 /**
- * Function: free_memblock
+ * Function: ui_read_search
  * 
- * Description: Frees the buffer and searchmask inside an individual memory block structure, then frees the memory block.
+ * Description: UI function --- Turns a menu choice or a value typed at a scan prompt into a search, asking for the operands
+ *              the condition needs
  *
  * Input:
- *   *mb - a pointer to the memory block to be freed
+ *   type - the value type of the scan
+ *   *s - what was typed: a value, or one of the condition letters printed by ui_run_scan (or 'u' for unknown on the first scan)
+ *   first - TRUE on the first scan, where there are no previous values to compare with
+ *   *search - receives the search
+ *
+ * Output:
+ *   TRUE if a valid search was entered
  */
-void free_memblock (MEMBLOCK *mb)
+BOOL ui_read_search (VALUE_TYPE type, const char *s, BOOL first, SEARCH_PARAMS *search)
 {
-    if (mb)
+    BOOL letter = s[0] != 0 && (s[1] == '\n' || s[1] == '\r' || s[1] == 0);
+
+    memset (search, 0, sizeof(*search));
+
+    if (letter && s[0] == 'b')
+    {
+        search->condition = COND_BETWEEN;
+        return ui_read_value ("Enter the lower bound: ", type, &search->a) && ui_read_value ("Enter the upper bound: ", type, &search->b);
+    }
+    if (letter && s[0] == 'a')
     {
-        if (mb->buffer)
+        TYPED_VALUE eps;
+
+        if (!value_types[type].is_float)
         {
-            free (mb->buffer);
+            printf ("Approximate scans need a float type\r\n");
+            return FALSE;
         }
-
-        if (mb->searchmask)
+        search->condition = COND_EQUALS;
+        if (!ui_read_value ("Enter the value: ", type, &search->a) || !ui_read_value ("Enter the epsilon: ", TYPE_F64, &eps)) return FALSE;
+        search->epsilon = eps.f64;
+        return TRUE;
+    }
+    if (letter && first)
+    {
+        // there are no previous values yet, so only the unknown scan is left
+        search->condition = COND_UNCONDITIONAL;
+        if (s[0] == 'u') return TRUE;
+    }
+    else if (letter)
+    {
+        switch (s[0])
         {
-            free (mb->searchmask);
+            case 'i': search->condition = COND_INCREASED; return TRUE;
+            case 'd': search->condition = COND_DECREASED; return TRUE;
+            case 'c': search->condition = COND_CHANGED; return TRUE;
+            case 'u': search->condition = COND_UNCHANGED; return TRUE;
+            case '+':
+            case '-':
+                search->condition = (s[0] == '+') ? COND_INCREASED_BY : COND_DECREASED_BY;
+                if (!ui_read_value ("Enter the amount: ", type, &search->a)) return FALSE;
+                if (value_types[type].is_float)
+                {
+                    TYPED_VALUE eps;
+                    if (!ui_read_value ("Enter the epsilon: ", TYPE_F64, &eps)) return FALSE;
+                    search->epsilon = eps.f64;
+                }
+                return TRUE;
         }
+    }
 
-        free (mb);
+    search->condition = COND_EQUALS;
+    if (!parse_value (type, s, &search->a))
+    {
+        printf ("Not a valid %s value\r\n", value_types[type].name);
+        return FALSE;
     }
+
+    return TRUE;
+}
+
+double ui_scan_budget = 0; //seconds a scan started from the console may take before it stops (0: no limit)
+SCAN_OPTIONS ui_options = { 0, TRUE, FALSE, FALSE, 0, READ_GAP }; //settings of the scans made from the console
+static volatile sig_atomic_t ui_interrupted; //Ctrl+C was pressed during a scan
+
+static void ui_on_interrupt (int sig)
+{
+    ui_interrupted = 1;
+    signal (sig, ui_on_interrupt);
 }
 
 /**
- * Function: update_memblock
+ * Function: ui_scan_progress
  * 
- * Description: Updates an individual memory block structure based on a given memory scan/search condition
+ * Description: UI function --- Progress callback of console scans: keeps one line up to date once a scan takes a while,
+ *              and stops the scan on Ctrl+C
  *
  * Input:
- *   *mb - a pointer to the memory block to be updated
- *   condition - the type of scan to be performed
- *   val - (only used if doing an exact value match new/next scan) the value to be searched for
+ *   *progress - how far the scan has got
+ *   param - a BOOL set once the line has been printed
  */
-void update_memblock (MEMBLOCK *mb, SEARCH_CONDITION condition, unsigned int val)
+static BOOL ui_scan_progress (const SCAN_PROGRESS *progress, void *param)
 {
-    static unsigned char tempbuf[128*1024];
-    unsigned int bytes_left;
-    unsigned int total_read;
-    unsigned int bytes_to_read;
-    unsigned int bytes_read;
+    BOOL *printed = param;
 
-    if (mb->matches > 0)
+    if (*printed || progress->seconds >= PROGRESS_INTERVAL / 1000.0)
+    {
+        printf ("\r%3.0f%%  %llu of %llu MB in %u regions  %.0f MB/s  %.0f s left  (Ctrl+C stops)   ",
+                progress->bytes_total ? 100.0 * progress->bytes_done / progress->bytes_total : 100.0,
+                progress->bytes_done >> 20, progress->bytes_total >> 20, progress->blocks, progress->rate / (1 << 20),
+                progress->eta);
+        fflush (stdout);
+        *printed = TRUE;
+    }
+
+    return !ui_interrupted;
+}
+
+/**
+ * Function: ui_update_scan
+ * 
+ * Description: UI function --- Runs a scan (or resumes the stopped one) with a progress line, Ctrl+C to stop it and
+ *              ui_scan_budget, and says what is left if it stopped and how long a consistent scan paused the process
+ *
+ * Input:
+ *   *scan - the scan
+ *   *search - the condition, or NULL to resume the stopped scan
+ */
+void ui_update_scan (SCAN *scan, const SEARCH_PARAMS *search)
+{
+    SCAN_LIMITS limits;
+    BOOL printed = FALSE;
+    void (*previous)(int);
+
+    memset (&limits, 0, sizeof(limits));
+    limits.seconds = ui_scan_budget;
+    limits.progress = ui_scan_progress;
+    limits.param = &printed;
+
+    ui_interrupted = 0;
+    previous = signal (SIGINT, ui_on_interrupt);
+    if (search) update_scan_limited (scan, search, &limits);
+    else resume_scan (scan, &limits);
+    signal (SIGINT, previous == SIG_ERR ? SIG_DFL : previous);
+
+    if (printed) printf ("\r\n");
+    if (scan->options.consistent && scan->hProc)
+    {
+        printf ("Process %s for %.1f ms (%llu KB copied, %llu KB read after resuming)\r\n",
+                scan->pause_stats.suspended ? "suspended" : "not suspended", scan->pause_stats.pause,
+                scan->pause_stats.bytes_staged >> 10, scan->pause_stats.bytes_left >> 10);
+    }
+    if (scan->pending)
+    {
+        printf ("Scan stopped with %llu MB left; the matches there are from the scan before ([r] resumes)\r\n",
+                get_pending_bytes (scan) >> 20);
+    }
+}
+
+/**
+ * Function: ui_new_scan
+ * 
+ * Description: UI function --- Starts the program by asking user for input
+ *
+ * Output:
+ *   SCAN* - the created scan results based on the user input
+ */
+SCAN* ui_new_scan(void)
+{
+    SCAN *scan = NULL;
+    unsigned int pid;
+    VALUE_TYPE type;
+    int alignment;
+    REGION_FILTER filter;
+    SEARCH_PARAMS start;
+    char s[256];
+
+    while(1)
     {
-        bytes_left = mb->size;
-        total_read = 0;
-        mb->matches = 0;
-    
-        while (bytes_left)
+        printf ("\r\nEnter the pid: ");
+        fgets (s,sizeof(s),stdin);
+        pid = str2int (s);
+        printf ("\r\nEnter the value type (u8, u16, u32, u64, i8, i16, i32, i64, f32, f64): ");
+        fgets (s,sizeof(s),stdin);
+        type = parse_type (s);
+        if (type == TYPE_COUNT)
         {
-            bytes_to_read = (bytes_left > sizeof(tempbuf)) ? sizeof(tempbuf) : bytes_left;
-            ReadProcessMemory (mb->hProc, mb->addr + total_read, tempbuf, bytes_to_read, (DWORD*)&bytes_read);
-            if (bytes_read != bytes_to_read) break;
-    
-            if (condition == COND_UNCONDITIONAL)
-            {
-                memset (mb->searchmask + (total_read/8), 0xff, bytes_read/8);
-                mb->matches += bytes_read;
-            }
-            else
-            {
-                unsigned int offset;
-    
-                for (offset = 0; offset < bytes_read; offset += mb->data_size)
-                {
-                    if (IS_IN_SEARCH(mb,(total_read+offset)))
-                    {
-                        BOOL is_match = FALSE;
-                        unsigned int temp_val;
-                        unsigned int prev_val = 0;
-    
-                        switch (mb->data_size)
-                        {
-                            case 1:
-                                temp_val = tempbuf[offset];
-                                prev_val = *((unsigned char*)&mb->buffer[total_read+offset]);
-                                break;
-                            case 2:
-                                temp_val = *((unsigned short*)&tempbuf[offset]);
-                                prev_val = *((unsigned short*)&mb->buffer[total_read+offset]);
-                                break;
-                            case 4:
-                            default:
-                                temp_val = *((unsigned int*)&tempbuf[offset]);
-                                prev_val = *((unsigned int*)&mb->buffer[total_read+offset]);
-                                break;
-                        }
-    
-                        switch (condition)
-                        {
-                            case COND_EQUALS:
-                                is_match = (temp_val == val);
-                                break;
-                            case COND_INCREASED:
-                                is_match = (temp_val > prev_val);
-                                break;
-                            case COND_DECREASED:
-                                is_match = (temp_val < prev_val);
-                                break;
-                            default:
-                                break;
-                        }
-    
-                        if (is_match)
-                        {
-                            mb->matches++;
-                        }
-                        else
-                        {
-                            REMOVE_FROM_SEARCH(mb,(total_read+offset));
-                        }
-                    }
-                }
-            }
-    
-            memcpy (mb->buffer + total_read, tempbuf, bytes_read);
-    
-            bytes_left -= bytes_read;
-            total_read += bytes_read;
+            printf ("\r\nInvalid type");
+            continue;
+        }
+        printf ("\r\nEnter the alignment (1, 2, 4, 8, or empty for natural): ");
+        fgets (s,sizeof(s),stdin);
+        alignment = (s[0] == '\n' || s[0] == '\r' || s[0] == '\0') ? 0 : (int)str2int (s);
+        if (alignment != 0 && alignment != 1 && alignment != 2 && alignment != 4 && alignment != 8)
+        {
+            printf ("\r\nInvalid alignment");
+            continue;
+        }
+        printf ("\r\nEnter the regions to scan (e.g. \"private min=0x10000 priority\"), or empty for every writable one: ");
+        fgets (s,sizeof(s),stdin);
+        if (!parse_region_filter (s, &filter))
+        {
+            printf ("\r\nInvalid regions (private, mapped, image, +x, -x, module=, from=, to=, min=, max=, priority)");
+            continue;
         }
-    
-        mb->size = total_read;
+        printf ("\r\nEnter the start value, 'u' for unknown, 'b' for between or 'a' for approximately: ");
+        fgets (s,sizeof(s),stdin);
+        printf ("\r\n");
+        if (!ui_read_search (type, s, TRUE, &start)) continue;
+
+        scan = create_scan (pid, type, alignment, &filter, &ui_options);
+        if (scan) break;
+        printf ("\r\nInvalid scan");
+    }
+
+    ui_update_scan (scan, &start);
+    printf ("\r\n%llu matches found\r\n", get_match_count(scan));
+    if (scan->compressed)
+    {
+        printf ("Previous values kept in %llu KB\r\n", get_baseline_size (scan) >> 10);
     }
+
+    return scan;
 }
 
+/**
+ * Function: ui_poke
+ * 
+ * Description: UI function --- Continuation after ui_new_scan; Ask the user for further input after the initial scan in order to update a given memory address value
+ *
+ * Output:
+ *   hProc - process handle of the process which the memory address is in
+ *   type - the type of the value to be written
+ */
+void ui_poke (PROC_HANDLE hProc, VALUE_TYPE type)
+{
+    unsigned char *addr;
+    TYPED_VALUE val;
+    char s[64];
+
+    printf ("Enter the address: ");
+    fgets (s,sizeof(s),stdin);
+    addr = (unsigned char*)(uintptr_t)str2int (s);
+
+    printf ("\r\n");
+    if (ui_read_value ("Enter the value: ", type, &val))
+    {
+        poke (hProc, value_types[type].size, addr, &val);
+    }
+}
 
 /**
- * Function: create_scan
+ * Function: ui_aob_search
  * 
- * Description: Get the process handle and map out all virtual pages which we can write to using VirtualQueryEx, creating a linked list memory block structure based on the mapped data
+ * Description: UI function --- Asks for byte patterns and prints where they are in the process
  *
  * Input:
- *   pid - the process identifier to be scanned
- *   data_size - the number of bytes to be searched for (i.e. 1 byte, 2 byte, or 4 byte types)
+ *   hProc - the process to search
  */
-MEMBLOCK* create_scan (unsigned int pid, int data_size)
+void ui_aob_search (PROC_HANDLE hProc)
 {
-    MEMBLOCK *mb_list = NULL;
-    MEMORY_BASIC_INFORMATION meminfo;
-    unsigned char *addr = 0;
+    AOB_PATTERN *patterns = malloc (AOB_MAX_PATTERNS * sizeof(AOB_PATTERN));
+    unsigned long long searched;
+    char s[1024];
+    int count = 0, k;
+    size_t i;
 
-    HANDLE hProc = OpenProcess (PROCESS_ALL_ACCESS, FALSE, pid);
-    DWORD error  = GetLastError();
+    if (!patterns) return;
 
-    if (hProc)
+    printf ("Enter the byte patterns (e.g. 48 8B ?? ?? 89), one per line, and an empty line to search\r\n");
+    while (count < AOB_MAX_PATTERNS && fgets (s,sizeof(s),stdin) && s[strspn (s, " \t\r\n")] != 0)
+    {
+        if (parse_aob (s, &patterns[count])) count++;
+        else printf ("Not a valid pattern\r\n");
+    }
+
+    if (count > 0)
     {
-        while (1)
+        searched = aob_search (hProc, patterns, count, &ui_options);
+        printf ("%llu MB searched\r\n", searched >> 20);
+        for (k = 0; k < count; k++)
         {
-            if (VirtualQueryEx (hProc, addr, &meminfo, sizeof(meminfo)) == 0)
+            printf ("pattern %d: %llu matches\r\n", k + 1, (unsigned long long)patterns[k].count);
+            for (i = 0; i < patterns[k].count && i < AOB_PRINT_LIMIT; i++)
             {
-                break;
-            }
-#define WRITABLE (PAGE_READWRITE | PAGE_WRITECOPY | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)
-            if ((meminfo.State & MEM_COMMIT) && (meminfo.Protect & WRITABLE))
-            {
-                MEMBLOCK *mb = create_memblock (hProc, &meminfo, data_size);
-                if (mb)
-                {
-                    mb->next = mb_list;
-                    mb_list = mb;
-                }
+                printf ("  0x%08llx\r\n", (unsigned long long)(uintptr_t)patterns[k].results[i]);
             }
-            addr = (unsigned char*)meminfo.BaseAddress + meminfo.RegionSize;
+            free_aob_results (&patterns[k]);
         }
     }
-    else
-        printf ("Failed to open process - error - %d\r\n", error);
 
-    return mb_list;
+    free (patterns);
 }
 
 /**
- * Function: free_scan
+ * Function: ui_group_scan
  * 
- * Description: Frees all the scan data (which is just a memory block linked list).
+ * Description: UI function --- Asks for a struct template, prints the structs matching it and narrows them down with
+ *              next scans until an empty line
  *
  * Input:
- *   *mb_list - a pointer to the start of the memory block linked list
+ *   pid - the process to scan
  */
-void free_scan (MEMBLOCK *mb_list)
+void ui_group_scan (unsigned int pid)
 {
-    CloseHandle (mb_list->hProc);
+    GROUP_TEMPLATE tmpl;
+    SEARCH_PARAMS searches[GROUP_MAX_FIELDS];
+    GROUP_SCAN *group;
+    char s[1024];
+    char values[GROUP_MAX_FIELDS * 32];
+    size_t i;
 
-    while (mb_list)
+    printf ("Enter the struct template, e.g. u32@0 100; f32@8 between -1000 1000; f32@12\r\n");
+    fgets (s,sizeof(s),stdin);
+    if (!parse_group_template (s, &tmpl))
+    {
+        printf ("Not a valid template\r\n");
+        return;
+    }
+
+    group = group_scan (pid, &tmpl, NULL, &ui_options);
+    if (!group)
+    {
+        printf ("Group scans need a field with an equals or between condition\r\n");
+        return;
+    }
+
+    while (1)
     {
-        MEMBLOCK *mb = mb_list;
-        mb_list = mb_list->next;
-        free_memblock (mb);
+        printf ("%llu matches found\r\n", (unsigned long long)group->count);
+        for (i = 0; i < group->count && i < AOB_PRINT_LIMIT; i++)
+        {
+            format_group_values (group, i, values, sizeof(values));
+            printf ("  0x%08llx: %s\r\n", group->records[i * group_record_width (&group->tmpl)], values);
+        }
+
+        printf ("\r\nEnter the next conditions, one per field separated by ';', or an empty line to stop\r\n");
+        if (!fgets (s,sizeof(s),stdin) || s[strspn (s, " \t\r\n")] == 0) break;
+        s[strcspn (s, "\r\n")] = 0;
+        if (!parse_group_searches (&group->tmpl, s, searches)) printf ("Not valid conditions\r\n");
+        else if (!update_group_scan (group, searches)) printf ("Out of memory; the structs not tested yet were kept\r\n");
     }
+
+    free_group_scan (group);
 }
 
 /**
- * Function: update_memblock
+ * Function: ui_dump
  * 
- * Description: Updates all the scan data (which is just a memory block linked list) based on a given memory scan/search condition
+ * Description: UI function --- Asks for a file and writes a dump of the process to it
  *
  * Input:
- *   *mb_list - a pointer to the start of the memory block linked list
- *   condition - the type of scan to be performed
- *   val - (only used if doing an exact value match new/next scan) the value to be searched for
+ *   hProc - the process to dump
  */
-void update_scan (MEMBLOCK *mb_list, SEARCH_CONDITION condition, unsigned int val)
+void ui_dump (PROC_HANDLE hProc)
 {
-    MEMBLOCK *mb = mb_list;
-    while (mb)
+    DUMP_HEADER header;
+    char path[260];
+    char s[64];
+
+    printf ("Enter the dump file: ");
+    fgets (path,sizeof(path),stdin);
+    path[strcspn (path, "\r\n")] = 0;
+    printf ("\r\nCompress the dump (y/n)? ");
+    fgets (s,sizeof(s),stdin);
+    printf ("\r\n");
+
+    if (!dump_process (hProc, path, s[0] == 'y', &header))
     {
-        update_memblock (mb, condition, val);
-        mb = mb->next;
+        printf ("Failed to write the dump\r\n");
+        return;
     }
+    printf ("%u regions, %llu MB of memory in %llu MB\r\n", header.region_count, header.bytes >> 20,
+            (header.block_offset + header.block_count * sizeof(DUMP_BLOCK)) >> 20);
 }
 
 /**
- * Function: dump_scan_info
+ * Function: ui_view_dump
  * 
- * Description: Print out the entire program's memory in hex to the screen
+ * Description: UI function --- Hex viewer for a dump file; only the blocks that are shown are read from the file
  *
  * Input:
- *   *mb_list - a pointer to the start of the memory block linked list
- *
- * Notes:
- *   Not very useful since it takes forever to print everything to screen and we can't do anything with it. Probably better to save to disk.
+ *   *path - the dump file
  */
-void dump_scan_info (MEMBLOCK *mb_list)
+void ui_view_dump (const char *path)
 {
-    MEMBLOCK *mb = mb_list;
+    DUMP_VIEW *view = open_dump (path);
+    unsigned long long addr;
+    unsigned int i, line;
+    char s[64];
+
+    if (!view)
+    {
+        printf ("%s is not a dump\r\n", path);
+        return;
+    }
 
-    while (mb)
+    printf ("Dump of process %u: %u regions, %llu MB of memory\r\n", view->header->pid, view->header->region_count, view->header->bytes >> 20);
+    addr = view->header->region_count ? view->regions[0].addr : 0;
+    while (1)
     {
-        int i;
-        printf ("0x%08x %d\r\n", mb->addr, mb->size);
+        printf ("\r\nEnter an address, 'r' to list the regions, nothing to go on or 'q' to go back: ");
+        if (!fgets (s,sizeof(s),stdin) || s[0] == 'q') break;
+        printf ("\r\n");
 
-        for (i = 0; i < mb->size; i++)
+        if (s[0] == 'r')
         {
-            printf ("%02x", mb->buffer[i]);
+            for (i = 0; i < view->header->region_count; i++)
+            {
+                const DUMP_REGION *region = &view->regions[i];
+                printf ("0x%08llx %10llu KB %c%c%c\r\n", region->addr, region->size >> 10, (region->protect & REGION_READ) ? 'r' : '-',
+                        (region->protect & REGION_WRITE) ? 'w' : '-', (region->protect & REGION_EXEC) ? 'x' : '-');
+            }
+            continue;
         }
-        printf ("\r\n");
+        if (s[0] != '\n' && s[0] != '\r') addr = str2int (s);
+
+        // bytes that are not in the dump are shown as ??
+        for (line = 0; line < DUMP_VIEW_LINES; line++, addr += 16)
+        {
+            unsigned char bytes[16];
+            BOOL ok[16];
+            size_t n = read_dump (view, addr, bytes, 16);
+
+            for (i = 0; i < 16; i++) ok[i] = i < n || read_dump (view, addr + i, &bytes[i], 1) == 1;
 
-        mb = mb->next;
+            printf ("0x%08llx: ", addr);
+            for (i = 0; i < 16; i++)
+            {
+                if (ok[i]) printf ("%02x ", bytes[i]);
+                else printf ("?? ");
+            }
+            printf (" ");
+            for (i = 0; i < 16; i++)
+            {
+                printf ("%c", (ok[i] && bytes[i] >= 0x20 && bytes[i] < 0x7f) ? bytes[i] : '.');
+            }
+            printf ("\r\n");
+        }
     }
+
+    close_dump (view);
 }
 
 /**
- * Function: poke
+ * Function: ui_capture_dumps
  * 
- * Description: Update a given memory address with a new value
+ * Description: UI function --- Dumps the process a number of times, a given time apart, for scanning later
  *
  * Input:
- *   hProc - process handle of the process which the memory address is in
- *   data_size - the data size of the value to be updated (i.e. 1 byte, 2 byte, or 4 byte types)
- *   addr - the hexadecimal memory address to be updated
- *   val - the new value the address is to be updated with
+ *   hProc - the process to dump
  */
-void poke (HANDLE hProc, int data_size, unsigned int addr, unsigned int val)
+void ui_capture_dumps (PROC_HANDLE hProc)
 {
-    if (WriteProcessMemory (hProc, (void*)addr, &val, data_size, NULL) == 0)
+    char prefix[260];
+    char path[1024];
+    char s[64];
+    int count, written;
+    unsigned int interval;
+    BOOL compress;
+
+    printf ("Enter the start of the dump file names: ");
+    fgets (prefix,sizeof(prefix),stdin);
+    prefix[strcspn (prefix, "\r\n")] = 0;
+    printf ("\r\nEnter the number of dumps: ");
+    fgets (s,sizeof(s),stdin);
+    count = (int)str2int (s);
+    printf ("\r\nEnter the milliseconds between them: ");
+    fgets (s,sizeof(s),stdin);
+    interval = (unsigned int)str2int (s);
+    printf ("\r\nCompress the dumps (y/n)? ");
+    fgets (s,sizeof(s),stdin);
+    compress = s[0] == 'y';
+    printf ("\r\n");
+    if (count < 1) return;
+
+    written = capture_dumps (hProc, prefix, count, interval, compress, NULL);
+    if (written == 0)
     {
-        printf ("poke failed\r\n");
+        printf ("Failed to write the dumps\r\n");
+        return;
     }
+    get_capture_path (prefix, 0, path, sizeof(path));
+    printf ("%d dumps written, from %s", written, path);
+    get_capture_path (prefix, written - 1, path, sizeof(path));
+    printf (" to %s\r\n", path);
 }
 
 /**
- * Function: peek
+ * Function: ui_dump_scan
  * 
- * Description: View the value of a given memory address
+ * Description: UI function --- Runs a scan on a dump instead of the process (see Offline scans): a next scan of the
+ *              current scan, or a new scan of the same type and alignment
  *
  * Input:
- *   hProc - process handle of the process which the memory address is in
- *   data_size - the data size of the value to be viewed (i.e. 1 byte, 2 byte, or 4 byte types)
- *   addr - the hexadecimal memory address to be viewed
+ *   *scan - the current scan
+ *   next - TRUE for a next scan, FALSE for a new one
+ *
+ * Output:
+ *   The new scan, or NULL if there is none (after a next scan, or if it failed)
  */
-unsigned int peek (HANDLE hProc, int data_size, unsigned int addr)
+SCAN* ui_dump_scan (SCAN *scan, BOOL next)
 {
-    unsigned int val = 0;
+    SEARCH_PARAMS search;
+    DUMP_VIEW *view;
+    SCAN *target = next ? scan : NULL;
+    char path[260];
+    char s[64];
 
-    if (ReadProcessMemory (hProc, (void*)addr, &val, data_size, NULL) == 0)
+    printf ("Enter the dump file: ");
+    fgets (path,sizeof(path),stdin);
+    path[strcspn (path, "\r\n")] = 0;
+    printf ("\r\n");
+    view = open_dump (path);
+    if (!view)
     {
-        printf ("peek failed\r\n");
+        printf ("%s is not a dump\r\n", path);
+        return NULL;
     }
 
-    return val;
+    if (next) printf ("Enter the next value or condition (i, d, +, -, c, u, b, a, or 'n' for unknown): ");
+    else printf ("Enter the start value, 'u' for unknown, 'b' for between or 'a' for approximately: ");
+    fgets (s,sizeof(s),stdin);
+    printf ("\r\n");
+    if (next && s[0] == 'n')
+    {
+        search.condition = COND_UNCONDITIONAL;
+    }
+    else if (!ui_read_search (scan->type, s, !next, &search))
+    {
+        close_dump (view);
+        return NULL;
+    }
+
+    // the console needs the process for everything but scans, so a new scan of a dump needs it to still run
+    if (!next)
+    {
+        target = create_dump_scan (view, scan->type, scan->stride, NULL, &ui_options);
+        if (!target) printf ("Invalid scan\r\n");
+        else if (!target->hProc)
+        {
+            printf ("Process %u is gone; batch mode can scan its dumps (see dump_scan)\r\n", view->header->pid);
+            free_scan (target);
+            target = NULL;
+        }
+    }
+    if (target && !update_scan_dump (target, &search, view)) printf ("Out of memory\r\n");
+    close_dump (view);
+    if (!target) return NULL;
+
+    printf ("%llu matches found\r\n", get_match_count (target));
+    return next ? NULL : target;
 }
 
 /**
- * Function: print_matches
+ * Function: ui_browse_matches
  * 
- * Description: Print out all matches to our search in a particular scan to the screen
+ * Description: UI function --- Shows the matches of a scan a page at a time, with jumps to any match, random samples and
+ *              the match counts per region or module
  *
  * Input:
- *   *mb_list - a pointer to the start of the memory block linked list
+ *   *scan - the scan
  */
-void print_matches (MEMBLOCK *mb_list)
+void ui_browse_matches (SCAN *scan)
 {
-    unsigned int offset;
-    MEMBLOCK *mb = mb_list;
+    MATCH_CURSOR *cursor = open_match_cursor (scan);
+    unsigned long long numbers[MATCH_PAGE];
+    unsigned long long total, first = 0, seed = 1;
+    char s[64];
+
+    if (!cursor) return;
+    total = get_cursor_total (cursor);
 
-    while (mb)
+    while (1)
     {
-        for (offset = 0; offset < mb->size; offset += mb->data_size)
+        print_cursor_matches (cursor, NULL, first, MATCH_PAGE, stdout);
+        printf ("\r\nMatches %llu to %llu of %llu. Enter a match number to go to, or",
+                total ? first : 0, (first + MATCH_PAGE < total) ? first + MATCH_PAGE - 1 : (total ? total - 1 : 0), total);
+        printf ("\r\n[n] next page");
+        printf ("\r\n[p] previous page");
+        printf ("\r\n[s] random sample");
+        printf ("\r\n[r] matches per region");
+        printf ("\r\n[o] matches per module");
+        printf ("\r\n[q] back\r\n");
+
+        if (!fgets (s,sizeof(s),stdin)) break;
+        printf ("\r\n");
+
+        if (s[0] >= '0' && s[0] <= '9')
+        {
+            first = str2int (s);
+            if (first >= total) first = total ? total - 1 : 0;
+        }
+        else if (s[0] == 'n' && first + MATCH_PAGE < total) first += MATCH_PAGE;
+        else if (s[0] == 'p') first = (first > MATCH_PAGE) ? first - MATCH_PAGE : 0;
+        else if (s[0] == 's')
         {
-            if (IS_IN_SEARCH(mb,offset))
+            size_t n = sample_matches (cursor, MATCH_PAGE, seed++, numbers);
+
+            print_cursor_matches (cursor, numbers, 0, n, stdout);
+            printf ("%llu matches picked at random, press enter", (unsigned long long)n);
+            fgets (s,sizeof(s),stdin);
+            printf ("\r\n");
+        }
+        else if (s[0] == 'r' || s[0] == 'o')
+        {
+            MATCH_GROUP *groups;
+            int count = group_matches (cursor, s[0] == 'o', &groups), g;
+
+            for (g = 0; g < count; g++)
             {
-                unsigned int val = peek (mb->hProc, mb->data_size, (unsigned int)mb->addr + offset);
-                printf ("0x%08x: 0x%08x (%d) \r\n", mb->addr + offset, val, val);
+                const char *name = groups[g].module[0] ? groups[g].module : (s[0] == 'o') ? "(outside modules)" : "";
+
+                printf ("0x%08llx %10llu KB %12llu matches from #%-12llu %s\r\n", (unsigned long long)(uintptr_t)groups[g].base,
+                        groups[g].size >> 10, groups[g].matches, groups[g].first, name);
+            }
+            if (count >= 0) free (groups);
+            printf ("Enter a match number to go to it, or press enter");
+            fgets (s,sizeof(s),stdin);
+            printf ("\r\n");
+            if (s[0] >= '0' && s[0] <= '9')
+            {
+                first = str2int (s);
+                if (first >= total) first = total ? total - 1 : 0;
             }
         }
-
-        mb = mb->next;
+        else if (s[0] == 'q') break;
     }
+
+    close_match_cursor (cursor);
 }
 
 /**
- * Function: get_match_count
+ * Function: ui_watch
  * 
- * Description: Print out the number of matches to our search in a particular scan to the screen
+ * Description: UI function --- Watches the matches of a scan for a while and writes every change to the screen or a file
  *
  * Input:
- *   *mb_list - a pointer to the start of the memory block linked list
+ *   *scan - the scan
  */
-int get_match_count (MEMBLOCK *mb_list)
+void ui_watch (SCAN *scan)
 {
-    MEMBLOCK *mb = mb_list;
-    int count = 0;
+    WATCH *w = create_watch (scan->hProc, scan->type);
+    WATCH_STATS stats;
+    unsigned int rate;
+    double seconds;
+    FILE *out = stdout;
+    char path[260];
+    char s[64];
 
-    while (mb)
+    if (!w || !watch_add_scan (w, scan))
     {
-        count += mb->matches;
-        mb = mb->next;
+        printf ("Out of memory\r\n");
+        free_watch (w);
+        return;
     }
 
-    return count;
-}
+    printf ("Enter the polls per second (empty for 1000): ");
+    fgets (s,sizeof(s),stdin);
+    rate = (s[0] == '\n' || s[0] == '\r') ? 1000 : (unsigned int)str2int (s);
+    printf ("\r\nEnter how many seconds to watch: ");
+    fgets (s,sizeof(s),stdin);
+    seconds = atof (s);
+    printf ("\r\nEnter the file for the changes (empty for the screen): ");
+    fgets (path,sizeof(path),stdin);
+    path[strcspn (path, "\r\n")] = 0;
+    printf ("\r\n");
 
+    if (rate == 0 || seconds <= 0)
+    {
+        printf ("Invalid rate or time\r\n");
+        free_watch (w);
+        return;
+    }
+    if (path[0])
+    {
+        out = fopen (path, "w");
+        if (!out)
+        {
+            printf ("Failed to open %s\r\n", path);
+            free_watch (w);
+            return;
+        }
+        setvbuf (out, NULL, _IOFBF, 1024*1024);
+    }
 
-/**
- * Function: str2int
- * 
- * Description: Utility function --- Convert a string to an integer
- *
- * Input:
- *   *s - the string to be converted. This can be in base 16 format (/0x[0-9a-fA-F]+/) or base 10 format (/\d+/)
- */
-unsigned int str2int (char *s)
-{
-    int base = 10;
+    printf ("Watching %u addresses\r\n", w->count);
+    if (run_watch (w, rate, seconds, out, &stats))
+    {
+        double elapsed = stats.elapsed_ns / 1e9;
 
-    if (s[0] == '0' && s[1] == 'x')
+        printf ("%llu polls in %.3f s (%.1f per second), %llu skipped, %llu changes\r\n", stats.polls, elapsed,
+                stats.polls / elapsed, stats.skipped, stats.events);
+        printf ("start late by %.1f us on average, %.1f us at most; jitter %.1f us; poll %.1f us on average, %.1f us at most; busy %.1f%%\r\n",
+                stats.polls ? stats.late_ns / 1e3 / stats.polls : 0.0, stats.max_late_ns / 1e3,
+                (stats.polls > 1) ? stats.jitter_ns / 1e3 / (stats.polls - 1) : 0.0,
+                stats.polls ? stats.busy_ns / 1e3 / stats.polls : 0.0, stats.max_poll_ns / 1e3, 100.0 * stats.busy_ns / stats.elapsed_ns);
+        printf ("%llu reads, %llu bytes read\r\n", stats.reads.syscalls, stats.reads.bytes_read);
+    }
+    else
     {
-        base = 16;
-        s += 2;
+        printf ("Out of memory\r\n");
     }
 
-    return strtoul (s, NULL, base);
+    if (out != stdout) fclose (out);
+    free_watch (w);
 }
 
 /**
- * Function: ui_new_scan
+ * Function: ui_freeze
  * 
- * Description: UI function --- Starts the program by asking user for input
+ * Description: UI function --- Freezes and unfreezes values and lists the frozen ones
  *
- * Output:
- *   MEMBLOCK* - the created scan results (which is just a memory block linked list) based on the user input
+ * Input:
+ *   **freeze - the freeze table; created on first use
+ *   *scan - the scan, for its process, type and matches
  */
-MEMBLOCK* ui_new_scan(void)
+void ui_freeze (FREEZE_TABLE **freeze, SCAN *scan)
 {
-    MEMBLOCK *scan = NULL;
-    DWORD pid;
-    int data_size;
-    unsigned int start_val;
-    SEARCH_CONDITION start_cond;
-    char s[20];
+    FREEZE_TABLE *t = *freeze;
+    TYPED_VALUE val;
+    unsigned char *addr;
+    unsigned int i;
+    char s[64];
 
-    while(1)
+    if (!t)
     {
-        printf ("\r\nEnter the pid: ");
-        fgets (s,sizeof(s),stdin);
-        pid = str2int (s);
-        printf ("\r\nEnter the data size: ");
-        fgets (s,sizeof(s),stdin);
-        data_size = str2int (s);
-        printf ("\r\nEnter the start value, or 'u' for unknown: ");
-        fgets (s,sizeof(s),stdin);
-        if (s[0] == 'u')
-        {
-            start_cond = COND_UNCONDITIONAL;
-            start_val = 0;
-        }
-        else
+        t = *freeze = create_freeze_table (scan->hProc, 0);
+        if (!t)
         {
-            start_cond = COND_EQUALS;
-            start_val = str2int (s);
+            printf ("Failed to start freezing\r\n");
+            return;
         }
-
-        scan = create_scan (pid, data_size);
-        if (scan) break;
-        printf ("\r\nInvalid scan");
     }
 
-    update_scan (scan, start_cond, start_val);
-    printf ("\r\n%d matches found\r\n", get_match_count(scan));
+    printf ("Enter an address to freeze, 'm' to freeze every match, 'u' to unfreeze an address, 'c' to unfreeze everything or 'l' to list: ");
+    fgets (s,sizeof(s),stdin);
+    printf ("\r\n");
 
-    return scan;
+    switch (s[0])
+    {
+        case 'l':
+            lock_enter (&t->lock);
+            for (i = 0; i < t->count; i++)
+            {
+                char text[64];
+
+                format_value (t->entries[i].type, &t->entries[i].value, text, sizeof(text));
+                printf ("0x%08llx: %s, changed by the process %llu times\r\n", (unsigned long long)(uintptr_t)t->entries[i].addr, text, t->entries[i].fights);
+            }
+            printf ("%u values frozen; %llu passes of %.1f us on average, %.1f us at most, every %.1f us\r\n", t->count, t->stats.passes,
+                    t->stats.passes ? t->stats.busy_ns / 1e3 / t->stats.passes : 0.0, t->stats.max_pass_ns / 1e3, t->period / 1e3);
+            printf ("%llu values written back, %llu after the process changed them, %llu failed; %llu reads\r\n", t->stats.writes, t->stats.fights,
+                    t->stats.failures, t->stats.reads.syscalls);
+            lock_leave (&t->lock);
+            break;
+        case 'c':
+            printf ("%u values unfrozen\r\n", unfreeze_value (t, NULL));
+            break;
+        case 'u':
+            printf ("Enter the address: ");
+            fgets (s,sizeof(s),stdin);
+            printf ("\r\n");
+            addr = (unsigned char*)(uintptr_t)str2int (s);
+            if (!addr || unfreeze_value (t, addr) == 0) printf ("Not frozen\r\n");
+            break;
+        case 'm':
+            if (ui_read_value ("Enter the value: ", scan->type, &val))
+            {
+                unsigned long long frozen = 0;
+                size_t b, k;
+
+                for (b = 0; b < scan->count; b++)
+                {
+                    MEMBLOCK *mb = &scan->blocks[b];
+
+                    if (mb->matchlist)
+                    {
+                        for (k = 0; k < mb->matches; k++)
+                        {
+                            frozen += freeze_value (t, mb->addr + mb->matchlist[k].offset, scan->type, &val);
+                        }
+                        continue;
+                    }
+                    for (k = 0; k < candidate_count (mb->size, mb->data_size, mb->stride); k++)
+                    {
+                        if (IS_IN_SEARCH(mb,k)) frozen += freeze_value (t, mb->addr + k * mb->stride, scan->type, &val);
+                    }
+                }
+                printf ("%llu values frozen\r\n", frozen);
+            }
+            break;
+        default:
+            addr = (unsigned char*)(uintptr_t)str2int (s);
+            if (!addr)
+            {
+                printf ("Invalid address\r\n");
+                break;
+            }
+            if (ui_read_value ("Enter the value: ", scan->type, &val) && !freeze_value (t, addr, scan->type, &val))
+            {
+                printf ("Out of memory\r\n");
+            }
+            break;
+    }
 }
 
 /**
- * Function: ui_poke
+ * Function: ui_pointer_scan
  * 
- * Description: UI function --- Continuation after ui_new_scan; Ask the user for further input after the initial scan in order to update a given memory address value
+ * Description: UI function --- Asks for an address and the bounds of the search, builds a pointer map of the process
+ *              and prints the pointer paths to the address; they can be narrowed down to those found in an earlier run
+ *              and saved
  *
- * Output:
- *   hProc - process handle of the process which the memory address is in
- *   data_size - the data size of the value to be viewed (i.e. 1 byte, 2 byte, or 4 byte types)
+ * Input:
+ *   hProc - the process
  */
-void ui_poke (HANDLE hProc, int data_size)
+void ui_pointer_scan (PROC_HANDLE hProc)
 {
-    unsigned int addr;
-    unsigned int val;
-    char s[20];
+    PTRSCAN_PARAMS params;
+    POINTER_PATHS paths, earlier;
+    PTR_MAP *map;
+    unsigned long long target, bytes_read, start;
+    char path[260];
+    char line[1024];
+    char s[64];
+    size_t i;
 
-    printf ("Enter the address: ");
+    printf ("Enter the address to find pointers to: ");
     fgets (s,sizeof(s),stdin);
-    addr = str2int (s);
+    target = str2int (s);
+    printf ("\r\n");
+    if (!target)
+    {
+        printf ("Invalid address\r\n");
+        return;
+    }
 
-    printf ("\r\nEnter the value: ");
+    printf ("Enter the most pointers in a path (default %d): ", PTRSCAN_DEPTH);
     fgets (s,sizeof(s),stdin);
-    val = str2int (s);
+    params.max_depth = atoi (s);
+    if (params.max_depth <= 0) params.max_depth = PTRSCAN_DEPTH;
+    if (params.max_depth > PTRSCAN_MAX_DEPTH) params.max_depth = PTRSCAN_MAX_DEPTH;
+    printf ("\r\nEnter the largest offset (default 0x%x): ", PTRSCAN_OFFSET);
+    fgets (s,sizeof(s),stdin);
+    params.max_offset = (unsigned int)str2int (s);
+    if (params.max_offset == 0) params.max_offset = PTRSCAN_OFFSET;
+    params.max_paths = PTRSCAN_PATHS;
+    params.max_nodes = PTRSCAN_NODES;
+    printf ("\r\nEnter a file to build the pointer map in, or nothing to build it in memory: ");
+    fgets (path,sizeof(path),stdin);
+    path[strcspn (path, "\r\n")] = 0;
+    printf ("\r\n");
+
+    start = clock_ns ();
+    map = build_pointer_map (hProc, path[0] ? path : NULL, &bytes_read, &ui_options);
+    if (!map)
+    {
+        printf ("Failed to build the pointer map\r\n");
+        return;
+    }
+    printf ("%llu pointers in %llu MB of writable memory and %d modules, in %.2f s\r\n", map->count, bytes_read >> 20,
+            map->nmodules, (clock_ns () - start) / 1e9);
+
+    start = clock_ns ();
+    pointer_scan (map, target, &params, &ui_options, &paths);
+    free_pointer_map (map);
+    printf ("%llu paths found in %.2f s\r\n", (unsigned long long)paths.count, (clock_ns () - start) / 1e9);
+
+    printf ("Enter a file of paths from an earlier run to keep only the paths found in both, or nothing: ");
+    fgets (path,sizeof(path),stdin);
+    path[strcspn (path, "\r\n")] = 0;
+    printf ("\r\n");
+    if (path[0])
+    {
+        if (load_pointer_paths (path, &earlier) && intersect_pointer_paths (&paths, &earlier) != (size_t)-1)
+        {
+            printf ("%llu paths found in both\r\n", (unsigned long long)paths.count);
+        }
+        else
+        {
+            printf ("Failed to read %s\r\n", path);
+        }
+        free_pointer_paths (&earlier);
+    }
+
+    for (i = 0; i < paths.count && i < PTRSCAN_PRINT_LIMIT; i++)
+    {
+        format_pointer_path (&paths, i, line, sizeof(line));
+        printf ("  %s\r\n", line);
+    }
+
+    printf ("Enter a file to save the paths to, or nothing: ");
+    fgets (path,sizeof(path),stdin);
+    path[strcspn (path, "\r\n")] = 0;
     printf ("\r\n");
+    if (path[0] && !save_pointer_paths (&paths, path))
+    {
+        printf ("Failed to save the paths\r\n");
+    }
 
-    poke (hProc, data_size, addr, val);
+    free_pointer_paths (&paths);
 }
 
 /**
@@ -565,13 +12288,14 @@ void ui_poke (HANDLE hProc, int data_size)
  * Description: UI function --- Continuation after ui_new_scan; Continue the scan by asking user for further input after the initial scan
  *
  * Output:
- *   MEMBLOCK* - the created scan results (which is just a memory block linked list) based on the user input
+ *   SCAN* - the created scan results based on the user input
  */
 void ui_run_scan(void)
 {
-    unsigned int val;
-    char s[20];
-    MEMBLOCK *scan;
+    SEARCH_PARAMS search;
+    char s[64];
+    SCAN *scan;
+    FREEZE_TABLE *freeze = NULL; //writes to the scan's process, so it is freed before the scan
 
     scan = ui_new_scan();
 
@@ -580,9 +12304,18 @@ void ui_run_scan(void)
         printf ("\r\nEnter the next value or");
         printf ("\r\n[i] increased");
         printf ("\r\n[d] decreased");
-        printf ("\r\n[m] print matches");
+        printf ("\r\n[+] increased by");
+        printf ("\r\n[-] decreased by");
+        printf ("\r\n[c] changed");
+        printf ("\r\n[u] unchanged");
+        printf ("\r\n[b] between");
+        printf ("\r\n[a] approximately (float types)");
+        printf ("\r\n[m] browse matches");
+        printf ("\r\n[w] watch matches");
         printf ("\r\n[p] poke address");
+        printf ("\r\n[f] freeze values");
         printf ("\r\n[n] new scan");
+        if (scan->pending) printf ("\r\n[r] resume the stopped scan");
         printf ("\r\n[X] extended options"); //because the initial author decided one char could abbreviate everything...
         printf ("\r\n[q] quit\r\n");
 
@@ -591,42 +12324,181 @@ void ui_run_scan(void)
 
         switch (s[0])
         {
-            case 'i':
-                update_scan (scan, COND_INCREASED, 0);
-                printf ("%d matches found\r\n", get_match_count(scan));
+            case 'm':
+                ui_browse_matches (scan);
                 break;
-            case 'd':
-                update_scan (scan, COND_DECREASED, 0);
-                printf ("%d matches found\r\n", get_match_count(scan));
+            case 'w':
+                ui_watch (scan);
                 break;
-            case 'm':
-                print_matches (scan);
+            case 'f':
+                ui_freeze (&freeze, scan);
                 break;
             case 'p':
-                ui_poke (scan->hProc, scan->data_size);
+                ui_poke (scan->hProc, scan->type);
                 break;
             case 'n':
+                free_freeze_table (freeze);
+                freeze = NULL;
                 free_scan (scan);
                 scan = ui_new_scan();
                 break;
             //get input again for extended options
             case 'X':
                 printf ("\r\nEnter the extended option choice");
-                printf ("\r\n[md] memory dump");
+                printf ("\r\n[md] memory dump (to a file)");
+                printf ("\r\n[vd] view a memory dump");
+                printf ("\r\n[cd] capture a series of memory dumps");
+                printf ("\r\n[ds] new scan of a memory dump");
+                printf ("\r\n[dn] next scan on a memory dump");
+                printf ("\r\n[ss] save snapshot");
+                printf ("\r\n[ls] load snapshot");
+                printf ("\r\n[as] array of bytes (signature) search");
+                printf ("\r\n[gs] group (struct) scan");
+                printf ("\r\n[ps] pointer scan");
+                printf ("\r\n[ir] incremental rescans of consistent scans (%s)", ui_options.incremental ? "on" : "off");
+                printf ("\r\n[cb] compressed previous values for new scans (%s)", ui_options.compressed ? "on" : "off");
+                printf ("\r\n[cs] consistent scans (%s)", ui_options.consistent ? "on" : "off");
+                if (ui_scan_budget > 0) printf ("\r\n[tb] time budget per scan (%.1f s)\r\n", ui_scan_budget);
+                else printf ("\r\n[tb] time budget per scan (off)\r\n");
                 fgets(s,sizeof(s),stdin);
                 printf ("\r\n");
                 
-                //print hexadecimal memory dump to screen
-                if( strcmp(s, "md\n") == 0 ){ dump_scan_info(scan); }
+                //dump the process memory to a file, or browse a dump
+                if( strcmp(s, "md\n") == 0 ){ ui_dump(scan->hProc); }
+                if( strcmp(s, "vd\n") == 0 )
+                {
+                    char path[260];
+
+                    printf ("Enter the dump file: ");
+                    fgets (path,sizeof(path),stdin);
+                    path[strcspn (path, "\r\n")] = 0;
+                    printf ("\r\n");
+                    ui_view_dump (path);
+                }
+
+                //dump the process at intervals, and scan the dumps instead of the process
+                if( strcmp(s, "cd\n") == 0 ){ ui_capture_dumps(scan->hProc); }
+                if( strcmp(s, "dn\n") == 0 ){ ui_dump_scan(scan, TRUE); }
+                if( strcmp(s, "ds\n") == 0 )
+                {
+                    SCAN *dumped = ui_dump_scan (scan, FALSE);
+                    if (dumped)
+                    {
+                        free_freeze_table (freeze);
+                        freeze = NULL;
+                        free_scan (scan);
+                        scan = dumped;
+                    }
+                }
+
+                //search every readable region for byte patterns
+                if( strcmp(s, "as\n") == 0 ){ ui_aob_search(scan->hProc); }
+
+                //find structs by several fields at once
+                if( strcmp(s, "gs\n") == 0 ){ ui_group_scan(process_id(scan->hProc)); }
+
+                //find pointer paths from the modules to an address
+                if( strcmp(s, "ps\n") == 0 ){ ui_pointer_scan(scan->hProc); }
+
+                //read every page at the next consistent scans, or only the pages written to since the last one
+                if( strcmp(s, "ir\n") == 0 )
+                {
+                    ui_options.incremental = !ui_options.incremental;
+                    scan->options.incremental = ui_options.incremental;
+                    printf ("Incremental rescans %s\r\n", ui_options.incremental ? "on" : "off");
+                }
+
+                //keep the previous values of the next new scans compressed, for targets too big to copy
+                if( strcmp(s, "cb\n") == 0 )
+                {
+                    ui_options.compressed = !ui_options.compressed;
+                    printf ("Compressed previous values %s from the next new scan\r\n", ui_options.compressed ? "on" : "off");
+                }
+
+                //suspend the process while the scans copy its values, so they all come from the same moment
+                if( strcmp(s, "cs\n") == 0 )
+                {
+                    ui_options.consistent = !ui_options.consistent;
+                    if (ui_options.consistent)
+                    {
+                        printf ("Enter the milliseconds the process may stay suspended, or 0 for no limit: ");
+                        fgets (s,sizeof(s),stdin);
+                        ui_options.max_pause = atof (s) > 0 ? atof (s) : 0;
+                        printf ("\r\n");
+                    }
+                    scan->options.consistent = ui_options.consistent;
+                    scan->options.max_pause = ui_options.max_pause;
+                    printf ("Consistent scans %s\r\n", ui_options.consistent ? "on" : "off");
+                }
+
+                //stop scans after a number of seconds, leaving the rest to resume
+                if( strcmp(s, "tb\n") == 0 )
+                {
+                    printf ("Enter the seconds a scan may take, or 0 for no limit: ");
+                    fgets (s,sizeof(s),stdin);
+                    ui_scan_budget = atof (s);
+                    printf ("\r\n");
+                }
+
+                //save the scan to a snapshot file, or replace it with one loaded from a file
+                if( strcmp(s, "ss\n") == 0 || strcmp(s, "ls\n") == 0 )
+                {
+                    char path[260];
+
+                    printf ("Enter the snapshot file: ");
+                    fgets (path,sizeof(path),stdin);
+                    path[strcspn (path, "\r\n")] = 0;
+                    printf ("\r\n");
+
+                    if (s[0] == 's')
+                    {
+                        printf (save_scan (scan, path) ? "Snapshot saved\r\n" : "Failed to save snapshot\r\n");
+                    }
+                    else
+                    {
+                        SCAN *loaded = load_scan (path, 0, &ui_options);
+                        if (loaded)
+                        {
+                            free_freeze_table (freeze);
+                            freeze = NULL;
+                            free_scan (scan);
+                            scan = loaded;
+                            printf ("%llu matches loaded\r\n", get_match_count(scan));
+                        }
+                    }
+                }
                 
+                break;
+            case 'r':
+                if (scan->pending)
+                {
+                    ui_update_scan (scan, NULL);
+                    printf ("%llu matches found\r\n", get_match_count(scan));
+                }
                 break;
             case 'q':
+                free_freeze_table (freeze);
                 free_scan (scan);
                 return;
             default:
-                val = str2int (s);
-                update_scan (scan, COND_EQUALS, val);
-                printf ("%d matches found\r\n", get_match_count(scan));
+                if (ui_read_search (scan->type, s, FALSE, &search))
+                {
+                    ui_update_scan (scan, &search);
+                    printf ("%llu matches found\r\n", get_match_count(scan));
+                    if (scan->read_stats.bytes_skipped)
+                    {
+                        printf ("%llu KB read, %llu KB not written to since the last scan skipped\r\n",
+                                scan->read_stats.bytes_read >> 10, scan->read_stats.bytes_skipped >> 10);
+                    }
+                    if (scan->read_stats.bytes_failed)
+                    {
+                        printf ("%llu KB could not be read, the matches there were dropped\r\n", scan->read_stats.bytes_failed >> 10);
+                    }
+                    if (scan->compressed)
+                    {
+                        printf ("Previous values kept in %llu KB\r\n", get_baseline_size (scan) >> 10);
+                    }
+                }
                 break;
         }
     }
@@ -637,6 +12509,7 @@ void ui_run_scan(void)
 
 int main (int argc, char *argv[])
 {
+#ifdef _WIN32
     // get process handle
     HANDLE hProc = GetCurrentProcess();
 
@@ -649,6 +12522,53 @@ int main (int argc, char *argv[])
     if (!SetPrivilege(hToken, SE_DEBUG_NAME, TRUE))
         printf ("Failed to set debug privilege");
 
+    // large pages for scan buffers (see alloc_pages) need SE_LOCK_MEMORY_NAME; without it normal pages are used
+    SetPrivilege(hToken, SE_LOCK_MEMORY_NAME, TRUE);
+#endif
+
+    // "memory_scanner view <dump file>" only browses a dump
+    if (argc == 3 && strcmp (argv[1], "view") == 0)
+    {
+        ui_view_dump (argv[2]);
+        return 0;
+    }
+
+    // "memory_scanner bench [options]" runs the benchmarks against a target it starts itself (see Benchmarks)
+    if (argc >= 2 && strcmp (argv[1], "bench") == 0)
+    {
+        BENCH_PARAMS params;
+
+        if (!parse_bench_params (argc - 2, argv + 2, &params))
+        {
+            printf ("Usage: memory_scanner bench [heap=<MB>] [regions=<n>] [density=<share>] [mutations=<n>] [runs=<n>]\n");
+            return 1;
+        }
+        return run_benchmarks (&params) ? 0 : 1;
+    }
+    if (argc >= 2 && strcmp (argv[1], "bench-target") == 0)
+    {
+        return run_bench_target (argc, argv);
+    }
+
+    // "memory_scanner batch <script|-> [json|csv]" runs a script of scan steps (see Batch mode)
+    if ((argc == 3 || argc == 4) && strcmp (argv[1], "batch") == 0)
+    {
+        BOOL csv = (argc == 4 && strcmp (argv[3], "csv") == 0);
+        FILE *script = strcmp (argv[2], "-") == 0 ? stdin : fopen (argv[2], "r");
+        BOOL ok;
+
+        if (!script || (argc == 4 && !csv && strcmp (argv[3], "json") != 0))
+        {
+            printf ("Usage: memory_scanner batch <script file, or - for stdin> [json|csv]\n");
+            return 1;
+        }
+        ok = run_batch (script, stdout, csv);
+        if (script != stdin) fclose (script);
+        return ok ? 0 : 1;
+    }
+
     ui_run_scan();
     return 0;
-}
\ No newline at end of file
+}
+
+#endif //MEMORY_SCANNER_LIBRARY
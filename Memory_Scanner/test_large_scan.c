@@ -0,0 +1,158 @@
+/*
+ * test_large_scan.c
+ * Description: Regression test for scans of regions larger than 4 GB
+ *
+ * Compilation:
+ *   Linux: gcc -O2 test_large_scan.c -o test_large_scan -lpthread
+ *
+ * Run format: "test_large_scan" prints one line per check and exits with 0 if all of them passed
+ *
+ * A child process maps a 5 GB region with MAP_NORESERVE and writes a value to a few pages of it, on both sides of the
+ * 2^31 and 2^32 byte offsets where sizes and offsets kept in 32 bits would wrap. The untouched pages read as zeros
+ * without ever being backed by memory, so the target needs almost no RAM. The scanner is built in from
+ * memory_scanner.c as a library, scans the region for the value, changes one of the copies past 4 GB and runs a next
+ * scan, checking the addresses and values each time. Linux only: the child is made with fork.
+ */
+
+#define MEMORY_SCANNER_LIBRARY
+#include "memory_scanner.c"
+
+#define REGION_SIZE (5ULL << 30)
+#define PLANTED 0x5ca1ab1eu
+#define CHANGED 0x0ddba11u
+
+// offsets of the planted values into the region
+static const unsigned long long planted[] =
+{
+    0x10,
+    (2ULL << 30) + 0x20, //past 2^31
+    (4ULL << 30) + 0x10, //past 2^32, at the same offset as the first one in 32 bits
+    (4ULL << 30) + (256ULL << 20) + 0x40,
+    REGION_SIZE - 4 //the last value of the region
+};
+#define NPLANTED (sizeof(planted) / sizeof(planted[0]))
+
+static int failures = 0;
+
+/**
+ * Function: check
+ *
+ * Description: Prints the outcome of a check and counts it if it failed
+ */
+static void check (BOOL ok, const char *what)
+{
+    printf ("%s: %s\n", ok ? "ok" : "FAILED", what);
+    if (!ok) failures++;
+}
+
+/**
+ * Function: run_target
+ *
+ * Description: The child process: maps the region, plants the values, sends the region's address up the pipe and
+ *              waits to be killed
+ */
+static void run_target (int fd)
+{
+    unsigned char *region = mmap (NULL, REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    unsigned int i;
+
+    if (region != MAP_FAILED)
+    {
+        for (i = 0; i < NPLANTED; i++) *(unsigned int*)(region + planted[i]) = PLANTED;
+    }
+    else
+    {
+        region = NULL;
+    }
+    if (write (fd, &region, sizeof(region)) != sizeof(region)) _exit (1);
+    for (;;) pause ();
+}
+
+/**
+ * Function: check_matches
+ *
+ * Description: Checks that the matches of a scan are exactly the given offsets into the region, with a value
+ */
+static void check_matches (SCAN *scan, unsigned char *region, const unsigned long long *offsets, unsigned int count,
+                           unsigned int value, const char *what)
+{
+    MATCH_ITERATOR it;
+    unsigned char *addr;
+    TYPED_VALUE val;
+    unsigned int i = 0;
+    BOOL ok = get_match_count (scan) == count;
+
+    first_match (&it, scan);
+    while (ok && next_match (&it, &addr, &val))
+    {
+        ok = i < count && addr == region + offsets[i] && val.u32 == value;
+        i++;
+    }
+    check (ok && i == count, what);
+}
+
+int main (void)
+{
+    int fds[2];
+    pid_t pid;
+    unsigned char *region = NULL;
+    REGION_FILTER filter;
+    SEARCH_PARAMS search;
+    SCAN_OPTIONS options;
+    SCAN *scan;
+    unsigned int value = CHANGED;
+    int compressed;
+
+    if (pipe (fds) != 0) return 1;
+    pid = fork ();
+    if (pid < 0) return 1;
+    if (pid == 0)
+    {
+        close (fds[0]);
+        run_target (fds[1]);
+    }
+    close (fds[1]);
+    if (read (fds[0], &region, sizeof(region)) != sizeof(region) || !region)
+    {
+        printf ("FAILED: the target could not map %llu bytes\n", REGION_SIZE);
+        kill (pid, SIGKILL);
+        return 1;
+    }
+
+    // only the region, so nothing else the target holds can match
+    default_region_filter (&filter);
+    filter.from = region;
+    filter.to = region + REGION_SIZE;
+    default_scan_options (&options);
+
+    for (compressed = 0; compressed < 2; compressed++)
+    {
+        options.compressed = compressed;
+        printf ("%s previous values\n", compressed ? "compressed" : "plain");
+
+        scan = create_scan (pid, TYPE_U32, 4, &filter, &options);
+        check (scan && scan->count == 1 && scan->blocks[0].size == REGION_SIZE, "one block of 5 GB");
+        if (!scan) break;
+
+        parse_search (TYPE_U32, "equals 0x5ca1ab1e", &search);
+        update_scan (scan, &search);
+        check_matches (scan, region, planted, NPLANTED, PLANTED, "the values before and past 2 GB and 4 GB are found");
+
+        // the copy past 2^32 changes; an offset wrapped to 32 bits would take it for the first one
+        write_memory (scan->hProc, region + planted[2], &value, sizeof(value));
+        parse_search (TYPE_U32, "changed", &search);
+        update_scan (scan, &search);
+        check_matches (scan, region, &planted[2], 1, CHANGED, "the value changed past 4 GB is the only match");
+
+        value = PLANTED;
+        write_memory (scan->hProc, region + planted[2], &value, sizeof(value));
+        value = CHANGED;
+        free_scan (scan);
+    }
+
+    kill (pid, SIGKILL);
+    waitpid (pid, NULL, 0);
+    printf (failures ? "%d checks failed\n" : "all checks passed\n", failures);
+
+    return failures != 0;
+}